@@ -0,0 +1,132 @@
+/*
+ * Measures gzip_compress() throughput in every mode with one thread and with
+ * thread_count threads, next to zlib's deflate at the same level, and checks
+ * the result with zlib.
+ *
+ *      cmake -S . -B build && cmake --build build --target bench_compress
+ *      build/bench_compress [length] [level] [thread_count]
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+
+#include <zlib.h>
+
+#include "gzip_compress.h"
+
+
+
+#define BENCH_ROUNDS    5
+
+
+static double now(void) {
+    struct timespec time;
+    clock_gettime(CLOCK_MONOTONIC, &time);
+    return time.tv_sec + time.tv_nsec * 1e-9;
+}
+
+/* Text-like input: words drawn from a small skewed vocabulary. */
+static void make_input(unsigned char* data, size_t length, unsigned seed) {
+    static const char* words[] = { "the ", "of ", "and ", "inflate ", "stream ", "block ", "huffman ", "table ", "window\n" };
+    srand(seed);
+    size_t i = 0;
+    while (i < length) {
+        const char* word = words[rand() % (rand() % 9 + 1)];
+        for (; *word && i < length; ++word, ++i)
+            data[i] = *word;
+    }
+}
+
+/* Decodes all members with zlib. Returns the decompressed length, 0 on failure. */
+static size_t decompress_gzip(const unsigned char* compressed, size_t compressed_length, unsigned char* decompressed, size_t decompressed_max_length) {
+    z_stream stream = { 0 };
+    inflateInit2(&stream, 31);
+    stream.next_in = (unsigned char*)compressed;
+    stream.avail_in = compressed_length;
+    stream.next_out = decompressed;
+    stream.avail_out = decompressed_max_length;
+
+    size_t length = 0;
+    int result;
+    while ((result = inflate(&stream, Z_FINISH)) == Z_STREAM_END && stream.avail_in) {
+        length += stream.total_out;
+        inflateReset(&stream);
+    }
+    length += stream.total_out;
+    inflateEnd(&stream);
+
+    return result == Z_STREAM_END ? length : 0;
+}
+
+static double time_zlib(const unsigned char* data, size_t length, int level, unsigned char* compressed, size_t compressed_max_length, size_t* compressed_length) {
+    double best = 1e30;
+    for (int round = 0; round < BENCH_ROUNDS; ++round) {
+        z_stream stream = { 0 };
+        double start = now();
+        deflateInit2(&stream, level, Z_DEFLATED, 31, 8, Z_DEFAULT_STRATEGY);
+        stream.next_in = (unsigned char*)data;
+        stream.avail_in = length;
+        stream.next_out = compressed;
+        stream.avail_out = compressed_max_length;
+        deflate(&stream, Z_FINISH);
+        *compressed_length = stream.total_out;
+        deflateEnd(&stream);
+        double elapsed = now() - start;
+        best = elapsed < best ? elapsed : best;
+    }
+    return best;
+}
+
+int main(int argc, char** argv) {
+    size_t length = argc > 1 ? strtoul(argv[1], NULL, 10) : 256 * 1024 * 1024;
+    int level = argc > 2 ? atoi(argv[2]) : 6;
+    unsigned thread_count = argc > 3 ? (unsigned)strtoul(argv[3], NULL, 10) : 0;
+
+    unsigned char* data = malloc(length);
+    unsigned char* decompressed = malloc(length);
+    make_input(data, length, 1);
+
+    double megabytes = (double)length / (1024 * 1024);
+    size_t zlib_max_length = compressBound(length) + 32;
+    unsigned char* zlib_compressed = malloc(zlib_max_length);
+    size_t zlib_length = 0;
+    double zlib = time_zlib(data, length, level, zlib_compressed, zlib_max_length, &zlib_length);
+    printf("input %zu bytes, level %d\n", length, level);
+    printf("zlib                  %8.1f MiB/s  %zu bytes\n", megabytes / zlib, zlib_length);
+    free(zlib_compressed);
+
+    static const char* mode_names[] = { "dictionary", "independent", "bgzf" };
+    for (int mode = GZIP_COMPRESS_DICTIONARY; mode <= GZIP_COMPRESS_BGZF; ++mode) {
+        struct GzipCompressOptions options = { .mode = mode, .level = level };
+        size_t compressed_max_length = gzip_compress_bound(length, &options);
+        unsigned char* compressed = malloc(compressed_max_length);
+        size_t compressed_length = 0;
+
+        double best[2] = { 1e30, 1e30 };
+        for (int threads = 0; threads < 2; ++threads) {
+            options.thread_count = threads ? thread_count : 1;
+            for (int round = 0; round < BENCH_ROUNDS; ++round) {
+                double start = now();
+                if (gzip_compress(data, length, compressed, &compressed_length, compressed_max_length, &options, NULL)) {
+                    fprintf(stderr, "gzip_compress failed\n");
+                    return 1;
+                }
+                double elapsed = now() - start;
+                best[threads] = elapsed < best[threads] ? elapsed : best[threads];
+            }
+        }
+
+        if (decompress_gzip(compressed, compressed_length, decompressed, length) != length || memcmp(decompressed, data, length)) {
+            fprintf(stderr, "%s output does not round trip\n", mode_names[mode]);
+            return 1;
+        }
+
+        printf("%-11s 1 thread %8.1f MiB/s  %zu bytes\n", mode_names[mode], megabytes / best[0], compressed_length);
+        printf("%-11s threads  %8.1f MiB/s  (%.2fx)\n", mode_names[mode], megabytes / best[1], best[0] / best[1]);
+        free(compressed);
+    }
+
+    return 0;
+}
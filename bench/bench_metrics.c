@@ -0,0 +1,151 @@
+/*
+ * Cost of the metrics built in with INFLATE_METRICS: tinflate() over many
+ * small messages with recording off, with histograms only, and with every or
+ * every 64th call traced. Then prints the latency quantiles recorded and the
+ * slowest traced calls. Configure with INFLATE_METRICS=OFF to compare against
+ * the library without them.
+ *
+ *      cmake -S . -B build -DINFLATE_METRICS=ON && cmake --build build --target bench_metrics
+ *      build/bench_metrics [message_count] [max_message_length]
+ *
+ * zlib is only used to produce the compressed input.
+ */
+
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+
+#include <zlib.h>
+
+#include "inflate.h"
+#include "inflate_metrics.h"
+
+
+
+#define BENCH_ROUNDS    20
+
+
+struct BenchMessage {
+    unsigned char* compressed;
+    size_t compressed_length;
+    size_t length;
+};
+
+
+static double now(void) {
+    struct timespec time;
+    clock_gettime(CLOCK_MONOTONIC, &time);
+    return time.tv_sec + time.tv_nsec * 1e-9;
+}
+
+/* Text-like input: words drawn from a small skewed vocabulary. */
+static void make_input(unsigned char* data, size_t length, unsigned seed) {
+    static const char* words[] = { "{\"id\": ", "\"name\": ", "\"value\": ", "true, ", "null, ", "\"metrics\", ", "42, ", "}, ", "\n" };
+    srand(seed);
+    size_t i = 0;
+    while (i < length) {
+        const char* word = words[rand() % (rand() % 9 + 1)];
+        for (; *word && i < length; ++word, ++i)
+            data[i] = *word;
+    }
+}
+
+/* Best time per call over BENCH_ROUNDS passes over all messages. */
+static double run(const struct BenchMessage* messages, size_t message_count, unsigned char* decompressed, size_t decompressed_max_length) {
+    double best = 1e30;
+    for (int round = 0; round < BENCH_ROUNDS; ++round) {
+        double start = now();
+        for (size_t i = 0; i < message_count; ++i) {
+            size_t length;
+            if (tinflate(messages[i].compressed, messages[i].compressed_length, decompressed, &length, decompressed_max_length) || length != messages[i].length) {
+                fprintf(stderr, "tinflate failed on message %zu\n", i);
+                exit(1);
+            }
+        }
+        double elapsed = now() - start;
+        best = elapsed < best ? elapsed : best;
+    }
+    return best / message_count * 1e9;
+}
+
+int main(int argc, char** argv) {
+    size_t message_count = argc > 1 ? strtoull(argv[1], NULL, 10) : 2000;
+    size_t max_length = argc > 2 ? strtoull(argv[2], NULL, 10) : 16384;
+
+    unsigned char* data = malloc(max_length);
+    unsigned char* decompressed = malloc(max_length);
+    struct BenchMessage* messages = calloc(message_count, sizeof(struct BenchMessage));
+    size_t total_length = 0;
+    for (size_t i = 0; i < message_count; ++i) {
+        /* Mostly small messages, a few up to max_length. */
+        size_t length = 64 + (size_t)rand() % (i % 16 ? max_length / 16 : max_length - 64);
+        make_input(data, length, (unsigned)i + 1);
+
+        uLong compressed_max_length = compressBound(length) + 64;
+        messages[i].compressed = malloc(compressed_max_length);
+        z_stream deflater = { 0 };
+        deflateInit2(&deflater, 6, Z_DEFLATED, -15, 8, Z_DEFAULT_STRATEGY);
+        deflater.next_in = data;
+        deflater.avail_in = (uInt)length;
+        deflater.next_out = messages[i].compressed;
+        deflater.avail_out = (uInt)compressed_max_length;
+        deflate(&deflater, Z_FINISH);
+        messages[i].compressed_length = compressed_max_length - deflater.avail_out;
+        messages[i].length = length;
+        deflateEnd(&deflater);
+        total_length += length;
+    }
+    printf("%zu messages, %zu bytes on average\n", message_count, total_length / message_count);
+
+    struct InflateMetricsOptions options = { .enabled = true };
+    inflate_metrics_configure(NULL);
+    double off = run(messages, message_count, decompressed, max_length);
+    printf("recording off           %8.0f ns/call\n", off);
+
+    if (inflate_metrics_configure(&options)) {
+        printf("metrics not built in (INFLATE_METRICS undefined)\n");
+        return 0;
+    }
+    double histograms = run(messages, message_count, decompressed, max_length);
+    printf("histograms              %8.0f ns/call  %+5.1f%%\n", histograms, 100 * (histograms / off - 1));
+
+    /* A threshold nothing reaches: the cost of tracing without that of publishing. */
+    options.trace_threshold = UINT64_MAX;
+    options.trace_sample = 64;
+    inflate_metrics_configure(&options);
+    double sampled = run(messages, message_count, decompressed, max_length);
+    printf("tracing 1 in 64 calls   %8.0f ns/call  %+5.1f%%\n", sampled, 100 * (sampled / off - 1));
+
+    options.trace_sample = 1;
+    inflate_metrics_configure(&options);
+    double traced = run(messages, message_count, decompressed, max_length);
+    printf("tracing every call      %8.0f ns/call  %+5.1f%%\n", traced, 100 * (traced / off - 1));
+
+    struct InflateMetricsSnapshot* snapshot = malloc(sizeof(struct InflateMetricsSnapshot));
+    inflate_metrics_snapshot(snapshot);
+    const struct InflateHistogram* latency = &snapshot->latency[INFLATE_METRICS_TINFLATE][INFLATE_SUCCESS];
+    printf("tinflate latency: %llu calls, p50 %llu ns, p99 %llu ns, p99.9 %llu ns, max %llu ns\n", (unsigned long long)latency->count,
+           (unsigned long long)inflate_histogram_quantile(latency, 0.5), (unsigned long long)inflate_histogram_quantile(latency, 0.99),
+           (unsigned long long)inflate_histogram_quantile(latency, 0.999), (unsigned long long)latency->max);
+
+    /* Trace what lies beyond p99.9 for one more pass. */
+    options.trace_threshold = inflate_histogram_quantile(latency, 0.999);
+    inflate_metrics_configure(&options);
+    run(messages, message_count, decompressed, max_length);
+    struct InflateTrace* traces = malloc(INFLATE_TRACE_RING_LENGTH * sizeof(struct InflateTrace));
+    size_t trace_count = inflate_metrics_traces(traces, INFLATE_TRACE_RING_LENGTH);
+    printf("%zu calls over %llu ns traced, the last ones:\n", trace_count, (unsigned long long)options.trace_threshold);
+    for (size_t i = trace_count > 4 ? trace_count - 4 : 0; i < trace_count; ++i) {
+        const struct InflateTrace* trace = &traces[i];
+        printf("  %8llu ns, %6zu -> %6zu bytes, headers %llu ns, data %llu ns, %ld page faults, blocks:", (unsigned long long)trace->latency, trace->compressed_length,
+               trace->decompressed_length, (unsigned long long)trace->phase_time[INFLATE_TRACE_HEADERS], (unsigned long long)trace->phase_time[INFLATE_TRACE_DATA],
+               trace->page_faults);
+        for (unsigned b = 0; b < trace->block_count && b < INFLATE_TRACE_MAX_BLOCKS; ++b)
+            printf(" %u%s", trace->blocks[b].type, trace->blocks[b].final ? "f" : "");
+        printf("\n");
+    }
+
+    return 0;
+}
@@ -0,0 +1,201 @@
+/*
+ * Share of a large one-shot decode spent on first-touch page faults. tinflate()
+ * runs once into memory faulted in beforehand, which is the decode alone, and
+ * then into fresh memory from malloc() and from inflate_output_create() with
+ * and without huge pages and the prefault thread. Also decodes through
+ * tinflate_output_sink() and reports how much of the output stayed resident.
+ *
+ *      cmake -S . -B build && cmake --build build --target bench_output
+ *      build/bench_output [length]
+ *
+ * zlib is only used to produce the compressed input.
+ */
+
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/resource.h>
+#include <time.h>
+
+#include <zlib.h>
+
+#include "inflate.h"
+#include "inflate_output.h"
+
+
+
+#define BENCH_ROUNDS    3
+
+
+struct BenchSink {
+    size_t length;
+};
+
+
+static double now(void) {
+    struct timespec time;
+    clock_gettime(CLOCK_MONOTONIC, &time);
+    return time.tv_sec + time.tv_nsec * 1e-9;
+}
+
+static long page_faults(void) {
+    struct rusage usage;
+    getrusage(RUSAGE_SELF, &usage);
+    return usage.ru_minflt + usage.ru_majflt;
+}
+
+/* Resident set size in bytes, 0 where /proc is not there. */
+static size_t resident(void) {
+    FILE* file = fopen("/proc/self/statm", "r");
+    unsigned long pages = 0, resident_pages = 0;
+    if (file) {
+        if (fscanf(file, "%lu %lu", &pages, &resident_pages) != 2)
+            resident_pages = 0;
+        fclose(file);
+    }
+    return resident_pages * 4096;
+}
+
+/* Text-like input: words drawn from a small skewed vocabulary, with numbers mixed in. */
+static void make_input(unsigned char* data, size_t length) {
+    static const char* words[] = { "the ", "of ", "and ", "output ", "page ", "fault ", "huge ", "prefault ", "buffer\n" };
+    srand(1);
+    size_t i = 0;
+    while (i < length) {
+        char number[16];
+        const char* word = rand() % 8 ? words[rand() % (rand() % 9 + 1)] : (sprintf(number, "%d ", rand() % 100000), number);
+        for (; *word && i < length; ++word, ++i)
+            data[i] = *word;
+    }
+}
+
+static int sink(void* context, const unsigned char* bytes, size_t length) {
+    struct BenchSink* bench_sink = context;
+    bench_sink->length += length;
+    (void)bytes;
+    return 0;
+}
+
+int main(int argc, char** argv) {
+    size_t length = argc > 1 ? strtoull(argv[1], NULL, 10) : (size_t)1 << 30;
+
+    unsigned char* data = malloc(length);
+    make_input(data, length);
+    uLong compressed_max_length = compressBound(length) + 64;
+    unsigned char* compressed = malloc(compressed_max_length);
+    z_stream deflater = { 0 };
+    deflateInit2(&deflater, 6, Z_DEFLATED, -15, 8, Z_DEFAULT_STRATEGY);
+    deflater.next_in = data;
+    deflater.avail_in = (uInt)length;
+    deflater.next_out = compressed;
+    deflater.avail_out = (uInt)compressed_max_length;
+    deflate(&deflater, Z_FINISH);
+    size_t compressed_length = compressed_max_length - deflater.avail_out;
+    deflateEnd(&deflater);
+    double megabytes = (double)length / (1024 * 1024);
+    printf("%zu bytes, compressed %zu bytes\n", length, compressed_length);
+
+    /* The decode alone: the output is faulted in before the clock starts. */
+    double best_warm = 1e30;
+    unsigned char* warm = malloc(length);
+    memset(warm, 0, length);
+    for (int round = 0; round < BENCH_ROUNDS; ++round) {
+        size_t decompressed_length;
+        double start = now();
+        if (tinflate(compressed, compressed_length, warm, &decompressed_length, length) || decompressed_length != length) {
+            fprintf(stderr, "tinflate failed\n");
+            return 1;
+        }
+        double elapsed = now() - start;
+        best_warm = elapsed < best_warm ? elapsed : best_warm;
+    }
+    if (memcmp(warm, data, length)) {
+        fprintf(stderr, "tinflate output differs\n");
+        return 1;
+    }
+    free(warm);
+    printf("prefaulted malloc()                       %8.1f MiB/s\n", megabytes / best_warm);
+
+    double best_cold = 1e30;
+    long cold_faults = 0;
+    for (int round = 0; round < BENCH_ROUNDS; ++round) {
+        unsigned char* cold = malloc(length);
+        size_t decompressed_length;
+        long faults = page_faults();
+        double start = now();
+        if (tinflate(compressed, compressed_length, cold, &decompressed_length, length) || decompressed_length != length) {
+            fprintf(stderr, "tinflate failed\n");
+            return 1;
+        }
+        double elapsed = now() - start;
+        if (elapsed < best_cold) {
+            best_cold = elapsed;
+            cold_faults = page_faults() - faults;
+        }
+        free(cold);
+    }
+    printf("fresh malloc()                            %8.1f MiB/s %9ld faults, %4.1f%% of the time faulting\n", megabytes / best_cold, cold_faults,
+           100 * (best_cold - best_warm) / best_cold);
+
+    static const char* pages_names[] = { "small pages", "THP", "hugetlb" };
+    for (int huge_pages = 0; huge_pages < 2; ++huge_pages) {
+        for (int prefault = 0; prefault < 2; ++prefault) {
+            struct InflateOutputOptions options = { .huge_pages = huge_pages, .prefault = prefault };
+            double best = 1e30;
+            long best_faults = 0;
+            unsigned pages = 0;
+            for (int round = 0; round < BENCH_ROUNDS; ++round) {
+                struct InflateOutput output;
+                if (inflate_output_create(length, &options, &output)) {
+                    fprintf(stderr, "inflate_output_create failed\n");
+                    return 1;
+                }
+                pages = output.pages;
+                size_t decompressed_length;
+                long faults = page_faults();
+                double start = now();
+                if (tinflate_output(compressed, compressed_length, &output, &decompressed_length) || decompressed_length != length) {
+                    fprintf(stderr, "tinflate_output failed\n");
+                    return 1;
+                }
+                double elapsed = now() - start;
+                if (elapsed < best) {
+                    best = elapsed;
+                    best_faults = page_faults() - faults;
+                }
+                if (!round && memcmp(output.bytes, data, length)) {
+                    fprintf(stderr, "tinflate_output output differs\n");
+                    return 1;
+                }
+                inflate_output_destroy(&output);
+            }
+            char name[64];
+            snprintf(name, sizeof(name), "%s%s", pages_names[pages], prefault ? ", prefaulted" : "");
+            printf("inflate_output, %-26s%8.1f MiB/s %9ld faults, %4.1f%% of the time faulting\n", name, megabytes / best, best_faults,
+                   100 * (best - best_warm > 0 ? best - best_warm : 0) / best);
+        }
+    }
+
+    struct InflateOutputOptions options = { .huge_pages = true, .prefault = true };
+    struct InflateOutput output;
+    inflate_output_create(length, &options, &output);
+    struct BenchSink bench_sink = { 0 };
+    size_t decompressed_length;
+    size_t before = resident();
+    double start = now();
+    if (tinflate_output_sink(compressed, compressed_length, &output, sink, &bench_sink, &decompressed_length) || bench_sink.length != length) {
+        fprintf(stderr, "tinflate_output_sink failed\n");
+        return 1;
+    }
+    double elapsed = now() - start;
+    size_t after = resident();
+    printf("inflate_output, sink                      %8.1f MiB/s, %.1f MiB of output resident afterwards\n", megabytes / elapsed,
+           (double)(after > before ? after - before : 0) / (1024 * 1024));
+    inflate_output_destroy(&output);
+
+    free(data);
+    free(compressed);
+
+    return 0;
+}
@@ -0,0 +1,101 @@
+/*
+ * Compares tinflate() with tinflate_parallel() on one large stream with a full
+ * flush after every flush_interval bytes of input, as pigz --independent and
+ * Z_FULL_FLUSH producers write them.
+ *
+ *      cmake -S . -B build && cmake --build build --target bench_parallel
+ *      build/bench_parallel [stream_length] [flush_interval] [thread_count]
+ *
+ * zlib is only used to produce the compressed input.
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+
+#include <zlib.h>
+
+#include "inflate.h"
+
+
+
+#define BENCH_ROUNDS    10
+
+
+static double now(void) {
+    struct timespec time;
+    clock_gettime(CLOCK_MONOTONIC, &time);
+    return time.tv_sec + time.tv_nsec * 1e-9;
+}
+
+/* Text-like input: words drawn from a small skewed vocabulary. */
+static void make_input(unsigned char* data, size_t length, unsigned seed) {
+    static const char* words[] = { "the ", "of ", "and ", "inflate ", "stream ", "block ", "huffman ", "table ", "window\n" };
+    srand(seed);
+    size_t i = 0;
+    while (i < length) {
+        const char* word = words[rand() % (rand() % 9 + 1)];
+        for (; *word && i < length; ++word, ++i)
+            data[i] = *word;
+    }
+}
+
+static size_t compress_raw(const unsigned char* data, size_t length, size_t flush_interval, unsigned char* compressed, size_t compressed_max_length) {
+    z_stream stream = { 0 };
+    deflateInit2(&stream, 6, Z_DEFLATED, -15, 8, Z_DEFAULT_STRATEGY);
+    stream.next_out = compressed;
+    stream.avail_out = compressed_max_length;
+    for (size_t offset = 0; offset < length;) {
+        size_t piece = length - offset < flush_interval ? length - offset : flush_interval;
+        stream.next_in = (unsigned char*)data + offset;
+        stream.avail_in = piece;
+        offset += piece;
+        deflate(&stream, offset < length ? Z_FULL_FLUSH : Z_FINISH);
+    }
+    size_t compressed_length = stream.total_out;
+    deflateEnd(&stream);
+    return compressed_length;
+}
+
+int main(int argc, char** argv) {
+    size_t stream_length = argc > 1 ? strtoul(argv[1], NULL, 10) : 256 * 1024 * 1024;
+    size_t flush_interval = argc > 2 ? strtoul(argv[2], NULL, 10) : 1024 * 1024;
+    unsigned thread_count = argc > 3 ? (unsigned)strtoul(argv[3], NULL, 10) : 0;
+
+    unsigned char* data = malloc(stream_length);
+    make_input(data, stream_length, 1);
+    size_t compressed_max_length = compressBound(stream_length);
+    unsigned char* compressed = malloc(compressed_max_length);
+    size_t compressed_length = compress_raw(data, stream_length, flush_interval, compressed, compressed_max_length);
+    unsigned char* decompressed = malloc(stream_length);
+
+    double best_sequential = 1e30;
+    double best_parallel = 1e30;
+    for (int round = 0; round < BENCH_ROUNDS; ++round) {
+        size_t length = 0;
+        double start = now();
+        if (tinflate(compressed, compressed_length, decompressed, &length, stream_length)) {
+            fprintf(stderr, "tinflate failed\n");
+            return 1;
+        }
+        double sequential = now() - start;
+
+        start = now();
+        if (tinflate_parallel(compressed, compressed_length, decompressed, &length, stream_length, thread_count) || memcmp(decompressed, data, stream_length)) {
+            fprintf(stderr, "tinflate_parallel failed\n");
+            return 1;
+        }
+        double parallel = now() - start;
+
+        best_sequential = sequential < best_sequential ? sequential : best_sequential;
+        best_parallel = parallel < best_parallel ? parallel : best_parallel;
+    }
+
+    double megabytes = (double)stream_length / (1024 * 1024);
+    printf("stream %zu bytes, compressed %zu bytes\n", stream_length, compressed_length);
+    printf("sequential %8.1f MiB/s\n", megabytes / best_sequential);
+    printf("parallel   %8.1f MiB/s (%.2fx)\n", megabytes / best_parallel, best_sequential / best_parallel);
+
+    return 0;
+}
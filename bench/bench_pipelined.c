@@ -0,0 +1,94 @@
+/*
+ * Compares tinflate() with tinflate_pipelined() on one large stream. The
+ * pipelined decoder needs two cores to pay off.
+ *
+ *      cmake -S . -B build && cmake --build build --target bench_pipelined
+ *      build/bench_pipelined [stream_length]
+ *
+ * zlib is only used to produce the compressed input.
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+
+#include <zlib.h>
+
+#include "inflate.h"
+
+
+
+#define BENCH_ROUNDS    10
+
+
+static double now(void) {
+    struct timespec time;
+    clock_gettime(CLOCK_MONOTONIC, &time);
+    return time.tv_sec + time.tv_nsec * 1e-9;
+}
+
+/* Text-like input: words drawn from a small skewed vocabulary. */
+static void make_input(unsigned char* data, size_t length, unsigned seed) {
+    static const char* words[] = { "the ", "of ", "and ", "inflate ", "stream ", "block ", "huffman ", "table ", "window\n" };
+    srand(seed);
+    size_t i = 0;
+    while (i < length) {
+        const char* word = words[rand() % (rand() % 9 + 1)];
+        for (; *word && i < length; ++word, ++i)
+            data[i] = *word;
+    }
+}
+
+static size_t compress_raw(const unsigned char* data, size_t length, unsigned char* compressed, size_t compressed_max_length) {
+    z_stream stream = { 0 };
+    deflateInit2(&stream, 6, Z_DEFLATED, -15, 8, Z_DEFAULT_STRATEGY);
+    stream.next_in = (unsigned char*)data;
+    stream.avail_in = length;
+    stream.next_out = compressed;
+    stream.avail_out = compressed_max_length;
+    deflate(&stream, Z_FINISH);
+    size_t compressed_length = stream.total_out;
+    deflateEnd(&stream);
+    return compressed_length;
+}
+
+int main(int argc, char** argv) {
+    size_t stream_length = argc > 1 ? strtoul(argv[1], NULL, 10) : 256 * 1024 * 1024;
+
+    unsigned char* data = malloc(stream_length);
+    make_input(data, stream_length, 1);
+    size_t compressed_max_length = compressBound(stream_length);
+    unsigned char* compressed = malloc(compressed_max_length);
+    size_t compressed_length = compress_raw(data, stream_length, compressed, compressed_max_length);
+    unsigned char* decompressed = malloc(stream_length);
+
+    double best_sequential = 1e30;
+    double best_pipelined = 1e30;
+    for (int round = 0; round < BENCH_ROUNDS; ++round) {
+        size_t length = 0;
+        double start = now();
+        if (tinflate(compressed, compressed_length, decompressed, &length, stream_length)) {
+            fprintf(stderr, "tinflate failed\n");
+            return 1;
+        }
+        double sequential = now() - start;
+
+        start = now();
+        if (tinflate_pipelined(compressed, compressed_length, decompressed, &length, stream_length) || memcmp(decompressed, data, stream_length)) {
+            fprintf(stderr, "tinflate_pipelined failed\n");
+            return 1;
+        }
+        double pipelined = now() - start;
+
+        best_sequential = sequential < best_sequential ? sequential : best_sequential;
+        best_pipelined = pipelined < best_pipelined ? pipelined : best_pipelined;
+    }
+
+    double megabytes = (double)stream_length / (1024 * 1024);
+    printf("stream %zu bytes, compressed %zu bytes\n", stream_length, compressed_length);
+    printf("sequential %8.1f MiB/s\n", megabytes / best_sequential);
+    printf("pipelined  %8.1f MiB/s (%.2fx)\n", megabytes / best_pipelined, best_sequential / best_pipelined);
+
+    return 0;
+}
@@ -0,0 +1,175 @@
+/*
+ * Compares png_decode(), which unfilters every scanline as soon as it is
+ * inflated, with two passes: zlib_decompress() of the concatenated IDAT data
+ * followed by unfiltering the whole image.
+ *
+ *      cmake -S . -B build -DCMAKE_C_FLAGS="-mavx2 -mpclmul" && cmake --build build --target bench_png
+ *      build/bench_png [width] [height] [bytes_per_pixel]
+ *
+ * zlib is only used to produce the image.
+ */
+
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+
+#include <zlib.h>
+
+#include "png_decode.h"
+#include "png_filter.h"
+#include "zlib_decompress.h"
+
+
+
+#define BENCH_ROUNDS        10
+#define BENCH_IDAT_LENGTH   8192
+
+
+static double now(void) {
+    struct timespec time;
+    clock_gettime(CLOCK_MONOTONIC, &time);
+    return time.tv_sec + time.tv_nsec * 1e-9;
+}
+
+static void put_be32(unsigned char* bytes, uint32_t value) {
+    bytes[0] = (unsigned char)(value >> 24);
+    bytes[1] = (unsigned char)(value >> 16);
+    bytes[2] = (unsigned char)(value >> 8);
+    bytes[3] = (unsigned char)value;
+}
+
+static size_t put_chunk(unsigned char* png, const char* type, const unsigned char* data, size_t length) {
+    put_be32(png, (uint32_t)length);
+    memcpy(png + 4, type, 4);
+    memcpy(png + 8, data, length);
+    put_be32(png + 8 + length, (uint32_t)crc32(crc32(0, (const unsigned char*)type, 4), data, length));
+    return length + 12;
+}
+
+/* A smooth gradient with noise, every row filtered with the type photo encoders pick most, cycling through all five. */
+static size_t make_png(unsigned width, unsigned height, unsigned bytes_per_pixel, unsigned char* png, unsigned char** idat, size_t* idat_length) {
+    /* Gray, gray 16 bit, RGB, RGBA and RGBA 16 bit by bytes per pixel. */
+    static const unsigned char color_types[] = { 0, 0, 0, 2, 6, 0, 0, 0, 6 };
+    size_t row_length = (size_t)width * bytes_per_pixel;
+    unsigned char* image = malloc(row_length * height);
+    unsigned char* filtered = malloc((row_length + 1) * height);
+
+    srand(1);
+    for (size_t y = 0; y < height; ++y) {
+        for (size_t x = 0; x < row_length; ++x)
+            image[y * row_length + x] = (unsigned char)((x / bytes_per_pixel + y) / 4 + x % bytes_per_pixel * 40 + rand() % 4);
+    }
+
+    for (size_t y = 0; y < height; ++y) {
+        unsigned filter = y % 5 == 0 ? PNG_FILTER_PAETH : (unsigned)(y % 5);
+        const unsigned char* row = image + y * row_length;
+        unsigned char* out = filtered + y * (row_length + 1);
+        out[0] = (unsigned char)filter;
+        for (size_t x = 0; x < row_length; ++x) {
+            int left = x >= bytes_per_pixel ? row[x - bytes_per_pixel] : 0;
+            int up = y ? row[x - row_length] : 0;
+            int up_left = y && x >= bytes_per_pixel ? row[x - row_length - bytes_per_pixel] : 0;
+            int predictor = 0;
+            if (filter == PNG_FILTER_SUB) {
+                predictor = left;
+            } else if (filter == PNG_FILTER_UP) {
+                predictor = up;
+            } else if (filter == PNG_FILTER_AVERAGE) {
+                predictor = (left + up) / 2;
+            } else if (filter == PNG_FILTER_PAETH) {
+                int estimate = left + up - up_left;
+                int a = abs(estimate - left), b = abs(estimate - up), c = abs(estimate - up_left);
+                predictor = a <= b && a <= c ? left : b <= c ? up : up_left;
+            }
+            out[x + 1] = (unsigned char)(row[x] - predictor);
+        }
+    }
+
+    uLongf compressed_length = compressBound((row_length + 1) * height);
+    *idat = malloc(compressed_length);
+    compress2(*idat, &compressed_length, filtered, (row_length + 1) * height, 6);
+    *idat_length = compressed_length;
+
+    unsigned char header[13];
+    put_be32(header, width);
+    put_be32(header + 4, height);
+    header[8] = bytes_per_pixel == 2 || bytes_per_pixel == 8 ? 16 : 8;
+    header[9] = color_types[bytes_per_pixel];
+    header[10] = header[11] = header[12] = 0;
+
+    size_t length = 8;
+    memcpy(png, "\x89PNG\r\n\x1a\n", 8);
+    length += put_chunk(png + length, "IHDR", header, sizeof(header));
+    for (size_t offset = 0; offset < compressed_length; offset += BENCH_IDAT_LENGTH) {
+        size_t piece = compressed_length - offset < BENCH_IDAT_LENGTH ? compressed_length - offset : BENCH_IDAT_LENGTH;
+        length += put_chunk(png + length, "IDAT", *idat + offset, piece);
+    }
+    length += put_chunk(png + length, "IEND", NULL, 0);
+
+    free(image);
+    free(filtered);
+    return length;
+}
+
+int main(int argc, char** argv) {
+    unsigned width = argc > 1 ? (unsigned)strtoul(argv[1], NULL, 10) : 4096;
+    unsigned height = argc > 2 ? (unsigned)strtoul(argv[2], NULL, 10) : 4096;
+    unsigned bytes_per_pixel = argc > 3 ? (unsigned)strtoul(argv[3], NULL, 10) : 4;
+    if (bytes_per_pixel != 1 && bytes_per_pixel != 2 && bytes_per_pixel != 3 && bytes_per_pixel != 4 && bytes_per_pixel != 8) {
+        fprintf(stderr, "bytes_per_pixel must be 1, 2, 3, 4 or 8\n");
+        return 1;
+    }
+
+    size_t row_length = (size_t)width * bytes_per_pixel;
+    size_t image_length = row_length * height;
+    unsigned char* png = malloc(2 * image_length + 1024);
+    unsigned char* idat;
+    size_t idat_length;
+    size_t png_length = make_png(width, height, bytes_per_pixel, png, &idat, &idat_length);
+
+    unsigned char* fused = malloc(image_length);
+    unsigned char* two_pass = malloc(image_length);
+    unsigned char* filtered = malloc((row_length + 1) * height);
+    unsigned char* zero_row = calloc(row_length, 1);
+
+    double best_fused = 1e30;
+    double best_two_pass = 1e30;
+    for (int round = 0; round < BENCH_ROUNDS; ++round) {
+        struct PngImage image;
+        double start = now();
+        if (png_decode(png, png_length, fused, image_length, &image)) {
+            fprintf(stderr, "png_decode failed\n");
+            return 1;
+        }
+        double elapsed = now() - start;
+        best_fused = elapsed < best_fused ? elapsed : best_fused;
+
+        start = now();
+        size_t filtered_length = 0;
+        if (zlib_decompress(idat, idat_length, filtered, &filtered_length, (row_length + 1) * height)) {
+            fprintf(stderr, "zlib_decompress failed\n");
+            return 1;
+        }
+        for (size_t y = 0; y < height; ++y) {
+            const unsigned char* previous = y ? two_pass + (y - 1) * row_length : zero_row;
+            unsigned char* row = two_pass + y * row_length;
+            png_unfilter_row(filtered[y * (row_length + 1)], filtered + y * (row_length + 1) + 1, previous, row, row_length, bytes_per_pixel);
+        }
+        elapsed = now() - start;
+        best_two_pass = elapsed < best_two_pass ? elapsed : best_two_pass;
+    }
+
+    if (memcmp(fused, two_pass, image_length)) {
+        fprintf(stderr, "outputs differ\n");
+        return 1;
+    }
+
+    double megabytes = (double)image_length / (1024 * 1024);
+    printf("%ux%u, %u bytes per pixel, png %zu bytes\n", width, height, bytes_per_pixel, png_length);
+    printf("two pass %8.1f MiB/s\n", megabytes / best_two_pass);
+    printf("fused    %8.1f MiB/s (%.2fx)\n", megabytes / best_fused, best_two_pass / best_fused);
+
+    return 0;
+}
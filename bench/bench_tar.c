@@ -0,0 +1,277 @@
+/*
+ * Extracts an in-memory tar.gz of many small files and a few large ones, once
+ * the way a serial tar does it (inflate a chunk with zlib, write what it
+ * holds, repeat) and once with tar_extract() at several writer counts. The
+ * first round of every run is checked against the source files.
+ *
+ *      cmake -S . -B build && cmake --build build --target bench_tar
+ *      build/bench_tar [directory] [small files] [large files] [large length]
+ *
+ * zlib produces the archive. Extraction goes to directory, /tmp by default,
+ * and is deleted between rounds.
+ */
+
+#include <fcntl.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/stat.h>
+#include <time.h>
+#include <unistd.h>
+
+#include <zlib.h>
+
+#include "tar_extract.h"
+
+
+
+#define BENCH_ROUNDS        3
+#define BENCH_CHUNK_LENGTH  (64 << 10)
+
+
+struct BenchFile {
+    char name[64];
+    unsigned char* data;
+    size_t length;
+};
+
+
+static double now(void) {
+    struct timespec time;
+    clock_gettime(CLOCK_MONOTONIC, &time);
+    return time.tv_sec + time.tv_nsec * 1e-9;
+}
+
+/* Text-like contents: words drawn from a small skewed vocabulary. */
+static void make_data(unsigned char* data, size_t length, unsigned seed) {
+    static const char* words[] = { "the ", "of ", "and ", "tar ", "archive ", "header ", "record ", "member ", "file\n" };
+    srand(seed);
+    size_t i = 0;
+    while (i < length) {
+        const char* word = words[rand() % (rand() % 9 + 1)];
+        for (; *word && i < length; ++word, ++i)
+            data[i] = *word;
+    }
+}
+
+static size_t add_header(unsigned char* tar, const char* name, size_t length, char type) {
+    memset(tar, 0, 512);
+    snprintf((char*)tar, 100, "%s", name);
+    snprintf((char*)tar + 100, 8, "%07o", 0644);
+    snprintf((char*)tar + 124, 12, "%011llo", (unsigned long long)length);
+    snprintf((char*)tar + 136, 12, "%011o", 1600000000);
+    tar[156] = (unsigned char)type;
+    memcpy(tar + 257, "ustar\0" "00", 8);
+    memset(tar + 148, ' ', 8);
+    unsigned sum = 0;
+    for (int i = 0; i < 512; ++i)
+        sum += tar[i];
+    snprintf((char*)tar + 148, 8, "%06o", sum);
+    return 512;
+}
+
+static void remove_tree(const char* directory) {
+    char command[4200];
+    snprintf(command, sizeof(command), "rm -rf '%s'", directory);
+    if (system(command))
+        fprintf(stderr, "could not remove %s\n", directory);
+}
+
+static int check(const char* directory, const struct BenchFile* files, size_t file_count) {
+    size_t max_length = 0;
+    for (size_t i = 0; i < file_count; ++i)
+        max_length = files[i].length > max_length ? files[i].length : max_length;
+    unsigned char* scratch = malloc(max_length + 1);
+
+    int good = 1;
+    for (size_t i = 0; good && i < file_count; ++i) {
+        char path[4200];
+        snprintf(path, sizeof(path), "%s/%s", directory, files[i].name);
+        FILE* file = fopen(path, "rb");
+        good = file && fread(scratch, 1, max_length + 1, file) == files[i].length && !memcmp(scratch, files[i].data, files[i].length);
+        if (file)
+            fclose(file);
+    }
+
+    free(scratch);
+    return good;
+}
+
+/* Serial baseline: one 64 KiB chunk at a time, every byte of file data going out as soon as it is decoded. */
+static int serial_extract(const unsigned char* compressed, size_t compressed_length, const char* directory) {
+    unsigned char* chunk = malloc(BENCH_CHUNK_LENGTH);
+    unsigned char header[512];
+    size_t header_length = 0;
+    uint64_t remaining = 0, padding = 0;
+    int fd = -1;
+
+    z_stream inflater = { 0 };
+    inflateInit2(&inflater, 31);
+    inflater.next_in = (unsigned char*)compressed;
+    inflater.avail_in = (uInt)compressed_length;
+
+    int result;
+    do {
+        inflater.next_out = chunk;
+        inflater.avail_out = BENCH_CHUNK_LENGTH;
+        result = inflate(&inflater, Z_NO_FLUSH);
+        size_t length = BENCH_CHUNK_LENGTH - inflater.avail_out;
+
+        for (size_t position = 0; position < length;) {
+            if (remaining) {
+                size_t piece = remaining < length - position ? (size_t)remaining : length - position;
+                if (write(fd, chunk + position, piece) != (ssize_t)piece)
+                    return 1;
+                remaining -= piece;
+                position += piece;
+                if (!remaining) {
+                    close(fd);
+                    fd = -1;
+                }
+            } else if (padding) {
+                size_t piece = padding < length - position ? (size_t)padding : length - position;
+                padding -= piece;
+                position += piece;
+            } else {
+                size_t piece = 512 - header_length < length - position ? 512 - header_length : length - position;
+                memcpy(header + header_length, chunk + position, piece);
+                header_length += piece;
+                position += piece;
+                if (header_length < 512)
+                    continue;
+                header_length = 0;
+                if (!header[0])
+                    continue;
+
+                char path[4200];
+                snprintf(path, sizeof(path), "%s/%.100s", directory, (char*)header);
+                remaining = strtoull((char*)header + 124, NULL, 8);
+                padding = -remaining & 511;
+                if (header[156] == '5') {
+                    mkdir(path, 0755);
+                    continue;
+                }
+                fd = open(path, O_WRONLY | O_CREAT | O_TRUNC, 0644);
+                if (fd < 0)
+                    return 1;
+                if (!remaining) {
+                    close(fd);
+                    fd = -1;
+                }
+            }
+        }
+    } while (result == Z_OK);
+    inflateEnd(&inflater);
+    free(chunk);
+
+    return result != Z_STREAM_END;
+}
+
+int main(int argc, char** argv) {
+    const char* base = argc > 1 ? argv[1] : "/tmp";
+    size_t small_count = argc > 2 ? strtoull(argv[2], NULL, 10) : 4000;
+    size_t large_count = argc > 3 ? strtoull(argv[3], NULL, 10) : 8;
+    size_t large_length = argc > 4 ? strtoull(argv[4], NULL, 10) : 8 << 20;
+
+    size_t file_count = small_count + large_count;
+    struct BenchFile* files = calloc(file_count, sizeof(struct BenchFile));
+    size_t tar_max_length = 1024 + 512 * 64;
+    for (size_t i = 0; i < file_count; ++i) {
+        files[i].length = i < small_count ? (size_t)(1 + i * 7919 % 16384) : large_length;
+        files[i].data = malloc(files[i].length);
+        make_data(files[i].data, files[i].length, (unsigned)i + 1);
+        snprintf(files[i].name, sizeof(files[i].name), "d%02zu/f%zu", i % 64, i);
+        tar_max_length += 1024 + files[i].length;
+    }
+
+    unsigned char* tar = calloc(1, tar_max_length);
+    size_t tar_length = 0;
+    for (unsigned i = 0; i < 64; ++i) {
+        char name[16];
+        snprintf(name, sizeof(name), "d%02u/", i);
+        tar_length += add_header(tar + tar_length, name, 0, '5');
+    }
+    uint64_t data_length = 0;
+    for (size_t i = 0; i < file_count; ++i) {
+        tar_length += add_header(tar + tar_length, files[i].name, files[i].length, '0');
+        memcpy(tar + tar_length, files[i].data, files[i].length);
+        tar_length += (files[i].length + 511) / 512 * 512;
+        data_length += files[i].length;
+    }
+    tar_length += 1024;
+
+    uLong compressed_max_length = compressBound(tar_length) + 64;
+    unsigned char* compressed = malloc(compressed_max_length);
+    z_stream deflater = { 0 };
+    deflateInit2(&deflater, 6, Z_DEFLATED, 31, 8, Z_DEFAULT_STRATEGY);
+    deflater.next_in = tar;
+    deflater.avail_in = (uInt)tar_length;
+    deflater.next_out = compressed;
+    deflater.avail_out = (uInt)compressed_max_length;
+    deflate(&deflater, Z_FINISH);
+    size_t compressed_length = compressed_max_length - deflater.avail_out;
+    deflateEnd(&deflater);
+
+    char directory[4096];
+    snprintf(directory, sizeof(directory), "%s/bench_tar_XXXXXX", base);
+    if (!mkdtemp(directory)) {
+        fprintf(stderr, "cannot create a directory in %s\n", base);
+        return 1;
+    }
+    rmdir(directory);
+
+    printf("%zu files, %llu bytes of data, archive %zu bytes, compressed %zu bytes\n", file_count, (unsigned long long)data_length, tar_length, compressed_length);
+
+    double best_serial = 1e30;
+    for (int round = 0; round < BENCH_ROUNDS; ++round) {
+        mkdir(directory, 0755);
+        double start = now();
+        if (serial_extract(compressed, compressed_length, directory)) {
+            fprintf(stderr, "serial extraction failed\n");
+            return 1;
+        }
+        double elapsed = now() - start;
+        best_serial = elapsed < best_serial ? elapsed : best_serial;
+        if (!round && !check(directory, files, file_count)) {
+            fprintf(stderr, "serial extraction differs\n");
+            return 1;
+        }
+        remove_tree(directory);
+    }
+    double megabytes = (double)tar_length / (1024 * 1024);
+    printf("zlib, serial        %8.1f MiB/s\n", megabytes / best_serial);
+
+    static const unsigned writer_counts[] = { 1, 2, 4, 8 };
+    for (size_t w = 0; w < sizeof(writer_counts) / sizeof(writer_counts[0]); ++w) {
+        struct TarExtractOptions options = { .writer_count = writer_counts[w] };
+        struct TarExtractStats best = { .elapsed = 1e30 };
+        for (int round = 0; round < BENCH_ROUNDS; ++round) {
+            mkdir(directory, 0755);
+            struct TarExtractStats stats;
+            int result = tar_extract(compressed, compressed_length, directory, &options, &stats);
+            if (result) {
+                fprintf(stderr, "tar_extract failed: %d\n", result);
+                return 1;
+            }
+            if (stats.elapsed < best.elapsed)
+                best = stats;
+            if (!round && !check(directory, files, file_count)) {
+                fprintf(stderr, "tar_extract differs\n");
+                return 1;
+            }
+            remove_tree(directory);
+        }
+        printf("tar_extract, %u writer%s %8.1f MiB/s (%.2fx)  decode %3.0f%%  parse %3.0f%%  decode waits %3.0f%%  writers busy %3.0f%%\n", writer_counts[w],
+               writer_counts[w] == 1 ? " " : "s", megabytes / best.elapsed, best_serial / best.elapsed, 100 * best.decode_busy / best.elapsed,
+               100 * best.parse_busy / best.elapsed, 100 * best.decode_wait / best.elapsed, 100 * best.write_busy / (best.elapsed * best.writer_count));
+    }
+
+    for (size_t i = 0; i < file_count; ++i)
+        free(files[i].data);
+    free(files);
+    free(tar);
+    free(compressed);
+
+    return 0;
+}
@@ -0,0 +1,146 @@
+/*
+ * Re-packs a deflate stream two ways: tinflate() followed by deflate_chunk()
+ * at the source's level, and inflate_tokens_export() followed by
+ * inflate_tokens_encode(), keeping the source's blocks and cutting new ones.
+ * Every result is checked with zlib.
+ *
+ *      cmake -S . -B build && cmake --build build --target bench_tokens
+ *      build/bench_tokens [length] [level]
+ *
+ * zlib produces the source stream.
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+
+#include <zlib.h>
+
+#include "deflate.h"
+#include "inflate.h"
+#include "inflate_tokens.h"
+
+
+
+#define BENCH_ROUNDS    5
+
+
+static double now(void) {
+    struct timespec time;
+    clock_gettime(CLOCK_MONOTONIC, &time);
+    return time.tv_sec + time.tv_nsec * 1e-9;
+}
+
+/* Text-like input: words drawn from a small skewed vocabulary, with numbers mixed in. */
+static void make_input(unsigned char* data, size_t length) {
+    static const char* words[] = { "the ", "of ", "and ", "inflate ", "stream ", "block ", "huffman ", "table ", "window\n" };
+    srand(1);
+    size_t i = 0;
+    while (i < length) {
+        char number[16];
+        const char* word = rand() % 8 ? words[rand() % (rand() % 9 + 1)] : (sprintf(number, "%d ", rand() % 100000), number);
+        for (; *word && i < length; ++word, ++i)
+            data[i] = *word;
+    }
+}
+
+static int check(const unsigned char* compressed, size_t compressed_length, const unsigned char* data, size_t length, unsigned char* scratch) {
+    z_stream inflater = { 0 };
+    inflateInit2(&inflater, -15);
+    inflater.next_in = (unsigned char*)compressed;
+    inflater.avail_in = (uInt)compressed_length;
+    inflater.next_out = scratch;
+    inflater.avail_out = (uInt)length + 1;
+    int result = inflate(&inflater, Z_FINISH);
+    size_t produced = length + 1 - inflater.avail_out;
+    inflateEnd(&inflater);
+    return result == Z_STREAM_END && produced == length && !memcmp(scratch, data, length);
+}
+
+int main(int argc, char** argv) {
+    size_t length = argc > 1 ? strtoull(argv[1], NULL, 10) : 64 << 20;
+    int level = argc > 2 ? atoi(argv[2]) : 6;
+
+    unsigned char* data = malloc(length);
+    make_input(data, length);
+
+    uLong source_max_length = compressBound(length) + 64;
+    unsigned char* source = malloc(source_max_length);
+    z_stream deflater = { 0 };
+    deflateInit2(&deflater, level, Z_DEFLATED, -15, 8, Z_DEFAULT_STRATEGY);
+    deflater.next_in = data;
+    deflater.avail_in = (uInt)length;
+    deflater.next_out = source;
+    deflater.avail_out = (uInt)source_max_length;
+    deflate(&deflater, Z_FINISH);
+    size_t source_length = source_max_length - deflater.avail_out;
+    deflateEnd(&deflater);
+
+    size_t tokens_max_length = inflate_tokens_bound(source_length, length);
+    unsigned char* tokens = malloc(tokens_max_length);
+    unsigned char* decompressed = malloc(length + 1);
+    size_t compressed_max_length = deflate_bound(length);
+    unsigned char* compressed = malloc(compressed_max_length);
+    struct Deflator* deflator = deflator_alloc(level);
+
+    double best_full = 1e30, best_export = 1e30, best_keep = 1e30, best_cut = 1e30;
+    size_t full_length = 0, tokens_length = 0, keep_length = 0, cut_length = 0;
+    for (int round = 0; round < BENCH_ROUNDS; ++round) {
+        double start = now();
+        size_t decompressed_length;
+        if (tinflate(source, source_length, decompressed, &decompressed_length, length) || decompressed_length != length) {
+            fprintf(stderr, "tinflate failed\n");
+            return 1;
+        }
+        full_length = deflate_chunk(deflator, decompressed, 0, length, true, compressed, compressed_max_length);
+        double elapsed = now() - start;
+        best_full = elapsed < best_full ? elapsed : best_full;
+        if (!round && (!full_length || !check(compressed, full_length, data, length, decompressed))) {
+            fprintf(stderr, "recompression differs\n");
+            return 1;
+        }
+
+        start = now();
+        if (inflate_tokens_export(source, source_length, INFLATE_FORMAT_RAW, tokens, &tokens_length, tokens_max_length)) {
+            fprintf(stderr, "inflate_tokens_export failed\n");
+            return 1;
+        }
+        double export_elapsed = now() - start;
+        best_export = export_elapsed < best_export ? export_elapsed : best_export;
+        if (inflate_tokens_encode(tokens, tokens_length, 0, compressed, &keep_length, compressed_max_length)) {
+            fprintf(stderr, "inflate_tokens_encode failed\n");
+            return 1;
+        }
+        elapsed = now() - start;
+        best_keep = elapsed < best_keep ? elapsed : best_keep;
+        if (!round && !check(compressed, keep_length, data, length, decompressed)) {
+            fprintf(stderr, "transcoding with the source's blocks differs\n");
+            return 1;
+        }
+
+        start = now();
+        if (inflate_tokens_encode(tokens, tokens_length, 4096, compressed, &cut_length, compressed_max_length)) {
+            fprintf(stderr, "inflate_tokens_encode failed\n");
+            return 1;
+        }
+        /* Both transcodes share one export. */
+        elapsed = now() - start + export_elapsed;
+        best_cut = elapsed < best_cut ? elapsed : best_cut;
+        if (!round && !check(compressed, cut_length, data, length, decompressed)) {
+            fprintf(stderr, "transcoding with 4096 token blocks differs\n");
+            return 1;
+        }
+    }
+
+    double megabytes = (double)length / (1024 * 1024);
+    printf("%zu bytes, level %d, source %zu bytes, tokens %zu bytes\n", length, level, source_length, tokens_length);
+    printf("decode + deflate_chunk    %8.1f MiB/s %10zu bytes\n", megabytes / best_full, full_length);
+    printf("export                    %8.1f MiB/s\n", megabytes / best_export);
+    printf("export + encode, kept     %8.1f MiB/s %10zu bytes (%.2fx)\n", megabytes / best_keep, keep_length, best_full / best_keep);
+    printf("export + encode, 4096     %8.1f MiB/s %10zu bytes (%.2fx)\n", megabytes / best_cut, cut_length, best_full / best_cut);
+
+    deflator_free(deflator);
+
+    return 0;
+}
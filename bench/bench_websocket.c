@@ -0,0 +1,176 @@
+/*
+ * Decodes interleaved permessage-deflate messages of many connections with
+ * context takeover, once with websocket_inflate_message() and once with one
+ * zlib stream per connection, and compares throughput and the memory an idle
+ * connection holds.
+ *
+ *      cmake -S . -B build && cmake --build build --target bench_websocket
+ *      build/bench_websocket [connection_count] [message_count] [message_length]
+ *
+ * zlib also produces the messages.
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+
+#include <zlib.h>
+
+#include "websocket_inflate.h"
+
+
+
+#define BENCH_ROUNDS    5
+
+
+static double now(void) {
+    struct timespec time;
+    clock_gettime(CLOCK_MONOTONIC, &time);
+    return time.tv_sec + time.tv_nsec * 1e-9;
+}
+
+/* A JSON event of around length bytes that repeats most of its keys and some values. */
+static size_t make_message(char* message, size_t length, unsigned connection, unsigned sequence) {
+    static const char* kinds[] = { "quote", "trade", "book", "status" };
+    size_t used = (size_t)sprintf(message, "{\"type\":\"%s\",\"connection\":%u,\"sequence\":%u,\"entries\":[", kinds[rand() % 4], connection, sequence);
+    while (used + 64 < length)
+        used += (size_t)sprintf(message + used, "{\"price\":%d.%02d,\"size\":%d,\"side\":\"%s\"},", 100 + rand() % 50, rand() % 100, rand() % 1000, rand() % 2 ? "bid" : "ask");
+    used += (size_t)sprintf(message + used, "{}]}");
+    return used;
+}
+
+static size_t allocated;
+
+static void* count_alloc(void* opaque, unsigned items, unsigned size) {
+    (void)opaque;
+    size_t* block = malloc(sizeof(size_t) + (size_t)items * size);
+    *block = (size_t)items * size;
+    allocated += *block;
+    return block + 1;
+}
+
+static void count_free(void* opaque, void* address) {
+    (void)opaque;
+    size_t* block = (size_t*)address - 1;
+    allocated -= *block;
+    free(block);
+}
+
+int main(int argc, char** argv) {
+    unsigned connection_count = argc > 1 ? (unsigned)strtoul(argv[1], NULL, 10) : 1000;
+    unsigned message_count = argc > 2 ? (unsigned)strtoul(argv[2], NULL, 10) : 100;
+    size_t message_length = argc > 3 ? strtoull(argv[3], NULL, 10) : 512;
+    size_t total = (size_t)connection_count * message_count;
+
+    /* Message i belongs to connection i % connection_count. */
+    char* text = malloc(message_length + 64);
+    unsigned char** payloads = malloc(total * sizeof(unsigned char*));
+    size_t* payload_lengths = malloc(total * sizeof(size_t));
+    size_t* lengths = malloc(total * sizeof(size_t));
+    unsigned char** originals = malloc(total * sizeof(unsigned char*));
+    z_stream* deflaters = calloc(connection_count, sizeof(z_stream));
+    size_t decompressed_total = 0;
+    size_t compressed_total = 0;
+
+    srand(1);
+    for (unsigned c = 0; c < connection_count; ++c)
+        deflateInit2(&deflaters[c], 6, Z_DEFLATED, -15, 8, Z_DEFAULT_STRATEGY);
+    for (size_t i = 0; i < total; ++i) {
+        z_stream* deflater = &deflaters[i % connection_count];
+        lengths[i] = make_message(text, message_length, (unsigned)(i % connection_count), (unsigned)(i / connection_count));
+        originals[i] = malloc(lengths[i]);
+        memcpy(originals[i], text, lengths[i]);
+
+        size_t max_length = deflateBound(deflater, lengths[i]) + 16;
+        payloads[i] = malloc(max_length);
+        deflater->next_in = originals[i];
+        deflater->avail_in = (uInt)lengths[i];
+        deflater->next_out = payloads[i];
+        deflater->avail_out = (uInt)max_length;
+        deflate(deflater, Z_SYNC_FLUSH);
+        payload_lengths[i] = max_length - deflater->avail_out - 4;
+
+        decompressed_total += lengths[i];
+        compressed_total += payload_lengths[i];
+    }
+    for (unsigned c = 0; c < connection_count; ++c)
+        deflateEnd(&deflaters[c]);
+
+    unsigned char* message = malloc(message_length + 64);
+    unsigned char* framed = malloc(message_length * 2 + 64);
+    double best_session = 1e30;
+    double best_zlib = 1e30;
+    size_t session_memory = 0;
+    size_t zlib_memory = 0;
+
+    for (int round = 0; round < BENCH_ROUNDS; ++round) {
+        struct WebSocketInflate** sessions = malloc(connection_count * sizeof(struct WebSocketInflate*));
+        for (unsigned c = 0; c < connection_count; ++c)
+            websocket_inflate_create(15, true, &sessions[c]);
+
+        double start = now();
+        for (size_t i = 0; i < total; ++i) {
+            size_t length;
+            if (websocket_inflate_message(sessions[i % connection_count], payloads[i], payload_lengths[i], message, &length, message_length + 64) || length != lengths[i]) {
+                fprintf(stderr, "websocket_inflate_message failed on message %zu\n", i);
+                return 1;
+            }
+            if (!round && memcmp(message, originals[i], length)) {
+                fprintf(stderr, "message %zu differs\n", i);
+                return 1;
+            }
+        }
+        double elapsed = now() - start;
+        best_session = elapsed < best_session ? elapsed : best_session;
+
+        session_memory = 0;
+        for (unsigned c = 0; c < connection_count; ++c) {
+            session_memory += websocket_inflate_memory(sessions[c]);
+            websocket_inflate_free(sessions[c]);
+        }
+        free(sessions);
+
+        z_stream* inflaters = calloc(connection_count, sizeof(z_stream));
+        allocated = 0;
+        for (unsigned c = 0; c < connection_count; ++c) {
+            inflaters[c].zalloc = count_alloc;
+            inflaters[c].zfree = count_free;
+            inflateInit2(&inflaters[c], -15);
+        }
+
+        start = now();
+        for (size_t i = 0; i < total; ++i) {
+            /* zlib wants the trailer back in the input. */
+            z_stream* inflater = &inflaters[i % connection_count];
+            memcpy(framed, payloads[i], payload_lengths[i]);
+            memcpy(framed + payload_lengths[i], "\x00\x00\xff\xff", 4);
+            inflater->next_in = framed;
+            inflater->avail_in = (uInt)payload_lengths[i] + 4;
+            inflater->next_out = message;
+            inflater->avail_out = (uInt)message_length + 64;
+            if (inflate(inflater, Z_SYNC_FLUSH) != Z_OK || message_length + 64 - inflater->avail_out != lengths[i]) {
+                fprintf(stderr, "zlib failed on message %zu\n", i);
+                return 1;
+            }
+        }
+        elapsed = now() - start;
+        best_zlib = elapsed < best_zlib ? elapsed : best_zlib;
+
+        zlib_memory = allocated;
+        for (unsigned c = 0; c < connection_count; ++c)
+            inflateEnd(&inflaters[c]);
+        free(inflaters);
+    }
+
+    double megabytes = (double)decompressed_total / (1024 * 1024);
+    printf("%u connections, %u messages each, %zu bytes per message, %.1fx compression\n", connection_count, message_count, decompressed_total / total,
+           (double)decompressed_total / compressed_total);
+    printf("zlib        %8.1f MiB/s %8.1f messages/ms %8zu bytes per idle connection\n", megabytes / best_zlib, total / best_zlib / 1000, zlib_memory / connection_count);
+    printf("session     %8.1f MiB/s %8.1f messages/ms %8zu bytes per idle connection (%.2fx)\n", megabytes / best_session, total / best_session / 1000,
+           session_memory / connection_count, best_zlib / best_session);
+
+    websocket_inflate_release_thread();
+
+    return 0;
+}
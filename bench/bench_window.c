@@ -0,0 +1,152 @@
+/*
+ * Compares one-shot tinflate() into a flat buffer with streaming decode
+ * through an InflateWindow: mirrored, sliding at the default capacity and
+ * sliding at the capacity inflate_window_create() falls back to. Input is fed
+ * in pieces. Timed runs use the output in place, as a streaming consumer
+ * would, so only the window itself is measured; one more run copies it out
+ * to check it.
+ *
+ *      cmake -S . -B build && cmake --build build --target bench_window
+ *      build/bench_window [length] [piece_length]
+ *
+ * zlib is only used to produce the input.
+ */
+
+#include <stdbool.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+
+#include <zlib.h>
+
+#include "inflate.h"
+#include "inflate_stream.h"
+#include "inflate_window.h"
+
+
+
+#define BENCH_ROUNDS    10
+
+
+static double now(void) {
+    struct timespec time;
+    clock_gettime(CLOCK_MONOTONIC, &time);
+    return time.tv_sec + time.tv_nsec * 1e-9;
+}
+
+/* Text-like input: words drawn from a small skewed vocabulary. */
+static void make_input(unsigned char* data, size_t length, unsigned seed) {
+    static const char* words[] = { "the ", "of ", "and ", "inflate ", "stream ", "block ", "huffman ", "table ", "window\n" };
+    srand(seed);
+    size_t i = 0;
+    while (i < length) {
+        const char* word = words[rand() % (rand() % 9 + 1)];
+        for (; *word && i < length; ++word, ++i)
+            data[i] = *word;
+    }
+}
+
+/* Decodes compressed in pieces of piece_length through window, into decompressed unless it is NULL. Returns the decompressed length, 0 on failure. */
+static size_t decode_streaming(struct InflateWindow* window, const unsigned char* compressed, size_t compressed_length, size_t piece_length, unsigned char* decompressed) {
+    static struct InflateStream stream;
+    struct InflateStash stash = { 0 };
+    inflate_stream_init(&stream, NULL, 0, NULL, 0);
+    inflate_window_reset(window);
+
+    size_t length = 0;
+    int result = INFLATE_COMPRESSED_INCOMPLETE;
+    for (size_t offset = 0; offset < compressed_length && result != INFLATE_SUCCESS;) {
+        const unsigned char* next = compressed + offset;
+        const unsigned char* end = compressed_length - offset < piece_length ? compressed + compressed_length : next + piece_length;
+        do {
+            inflate_window_prepare(window, &stream.cursor);
+            result = inflate_stream_feed(&stream, &stash, &next, end);
+            inflate_window_commit(window, &stream.cursor);
+            if (decompressed) {
+                length += inflate_window_take(window, decompressed + length, inflate_window_pending_length(window));
+            } else {
+                length += inflate_window_pending_length(window);
+                inflate_window_drop(window);
+            }
+        } while (result == INFLATE_DECOMPRESSED_OVERFLOW);
+        if (result != INFLATE_SUCCESS && result != INFLATE_COMPRESSED_INCOMPLETE)
+            return 0;
+        offset = next - compressed;
+    }
+
+    return result == INFLATE_SUCCESS ? length : 0;
+}
+
+static void run(const char* name, struct InflateWindow* window, const unsigned char* compressed, size_t compressed_length, size_t piece_length, const unsigned char* data,
+                size_t length, unsigned char* decompressed, double one_shot) {
+    if (decode_streaming(window, compressed, compressed_length, piece_length, decompressed) != length || memcmp(decompressed, data, length)) {
+        fprintf(stderr, "%s: output differs\n", name);
+        exit(1);
+    }
+
+    double best = 1e30;
+    for (int round = 0; round < BENCH_ROUNDS; ++round) {
+        double start = now();
+        decode_streaming(window, compressed, compressed_length, piece_length, NULL);
+        double elapsed = now() - start;
+        best = elapsed < best ? elapsed : best;
+    }
+
+    printf("%-24s %8.1f MiB/s (%.2fx, capacity %zu)\n", name, (double)length / (1024 * 1024) / best, one_shot / best, window->capacity);
+}
+
+int main(int argc, char** argv) {
+    size_t length = argc > 1 ? strtoull(argv[1], NULL, 10) : 64 << 20;
+    size_t piece_length = argc > 2 ? strtoull(argv[2], NULL, 10) : 64 << 10;
+
+    unsigned char* data = malloc(length);
+    make_input(data, length, 1);
+
+    z_stream deflater = { 0 };
+    deflateInit2(&deflater, 6, Z_DEFLATED, -15, 8, Z_DEFAULT_STRATEGY);
+    size_t compressed_max_length = deflateBound(&deflater, length);
+    unsigned char* compressed = malloc(compressed_max_length);
+    deflater.next_in = data;
+    deflater.avail_in = length;
+    deflater.next_out = compressed;
+    deflater.avail_out = compressed_max_length;
+    deflate(&deflater, Z_FINISH);
+    size_t compressed_length = deflater.total_out;
+    deflateEnd(&deflater);
+
+    unsigned char* decompressed = malloc(length);
+    double one_shot = 1e30;
+    for (int round = 0; round < BENCH_ROUNDS; ++round) {
+        size_t decompressed_length;
+        double start = now();
+        if (tinflate(compressed, compressed_length, decompressed, &decompressed_length, length) || decompressed_length != length) {
+            fprintf(stderr, "tinflate failed\n");
+            return 1;
+        }
+        double elapsed = now() - start;
+        one_shot = elapsed < one_shot ? elapsed : one_shot;
+    }
+    printf("%zu bytes, compressed %zu, pieces of %zu\n", length, compressed_length, piece_length);
+    printf("%-24s %8.1f MiB/s\n", "one-shot", (double)length / (1024 * 1024) / one_shot);
+
+    struct InflateWindow window;
+    if (inflate_window_create(&window, INFLATE_WINDOW_DEFAULT_CAPACITY, true) || window.memory != INFLATE_WINDOW_MIRRORED) {
+        fprintf(stderr, "no mirrored window here\n");
+    } else {
+        run("mirrored", &window, compressed, compressed_length, piece_length, data, length, decompressed, one_shot);
+        inflate_window_destroy(&window);
+    }
+
+    unsigned char* buffer = malloc(INFLATE_WINDOW_DEFAULT_CAPACITY);
+    inflate_window_init(&window, buffer, INFLATE_WINDOW_DEFAULT_CAPACITY);
+    run("sliding", &window, compressed, compressed_length, piece_length, data, length, decompressed, one_shot);
+    free(buffer);
+
+    if (inflate_window_create(&window, INFLATE_WINDOW_DEFAULT_CAPACITY, false))
+        return 1;
+    run("sliding, fallback", &window, compressed, compressed_length, piece_length, data, length, decompressed, one_shot);
+    inflate_window_destroy(&window);
+
+    return 0;
+}
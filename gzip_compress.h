@@ -0,0 +1,86 @@
+/*
+ * https://datatracker.ietf.org/doc/html/rfc1952
+ * https://samtools.github.io/hts-specs/SAMv1.pdf (section 4.1, BGZF)
+ * https://linux.die.net/man/1/dictzip (RA extra field)
+ */
+
+#ifndef GZIP_COMPRESS_H
+#define GZIP_COMPRESS_H
+
+
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+
+#include "MDE.h"
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+
+
+/* How the input is split across threads. */
+enum GzipCompressMode {
+    /* One member. Every chunk may refer back into the 32 KiB before it, like pigz. Chunks end with a sync flush. */
+    GZIP_COMPRESS_DICTIONARY = 0,
+    /* One member. Chunks are compressed on their own and end with a full flush, so decoding can start at any of them. */
+    GZIP_COMPRESS_INDEPENDENT,
+    /* One BGZF member per chunk, followed by the BGZF end-of-file marker. */
+    GZIP_COMPRESS_BGZF,
+};
+
+struct GzipCompressOptions {
+    enum GzipCompressMode mode;
+    int level;                  // 0 (stored) to 9.
+    size_t chunk_length;        // Uncompressed bytes per chunk, 0 selects the mode's default.
+    unsigned thread_count;      // 0 selects the number of online processors.
+    bool extra_index;           // GZIP_COMPRESS_INDEPENDENT: write a dictzip RA index into the header's extra field.
+};
+
+/* A place in the compressed stream where decoding can start without history. */
+struct GzipSeekPoint {
+    uint64_t compressed_offset;     // Offset of a block header (BGZF: of a member header) from the start of the file.
+    uint64_t decompressed_offset;
+};
+
+struct GzipSeekIndex {
+    struct GzipSeekPoint* points;
+    size_t point_count;
+};
+
+
+/* Upper bound of the compressed length of length bytes with the given options. */
+extern size_t gzip_compress_bound(size_t length, const struct GzipCompressOptions* options);
+
+/*
+ * Compresses data into a gzip file on thread_count threads. Chunks are
+ * compressed in parallel and the result is a standard gzip file any gzip
+ * decoder reads. If index is not NULL it receives the seek points of the file,
+ * one per chunk; GZIP_COMPRESS_DICTIONARY has none and returns
+ * INFLATE_NOT_INDEXABLE. An RA extra field is limited to chunks of at most
+ * 65535 bytes that compress to at most 65535 bytes, and to 32762 chunks;
+ * INFLATE_NOT_INDEXABLE is returned otherwise.
+ */
+extern int gzip_compress(const unsigned char* data, size_t length, unsigned char* compressed, size_t* compressed_length, size_t compressed_max_length,
+                         const struct GzipCompressOptions* options, struct GzipSeekIndex* index);
+
+/*
+ * Serialises an index for a sidecar file: the magic "GZSI", a little endian
+ * 32 bit version (1) and 64 bit point count, followed by every point as two
+ * little endian 64 bit offsets. Returns the serialised length, 0 if it does
+ * not fit max_length.
+ */
+extern size_t gzip_seek_index_write(const struct GzipSeekIndex* index, unsigned char* out, size_t max_length);
+
+/* Reads a serialised sidecar index. The points are allocated and released with gzip_seek_index_free(). */
+extern int gzip_seek_index_read(const unsigned char* in, size_t length, struct GzipSeekIndex* index);
+
+extern void gzip_seek_index_free(struct GzipSeekIndex* index);
+
+#ifdef __cplusplus
+}
+#endif
+
+
+#endif /* GZIP_COMPRESS_H */
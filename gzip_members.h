@@ -0,0 +1,69 @@
+/*
+ * https://datatracker.ietf.org/doc/html/rfc1952#section-2.2
+ * https://samtools.github.io/hts-specs/SAMv1.pdf (section 4.1, BGZF)
+ */
+
+#ifndef GZIP_MEMBERS_H
+#define GZIP_MEMBERS_H
+
+
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+
+#include "MDE.h"
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+
+
+/* Location of a single gzip member within the compressed input and the decompressed output. */
+struct GzipMember {
+    size_t compressed_offset;       // Offset of the member header.
+    size_t deflate_offset;          // Offset of the deflate data.
+    size_t deflate_length;
+    size_t decompressed_offset;     // Offset of the member's data in the concatenated output.
+    uint32_t decompressed_length;   // ISIZE.
+    uint32_t crc32;                 // CRC32 of the member's decompressed data.
+};
+
+struct GzipMemberIndex {
+    struct GzipMember* members;
+    size_t member_count;
+    size_t decompressed_length;     // Sum of all member lengths.
+    bool bgzf;                      // Every member carries a BGZF BSIZE field.
+};
+
+
+/*
+ * Builds an index of all members in a multi-member gzip file. Members with a
+ * BGZF BSIZE field are located from it without decoding any deflate data. For
+ * other members the end is found by walking the Huffman codes as
+ * inflate_scan_length() does, one member after the other but without writing
+ * output; their ISIZE must match. A member that decodes to 4 GiB or more gives
+ * INFLATE_NOT_INDEXABLE.
+ */
+extern int gzip_members_scan(const unsigned char* compressed, size_t compressed_length, struct GzipMemberIndex* index);
+
+/*
+ * Decompresses all indexed members on thread_count threads (0 selects the number
+ * of online processors). Every member is written straight to its final offset.
+ */
+extern int gzip_members_decompress(const unsigned char* compressed, const struct GzipMemberIndex* index, unsigned char* decompressed, size_t decompressed_max_length, unsigned thread_count);
+
+/*
+ * Reads from a BGZF virtual offset (coffset << 16 | uoffset) up to the end of the
+ * member containing it. Only that member is decoded.
+ */
+extern int gzip_members_read_virtual(const unsigned char* compressed, const struct GzipMemberIndex* index, uint64_t virtual_offset, unsigned char* decompressed, size_t* decompressed_length, size_t decompressed_max_length);
+
+extern void gzip_members_free(struct GzipMemberIndex* index);
+
+#ifdef __cplusplus
+}
+#endif
+
+
+#endif /* GZIP_MEMBERS_H */
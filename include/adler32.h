@@ -0,0 +1,17 @@
+/* https://datatracker.ietf.org/doc/html/rfc1950#section-9 */
+
+#ifndef ADLER32_H
+#define ADLER32_H
+
+
+#include <stddef.h>
+#include <stdint.h>
+
+
+
+/* Updates adler with the Adler-32 of the given bytes. Start with adler = 1. */
+uint32_t adler32_update(uint32_t adler, const uint8_t* data, size_t length);
+
+
+
+#endif /* ADLER32_H */
@@ -2,11 +2,13 @@
 #define BIT_READER_H
 
 
+#include <stddef.h>
 #include <stdint.h>
+#include <string.h>
 
 
 
-#define BITMASK(n)  ((1ULL << n) - 1)
+#define BITMASK(n)  ((1ULL << (n)) - 1)
 
 
 typedef uint64_t Buffer;
@@ -21,8 +23,10 @@ do {                                                                \
 /* Fills bit buffer to 56-63 bits or less if not enough bytes are left. */
 #define FILL_BUFFER()                                               \
 do {                                                                \
-    if (compressed_end - compressed_next >= sizeof(Buffer)) {       \
-        buffer |= *(Buffer*)compressed_next << buffer_count;        \
+    if (compressed_end - compressed_next >= (ptrdiff_t)sizeof(Buffer)) { \
+        Buffer word;                                                \
+        memcpy(&word, compressed_next, sizeof(word));               \
+        buffer |= word << buffer_count;                             \
         compressed_next += (63 - buffer_count) >> 3;                \
         buffer_count |= 56;                                         \
     } else {                                                        \
@@ -0,0 +1,20 @@
+/* https://datatracker.ietf.org/doc/html/rfc1952#section-8 */
+
+#ifndef CRC32_H
+#define CRC32_H
+
+
+#include <stddef.h>
+#include <stdint.h>
+
+
+
+/* Updates crc with the CRC-32 of the given bytes. Start with crc = 0. */
+uint32_t crc32_update(uint32_t crc, const uint8_t* data, size_t length);
+
+/* Returns the CRC-32 of A followed by B, given crc_a, crc_b and the length of B. */
+uint32_t crc32_merge(uint32_t crc_a, uint32_t crc_b, uint64_t length_b);
+
+
+
+#endif /* CRC32_H */
@@ -0,0 +1,108 @@
+/*
+ * https://datatracker.ietf.org/doc/html/rfc1951
+ *
+ * Deflate encoder: a hash chain matcher producing InflateTokens and a block
+ * writer choosing between dynamic Huffman, static Huffman and stored blocks.
+ * Input is compressed in chunks that concatenate on byte boundaries.
+ */
+
+#ifndef DEFLATE_H
+#define DEFLATE_H
+
+
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+
+#include "bit_reader.h"
+#include "inflate_internal.h"
+#include "inflate_stream.h"
+
+
+
+#define DEFLATE_MIN_LEVEL           0
+#define DEFLATE_MAX_LEVEL           9
+
+#define DEFLATE_HASH_BITS           15
+#define DEFLATE_HASH_LENGTH         (1 << DEFLATE_HASH_BITS)
+#define DEFLATE_WINDOW_LENGTH       INFLATE_MAX_LZ77_DISTANCE
+
+/* Tokens collected before a block is written. */
+#define DEFLATE_BLOCK_TOKENS        16384
+
+#define DEFLATE_LENGTH_CODE_COUNT   29
+#define DEFLATE_DISTANCE_CODE_COUNT 30
+
+
+/* LSB first bit writer. Running out of space sets overflow and drops further output. */
+struct BitWriter {
+    uint8_t* next;
+    uint8_t* end;
+    Buffer buffer;
+    uint32_t buffer_count;
+    bool overflow;
+};
+
+/* Huffman codes of one block. Codes are stored bit reversed, ready for an LSB first bit writer. */
+struct DeflateCodes {
+    uint16_t literal_codes[INFLATE_LITERAL_CODE_COUNT];
+    uint8_t literal_lengths[INFLATE_LITERAL_CODE_COUNT];
+    uint16_t distance_codes[INFLATE_DISTANCE_CODE_COUNT];
+    uint8_t distance_lengths[INFLATE_DISTANCE_CODE_COUNT];
+};
+
+struct Deflator {
+    int level;
+    unsigned max_chain;
+    unsigned nice_length;
+    unsigned lazy_length;       // 0 selects greedy matching.
+    unsigned good_length;
+
+    /* Hash chains over positions relative to the start of the dictionary. */
+    int32_t head[DEFLATE_HASH_LENGTH];
+    int32_t previous[DEFLATE_WINDOW_LENGTH];
+
+    InflateToken tokens[DEFLATE_BLOCK_TOKENS];
+
+    uint8_t length_symbols[INFLATE_MAX_LZ77_LENGTH + 1];
+    uint8_t distance_symbols[512];
+
+    struct DeflateCodes static_codes;
+    struct DeflateCodes codes;
+};
+
+
+/* Allocates a deflator for level 0 (stored blocks only) to 9. Returns NULL without memory. */
+struct Deflator* deflator_alloc(int level);
+
+void deflator_free(struct Deflator* deflator);
+
+/* Upper bound of the output of deflate_chunk() for length bytes of input. */
+size_t deflate_bound(size_t length);
+
+/*
+ * Compresses data[0, length). Matches may refer back into the dictionary_length
+ * bytes before data. The final chunk of a stream ends with the final block,
+ * any other chunk with an empty stored block (a sync flush), so chunks
+ * compressed separately concatenate to a valid stream. Returns the compressed
+ * length, or 0 if it does not fit compressed_max_length.
+ */
+size_t deflate_chunk(struct Deflator* deflator, const uint8_t* data, size_t dictionary_length, size_t length, bool final, uint8_t* compressed, size_t compressed_max_length);
+
+/* Block writer for tokens that come from elsewhere than deflate_chunk(). */
+void deflate_writer_init(struct BitWriter* writer, uint8_t* compressed, size_t compressed_max_length);
+
+/*
+ * Writes tokens as the cheapest of a dynamic and a static Huffman block. If raw
+ * holds the raw_length bytes the tokens decode to, a stored block is considered
+ * as well.
+ */
+void deflate_write_block(struct Deflator* deflator, struct BitWriter* writer, const InflateToken* tokens, size_t token_count, const uint8_t* raw, size_t raw_length,
+                         bool final);
+
+/* Pads the last byte with zeroes. Returns the compressed length, or 0 if it did not fit. */
+size_t deflate_writer_finish(struct BitWriter* writer, const uint8_t* compressed);
+
+
+
+#endif /* DEFLATE_H */
@@ -0,0 +1,66 @@
+/* https://datatracker.ietf.org/doc/html/rfc1952#section-2.3 */
+
+#ifndef GZIP_HEADER_H
+#define GZIP_HEADER_H
+
+
+#include <stddef.h>
+#include <stdint.h>
+
+
+
+#define GZIP_ID1                    0x1F
+#define GZIP_ID2                    0x8B
+#define GZIP_CM_DEFLATE             8
+
+/* Header flags (FLG). */
+#define GZIP_FTEXT                  0x01
+#define GZIP_FHCRC                  0x02
+#define GZIP_FEXTRA                 0x04
+#define GZIP_FNAME                  0x08
+#define GZIP_FCOMMENT               0x10
+#define GZIP_FRESERVED              0xE0
+
+#define GZIP_MIN_HEADER_LENGTH      10
+#define GZIP_TRAILER_LENGTH         8
+
+/* BGZF extra subfield (SAM/BAM specification, section 4.1). */
+#define BGZF_SI1                    66
+#define BGZF_SI2                    67
+#define BGZF_SLEN                   2
+#define BGZF_MAX_BLOCK_LENGTH       65536
+#define BGZF_HEADER_LENGTH          18
+
+/* dictzip random access extra subfield (dictzip(1)). */
+#define DICTZIP_SI1                 82
+#define DICTZIP_SI2                 65
+#define DICTZIP_VERSION             1
+
+
+struct GzipHeader {
+    size_t header_length;   // Offset of the deflate data from the start of the member.
+    uint8_t flags;
+    uint32_t block_length;  // BSIZE + 1 if the member is a BGZF block, 0 otherwise.
+};
+
+
+/* Parses a gzip member header. Returns INFLATE_COMPRESSED_INCOMPLETE if the header does not fit in compressed_length bytes. */
+int gzip_parse_header(const uint8_t* compressed, size_t compressed_length, struct GzipHeader* header);
+
+static inline uint32_t gzip_read_le32(const uint8_t* bytes) {
+    return (uint32_t)bytes[0] | (uint32_t)bytes[1] << 8 | (uint32_t)bytes[2] << 16 | (uint32_t)bytes[3] << 24;
+}
+
+static inline void gzip_write_le16(uint8_t* bytes, uint16_t value) {
+    bytes[0] = (uint8_t)value;
+    bytes[1] = (uint8_t)(value >> 8);
+}
+
+static inline void gzip_write_le32(uint8_t* bytes, uint32_t value) {
+    gzip_write_le16(bytes, (uint16_t)value);
+    gzip_write_le16(bytes + 2, (uint16_t)(value >> 16));
+}
+
+
+
+#endif /* GZIP_HEADER_H */
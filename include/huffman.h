@@ -21,6 +21,21 @@
 #define DISTANCE_TABLE_BITS         8
 #define DISTANCE_ENOUGH             402
 
+/* Indicates a literal entry in the literal table. */
+#define HUFFMAN_LITERAL             0x80000000
+
+/* Indicates that HUFFMAN_SUBTABLE_POINTER, HUFFMAN_END_OF_BLOCK or HUFFMAN_INVALID */
+#define HUFFMAN_EXCEPTIONAL         0x00008000
+
+/* Indicates a subtable pointer entry in the literal or distance table. */
+#define HUFFMAN_SUBTABLE_POINTER    0x00004000
+
+/* Indicates end-of-block entry in the literal table. */
+#define HUFFMAN_END_OF_BLOCK        0x00002000
+
+/* Indicates a symbol the deflate format reserves: literal/length 286 and 287, distance 30 and 31. */
+#define HUFFMAN_INVALID             0x00001000
+
 
 struct Inflator {
     union {
@@ -0,0 +1,69 @@
+/*
+ * Hooks the entry points use to feed inflate_metrics.h. Without
+ * INFLATE_METRICS defined they expand to nothing and decoding goes straight to
+ * inflate_stream_decode().
+ */
+
+#ifndef INFLATE_METRICS_INTERNAL_H
+#define INFLATE_METRICS_INTERNAL_H
+
+
+#include <stdint.h>
+
+#include "inflate_metrics.h"
+#include "inflate_stream.h"
+
+
+
+#if defined(INFLATE_METRICS)
+
+#include <stdatomic.h>
+
+/* One measured call, on the caller's stack. start is 0 when recording is off. */
+struct InflateMetricsCall {
+    uint64_t start;
+};
+
+extern atomic_bool inflate_metrics_enabled;
+
+/* Starts timing the call, and tracing it if it is sampled. */
+void inflate_metrics_begin(struct InflateMetricsCall* call);
+
+/* Records the call in the thread's histograms, and in the trace ring if it was traced and slow. */
+void inflate_metrics_end(struct InflateMetricsCall* call, enum InflateMetricsEntry entry, int result, size_t compressed_length, size_t decompressed_length);
+
+/* inflate_stream_decode(), timing every block when the call is traced. */
+int inflate_metrics_decode(struct InflateStream* stream);
+
+/* Start of a phase of a traced call, 0 when the call is not traced. */
+uint64_t inflate_metrics_phase_start(void);
+
+void inflate_metrics_phase_end(enum InflateTracePhase phase, uint64_t start);
+
+#define INFLATE_METRICS_BEGIN(call)                                                             \
+    struct InflateMetricsCall call = { 0 };                                                     \
+    if (atomic_load_explicit(&inflate_metrics_enabled, memory_order_relaxed))                   \
+        inflate_metrics_begin(&call)
+
+#define INFLATE_METRICS_END(call, entry, result, compressed_length, decompressed_length)        \
+    do {                                                                                        \
+        if (call.start)                                                                         \
+            inflate_metrics_end(&call, entry, result, compressed_length, decompressed_length);  \
+    } while (0)
+
+#define INFLATE_METRICS_DECODE(stream)              inflate_metrics_decode(stream)
+#define INFLATE_METRICS_PHASE_BEGIN(start)          uint64_t start = inflate_metrics_phase_start()
+#define INFLATE_METRICS_PHASE_END(phase, start)     inflate_metrics_phase_end(phase, start)
+
+#else
+
+#define INFLATE_METRICS_BEGIN(call)
+#define INFLATE_METRICS_END(call, entry, result, compressed_length, decompressed_length)
+#define INFLATE_METRICS_DECODE(stream)              inflate_stream_decode(stream)
+#define INFLATE_METRICS_PHASE_BEGIN(start)
+#define INFLATE_METRICS_PHASE_END(phase, start)
+
+#endif
+
+
+#endif /* INFLATE_METRICS_INTERNAL_H */
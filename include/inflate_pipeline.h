@@ -0,0 +1,30 @@
+/*
+ * Two stage decoding of a single deflate stream. The calling thread decodes
+ * Huffman codes into InflateTokens and passes them through a single producer,
+ * single consumer ring to a second thread that copies matches and stored data
+ * to the output and updates an optional check value.
+ */
+
+#ifndef INFLATE_PIPELINE_H
+#define INFLATE_PIPELINE_H
+
+
+#include <stddef.h>
+#include <stdint.h>
+
+#include "inflate_stream.h"
+
+
+
+/*
+ * Decodes the raw deflate stream in compressed like inflate_stream_decode()
+ * would, with the same output and result. *compressed_end receives the first
+ * byte following the stream. If check is given, *check_value is updated with
+ * all output.
+ */
+int inflate_pipeline_decode(const uint8_t* compressed, size_t compressed_length, uint8_t* decompressed, size_t decompressed_max_length, size_t* decompressed_length,
+                            const uint8_t** compressed_end, InflateCheck check, uint32_t* check_value);
+
+
+
+#endif /* INFLATE_PIPELINE_H */
@@ -0,0 +1,25 @@
+/*
+ * The length-only walk behind inflate_scan_length(), for other parts of the
+ * library that need to find where a deflate stream ends without decoding it.
+ */
+
+#ifndef INFLATE_SCAN_INTERNAL_H
+#define INFLATE_SCAN_INTERNAL_H
+
+
+#include <stddef.h>
+
+#include "inflate_stream.h"
+
+
+
+/*
+ * Walks a stream from inflate_stream_init() to its end without output,
+ * counting the bytes it decodes to. inflate_stream_compressed_end() then
+ * gives the first byte following it.
+ */
+int inflate_scan_count(struct InflateStream* stream, size_t* decompressed_length);
+
+
+
+#endif /* INFLATE_SCAN_INTERNAL_H */
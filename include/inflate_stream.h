@@ -0,0 +1,276 @@
+/*
+ * Resumable deflate decoder. All entry points of the library drive an
+ * InflateStream; tinflate() simply runs one to completion.
+ *
+ * Huffman coded data is decoded one token at a time and a token is only
+ * consumed once all of its bits are present and its output fits. Running out
+ * of input or output in the middle of block data therefore suspends the stream
+ * at a token boundary and the caller can resume it with more input or more
+ * output space. Block headers are not resumable: a caller that feeds input in
+ * pieces either keeps a copy of the stream taken before
+ * inflate_stream_block_header() or lets inflate_stream_feed() do so.
+ */
+
+#ifndef INFLATE_STREAM_H
+#define INFLATE_STREAM_H
+
+
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+#include <string.h>
+
+#include "bit_reader.h"
+#include "huffman.h"
+#include "inflate.h"
+#include "inflate_internal.h"
+
+
+
+/* Stream states. */
+#define INFLATE_STREAM_BLOCK_HEADER         0
+#define INFLATE_STREAM_STORED               1
+#define INFLATE_STREAM_HUFFMAN              2
+#define INFLATE_STREAM_DONE                 3
+
+/* Returned by inflate_cursor_step() when the end-of-block symbol was consumed. */
+#define INFLATE_STREAM_BLOCK_END            (-1)
+
+/* Input the stream has taken but could not use yet. Must hold the largest block header (about 570 bytes). */
+#define INFLATE_STASH_SIZE                  1024
+
+/* Most bits a single literal/length plus distance token can span. */
+#define INFLATE_MAX_TOKEN_BITS              (INFLATE_MAX_LITERAL_CODE_LENGTH + 5 + INFLATE_MAX_DISTANCE_CODE_LENGTH + 13)
+
+/*
+ * Decoded tokens. Bits not described contain zeroes:
+ *
+ *  Literal:
+ *      Bit 7-0:    literal value
+ *  Match:
+ *      Bit 31:     1 (INFLATE_TOKEN_MATCH)
+ *      Bit 24-16:  length
+ *      Bit 15-0:   distance - 1
+ *  End of block:
+ *      Bit 30:     1 (INFLATE_TOKEN_END_OF_BLOCK)
+ */
+typedef uint32_t InflateToken;
+
+#define INFLATE_TOKEN_MATCH                 0x80000000
+#define INFLATE_TOKEN_END_OF_BLOCK          0x40000000
+
+#define INFLATE_TOKEN_LENGTH(token)         ((token) >> 16 & BITMASK(9))
+#define INFLATE_TOKEN_DISTANCE(token)       (((token) & BITMASK(16)) + 1)
+
+/* Updates a check value (Adler-32, CRC-32) with the given output. */
+typedef uint32_t (*InflateCheck)(uint32_t check, const uint8_t* data, size_t length);
+
+
+/* Output that came before decompressed_start but lives elsewhere, such as the window of an earlier message. */
+struct InflateHistory {
+    const uint8_t* bytes;   // Ring of capacity bytes, the oldest at start.
+    size_t start;
+    size_t length;
+    size_t capacity;
+};
+
+/* The hot part of the stream state. Kept separate so decode loops can hold it in a local and let it live in registers. */
+struct InflateCursor {
+    const uint8_t* compressed_next;
+    const uint8_t* compressed_end;
+    Buffer buffer;
+    uint32_t buffer_count;
+
+    /* Back references may reach back as far as decompressed_start, and on into history unless it is NULL. */
+    uint8_t* decompressed_start;
+    uint8_t* decompressed_next;
+    uint8_t* decompressed_end;
+    const struct InflateHistory* history;
+};
+
+/* Bytes carried between inflate_stream_feed() calls: a block header split across input buffers or input read past the end of the stream. */
+struct InflateStash {
+    size_t length;
+    uint8_t bytes[INFLATE_STASH_SIZE + sizeof(Buffer)];
+};
+
+struct InflateStream {
+    struct InflateCursor cursor;
+
+    unsigned state;
+    bool final_block;
+    uint32_t stored_remaining;
+
+    struct Inflator inflator;
+};
+
+
+/* Prepares a stream for decoding compressed into decompressed. Nothing is written to the stream's tables. */
+void inflate_stream_init(struct InflateStream* stream, const uint8_t* compressed, size_t compressed_length, uint8_t* decompressed, size_t decompressed_max_length);
+
+/* Reads the next block header, builds the Huffman tables of compressed blocks. */
+int inflate_stream_block_header(struct InflateStream* stream);
+
+/* Decodes the data of the current block. Returns INFLATE_SUCCESS once the block is complete. */
+int inflate_stream_decode_block(struct InflateStream* stream);
+
+/* Decodes blocks until the final block is complete. */
+int inflate_stream_decode(struct InflateStream* stream);
+
+/* Returns the first byte following the deflate stream. Only meaningful once the stream is done. */
+const uint8_t* inflate_stream_compressed_end(struct InflateStream* stream);
+
+/*
+ * Decodes input that arrives in pieces. Any block header split across pieces is
+ * kept in stash until the rest arrives. *compressed is advanced past everything
+ * taken. Returns INFLATE_COMPRESSED_INCOMPLETE once all input is taken,
+ * INFLATE_DECOMPRESSED_OVERFLOW when the output range is full and INFLATE_SUCCESS
+ * at the end of the stream. Unused bytes are then handed back through *compressed
+ * where possible; the rest stays in stash.
+ */
+int inflate_stream_feed(struct InflateStream* stream, struct InflateStash* stash, const uint8_t** compressed, const uint8_t* compressed_end);
+
+/* Reads bytes that follow a finished stream, from stash first and then from *compressed. Returns the number of bytes read. */
+size_t inflate_stash_read(struct InflateStash* stash, const uint8_t** compressed, const uint8_t* compressed_end, uint8_t* bytes, size_t length);
+
+/* Copies a back reference that starts in the cursor's history, before decompressed_start. The output must have room. */
+void inflate_cursor_copy_history(struct InflateCursor* cursor, unsigned distance, unsigned length);
+
+
+/* Copies a back reference. The source overlaps the destination whenever distance < length. */
+static inline void lz77(uint8_t* destination, const uint8_t* decompressed_end, unsigned distance, unsigned length) {
+    const uint8_t* source = destination - distance;
+    uint8_t* end = destination + length;
+
+    /* Word copies may write up to 7 bytes past end, which is fine as long as they stay inside the output buffer. */
+    if (distance >= sizeof(uint64_t) && decompressed_end - end >= (ptrdiff_t)sizeof(uint64_t)) {
+        do {
+            uint64_t word;
+            memcpy(&word, source, sizeof(word));
+            memcpy(destination, &word, sizeof(word));
+            source += sizeof(word);
+            destination += sizeof(word);
+        } while (destination < end);
+    } else if (distance == 1) {
+        memset(destination, *source, length);
+    } else {
+        for (; destination < end; ++destination) {
+            *destination = *source;
+            ++source;
+        }
+    }
+}
+
+/*
+ * Decodes the token at the start of buffer without consuming it. *token_bits
+ * receives the number of bits the token spans. Bits above buffer_count may be
+ * looked at but a token that needs them is reported as incomplete. Reserved
+ * symbols give INFLATE_VALUE_NOT_ALLOWED.
+ */
+static inline int inflate_decode_token(const struct Inflator* inflator, Buffer buffer, uint32_t buffer_count, InflateToken* token, unsigned* token_bits) {
+    const uint32_t* literal_table = inflator->u.literal_table;
+    unsigned bits = 0;
+
+    uint32_t entry = literal_table[buffer & BITMASK(inflator->literal_table_bits)];
+    if (entry & HUFFMAN_SUBTABLE_POINTER) {
+        bits = entry & BITMASK(4);
+        entry = literal_table[(entry >> 16) + (buffer >> bits & BITMASK(entry >> 8 & BITMASK(4)))];
+    }
+
+    if (entry & HUFFMAN_LITERAL) {
+        bits += (uint8_t)entry;
+        *token = entry >> 16 & BITMASK(8);
+    } else if (entry & HUFFMAN_EXCEPTIONAL) {
+        bits += (uint8_t)entry;
+        if (bits > buffer_count)
+            return INFLATE_COMPRESSED_INCOMPLETE;
+        if (entry & HUFFMAN_INVALID)
+            return INFLATE_VALUE_NOT_ALLOWED;
+        *token = INFLATE_TOKEN_END_OF_BLOCK;
+    } else {
+        /* Length codeword followed by its extra bits. */
+        unsigned codeword_bits = entry >> 8 & BITMASK(4);
+        unsigned length = (entry >> 16) + (buffer >> (bits + codeword_bits) & BITMASK((uint8_t)entry - codeword_bits));
+        bits += (uint8_t)entry;
+
+        /* Distance codeword followed by its extra bits. */
+        entry = inflator->distance_table[buffer >> bits & BITMASK(DISTANCE_TABLE_BITS)];
+        if (entry & HUFFMAN_SUBTABLE_POINTER) {
+            unsigned main_table_bits = entry & BITMASK(4);
+            entry = inflator->distance_table[(entry >> 16) + (buffer >> (bits + main_table_bits) & BITMASK(entry >> 8 & BITMASK(4)))];
+            bits += main_table_bits;
+        }
+        if (entry & HUFFMAN_INVALID) {
+            bits += (uint8_t)entry;
+            return bits > buffer_count ? INFLATE_COMPRESSED_INCOMPLETE : INFLATE_VALUE_NOT_ALLOWED;
+        }
+        codeword_bits = entry >> 8 & BITMASK(4);
+        unsigned distance = (entry >> 16) + (buffer >> (bits + codeword_bits) & BITMASK((uint8_t)entry - codeword_bits));
+        bits += (uint8_t)entry;
+
+        *token = INFLATE_TOKEN_MATCH | length << 16 | (distance - 1);
+    }
+
+    if (bits > buffer_count)
+        return INFLATE_COMPRESSED_INCOMPLETE;
+    *token_bits = bits;
+
+    return INFLATE_SUCCESS;
+}
+
+/*
+ * Decodes and materialises a single token of Huffman block data. Returns
+ * INFLATE_STREAM_BLOCK_END after the end-of-block symbol. Nothing is consumed
+ * when the token does not fit the input or the output.
+ */
+static inline int inflate_cursor_step(struct InflateCursor* cursor, const struct Inflator* inflator) {
+    const uint8_t* compressed_next = cursor->compressed_next;
+    const uint8_t* compressed_end = cursor->compressed_end;
+    Buffer buffer = cursor->buffer;
+    uint32_t buffer_count = cursor->buffer_count;
+
+    if (buffer_count < INFLATE_MAX_TOKEN_BITS)
+        FILL_BUFFER();
+    cursor->compressed_next = compressed_next;
+    cursor->buffer = buffer;
+    cursor->buffer_count = buffer_count;
+
+    InflateToken token;
+    unsigned token_bits;
+    int result = inflate_decode_token(inflator, buffer, buffer_count, &token, &token_bits);
+    if (result)
+        return result;
+
+    if (!(token & (INFLATE_TOKEN_MATCH | INFLATE_TOKEN_END_OF_BLOCK))) {
+        if (cursor->decompressed_next == cursor->decompressed_end)
+            return INFLATE_DECOMPRESSED_OVERFLOW;
+        *cursor->decompressed_next = (uint8_t)token;
+        ++cursor->decompressed_next;
+    } else if (token & INFLATE_TOKEN_MATCH) {
+        unsigned length = INFLATE_TOKEN_LENGTH(token);
+        unsigned distance = INFLATE_TOKEN_DISTANCE(token);
+        if (distance > cursor->decompressed_next - cursor->decompressed_start) {
+            if (!cursor->history || distance - (size_t)(cursor->decompressed_next - cursor->decompressed_start) > cursor->history->length)
+                return INFLATE_INVALID_LZ77;
+            if (length > cursor->decompressed_end - cursor->decompressed_next)
+                return INFLATE_DECOMPRESSED_OVERFLOW;
+            inflate_cursor_copy_history(cursor, distance, length);
+        } else {
+            if (length > cursor->decompressed_end - cursor->decompressed_next)
+                return INFLATE_DECOMPRESSED_OVERFLOW;
+            lz77(cursor->decompressed_next, cursor->decompressed_end, distance, length);
+            cursor->decompressed_next += length;
+        }
+    } else {
+        result = INFLATE_STREAM_BLOCK_END;
+    }
+
+    cursor->buffer = buffer >> token_bits;
+    cursor->buffer_count = buffer_count - token_bits;
+
+    return result;
+}
+
+
+
+#endif /* INFLATE_STREAM_H */
@@ -0,0 +1,88 @@
+/*
+ * Output buffer for decoders that hand their output over in pieces. The
+ * window keeps the last INFLATE_MAX_LZ77_DISTANCE bytes of output for back
+ * references followed by output the caller has not taken yet. When free space
+ * runs low the kept bytes slide to the front of the buffer.
+ *
+ * A mirrored window instead maps the same pages twice, back to back, and is
+ * used as a ring: any capacity bytes starting inside the first mapping are
+ * contiguous in memory, so back references and pending output never wrap and
+ * nothing ever slides. Offsets then only move back by whole capacities.
+ */
+
+#ifndef INFLATE_WINDOW_H
+#define INFLATE_WINDOW_H
+
+
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+
+#include "inflate_stream.h"
+
+
+
+/* Default window capacity: the history plus room to decode ahead of the caller. */
+#define INFLATE_WINDOW_DEFAULT_CAPACITY     (4 * INFLATE_MAX_LZ77_DISTANCE)
+
+/* Smallest capacity inflate_window_create() falls back to without mirroring, so sliding copies the history rarely. */
+#define INFLATE_WINDOW_SLIDING_CAPACITY     (32 * INFLATE_MAX_LZ77_DISTANCE)
+
+/* Window memory. */
+#define INFLATE_WINDOW_BORROWED             0   // Owned by the caller.
+#define INFLATE_WINDOW_ALLOCATED            1   // malloc()ed by inflate_window_create().
+#define INFLATE_WINDOW_MIRRORED             2   // Mapped twice by inflate_window_create().
+
+
+struct InflateWindow {
+    uint8_t* buffer;
+    size_t capacity;
+
+    size_t pending;     // Offset of the first byte not taken yet.
+    size_t end;         // Offset past the last decoded byte.
+
+    unsigned memory;
+};
+
+
+/* Uses buffer, of at least 2 * INFLATE_MAX_LZ77_DISTANCE bytes, as an empty window. */
+void inflate_window_init(struct InflateWindow* window, uint8_t* buffer, size_t capacity);
+
+/*
+ * Allocates a mirrored window of at least capacity bytes, rounded up to whole
+ * pages. Where pages cannot be mapped twice, or mirrored is false, falls back
+ * to a sliding window of at least INFLATE_WINDOW_SLIDING_CAPACITY bytes.
+ */
+int inflate_window_create(struct InflateWindow* window, size_t capacity, bool mirrored);
+
+/* Releases the memory of a window from inflate_window_create(). */
+void inflate_window_destroy(struct InflateWindow* window);
+
+/* Forgets all output, history included. */
+void inflate_window_reset(struct InflateWindow* window);
+
+/*
+ * Points the cursor's output at the free part of the window, sliding the window
+ * first if free space runs low. Pending output starts at buffer + pending and is
+ * always contiguous.
+ */
+void inflate_window_prepare(struct InflateWindow* window, struct InflateCursor* cursor);
+
+/* Records the output the cursor decoded since inflate_window_prepare(). */
+void inflate_window_commit(struct InflateWindow* window, const struct InflateCursor* cursor);
+
+/* Copies up to length pending bytes to decompressed. Returns the number of bytes copied. */
+size_t inflate_window_take(struct InflateWindow* window, uint8_t* decompressed, size_t length);
+
+static inline size_t inflate_window_pending_length(const struct InflateWindow* window) {
+    return window->end - window->pending;
+}
+
+/* Marks all pending output as taken without copying it anywhere. */
+static inline void inflate_window_drop(struct InflateWindow* window) {
+    window->pending = window->end;
+}
+
+
+
+#endif /* INFLATE_WINDOW_H */
@@ -0,0 +1,30 @@
+/* https://www.w3.org/TR/png/#9Filters */
+
+#ifndef PNG_FILTER_H
+#define PNG_FILTER_H
+
+
+#include <stddef.h>
+#include <stdint.h>
+
+
+
+/* Filter types. */
+#define PNG_FILTER_NONE             0
+#define PNG_FILTER_SUB              1
+#define PNG_FILTER_UP               2
+#define PNG_FILTER_AVERAGE          3
+#define PNG_FILTER_PAETH            4
+
+
+/*
+ * Reverses filter on one scanline of length bytes. previous is the unfiltered
+ * row above, all zeroes for the first row, and bytes_per_pixel is rounded up to
+ * at least 1. filtered and row must not overlap. Returns
+ * INFLATE_VALUE_NOT_ALLOWED for an unknown filter type.
+ */
+int png_unfilter_row(unsigned filter, const uint8_t* filtered, const uint8_t* previous, uint8_t* row, size_t length, unsigned bytes_per_pixel);
+
+
+
+#endif /* PNG_FILTER_H */
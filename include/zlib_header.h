@@ -0,0 +1,44 @@
+/* https://datatracker.ietf.org/doc/html/rfc1950#section-2.2 */
+
+#ifndef ZLIB_HEADER_H
+#define ZLIB_HEADER_H
+
+
+#include <stddef.h>
+#include <stdint.h>
+
+#include "inflate.h"
+
+
+
+/* CMF and FLG, followed by the deflate stream and the big-endian Adler-32 of the data. */
+#define ZLIB_HEADER_LENGTH          2
+#define ZLIB_TRAILER_LENGTH         4
+
+#define ZLIB_METHOD_DEFLATE         8
+#define ZLIB_MAX_WINDOW_INFO        7
+#define ZLIB_FLAG_DICTIONARY        0x20
+
+
+/* Checks CMF and FLG. Preset dictionaries are not supported. */
+static inline int zlib_parse_header(const uint8_t* compressed, size_t compressed_length) {
+    if (compressed_length < ZLIB_HEADER_LENGTH)
+        return INFLATE_COMPRESSED_INCOMPLETE;
+
+    unsigned method = compressed[0] & 0x0F;
+    unsigned window_info = compressed[0] >> 4;
+    if (method != ZLIB_METHOD_DEFLATE || window_info > ZLIB_MAX_WINDOW_INFO || (compressed[0] << 8 | compressed[1]) % 31)
+        return INFLATE_INVALID_HEADER;
+    if (compressed[1] & ZLIB_FLAG_DICTIONARY)
+        return INFLATE_INVALID_HEADER;
+
+    return INFLATE_SUCCESS;
+}
+
+static inline uint32_t zlib_read_be32(const uint8_t* bytes) {
+    return (uint32_t)bytes[0] << 24 | (uint32_t)bytes[1] << 16 | (uint32_t)bytes[2] << 8 | bytes[3];
+}
+
+
+
+#endif /* ZLIB_HEADER_H */
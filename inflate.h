@@ -8,6 +8,10 @@
 
 #include "MDE.h"
 
+#ifdef __cplusplus
+extern "C" {
+#endif
+
 /* Inflate success and error codes. */
 enum InflateError {
     INFLATE_SUCCESS = 0,
@@ -22,10 +26,33 @@ enum InflateError {
     INFLATE_OVERFULL_HUFFMAN_CODE,
     INFLATE_INCOMPLETE_HUFFMAN_CODE,
     INFLATE_INVALID_HUFFMAN_CODE,
+    INFLATE_INVALID_HEADER,
+    INFLATE_CHECKSUM_MISMATCH,
+    INFLATE_NOT_INDEXABLE,
+    INFLATE_IO_ERROR,
 };
 
 
 extern int tinflate(const unsigned char* compressed, size_t compressed_length, unsigned char* decompressed, size_t* decompressed_length, size_t decompressed_max_length);
 
+/*
+ * Same as tinflate(), but Huffman decoding runs on the calling thread while a
+ * second thread copies matches into the output. Only worth the thread for
+ * large streams.
+ */
+extern int tinflate_pipelined(const unsigned char* compressed, size_t compressed_length, unsigned char* decompressed, size_t* decompressed_length, size_t decompressed_max_length);
+
+/*
+ * Same as tinflate(), but cuts the stream at full flush points (an empty
+ * stored block after which nothing refers back) and decodes the pieces on
+ * thread_count threads, 0 selecting the number of online processors. Streams
+ * without full flush points decode sequentially.
+ */
+extern int tinflate_parallel(const unsigned char* compressed, size_t compressed_length, unsigned char* decompressed, size_t* decompressed_length, size_t decompressed_max_length, unsigned thread_count);
+
+#ifdef __cplusplus
+}
+#endif
+
 
 #endif /* INFLATE_H */
@@ -0,0 +1,427 @@
+/*
+ * Header-only C++20 interface to inflate.h, zlib_decompress.h, gzip_members.h
+ * and inflate_reader.h.
+ *
+ * Every call forwards to the C entry point with the caller's memory; the only
+ * allocations made here are the result buffers, which come from the supplied
+ * std::pmr::memory_resource and are never value-initialised. chunks() decodes
+ * through an InflateReader, whose small window the library allocates.
+ */
+
+#ifndef INFLATE_HPP
+#define INFLATE_HPP
+
+
+#include <coroutine>
+#include <cstddef>
+#include <cstdint>
+#include <exception>
+#include <memory>
+#include <memory_resource>
+#include <new>
+#include <span>
+#include <utility>
+
+#if __has_include(<expected>)
+#include <expected>
+#endif
+
+#include "gzip_members.h"
+#include "inflate.h"
+#include "inflate_reader.h"
+#include "zlib_decompress.h"
+
+
+
+namespace Inflate {
+
+
+/* Result type. std::expected when the standard library provides it, otherwise a minimal stand-in with the same interface. */
+#if defined(__cpp_lib_expected)
+
+template <class T>
+using Result = std::expected<T, InflateError>;
+
+inline std::unexpected<InflateError> failure(InflateError error) noexcept {
+    return std::unexpected<InflateError>(error);
+}
+
+#else
+
+struct Failure {
+    InflateError error;
+};
+
+inline Failure failure(InflateError error) noexcept {
+    return Failure{ error };
+}
+
+template <class T>
+class Result {
+public:
+    Result(T value) : m_has_value(true) { new (&m_value) T(std::move(value)); }
+    Result(Failure failure) noexcept : m_error(failure.error), m_has_value(false) {}
+
+    Result(Result&& other) : m_has_value(other.m_has_value) {
+        if (m_has_value)
+            new (&m_value) T(std::move(other.m_value));
+        else
+            m_error = other.m_error;
+    }
+    Result(const Result&) = delete;
+    Result& operator=(const Result&) = delete;
+    Result& operator=(Result&&) = delete;
+
+    ~Result() {
+        if (m_has_value)
+            m_value.~T();
+    }
+
+    bool has_value() const noexcept { return m_has_value; }
+    explicit operator bool() const noexcept { return m_has_value; }
+
+    T& value() & { return m_value; }
+    T&& value() && { return std::move(m_value); }
+    T& operator*() & noexcept { return m_value; }
+    T&& operator*() && noexcept { return std::move(m_value); }
+    T* operator->() noexcept { return &m_value; }
+
+    InflateError error() const noexcept { return m_error; }
+
+private:
+    union {
+        T m_value;
+        InflateError m_error;
+    };
+    bool m_has_value;
+};
+
+#endif
+
+
+/* Move-only byte buffer whose storage comes from a memory resource. The contents are left uninitialised. */
+class Buffer {
+public:
+    Buffer() noexcept = default;
+
+    Buffer(std::size_t capacity, std::pmr::memory_resource* resource)
+        : m_resource(resource),
+          m_data(static_cast<std::byte*>(resource->allocate(capacity ? capacity : 1))),
+          m_capacity(capacity) {}
+
+    Buffer(Buffer&& other) noexcept
+        : m_resource(other.m_resource),
+          m_data(std::exchange(other.m_data, nullptr)),
+          m_size(std::exchange(other.m_size, 0)),
+          m_capacity(std::exchange(other.m_capacity, 0)) {}
+
+    Buffer& operator=(Buffer&& other) noexcept {
+        if (this != &other) {
+            release();
+            m_resource = other.m_resource;
+            m_data = std::exchange(other.m_data, nullptr);
+            m_size = std::exchange(other.m_size, 0);
+            m_capacity = std::exchange(other.m_capacity, 0);
+        }
+        return *this;
+    }
+
+    Buffer(const Buffer&) = delete;
+    Buffer& operator=(const Buffer&) = delete;
+
+    ~Buffer() { release(); }
+
+    std::byte* data() noexcept { return m_data; }
+    const std::byte* data() const noexcept { return m_data; }
+    std::size_t size() const noexcept { return m_size; }
+    std::size_t capacity() const noexcept { return m_capacity; }
+    std::pmr::memory_resource* resource() const noexcept { return m_resource; }
+
+    void set_size(std::size_t size) noexcept { m_size = size; }
+
+    std::span<std::byte> span() noexcept { return { m_data, m_size }; }
+    std::span<const std::byte> span() const noexcept { return { m_data, m_size }; }
+    operator std::span<const std::byte>() const noexcept { return span(); }
+
+private:
+    void release() noexcept {
+        if (m_data)
+            m_resource->deallocate(m_data, m_capacity ? m_capacity : 1);
+        m_data = nullptr;
+    }
+
+    std::pmr::memory_resource* m_resource = nullptr;
+    std::byte* m_data = nullptr;
+    std::size_t m_size = 0;
+    std::size_t m_capacity = 0;
+};
+
+
+/* Lazily evaluated sequence produced by a coroutine. The coroutine may co_return an InflateError, available through error() once iteration ends. */
+template <class T>
+class Generator {
+public:
+    struct promise_type {
+        const T* current = nullptr;
+        InflateError error = INFLATE_SUCCESS;
+        std::exception_ptr exception;
+
+        Generator get_return_object() noexcept { return Generator(std::coroutine_handle<promise_type>::from_promise(*this)); }
+        std::suspend_always initial_suspend() noexcept { return {}; }
+        std::suspend_always final_suspend() noexcept { return {}; }
+        std::suspend_always yield_value(const T& value) noexcept {
+            current = &value;
+            return {};
+        }
+        void return_value(InflateError result) noexcept { error = result; }
+        void unhandled_exception() noexcept { exception = std::current_exception(); }
+    };
+
+    using Handle = std::coroutine_handle<promise_type>;
+
+    struct Sentinel {};
+
+    class Iterator {
+    public:
+        using value_type = T;
+        using difference_type = std::ptrdiff_t;
+
+        explicit Iterator(Handle handle) noexcept : m_handle(handle) {}
+
+        const T& operator*() const noexcept { return *m_handle.promise().current; }
+
+        Iterator& operator++() {
+            m_handle.resume();
+            if (m_handle.promise().exception)
+                std::rethrow_exception(m_handle.promise().exception);
+            return *this;
+        }
+        void operator++(int) { ++*this; }
+
+        bool operator==(Sentinel) const noexcept { return m_handle.done(); }
+
+    private:
+        Handle m_handle;
+    };
+
+    explicit Generator(Handle handle) noexcept : m_handle(handle) {}
+    Generator(Generator&& other) noexcept : m_handle(std::exchange(other.m_handle, nullptr)) {}
+    Generator& operator=(Generator&& other) noexcept {
+        if (this != &other) {
+            if (m_handle)
+                m_handle.destroy();
+            m_handle = std::exchange(other.m_handle, nullptr);
+        }
+        return *this;
+    }
+    Generator(const Generator&) = delete;
+    Generator& operator=(const Generator&) = delete;
+
+    ~Generator() {
+        if (m_handle)
+            m_handle.destroy();
+    }
+
+    Iterator begin() {
+        m_handle.resume();
+        if (m_handle.promise().exception)
+            std::rethrow_exception(m_handle.promise().exception);
+        return Iterator(m_handle);
+    }
+    Sentinel end() const noexcept { return {}; }
+
+    InflateError error() const noexcept { return m_handle.promise().error; }
+
+private:
+    Handle m_handle;
+};
+
+
+namespace detail {
+
+inline const unsigned char* bytes(std::span<const std::byte> span) noexcept {
+    return reinterpret_cast<const unsigned char*>(span.data());
+}
+
+inline unsigned char* bytes(std::span<std::byte> span) noexcept {
+    return reinterpret_cast<unsigned char*>(span.data());
+}
+
+using Decompressor = int (*)(const unsigned char*, std::size_t, unsigned char*, std::size_t*, std::size_t);
+
+inline Result<std::span<std::byte>> into_span(Decompressor decompressor, std::span<const std::byte> compressed, std::span<std::byte> decompressed) noexcept {
+    std::size_t length = 0;
+    int result = decompressor(bytes(compressed), compressed.size(), bytes(decompressed), &length, decompressed.size());
+    if (result)
+        return failure(static_cast<InflateError>(result));
+    return decompressed.first(length);
+}
+
+/*
+ * Retries with a doubled buffer on overflow, up to max_size bytes; output that
+ * does not fit then gives INFLATE_DECOMPRESSED_OVERFLOW. size_hint should be
+ * the exact size whenever it is known.
+ */
+inline Result<Buffer> into_buffer(Decompressor decompressor, std::span<const std::byte> compressed, std::size_t size_hint, std::size_t max_size,
+                                  std::pmr::memory_resource* resource) {
+    std::size_t capacity = size_hint ? size_hint : 4 * compressed.size() + 64;
+    if (capacity > max_size)
+        capacity = max_size;
+    for (;;) {
+        Buffer buffer(capacity, resource);
+        std::size_t length = 0;
+        int result = decompressor(bytes(compressed), compressed.size(), reinterpret_cast<unsigned char*>(buffer.data()), &length, capacity);
+        if (!result) {
+            buffer.set_size(length);
+            return buffer;
+        }
+        if (result != INFLATE_DECOMPRESSED_OVERFLOW || capacity == max_size)
+            return failure(static_cast<InflateError>(result));
+        capacity = capacity > max_size / 2 ? max_size : 2 * capacity;
+    }
+}
+
+} // namespace detail
+
+
+/* Largest result the Buffer overloads grow to unless given a max_size. */
+inline constexpr std::size_t default_max_size = std::size_t(1) << 30;
+
+/* Raw deflate (RFC 1951). */
+inline Result<std::span<std::byte>> decompress(std::span<const std::byte> compressed, std::span<std::byte> decompressed) noexcept {
+    return detail::into_span(tinflate, compressed, decompressed);
+}
+
+inline Result<Buffer> decompress(std::span<const std::byte> compressed, std::size_t size_hint = 0, std::size_t max_size = default_max_size,
+                                 std::pmr::memory_resource* resource = std::pmr::get_default_resource()) {
+    return detail::into_buffer(tinflate, compressed, size_hint, max_size, resource);
+}
+
+/* zlib (RFC 1950). */
+inline Result<std::span<std::byte>> zlib_decompress(std::span<const std::byte> compressed, std::span<std::byte> decompressed) noexcept {
+    return detail::into_span(::zlib_decompress, compressed, decompressed);
+}
+
+inline Result<Buffer> zlib_decompress(std::span<const std::byte> compressed, std::size_t size_hint = 0, std::size_t max_size = default_max_size,
+                                      std::pmr::memory_resource* resource = std::pmr::get_default_resource()) {
+    return detail::into_buffer(::zlib_decompress, compressed, size_hint, max_size, resource);
+}
+
+/*
+ * Yields the output of a raw deflate, zlib or gzip stream a window at a time,
+ * whatever its length. Each span stays valid until the generator is advanced,
+ * compressed must outlive the generator. Check values are verified as each
+ * stream or member ends; a mismatch ends iteration with error().
+ */
+inline Generator<std::span<const std::byte>> chunks(std::span<const std::byte> compressed, InflateFormat format) {
+    InflateReader* created = nullptr;
+    int result = inflate_reader_create(detail::bytes(compressed), compressed.size(), format, &created);
+    if (result)
+        co_return static_cast<InflateError>(result);
+    std::unique_ptr<InflateReader, void (*)(InflateReader*)> reader(created, inflate_reader_destroy);
+
+    for (;;) {
+        const unsigned char* chunk = nullptr;
+        std::size_t length = 0;
+        result = inflate_reader_next(reader.get(), &chunk, &length);
+        if (result)
+            co_return static_cast<InflateError>(result);
+        if (!length)
+            co_return INFLATE_SUCCESS;
+        co_yield std::span<const std::byte>(reinterpret_cast<const std::byte*>(chunk), length);
+    }
+}
+
+
+/*
+ * Owns the member index of a multi-member gzip file. The compressed bytes are
+ * borrowed and must outlive the object. Move-only, so a scanned file can be
+ * handed to a worker thread as a unit.
+ */
+class GzipMembers {
+public:
+    static Result<GzipMembers> scan(std::span<const std::byte> compressed) noexcept {
+        GzipMembers members(compressed);
+        int result = gzip_members_scan(detail::bytes(compressed), compressed.size(), &members.m_index);
+        if (result)
+            return failure(static_cast<InflateError>(result));
+        return members;
+    }
+
+    GzipMembers(GzipMembers&& other) noexcept : m_compressed(other.m_compressed), m_index(std::exchange(other.m_index, GzipMemberIndex{})) {}
+    GzipMembers& operator=(GzipMembers&& other) noexcept {
+        if (this != &other) {
+            gzip_members_free(&m_index);
+            m_compressed = other.m_compressed;
+            m_index = std::exchange(other.m_index, GzipMemberIndex{});
+        }
+        return *this;
+    }
+    GzipMembers(const GzipMembers&) = delete;
+    GzipMembers& operator=(const GzipMembers&) = delete;
+
+    ~GzipMembers() { gzip_members_free(&m_index); }
+
+    std::size_t decompressed_size() const noexcept { return m_index.decompressed_length; }
+    std::span<const GzipMember> members() const noexcept { return { m_index.members, m_index.member_count }; }
+    const GzipMemberIndex& index() const noexcept { return m_index; }
+
+    Result<std::span<std::byte>> decompress(std::span<std::byte> decompressed, unsigned thread_count = 0) const noexcept {
+        int result = gzip_members_decompress(detail::bytes(m_compressed), &m_index, detail::bytes(decompressed), decompressed.size(), thread_count);
+        if (result)
+            return failure(static_cast<InflateError>(result));
+        return decompressed.first(m_index.decompressed_length);
+    }
+
+    Result<Buffer> decompress(std::pmr::memory_resource* resource = std::pmr::get_default_resource(), unsigned thread_count = 0) const {
+        Buffer buffer(m_index.decompressed_length, resource);
+        int result = gzip_members_decompress(detail::bytes(m_compressed), &m_index, reinterpret_cast<unsigned char*>(buffer.data()), buffer.capacity(), thread_count);
+        if (result)
+            return failure(static_cast<InflateError>(result));
+        buffer.set_size(m_index.decompressed_length);
+        return buffer;
+    }
+
+    Result<std::span<std::byte>> read_virtual(std::uint64_t virtual_offset, std::span<std::byte> decompressed) const noexcept {
+        std::size_t length = 0;
+        int result = gzip_members_read_virtual(detail::bytes(m_compressed), &m_index, virtual_offset, detail::bytes(decompressed), &length, decompressed.size());
+        if (result)
+            return failure(static_cast<InflateError>(result));
+        return decompressed.first(length);
+    }
+
+    /*
+     * Yields the decompressed members one at a time. Each span stays valid until
+     * the generator is advanced; a single scratch buffer from resource is reused.
+     * Member sized pieces need the index, Inflate::chunks() iterates any gzip
+     * file in window sized ones instead.
+     */
+    Generator<std::span<const std::byte>> chunks(std::pmr::memory_resource* resource = std::pmr::get_default_resource()) const {
+        std::uint32_t largest = 0;
+        for (const GzipMember& member : members())
+            largest = member.decompressed_length > largest ? member.decompressed_length : largest;
+
+        Buffer scratch(largest, resource);
+        for (const GzipMember& member : members()) {
+            std::size_t length = 0;
+            int result = gzip_members_read_virtual(detail::bytes(m_compressed), &m_index, static_cast<std::uint64_t>(member.compressed_offset) << 16, reinterpret_cast<unsigned char*>(scratch.data()), &length, scratch.capacity());
+            if (result)
+                co_return static_cast<InflateError>(result);
+            co_yield std::span<const std::byte>(scratch.data(), length);
+        }
+        co_return INFLATE_SUCCESS;
+    }
+
+private:
+    explicit GzipMembers(std::span<const std::byte> compressed) noexcept : m_compressed(compressed), m_index{} {}
+
+    std::span<const std::byte> m_compressed;
+    GzipMemberIndex m_index;
+};
+
+
+} // namespace Inflate
+
+
+
+#endif /* INFLATE_HPP */
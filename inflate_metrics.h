@@ -0,0 +1,140 @@
+/* https://hdrhistogram.github.io/HdrHistogram/ (log-linear buckets) */
+
+#ifndef INFLATE_METRICS_H
+#define INFLATE_METRICS_H
+
+
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+
+#include "MDE.h"
+#include "inflate.h"
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+
+
+/*
+ * Latency and size histograms for the library's entry points, plus a ring of
+ * traces of slow calls. Only compiled in when the library is built with
+ * INFLATE_METRICS defined; otherwise the entry points carry no trace of it and
+ * inflate_metrics_configure() returns INFLATE_VALUE_NOT_ALLOWED. Built in but
+ * not enabled, a call costs one relaxed atomic load.
+ *
+ * Every thread records into histograms of its own, without locks or atomic
+ * read-modify-writes; inflate_metrics_snapshot() adds them up.
+ */
+
+
+/* Values below 2^(SUB_BUCKET_BITS + 1) get a bucket each, above that every power of two is split into 2^SUB_BUCKET_BITS buckets. */
+#define INFLATE_HISTOGRAM_SUB_BUCKET_BITS   3
+#define INFLATE_HISTOGRAM_BUCKET_COUNT      ((64 - INFLATE_HISTOGRAM_SUB_BUCKET_BITS + 1) << INFLATE_HISTOGRAM_SUB_BUCKET_BITS)
+
+/* Histograms are kept per result: every INFLATE_* code. */
+#define INFLATE_METRICS_RESULT_COUNT        (INFLATE_IO_ERROR + 1)
+
+/* Blocks a trace describes one by one; the rest only count towards its totals. */
+#define INFLATE_TRACE_MAX_BLOCKS            64
+
+/* Slow call traces kept, the oldest overwritten first. */
+#define INFLATE_TRACE_RING_LENGTH           64
+
+
+/* Measured entry points. */
+enum InflateMetricsEntry {
+    INFLATE_METRICS_TINFLATE = 0,
+    INFLATE_METRICS_ZLIB_DECOMPRESS,
+    INFLATE_METRICS_ENTRY_COUNT,
+};
+
+/* Where a traced call spent its time. */
+enum InflateTracePhase {
+    INFLATE_TRACE_HEADERS = 0,      // Block headers, Huffman tables included.
+    INFLATE_TRACE_DATA,             // Block data.
+    INFLATE_TRACE_CHECKSUM,
+    INFLATE_TRACE_PHASE_COUNT,
+};
+
+struct InflateMetricsOptions {
+    bool enabled;
+    uint64_t trace_threshold;   // Nanoseconds. Traced calls taking at least this long go to the ring, 0 traces nothing.
+    unsigned trace_sample;      // Every trace_sample-th call on a thread is traced, 0 and 1 trace all of them.
+};
+
+struct InflateHistogram {
+    uint64_t count;
+    uint64_t sum;
+    uint64_t min;
+    uint64_t max;
+    uint64_t buckets[INFLATE_HISTOGRAM_BUCKET_COUNT];
+};
+
+/* Latency in nanoseconds and input and output length in bytes, per entry point and result. */
+struct InflateMetricsSnapshot {
+    struct InflateHistogram latency[INFLATE_METRICS_ENTRY_COUNT][INFLATE_METRICS_RESULT_COUNT];
+    struct InflateHistogram compressed[INFLATE_METRICS_ENTRY_COUNT][INFLATE_METRICS_RESULT_COUNT];
+    struct InflateHistogram decompressed[INFLATE_METRICS_ENTRY_COUNT][INFLATE_METRICS_RESULT_COUNT];
+};
+
+struct InflateTraceBlock {
+    uint8_t type;                   // BTYPE.
+    bool final;
+    uint32_t compressed_length;     // Bytes, header included, rounded down.
+    uint32_t decompressed_length;
+    uint64_t header_time;           // Nanoseconds.
+    uint64_t data_time;
+};
+
+struct InflateTrace {
+    uint64_t sequence;              // Order in which traces were recorded.
+    enum InflateMetricsEntry entry;
+    int result;
+    uint64_t latency;               // Nanoseconds.
+    size_t compressed_length;
+    size_t decompressed_length;
+    uint64_t phase_time[INFLATE_TRACE_PHASE_COUNT];
+    long page_faults;               // Minor and major faults taken by the thread during the call, -1 where unknown.
+    unsigned block_count;           // May exceed INFLATE_TRACE_MAX_BLOCKS.
+    struct InflateTraceBlock blocks[INFLATE_TRACE_MAX_BLOCKS];
+};
+
+
+/* Starts, stops or changes recording. options NULL stops it. Histograms and traces recorded so far are kept. */
+extern int inflate_metrics_configure(const struct InflateMetricsOptions* options);
+
+/* Adds up the histograms of all threads, including those that have released their state. */
+extern void inflate_metrics_snapshot(struct InflateMetricsSnapshot* snapshot);
+
+/* Adds source into destination, for instance snapshots of several processes. */
+extern void inflate_metrics_merge(struct InflateMetricsSnapshot* destination, const struct InflateMetricsSnapshot* source);
+
+extern void inflate_histogram_merge(struct InflateHistogram* destination, const struct InflateHistogram* source);
+
+/* The lower bound of the bucket holding the given fraction (0 to 1) of recorded values, within 1 / 2^SUB_BUCKET_BITS. */
+extern uint64_t inflate_histogram_quantile(const struct InflateHistogram* histogram, double quantile);
+
+/* Lowest value the bucket counts. */
+extern uint64_t inflate_histogram_bucket_value(unsigned bucket);
+
+/*
+ * Copies up to max_count traces, oldest first, and returns how many. Traces
+ * being overwritten while they are copied are left out.
+ */
+extern size_t inflate_metrics_traces(struct InflateTrace* traces, size_t max_count);
+
+/*
+ * Hands the calling thread's histograms over to the next thread that records.
+ * Threads that come and go should call it before they exit; their counts stay
+ * in snapshots either way.
+ */
+extern void inflate_metrics_release_thread(void);
+
+#ifdef __cplusplus
+}
+#endif
+
+
+#endif /* INFLATE_METRICS_H */
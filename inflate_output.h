@@ -0,0 +1,93 @@
+/*
+ * https://www.kernel.org/doc/html/latest/admin-guide/mm/hugetlbpage.html
+ * https://www.kernel.org/doc/html/latest/admin-guide/mm/transhuge.html
+ */
+
+#ifndef INFLATE_OUTPUT_H
+#define INFLATE_OUTPUT_H
+
+
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+
+#include "MDE.h"
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+
+
+/*
+ * Output memory for one-shot decodes of known length, for instance from the
+ * gzip ISIZE of a member under 4 GiB, a GzipMemberIndex or the caller's own
+ * records. Decoding many gigabytes into fresh memory takes a page fault per
+ * 4 KiB page written; these buffers are backed by huge pages where possible
+ * and can be faulted in by a helper thread ahead of the decoder.
+ */
+
+
+/* Pages backing an InflateOutput. */
+#define INFLATE_OUTPUT_SMALL_PAGES          0   // Ordinary pages, or malloc() where mapping is not available.
+#define INFLATE_OUTPUT_TRANSPARENT_HUGE     1   // Anonymous memory madvise()d for transparent huge pages.
+#define INFLATE_OUTPUT_HUGETLB              2   // Reserved huge pages (MAP_HUGETLB).
+
+/* Default distance the helper thread keeps faulting ahead of the decoder. */
+#define INFLATE_OUTPUT_DEFAULT_PREFAULT     (64 << 20)
+
+
+struct InflateOutputOptions {
+    bool huge_pages;            // Try MAP_HUGETLB, then transparent huge pages.
+    bool prefault;              // Fault pages in on a helper thread while tinflate_output() decodes.
+    size_t prefault_distance;   // How far ahead of the decoder, 0 selects INFLATE_OUTPUT_DEFAULT_PREFAULT.
+};
+
+/* Set up by inflate_output_create(). */
+struct InflateOutput {
+    unsigned char* bytes;
+    size_t length;
+    unsigned pages;             // INFLATE_OUTPUT_SMALL_PAGES, INFLATE_OUTPUT_TRANSPARENT_HUGE or INFLATE_OUTPUT_HUGETLB.
+    size_t page_length;         // Granularity inflate_output_release() works in.
+
+    struct InflateOutputOptions options;
+    void* mapping;              // NULL when bytes came from malloc().
+    size_t mapping_length;
+};
+
+/* Receives output as tinflate_output_sink() decodes it. A non-zero return ends decoding with that result. */
+typedef int (*InflateOutputSink)(void* context, const unsigned char* bytes, size_t length);
+
+
+/* Reserves length bytes of output. options may be NULL for small pages without prefaulting. */
+extern int inflate_output_create(size_t length, const struct InflateOutputOptions* options, struct InflateOutput* output);
+
+extern void inflate_output_destroy(struct InflateOutput* output);
+
+/*
+ * Same as tinflate() into output->bytes. With prefaulting the helper thread
+ * stays up to prefault_distance bytes ahead of the decoder, which faults
+ * pages in itself where it catches up. Only without MADV_POPULATE_WRITE,
+ * when the helper has to write to pages to fault them in, does the decoder
+ * wait for the chunk the helper is working on.
+ */
+extern int tinflate_output(const unsigned char* compressed, size_t compressed_length, struct InflateOutput* output, size_t* decompressed_length);
+
+/*
+ * Same as tinflate_output(), but hands output to sink as it is decoded and
+ * gives back the memory of output the decoder no longer refers to. Only the
+ * last few chunks and whatever the helper faulted in ahead stay resident, and
+ * output->bytes holds no complete result afterwards.
+ */
+extern int tinflate_output_sink(const unsigned char* compressed, size_t compressed_length, struct InflateOutput* output, InflateOutputSink sink, void* context,
+                                size_t* decompressed_length);
+
+/* Gives back the memory of the whole pages within [offset, offset + length). They read as zeroes afterwards. */
+extern void inflate_output_release(struct InflateOutput* output, size_t offset, size_t length);
+
+#ifdef __cplusplus
+}
+#endif
+
+
+#endif /* INFLATE_OUTPUT_H */
@@ -0,0 +1,46 @@
+/*
+ * https://datatracker.ietf.org/doc/html/rfc1950
+ * https://datatracker.ietf.org/doc/html/rfc1952
+ */
+
+#ifndef INFLATE_READER_H
+#define INFLATE_READER_H
+
+
+#include <stddef.h>
+
+#include "MDE.h"
+#include "inflate_scan.h"
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+
+
+/*
+ * Hands out the output of a stream held in memory a piece at a time, decoded
+ * into a small internal window as inflate_scan_verify() does. Memory use does
+ * not depend on the input, and the check values are verified as each member
+ * or stream ends.
+ */
+struct InflateReader;
+
+
+extern int inflate_reader_create(const unsigned char* compressed, size_t compressed_length, enum InflateFormat format, struct InflateReader** reader);
+
+/*
+ * Decodes the next piece of output. *chunk stays valid until the next call.
+ * At the end of the input *chunk_length is 0. An error is returned again by
+ * every later call.
+ */
+extern int inflate_reader_next(struct InflateReader* reader, const unsigned char** chunk, size_t* chunk_length);
+
+extern void inflate_reader_destroy(struct InflateReader* reader);
+
+#ifdef __cplusplus
+}
+#endif
+
+
+#endif /* INFLATE_READER_H */
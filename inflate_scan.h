@@ -0,0 +1,47 @@
+/*
+ * https://datatracker.ietf.org/doc/html/rfc1950
+ * https://datatracker.ietf.org/doc/html/rfc1952
+ */
+
+#ifndef INFLATE_SCAN_H
+#define INFLATE_SCAN_H
+
+
+#include <stddef.h>
+
+#include "MDE.h"
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+
+
+/* Containers the scan modes understand. */
+enum InflateFormat {
+    INFLATE_FORMAT_RAW = 0,
+    INFLATE_FORMAT_ZLIB,
+    INFLATE_FORMAT_GZIP,        // One or more concatenated members.
+};
+
+
+/*
+ * Decodes the Huffman codes of compressed and sums up the decompressed length
+ * without writing any output. Only the deflate structure is validated,
+ * checksums need the data and are not verified.
+ */
+extern int inflate_scan_length(const unsigned char* compressed, size_t compressed_length, enum InflateFormat format, size_t* decompressed_length);
+
+/*
+ * Decompresses into a small internal window that is thrown away and verifies
+ * the Adler-32 or CRC-32 and ISIZE trailers. Memory use does not depend on
+ * the input.
+ */
+extern int inflate_scan_verify(const unsigned char* compressed, size_t compressed_length, enum InflateFormat format, size_t* decompressed_length);
+
+#ifdef __cplusplus
+}
+#endif
+
+
+#endif /* INFLATE_SCAN_H */
@@ -0,0 +1,67 @@
+/*
+ * https://datatracker.ietf.org/doc/html/rfc1951
+ * https://datatracker.ietf.org/doc/html/rfc1950
+ * https://datatracker.ietf.org/doc/html/rfc1952
+ */
+
+#ifndef INFLATE_TOKENS_H
+#define INFLATE_TOKENS_H
+
+
+#include <stddef.h>
+
+#include "MDE.h"
+#include "inflate_scan.h"
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+
+
+/*
+ * Token files hold the LZ77 parse of a deflate stream rather than its output.
+ * A 16 byte header, the magic "LZTK", a little endian 32 bit version (1) and
+ * 64 bit decompressed length, is followed by records that start with a tag
+ * byte:
+ *
+ *  0x00-0x7E   literal run: tag + 1 literal bytes follow
+ *  0x7F        block header: one byte follows, bit 0 BFINAL and bits 2-1 BTYPE
+ *              of the block in the source stream
+ *  0x80-0xFF   match of three bytes: bits 6-0 of the tag and the second byte
+ *              hold distance - 1 (big endian), the third byte length - 3
+ */
+
+
+/*
+ * Upper bound of the token file of a stream that is compressed_length bytes
+ * long and decompresses to decompressed_length bytes.
+ */
+extern size_t inflate_tokens_bound(size_t compressed_length, size_t decompressed_length);
+
+/*
+ * Parses compressed like inflate_scan_length() does and writes the tokens it
+ * decodes to instead of their output. Gzip members follow each other in one
+ * token file. Checksums need the output and are not verified. Returns
+ * INFLATE_DECOMPRESSED_OVERFLOW if the tokens do not fit tokens_max_length.
+ */
+extern int inflate_tokens_export(const unsigned char* compressed, size_t compressed_length, enum InflateFormat format, unsigned char* tokens,
+                                 size_t* tokens_length, size_t tokens_max_length);
+
+/*
+ * Huffman codes a token file again as a raw deflate stream without searching
+ * for matches. With block_tokens 0 the blocks of the source stream are kept,
+ * otherwise a block is cut every block_tokens tokens (at most 16384), and
+ * empty blocks such as flush points are dropped either way. Every block is
+ * written as a dynamic or static Huffman block, blocks of literals only as a
+ * stored block when that is smaller.
+ */
+extern int inflate_tokens_encode(const unsigned char* tokens, size_t tokens_length, size_t block_tokens, unsigned char* compressed, size_t* compressed_length,
+                                 size_t compressed_max_length);
+
+#ifdef __cplusplus
+}
+#endif
+
+
+#endif /* INFLATE_TOKENS_H */
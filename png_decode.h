@@ -0,0 +1,66 @@
+/*
+ * https://www.w3.org/TR/png/
+ * https://datatracker.ietf.org/doc/html/rfc1950
+ */
+
+#ifndef PNG_DECODE_H
+#define PNG_DECODE_H
+
+
+#include <stddef.h>
+#include <stdint.h>
+
+#include "MDE.h"
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+
+
+/* Color types. */
+#define PNG_COLOR_GRAY          0
+#define PNG_COLOR_RGB           2
+#define PNG_COLOR_PALETTE       3
+#define PNG_COLOR_GRAY_ALPHA    4
+#define PNG_COLOR_RGBA          6
+
+
+struct PngImage {
+    uint32_t width;
+    uint32_t height;
+    uint8_t bit_depth;
+    uint8_t color_type;
+    uint8_t interlace;
+
+    size_t row_length;          // Bytes per unfiltered row, without the filter type byte.
+    unsigned bytes_per_pixel;   // Rounded up to at least 1.
+};
+
+
+/* Reads the IHDR chunk following the PNG signature. */
+extern int png_read_header(const unsigned char* png, size_t png_length, struct PngImage* image);
+
+/*
+ * Decodes the image data of a PNG file into height rows of row_length bytes,
+ * exactly as the scanlines are stored (no palette expansion or byte swapping).
+ * The zlib stream is inflated straight from the IDAT chunks and every row is
+ * unfiltered as soon as it is complete, so pixels is written once. Interlaced
+ * images are not supported and return INFLATE_VALUE_NOT_ALLOWED.
+ */
+extern int png_decode(const unsigned char* png, size_t png_length, unsigned char* pixels, size_t pixels_max_length, struct PngImage* image);
+
+/*
+ * Decodes the zlib stream carried by the data of chunk_count IDAT chunks for the
+ * image described by image, as png_decode() does. The chunks need not be adjacent
+ * in memory.
+ */
+extern int png_decode_idat(const struct PngImage* image, const unsigned char* const* chunks, const size_t* chunk_lengths, size_t chunk_count, unsigned char* pixels,
+                           size_t pixels_max_length);
+
+#ifdef __cplusplus
+}
+#endif
+
+
+#endif /* PNG_DECODE_H */
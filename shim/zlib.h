@@ -0,0 +1,294 @@
+/*
+ * zlib compatible decompression interface (https://zlib.net/manual.html).
+ *
+ * Declares the API of zlib 1.2 with the same types, layout and symbol names,
+ * so programs built against zlib can use the shim by relinking or through
+ * LD_PRELOAD:
+ *
+ *      cmake -S . -B build && cmake --build build --target zlib_shim
+ *      LD_PRELOAD=build/libz.so.1 program
+ *
+ * src/zlib_shim.c implements inflate(), uncompress() and the check values on
+ * top of this library. Everything else, compression and gz* files included,
+ * is passed on to the system's libz.so.1 (src/zlib_forward.c), which is
+ * loaded from the path found at configure time. All functions carry the
+ * symbol versions of zlib's own libz.so.1 (shim/zlib.map).
+ */
+
+#ifndef ZLIB_H
+#define ZLIB_H
+
+
+#include <stdarg.h>
+#include <stddef.h>
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+
+
+#define ZLIB_VERSION        "1.2.13"
+#define ZLIB_VERNUM         0x12d0
+
+#define MAX_WBITS           15
+
+#ifndef ZEXTERN
+#if defined(__GNUC__)
+#define ZEXTERN             extern __attribute__((visibility("default")))
+#else
+#define ZEXTERN             extern
+#endif
+#endif
+#ifndef ZEXPORT
+#define ZEXPORT
+#endif
+#ifndef OF
+#define OF(args)            args
+#endif
+#ifndef z_const
+#define z_const
+#endif
+
+typedef unsigned char       Byte;
+typedef unsigned int        uInt;
+typedef unsigned long       uLong;
+typedef Byte                Bytef;
+typedef char                charf;
+typedef int                 intf;
+typedef uInt                uIntf;
+typedef uLong               uLongf;
+typedef void*               voidpf;
+typedef void const*         voidpc;
+typedef void*               voidp;
+
+typedef voidpf (*alloc_func)(voidpf opaque, uInt items, uInt size);
+typedef void (*free_func)(voidpf opaque, voidpf address);
+
+struct internal_state;
+
+typedef struct z_stream_s {
+    z_const Bytef* next_in;     // Next input byte.
+    uInt avail_in;              // Number of bytes available at next_in.
+    uLong total_in;             // Total number of input bytes read so far.
+
+    Bytef* next_out;            // Next output byte will go here.
+    uInt avail_out;             // Remaining free space at next_out.
+    uLong total_out;            // Total number of bytes output so far.
+
+    z_const char* msg;          // Last error message, NULL if no error.
+    struct internal_state* state;
+
+    alloc_func zalloc;          // Used to allocate the internal state.
+    free_func zfree;            // Used to free the internal state.
+    voidpf opaque;              // Private data passed to zalloc and zfree.
+
+    int data_type;
+    uLong adler;                // Adler-32 or CRC-32 of the output so far.
+    uLong reserved;
+} z_stream;
+
+typedef z_stream* z_streamp;
+
+/* As zlib has them for a library built without _FILE_OFFSET_BITS. */
+typedef long                z_off_t;
+typedef long long           z_off64_t;
+
+typedef struct gz_header_s {
+    int text;                   // True if compressed data believed to be text.
+    uLong time;                 // Modification time.
+    int xflags;                 // Extra flags, not used when writing a gzip file.
+    int os;                     // Operating system.
+    Bytef* extra;               // Pointer to extra field or Z_NULL if none.
+    uInt extra_len;             // Extra field length, valid if extra != Z_NULL.
+    uInt extra_max;             // Space at extra, only when reading header.
+    Bytef* name;                // Pointer to zero-terminated file name or Z_NULL.
+    uInt name_max;              // Space at name, only when reading header.
+    Bytef* comment;             // Pointer to zero-terminated comment or Z_NULL.
+    uInt comm_max;              // Space at comment, only when reading header.
+    int hcrc;                   // True if there was or will be a header crc.
+    int done;                   // True when done reading gzip header.
+} gz_header;
+
+typedef gz_header* gz_headerp;
+
+typedef struct gzFile_s* gzFile;
+
+typedef unsigned (*in_func)(void*, z_const unsigned char**);
+typedef int (*out_func)(void*, unsigned char*, unsigned);
+
+
+/* Allowed flush values. */
+#define Z_NO_FLUSH          0
+#define Z_PARTIAL_FLUSH     1
+#define Z_SYNC_FLUSH        2
+#define Z_FULL_FLUSH        3
+#define Z_FINISH            4
+#define Z_BLOCK             5
+#define Z_TREES             6
+
+/* Return codes. */
+#define Z_OK                0
+#define Z_STREAM_END        1
+#define Z_NEED_DICT         2
+#define Z_ERRNO             (-1)
+#define Z_STREAM_ERROR      (-2)
+#define Z_DATA_ERROR        (-3)
+#define Z_MEM_ERROR         (-4)
+#define Z_BUF_ERROR         (-5)
+#define Z_VERSION_ERROR     (-6)
+
+/* Compression levels and strategies. */
+#define Z_NO_COMPRESSION        0
+#define Z_BEST_SPEED            1
+#define Z_BEST_COMPRESSION      9
+#define Z_DEFAULT_COMPRESSION   (-1)
+
+#define Z_FILTERED          1
+#define Z_HUFFMAN_ONLY      2
+#define Z_RLE               3
+#define Z_FIXED             4
+#define Z_DEFAULT_STRATEGY  0
+
+#define MAX_MEM_LEVEL       9
+
+#define Z_BINARY            0
+#define Z_TEXT              1
+#define Z_ASCII             Z_TEXT
+#define Z_UNKNOWN           2
+
+#define Z_DEFLATED          8
+
+#define Z_NULL              0
+
+
+ZEXTERN const char* ZEXPORT zlibVersion OF((void));
+
+ZEXTERN int ZEXPORT inflateInit_ OF((z_streamp strm, const char* version, int stream_size));
+/*
+ * windowBits 8..15 expects a zlib stream, -8..-15 raw deflate, 24..31 a gzip
+ * member and 40..47 detects zlib or gzip. 0 takes the size from the zlib
+ * header. The full 32K history is always kept.
+ */
+ZEXTERN int ZEXPORT inflateInit2_ OF((z_streamp strm, int windowBits, const char* version, int stream_size));
+/* Z_NO_FLUSH, Z_SYNC_FLUSH and Z_FINISH all decode as much as input and output allow. */
+ZEXTERN int ZEXPORT inflate OF((z_streamp strm, int flush));
+/*
+ * After Z_STREAM_END, input read past the end of the stream that could not be
+ * handed back through next_in is kept for the next stream. A reset in the
+ * middle of a stream drops everything buffered for it.
+ */
+ZEXTERN int ZEXPORT inflateReset OF((z_streamp strm));
+ZEXTERN int ZEXPORT inflateReset2 OF((z_streamp strm, int windowBits));
+ZEXTERN int ZEXPORT inflateEnd OF((z_streamp strm));
+
+ZEXTERN int ZEXPORT uncompress OF((Bytef* dest, uLongf* destLen, const Bytef* source, uLong sourceLen));
+
+ZEXTERN uLong ZEXPORT adler32 OF((uLong adler, const Bytef* buf, uInt len));
+ZEXTERN uLong ZEXPORT crc32 OF((uLong crc, const Bytef* buf, uInt len));
+ZEXTERN uLong ZEXPORT adler32_z OF((uLong adler, const Bytef* buf, size_t len));
+ZEXTERN uLong ZEXPORT crc32_z OF((uLong crc, const Bytef* buf, size_t len));
+
+/*
+ * Implemented on the shim's own inflate state but not supported by it: they
+ * fail as zlib does for a stream it cannot handle. inflateResetKeep() is the
+ * same as inflateReset(), inflateValidate() accepts only check != 0.
+ */
+ZEXTERN int ZEXPORT inflateSetDictionary OF((z_streamp strm, const Bytef* dictionary, uInt dictLength));
+ZEXTERN int ZEXPORT inflateGetDictionary OF((z_streamp strm, Bytef* dictionary, uInt* dictLength));
+ZEXTERN int ZEXPORT inflateSync OF((z_streamp strm));
+ZEXTERN int ZEXPORT inflateSyncPoint OF((z_streamp strm));
+ZEXTERN int ZEXPORT inflateCopy OF((z_streamp dest, z_streamp source));
+ZEXTERN int ZEXPORT inflatePrime OF((z_streamp strm, int bits, int value));
+ZEXTERN long ZEXPORT inflateMark OF((z_streamp strm));
+ZEXTERN int ZEXPORT inflateGetHeader OF((z_streamp strm, gz_headerp head));
+ZEXTERN int ZEXPORT inflateUndermine OF((z_streamp strm, int subvert));
+ZEXTERN int ZEXPORT inflateResetKeep OF((z_streamp strm));
+ZEXTERN int ZEXPORT inflateValidate OF((z_streamp strm, int check));
+ZEXTERN unsigned long ZEXPORT inflateCodesUsed OF((z_streamp strm));
+
+/* Passed on to the system's libz. */
+ZEXTERN int ZEXPORT deflateInit_ OF((z_streamp strm, int level, const char* version, int stream_size));
+ZEXTERN int ZEXPORT deflateInit2_ OF((z_streamp strm, int level, int method, int windowBits, int memLevel, int strategy, const char* version, int stream_size));
+ZEXTERN int ZEXPORT deflate OF((z_streamp strm, int flush));
+ZEXTERN int ZEXPORT deflateEnd OF((z_streamp strm));
+ZEXTERN int ZEXPORT deflateSetDictionary OF((z_streamp strm, const Bytef* dictionary, uInt dictLength));
+ZEXTERN int ZEXPORT deflateGetDictionary OF((z_streamp strm, Bytef* dictionary, uInt* dictLength));
+ZEXTERN int ZEXPORT deflateCopy OF((z_streamp dest, z_streamp source));
+ZEXTERN int ZEXPORT deflateReset OF((z_streamp strm));
+ZEXTERN int ZEXPORT deflateResetKeep OF((z_streamp strm));
+ZEXTERN int ZEXPORT deflateParams OF((z_streamp strm, int level, int strategy));
+ZEXTERN int ZEXPORT deflateTune OF((z_streamp strm, int good_length, int max_lazy, int nice_length, int max_chain));
+ZEXTERN uLong ZEXPORT deflateBound OF((z_streamp strm, uLong sourceLen));
+ZEXTERN int ZEXPORT deflatePending OF((z_streamp strm, unsigned* pending, int* bits));
+ZEXTERN int ZEXPORT deflatePrime OF((z_streamp strm, int bits, int value));
+ZEXTERN int ZEXPORT deflateSetHeader OF((z_streamp strm, gz_headerp head));
+
+ZEXTERN int ZEXPORT inflateBackInit_ OF((z_streamp strm, int windowBits, unsigned char* window, const char* version, int stream_size));
+ZEXTERN int ZEXPORT inflateBack OF((z_streamp strm, in_func in, void* in_desc, out_func out, void* out_desc));
+ZEXTERN int ZEXPORT inflateBackEnd OF((z_streamp strm));
+
+ZEXTERN uLong ZEXPORT zlibCompileFlags OF((void));
+ZEXTERN const char* ZEXPORT zError OF((int err));
+ZEXTERN const uLong* ZEXPORT get_crc_table OF((void));
+
+ZEXTERN int ZEXPORT compress OF((Bytef* dest, uLongf* destLen, const Bytef* source, uLong sourceLen));
+ZEXTERN int ZEXPORT compress2 OF((Bytef* dest, uLongf* destLen, const Bytef* source, uLong sourceLen, int level));
+ZEXTERN uLong ZEXPORT compressBound OF((uLong sourceLen));
+ZEXTERN int ZEXPORT uncompress2 OF((Bytef* dest, uLongf* destLen, const Bytef* source, uLong* sourceLen));
+
+ZEXTERN uLong ZEXPORT adler32_combine OF((uLong adler1, uLong adler2, z_off_t len2));
+ZEXTERN uLong ZEXPORT adler32_combine64 OF((uLong adler1, uLong adler2, z_off64_t len2));
+ZEXTERN uLong ZEXPORT crc32_combine OF((uLong crc1, uLong crc2, z_off_t len2));
+ZEXTERN uLong ZEXPORT crc32_combine64 OF((uLong crc1, uLong crc2, z_off64_t len2));
+ZEXTERN uLong ZEXPORT crc32_combine_gen OF((z_off_t len2));
+ZEXTERN uLong ZEXPORT crc32_combine_gen64 OF((z_off64_t len2));
+ZEXTERN uLong ZEXPORT crc32_combine_op OF((uLong crc1, uLong crc2, uLong op));
+
+ZEXTERN gzFile ZEXPORT gzopen OF((const char* path, const char* mode));
+ZEXTERN gzFile ZEXPORT gzopen64 OF((const char* path, const char* mode));
+ZEXTERN gzFile ZEXPORT gzdopen OF((int fd, const char* mode));
+ZEXTERN int ZEXPORT gzbuffer OF((gzFile file, unsigned size));
+ZEXTERN int ZEXPORT gzsetparams OF((gzFile file, int level, int strategy));
+ZEXTERN int ZEXPORT gzread OF((gzFile file, voidp buf, unsigned len));
+ZEXTERN size_t ZEXPORT gzfread OF((voidp buf, size_t size, size_t nitems, gzFile file));
+ZEXTERN int ZEXPORT gzwrite OF((gzFile file, voidpc buf, unsigned len));
+ZEXTERN size_t ZEXPORT gzfwrite OF((voidpc buf, size_t size, size_t nitems, gzFile file));
+ZEXTERN int ZEXPORT gzprintf OF((gzFile file, const char* format, ...));
+ZEXTERN int ZEXPORT gzvprintf OF((gzFile file, const char* format, va_list va));
+ZEXTERN int ZEXPORT gzputs OF((gzFile file, const char* s));
+ZEXTERN char* ZEXPORT gzgets OF((gzFile file, char* buf, int len));
+ZEXTERN int ZEXPORT gzputc OF((gzFile file, int c));
+ZEXTERN int ZEXPORT gzgetc OF((gzFile file));
+ZEXTERN int ZEXPORT gzgetc_ OF((gzFile file));
+ZEXTERN int ZEXPORT gzungetc OF((int c, gzFile file));
+ZEXTERN int ZEXPORT gzflush OF((gzFile file, int flush));
+ZEXTERN z_off_t ZEXPORT gzseek OF((gzFile file, z_off_t offset, int whence));
+ZEXTERN z_off64_t ZEXPORT gzseek64 OF((gzFile file, z_off64_t offset, int whence));
+ZEXTERN int ZEXPORT gzrewind OF((gzFile file));
+ZEXTERN z_off_t ZEXPORT gztell OF((gzFile file));
+ZEXTERN z_off64_t ZEXPORT gztell64 OF((gzFile file));
+ZEXTERN z_off_t ZEXPORT gzoffset OF((gzFile file));
+ZEXTERN z_off64_t ZEXPORT gzoffset64 OF((gzFile file));
+ZEXTERN int ZEXPORT gzeof OF((gzFile file));
+ZEXTERN int ZEXPORT gzdirect OF((gzFile file));
+ZEXTERN int ZEXPORT gzclose OF((gzFile file));
+ZEXTERN int ZEXPORT gzclose_r OF((gzFile file));
+ZEXTERN int ZEXPORT gzclose_w OF((gzFile file));
+ZEXTERN const char* ZEXPORT gzerror OF((gzFile file, int* errnum));
+ZEXTERN void ZEXPORT gzclearerr OF((gzFile file));
+
+#define inflateInit(strm)                   inflateInit_((strm), ZLIB_VERSION, (int)sizeof(z_stream))
+#define inflateInit2(strm, windowBits)      inflateInit2_((strm), (windowBits), ZLIB_VERSION, (int)sizeof(z_stream))
+#define deflateInit(strm, level)            deflateInit_((strm), (level), ZLIB_VERSION, (int)sizeof(z_stream))
+#define deflateInit2(strm, level, method, windowBits, memLevel, strategy) \
+    deflateInit2_((strm), (level), (method), (windowBits), (memLevel), (strategy), ZLIB_VERSION, (int)sizeof(z_stream))
+#define inflateBackInit(strm, windowBits, window) \
+    inflateBackInit_((strm), (windowBits), (window), ZLIB_VERSION, (int)sizeof(z_stream))
+
+#ifdef __cplusplus
+}
+#endif
+
+
+#endif /* ZLIB_H */
@@ -0,0 +1,49 @@
+/*
+ * Adler-32 as used by zlib (RFC 1950). Both sums are only reduced modulo
+ * ADLER32_BASE every ADLER32_MAX_RUN bytes, the longest run for which the
+ * second sum cannot overflow 32 bits.
+ */
+
+#include "adler32.h"
+
+#include <stddef.h>
+#include <stdint.h>
+
+
+
+#define ADLER32_BASE        65521
+#define ADLER32_MAX_RUN     5552
+
+
+
+uint32_t adler32_update(uint32_t adler, const uint8_t* data, size_t length) {
+    uint32_t a = adler & 0xffff;
+    uint32_t b = adler >> 16;
+
+    while (length) {
+        size_t run = length < ADLER32_MAX_RUN ? length : ADLER32_MAX_RUN;
+        length -= run;
+
+        for (; run >= 8; run -= 8) {
+            a += data[0]; b += a;
+            a += data[1]; b += a;
+            a += data[2]; b += a;
+            a += data[3]; b += a;
+            a += data[4]; b += a;
+            a += data[5]; b += a;
+            a += data[6]; b += a;
+            a += data[7]; b += a;
+            data += 8;
+        }
+        for (; run; --run) {
+            a += *data;
+            b += a;
+            ++data;
+        }
+
+        a %= ADLER32_BASE;
+        b %= ADLER32_BASE;
+    }
+
+    return b << 16 | a;
+}
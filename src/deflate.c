@@ -0,0 +1,721 @@
+/*
+ * Deflate encoder. Matches are found with hash chains over 3 byte prefixes,
+ * lazily from level 4 on. Every block of DEFLATE_BLOCK_TOKENS tokens is sized
+ * as a dynamic Huffman, a static Huffman and a stored block and written in
+ * whichever form is smallest, so the output never grows much past the input.
+ *
+ * Huffman code lengths are computed with the in-place algorithm of Moffat and
+ * Katajainen and then limited to the deflate maximum by moving leaves up the
+ * tree until the Kraft sum is exact again.
+ */
+
+#include "deflate.h"
+
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "bit_reader.h"
+#include "inflate.h"
+#include "inflate_internal.h"
+#include "inflate_stream.h"
+
+
+
+#define DEFLATE_WINDOW_MASK         (DEFLATE_WINDOW_LENGTH - 1)
+
+/* A match of the minimum length further back than this costs more than its literals. */
+#define DEFLATE_TOO_FAR             4096
+
+#define DEFLATE_MAX_STORED_LENGTH   65535
+
+/* Bits of a stored block besides its data: block header, up to 7 bits alignment, LEN and NLEN. */
+#define DEFLATE_STORED_OVERHEAD     (3 + 7 + 32)
+
+#define DEFLATE_LITERAL_SYMBOLS     286
+#define DEFLATE_CODE_LENGTH_REPEAT  16
+#define DEFLATE_CODE_LENGTH_ZEROS   17
+#define DEFLATE_CODE_LENGTH_ZEROS_LONG  18
+
+
+struct DeflateLevel {
+    uint16_t max_chain;
+    uint16_t nice_length;
+    uint16_t lazy_length;
+    uint16_t good_length;   // A pending match this long cuts the chain to a quarter.
+};
+
+/* Matcher effort per level. Level 0 writes stored blocks only. */
+static const struct DeflateLevel deflate_levels[DEFLATE_MAX_LEVEL + 1] = {
+    {    0,   0,   0,   0 },
+    {    4,   8,   0,   0 },
+    {    8,  16,   0,   0 },
+    {   32,  32,   0,   0 },
+    {   16,  16,  16,   4 },
+    {   32,  32,  32,   8 },
+    {  128, 128, 128,   8 },
+    {  256, 128, 258,   8 },
+    { 1024, 258, 258,  32 },
+    { 4096, 258, 258,  32 },
+};
+
+static const uint16_t length_base[DEFLATE_LENGTH_CODE_COUNT] = {
+    3, 4, 5, 6, 7, 8, 9, 10, 11, 13, 15, 17, 19, 23, 27, 31, 35, 43, 51, 59, 67, 83, 99, 115, 131, 163, 195, 227, 258
+};
+
+static const uint8_t length_extra_bits[DEFLATE_LENGTH_CODE_COUNT] = {
+    0, 0, 0, 0, 0, 0, 0, 0, 1, 1, 1, 1, 2, 2, 2, 2, 3, 3, 3, 3, 4, 4, 4, 4, 5, 5, 5, 5, 0
+};
+
+static const uint16_t distance_base[DEFLATE_DISTANCE_CODE_COUNT] = {
+    1, 2, 3, 4, 5, 7, 9, 13, 17, 25, 33, 49, 65, 97, 129, 193, 257, 385, 513, 769, 1025, 1537, 2049, 3073, 4097, 6145, 8193, 12289, 16385, 24577
+};
+
+static const uint8_t distance_extra_bits[DEFLATE_DISTANCE_CODE_COUNT] = {
+    0, 0, 0, 0, 1, 1, 2, 2, 3, 3, 4, 4, 5, 5, 6, 6, 7, 7, 8, 8, 9, 9, 10, 10, 11, 11, 12, 12, 13, 13
+};
+
+/* Order in which the code length code lengths are sent (RFC 1951, section 3.2.7). */
+static const uint8_t code_length_order[INFLATE_CODE_LENGTH_CODE_COUNT] = {
+    16, 17, 18, 0, 8, 7, 9, 6, 10, 5, 11, 4, 12, 3, 13, 2, 14, 1, 15
+};
+
+
+/* State of the chunk being matched. Positions are relative to base, the start of the dictionary. */
+struct Matcher {
+    struct Deflator* deflator;
+    struct BitWriter* writer;
+    const uint8_t* base;
+    int32_t end;
+
+    size_t token_count;
+    int32_t block_start;    // First position covered by the collected tokens.
+};
+
+struct SymbolFrequency {
+    uint32_t key;           // Frequency, later reused for code lengths.
+    uint16_t symbol;
+};
+
+
+/* Fills the level independent symbol tables and the static Huffman codes. */
+static void init_tables(struct Deflator* deflator);
+
+/* Finds matches in base[start, end) and writes the resulting blocks. */
+static void match_chunk(struct Matcher* matcher, int32_t start, bool final);
+
+/* Writes the collected tokens as the cheapest of the three block types. block_end is the position following the last token. */
+static void write_block(struct Matcher* matcher, int32_t block_end, bool final);
+
+static void write_stored(struct BitWriter* writer, const uint8_t* data, size_t length, bool final);
+
+static void write_tokens(struct BitWriter* writer, const struct Deflator* deflator, const struct DeflateCodes* codes, const InflateToken* tokens, size_t token_count);
+
+/* Computes code lengths no longer than max_length. At least two symbols receive a code so the code is complete. */
+static void build_code_lengths(uint32_t* frequencies, unsigned symbol_count, unsigned max_length, uint8_t* lengths);
+
+/* Assigns canonical codes to the code lengths, bit reversed for the writer. */
+static void assign_codes(const uint8_t* lengths, unsigned symbol_count, uint16_t* codes);
+
+/* Run length encodes code lengths with symbols 16, 17 and 18. Each entry holds the symbol in bits 7-0 and its extra bits above. Returns the entry count. */
+static unsigned encode_code_lengths(const uint8_t* lengths, unsigned length_count, uint16_t* entries, uint32_t* frequencies);
+
+
+static inline void put_bits(struct BitWriter* writer, uint32_t bits, uint32_t count) {
+    writer->buffer |= (Buffer)bits << writer->buffer_count;
+    writer->buffer_count += count;
+    if (writer->buffer_count >= 32) {
+        if (writer->end - writer->next >= 4) {
+            uint32_t word = (uint32_t)writer->buffer;
+            memcpy(writer->next, &word, sizeof(word));
+            writer->next += 4;
+        } else {
+            writer->overflow = true;
+        }
+        writer->buffer >>= 32;
+        writer->buffer_count -= 32;
+    }
+}
+
+/* Writes out the pending bits, padding the last byte with zeroes. */
+static inline void flush_bits(struct BitWriter* writer) {
+    while (writer->buffer_count) {
+        if (writer->next < writer->end) {
+            *writer->next = (uint8_t)writer->buffer;
+            ++writer->next;
+        } else {
+            writer->overflow = true;
+        }
+        writer->buffer >>= 8;
+        writer->buffer_count = writer->buffer_count > 8 ? writer->buffer_count - 8 : 0;
+    }
+}
+
+static inline unsigned distance_symbol(const struct Deflator* deflator, unsigned distance) {
+    --distance;
+    return distance < 256 ? deflator->distance_symbols[distance] : deflator->distance_symbols[256 + (distance >> 7)];
+}
+
+static inline uint32_t hash3(const uint8_t* bytes) {
+    uint32_t value = (uint32_t)bytes[0] | (uint32_t)bytes[1] << 8 | (uint32_t)bytes[2] << 16;
+    return value * 0x9E3779B1u >> (32 - DEFLATE_HASH_BITS);
+}
+
+/* Adds position to its hash chain and returns the previous chain head. */
+static inline int32_t insert_position(struct Deflator* deflator, const uint8_t* base, int32_t position) {
+    uint32_t hash = hash3(base + position);
+    int32_t candidate = deflator->head[hash];
+    deflator->previous[position & DEFLATE_WINDOW_MASK] = candidate;
+    deflator->head[hash] = position;
+    return candidate;
+}
+
+static inline unsigned match_length(const uint8_t* current, const uint8_t* match, unsigned max_length) {
+    unsigned length = 0;
+#if defined(__BYTE_ORDER__) && __BYTE_ORDER__ == __ORDER_LITTLE_ENDIAN__
+    while (max_length - length >= sizeof(uint64_t)) {
+        uint64_t a, b;
+        memcpy(&a, current + length, sizeof(a));
+        memcpy(&b, match + length, sizeof(b));
+        if (a != b)
+            return length + (__builtin_ctzll(a ^ b) >> 3);
+        length += sizeof(uint64_t);
+    }
+#endif
+    while (length < max_length && current[length] == match[length])
+        ++length;
+    return length;
+}
+
+/* Walks the hash chain from candidate for a match longer than shorter_than. Returns its length, 0 if none is found or worth coding. */
+static inline unsigned longest_match(const struct Deflator* deflator, const uint8_t* base, int32_t position, int32_t candidate, unsigned max_length, unsigned shorter_than,
+                                     unsigned* distance) {
+    const uint8_t* current = base + position;
+    int32_t limit = position - DEFLATE_WINDOW_LENGTH;
+    unsigned best = shorter_than < INFLATE_MIN_LZ77_LENGTH ? INFLATE_MIN_LZ77_LENGTH - 1 : shorter_than;
+    unsigned chain = deflator->max_chain;
+    if (shorter_than >= INFLATE_MIN_LZ77_LENGTH && shorter_than >= deflator->good_length)
+        chain >>= 2;
+    if (best >= max_length)
+        return 0;
+
+    while (candidate >= 0 && candidate >= limit && chain--) {
+        const uint8_t* match = base + candidate;
+        if (match[best] == current[best] && match[0] == current[0] && match[1] == current[1]) {
+            unsigned length = match_length(current, match, max_length);
+            if (length > best) {
+                best = length;
+                *distance = position - candidate;
+                if (length >= deflator->nice_length || length == max_length)
+                    break;
+            }
+        }
+        candidate = deflator->previous[candidate & DEFLATE_WINDOW_MASK];
+    }
+
+    if (best <= shorter_than || best < INFLATE_MIN_LZ77_LENGTH || (best == INFLATE_MIN_LZ77_LENGTH && *distance > DEFLATE_TOO_FAR))
+        return 0;
+    return best;
+}
+
+static inline void emit(struct Matcher* matcher, InflateToken token, int32_t block_end) {
+    matcher->deflator->tokens[matcher->token_count] = token;
+    if (++matcher->token_count == DEFLATE_BLOCK_TOKENS)
+        write_block(matcher, block_end, false);
+}
+
+
+struct Deflator* deflator_alloc(int level) {
+    if (level < DEFLATE_MIN_LEVEL || level > DEFLATE_MAX_LEVEL)
+        return NULL;
+
+    struct Deflator* deflator = malloc(sizeof(struct Deflator));
+    if (!deflator)
+        return NULL;
+
+    deflator->level = level;
+    deflator->max_chain = deflate_levels[level].max_chain;
+    deflator->nice_length = deflate_levels[level].nice_length;
+    deflator->lazy_length = deflate_levels[level].lazy_length;
+    deflator->good_length = deflate_levels[level].good_length;
+    init_tables(deflator);
+
+    return deflator;
+}
+
+void deflator_free(struct Deflator* deflator) {
+    free(deflator);
+}
+
+size_t deflate_bound(size_t length) {
+    /* Every block costs at most its stored size. A block covers at least DEFLATE_BLOCK_TOKENS bytes unless it is the last. */
+    size_t blocks = length / DEFLATE_BLOCK_TOKENS + length / DEFLATE_MAX_STORED_LENGTH + 2;
+    return length + blocks * ((DEFLATE_STORED_OVERHEAD + 7) / 8) + 16;
+}
+
+size_t deflate_chunk(struct Deflator* deflator, const uint8_t* data, size_t dictionary_length, size_t length, bool final, uint8_t* compressed, size_t compressed_max_length) {
+    struct BitWriter writer;
+    deflate_writer_init(&writer, compressed, compressed_max_length);
+
+    if (dictionary_length > DEFLATE_WINDOW_LENGTH)
+        dictionary_length = DEFLATE_WINDOW_LENGTH;
+    if (length > INT32_MAX - DEFLATE_WINDOW_LENGTH)
+        return 0;
+
+    if (!deflator->level) {
+        if (length || final)
+            write_stored(&writer, data, length, final);
+    } else {
+        struct Matcher matcher = {
+            .deflator = deflator,
+            .writer = &writer,
+            .base = data - dictionary_length,
+            .end = (int32_t)(dictionary_length + length),
+        };
+        match_chunk(&matcher, (int32_t)dictionary_length, final);
+    }
+
+    /* An empty stored block brings a chunk that does not end the stream to a byte boundary. */
+    if (!final)
+        write_stored(&writer, NULL, 0, false);
+
+    return deflate_writer_finish(&writer, compressed);
+}
+
+void deflate_writer_init(struct BitWriter* writer, uint8_t* compressed, size_t compressed_max_length) {
+    *writer = (struct BitWriter){
+        .next = compressed,
+        .end = compressed + compressed_max_length,
+    };
+}
+
+void deflate_write_block(struct Deflator* deflator, struct BitWriter* writer, const InflateToken* tokens, size_t token_count, const uint8_t* raw, size_t raw_length,
+                         bool final) {
+    uint32_t literal_frequencies[INFLATE_LITERAL_CODE_COUNT] = { 0 };
+    uint32_t distance_frequencies[INFLATE_DISTANCE_CODE_COUNT] = { 0 };
+    uint64_t extra_bits = 0;
+    for (size_t i = 0; i < token_count; ++i) {
+        InflateToken token = tokens[i];
+        if (token & INFLATE_TOKEN_MATCH) {
+            unsigned length_code = deflator->length_symbols[INFLATE_TOKEN_LENGTH(token)];
+            unsigned distance_code = distance_symbol(deflator, INFLATE_TOKEN_DISTANCE(token));
+            ++literal_frequencies[INFLATE_END_OF_BLOCK + 1 + length_code];
+            ++distance_frequencies[distance_code];
+            extra_bits += length_extra_bits[length_code] + distance_extra_bits[distance_code];
+        } else {
+            ++literal_frequencies[token];
+        }
+    }
+    literal_frequencies[INFLATE_END_OF_BLOCK] = 1;
+
+    /* Dynamic codes and the run length coded code lengths that describe them. */
+    struct DeflateCodes* codes = &deflator->codes;
+    memset(codes->literal_lengths, 0, sizeof(codes->literal_lengths));
+    memset(codes->distance_lengths, 0, sizeof(codes->distance_lengths));
+    build_code_lengths(literal_frequencies, DEFLATE_LITERAL_SYMBOLS, INFLATE_MAX_LITERAL_CODE_LENGTH, codes->literal_lengths);
+    build_code_lengths(distance_frequencies, DEFLATE_DISTANCE_CODE_COUNT, INFLATE_MAX_DISTANCE_CODE_LENGTH, codes->distance_lengths);
+
+    unsigned literal_count = DEFLATE_LITERAL_SYMBOLS;
+    while (literal_count > INFLATE_END_OF_BLOCK + 1 && !codes->literal_lengths[literal_count - 1])
+        --literal_count;
+    unsigned distance_count = DEFLATE_DISTANCE_CODE_COUNT;
+    while (distance_count > 1 && !codes->distance_lengths[distance_count - 1])
+        --distance_count;
+
+    uint8_t lengths[DEFLATE_LITERAL_SYMBOLS + DEFLATE_DISTANCE_CODE_COUNT];
+    memcpy(lengths, codes->literal_lengths, literal_count);
+    memcpy(lengths + literal_count, codes->distance_lengths, distance_count);
+
+    uint16_t entries[DEFLATE_LITERAL_SYMBOLS + DEFLATE_DISTANCE_CODE_COUNT];
+    uint32_t code_length_frequencies[INFLATE_CODE_LENGTH_CODE_COUNT] = { 0 };
+    unsigned entry_count = encode_code_lengths(lengths, literal_count + distance_count, entries, code_length_frequencies);
+
+    uint8_t code_length_lengths[INFLATE_CODE_LENGTH_CODE_COUNT] = { 0 };
+    uint16_t code_length_codes[INFLATE_CODE_LENGTH_CODE_COUNT];
+    build_code_lengths(code_length_frequencies, INFLATE_CODE_LENGTH_CODE_COUNT, INFLATE_MAX_CODE_LENGTH_CODE_LENGTH, code_length_lengths);
+    assign_codes(code_length_lengths, INFLATE_CODE_LENGTH_CODE_COUNT, code_length_codes);
+
+    unsigned code_length_count = INFLATE_CODE_LENGTH_CODE_COUNT;
+    while (code_length_count > 4 && !code_length_lengths[code_length_order[code_length_count - 1]])
+        --code_length_count;
+
+    /* Size the block three ways. The extra bits of matches are the same for both Huffman variants. */
+    uint64_t dynamic_bits = 3 + 5 + 5 + 4 + 3 * code_length_count + extra_bits;
+    for (unsigned symbol = 0; symbol < INFLATE_CODE_LENGTH_CODE_COUNT; ++symbol)
+        dynamic_bits += (uint64_t)code_length_frequencies[symbol] * code_length_lengths[symbol];
+    dynamic_bits += 2 * code_length_frequencies[DEFLATE_CODE_LENGTH_REPEAT] + 3 * code_length_frequencies[DEFLATE_CODE_LENGTH_ZEROS]
+                  + 7 * code_length_frequencies[DEFLATE_CODE_LENGTH_ZEROS_LONG];
+
+    uint64_t static_bits = 3 + extra_bits;
+    for (unsigned symbol = 0; symbol < DEFLATE_LITERAL_SYMBOLS; ++symbol) {
+        dynamic_bits += (uint64_t)literal_frequencies[symbol] * codes->literal_lengths[symbol];
+        static_bits += (uint64_t)literal_frequencies[symbol] * deflator->static_codes.literal_lengths[symbol];
+    }
+    for (unsigned symbol = 0; symbol < DEFLATE_DISTANCE_CODE_COUNT; ++symbol) {
+        dynamic_bits += (uint64_t)distance_frequencies[symbol] * codes->distance_lengths[symbol];
+        static_bits += (uint64_t)distance_frequencies[symbol] * deflator->static_codes.distance_lengths[symbol];
+    }
+
+    if (raw) {
+        size_t stored_pieces = raw_length ? (raw_length + DEFLATE_MAX_STORED_LENGTH - 1) / DEFLATE_MAX_STORED_LENGTH : 1;
+        uint64_t stored_bits = (uint64_t)stored_pieces * DEFLATE_STORED_OVERHEAD + 8 * (uint64_t)raw_length;
+
+        if (stored_bits <= static_bits && stored_bits <= dynamic_bits) {
+            write_stored(writer, raw, raw_length, final);
+            return;
+        }
+    }
+
+    put_bits(writer, final, 1);
+    if (static_bits <= dynamic_bits) {
+        put_bits(writer, INFLATE_BLOCKTYPE_STATIC_HUFFMAN, 2);
+        write_tokens(writer, deflator, &deflator->static_codes, tokens, token_count);
+        return;
+    }
+
+    put_bits(writer, INFLATE_BLOCKTYPE_DYNAMIC_HUFFMAN, 2);
+    put_bits(writer, literal_count - (INFLATE_END_OF_BLOCK + 1), 5);
+    put_bits(writer, distance_count - 1, 5);
+    put_bits(writer, code_length_count - 4, 4);
+    for (unsigned i = 0; i < code_length_count; ++i)
+        put_bits(writer, code_length_lengths[code_length_order[i]], 3);
+
+    for (unsigned i = 0; i < entry_count; ++i) {
+        unsigned symbol = entries[i] & BITMASK(8);
+        put_bits(writer, code_length_codes[symbol], code_length_lengths[symbol]);
+        if (symbol == DEFLATE_CODE_LENGTH_REPEAT)
+            put_bits(writer, entries[i] >> 8, 2);
+        else if (symbol == DEFLATE_CODE_LENGTH_ZEROS)
+            put_bits(writer, entries[i] >> 8, 3);
+        else if (symbol == DEFLATE_CODE_LENGTH_ZEROS_LONG)
+            put_bits(writer, entries[i] >> 8, 7);
+    }
+
+    assign_codes(codes->literal_lengths, INFLATE_LITERAL_CODE_COUNT, codes->literal_codes);
+    assign_codes(codes->distance_lengths, INFLATE_DISTANCE_CODE_COUNT, codes->distance_codes);
+    write_tokens(writer, deflator, codes, tokens, token_count);
+}
+
+size_t deflate_writer_finish(struct BitWriter* writer, const uint8_t* compressed) {
+    flush_bits(writer);
+
+    return writer->overflow ? 0 : (size_t)(writer->next - compressed);
+}
+
+
+
+
+static void init_tables(struct Deflator* deflator) {
+    for (unsigned symbol = 0; symbol < DEFLATE_LENGTH_CODE_COUNT; ++symbol) {
+        for (unsigned length = length_base[symbol]; length < length_base[symbol] + (1u << length_extra_bits[symbol]) && length <= INFLATE_MAX_LZ77_LENGTH; ++length)
+            deflator->length_symbols[length] = (uint8_t)symbol;
+    }
+    deflator->length_symbols[INFLATE_MAX_LZ77_LENGTH] = DEFLATE_LENGTH_CODE_COUNT - 1;
+
+    for (unsigned symbol = 0; symbol < DEFLATE_DISTANCE_CODE_COUNT; ++symbol) {
+        for (unsigned distance = distance_base[symbol] - 1; distance < distance_base[symbol] - 1 + (1u << distance_extra_bits[symbol]); ++distance) {
+            if (distance < 256)
+                deflator->distance_symbols[distance] = (uint8_t)symbol;
+            else
+                deflator->distance_symbols[256 + (distance >> 7)] = (uint8_t)symbol;
+        }
+    }
+
+    /* Static Huffman code lengths (RFC 1951, section 3.2.6). */
+    struct DeflateCodes* codes = &deflator->static_codes;
+    for (unsigned symbol = 0; symbol < INFLATE_LITERAL_CODE_COUNT; ++symbol)
+        codes->literal_lengths[symbol] = symbol < 144 ? 8 : symbol < 256 ? 9 : symbol < 280 ? 7 : 8;
+    for (unsigned symbol = 0; symbol < INFLATE_DISTANCE_CODE_COUNT; ++symbol)
+        codes->distance_lengths[symbol] = 5;
+    assign_codes(codes->literal_lengths, INFLATE_LITERAL_CODE_COUNT, codes->literal_codes);
+    assign_codes(codes->distance_lengths, INFLATE_DISTANCE_CODE_COUNT, codes->distance_codes);
+}
+
+static void match_chunk(struct Matcher* matcher, int32_t start, bool final) {
+    struct Deflator* deflator = matcher->deflator;
+    const uint8_t* base = matcher->base;
+    int32_t end = matcher->end;
+
+    memset(deflator->head, 0xFF, sizeof(deflator->head));
+    for (int32_t position = 0; position + INFLATE_MIN_LZ77_LENGTH <= start; ++position)
+        insert_position(deflator, base, position);
+
+    matcher->token_count = 0;
+    matcher->block_start = start;
+
+    /* A match found at position - 1 that waits for the match at position to turn out shorter. */
+    bool pending = false;
+    unsigned pending_length = 0;
+    unsigned pending_distance = 0;
+
+    int32_t position = start;
+    while (position < end) {
+        unsigned max_length = end - position < INFLATE_MAX_LZ77_LENGTH ? (unsigned)(end - position) : INFLATE_MAX_LZ77_LENGTH;
+        unsigned length = 0;
+        unsigned distance = 0;
+        if (max_length >= INFLATE_MIN_LZ77_LENGTH) {
+            int32_t candidate = insert_position(deflator, base, position);
+            length = longest_match(deflator, base, position, candidate, max_length, pending ? pending_length : 0, &distance);
+        }
+
+        if (pending) {
+            pending = false;
+            if (pending_length >= length) {
+                int32_t match_end = position - 1 + (int32_t)pending_length;
+                for (int32_t next = position + 1; next < match_end && next + INFLATE_MIN_LZ77_LENGTH <= end; ++next)
+                    insert_position(deflator, base, next);
+                emit(matcher, INFLATE_TOKEN_MATCH | pending_length << 16 | (pending_distance - 1), match_end);
+                position = match_end;
+                continue;
+            }
+            emit(matcher, base[position - 1], position);
+        }
+
+        if (!length) {
+            emit(matcher, base[position], position + 1);
+            ++position;
+        } else if (length >= deflator->lazy_length) {
+            /* Greedy levels and long matches are taken right away. */
+            int32_t match_end = position + (int32_t)length;
+            for (int32_t next = position + 1; next < match_end && next + INFLATE_MIN_LZ77_LENGTH <= end; ++next)
+                insert_position(deflator, base, next);
+            emit(matcher, INFLATE_TOKEN_MATCH | length << 16 | (distance - 1), match_end);
+            position = match_end;
+        } else {
+            pending = true;
+            pending_length = length;
+            pending_distance = distance;
+            ++position;
+        }
+    }
+
+    if (matcher->token_count || final)
+        write_block(matcher, end, final);
+}
+
+static void write_block(struct Matcher* matcher, int32_t block_end, bool final) {
+    size_t token_count = matcher->token_count;
+    const uint8_t* raw = matcher->base + matcher->block_start;
+    size_t raw_length = (size_t)(block_end - matcher->block_start);
+
+    matcher->token_count = 0;
+    matcher->block_start = block_end;
+
+    deflate_write_block(matcher->deflator, matcher->writer, matcher->deflator->tokens, token_count, raw, raw_length, final);
+}
+
+static void write_stored(struct BitWriter* writer, const uint8_t* data, size_t length, bool final) {
+    do {
+        size_t piece = length < DEFLATE_MAX_STORED_LENGTH ? length : DEFLATE_MAX_STORED_LENGTH;
+
+        put_bits(writer, final && piece == length, 1);
+        put_bits(writer, INFLATE_BLOCKTYPE_UNCOMPRESSED, 2);
+        flush_bits(writer);
+        put_bits(writer, (uint32_t)piece, 16);
+        put_bits(writer, (uint32_t)~piece & BITMASK(16), 16);
+
+        if ((size_t)(writer->end - writer->next) >= piece) {
+            if (piece)
+                memcpy(writer->next, data, piece);
+            writer->next += piece;
+        } else {
+            writer->overflow = true;
+        }
+
+        data += piece;
+        length -= piece;
+    } while (length);
+}
+
+static void write_tokens(struct BitWriter* writer, const struct Deflator* deflator, const struct DeflateCodes* codes, const InflateToken* tokens, size_t token_count) {
+    for (size_t i = 0; i < token_count; ++i) {
+        InflateToken token = tokens[i];
+        if (!(token & INFLATE_TOKEN_MATCH)) {
+            put_bits(writer, codes->literal_codes[token], codes->literal_lengths[token]);
+            continue;
+        }
+
+        unsigned length = INFLATE_TOKEN_LENGTH(token);
+        unsigned length_code = deflator->length_symbols[length];
+        unsigned literal_symbol = INFLATE_END_OF_BLOCK + 1 + length_code;
+        put_bits(writer, codes->literal_codes[literal_symbol], codes->literal_lengths[literal_symbol]);
+        put_bits(writer, length - length_base[length_code], length_extra_bits[length_code]);
+
+        unsigned distance = INFLATE_TOKEN_DISTANCE(token);
+        unsigned distance_code = distance_symbol(deflator, distance);
+        put_bits(writer, codes->distance_codes[distance_code], codes->distance_lengths[distance_code]);
+        put_bits(writer, distance - distance_base[distance_code], distance_extra_bits[distance_code]);
+    }
+
+    put_bits(writer, codes->literal_codes[INFLATE_END_OF_BLOCK], codes->literal_lengths[INFLATE_END_OF_BLOCK]);
+}
+
+static int compare_frequencies(const void* a, const void* b) {
+    const struct SymbolFrequency* x = a;
+    const struct SymbolFrequency* y = b;
+    if (x->key != y->key)
+        return x->key < y->key ? -1 : 1;
+    return x->symbol < y->symbol ? -1 : 1;
+}
+
+static void build_code_lengths(uint32_t* frequencies, unsigned symbol_count, unsigned max_length, uint8_t* lengths) {
+    /* A lone used symbol still gets a one bit code, which needs a second one to be complete. */
+    unsigned used = 0;
+    for (unsigned symbol = 0; symbol < symbol_count; ++symbol)
+        used += frequencies[symbol] != 0;
+    for (unsigned symbol = 0; used < 2; ++symbol) {
+        if (!frequencies[symbol]) {
+            frequencies[symbol] = 1;
+            ++used;
+        }
+    }
+
+    struct SymbolFrequency sorted[INFLATE_MAX_CODE_COUNT];
+    unsigned count = 0;
+    for (unsigned symbol = 0; symbol < symbol_count; ++symbol) {
+        if (frequencies[symbol])
+            sorted[count++] = (struct SymbolFrequency){ .key = frequencies[symbol], .symbol = (uint16_t)symbol };
+    }
+    qsort(sorted, count, sizeof(struct SymbolFrequency), compare_frequencies);
+
+    /* Moffat and Katajainen: turn the sorted frequencies into code lengths in place. */
+    sorted[0].key += sorted[1].key;
+    unsigned root = 0;
+    unsigned leaf = 2;
+    for (unsigned next = 1; next < count - 1; ++next) {
+        if (leaf >= count || sorted[root].key < sorted[leaf].key) {
+            sorted[next].key = sorted[root].key;
+            sorted[root++].key = next;
+        } else {
+            sorted[next].key = sorted[leaf++].key;
+        }
+
+        if (leaf >= count || (root < next && sorted[root].key < sorted[leaf].key)) {
+            sorted[next].key += sorted[root].key;
+            sorted[root++].key = next;
+        } else {
+            sorted[next].key += sorted[leaf++].key;
+        }
+    }
+
+    sorted[count - 2].key = 0;
+    for (int next = (int)count - 3; next >= 0; --next)
+        sorted[next].key = sorted[sorted[next].key].key + 1;
+
+    int available = 1;
+    int used_nodes = 0;
+    unsigned depth = 0;
+    int internal = (int)count - 2;
+    int next = (int)count - 1;
+    while (available > 0) {
+        while (internal >= 0 && sorted[internal].key == depth) {
+            ++used_nodes;
+            --internal;
+        }
+        while (available > used_nodes) {
+            sorted[next--].key = depth;
+            --available;
+        }
+        available = 2 * used_nodes;
+        ++depth;
+        used_nodes = 0;
+    }
+
+    /* Limit the lengths: fold overlong codes into max_length and deepen shorter ones until the Kraft sum is exact. */
+    unsigned length_counts[INFLATE_MAX_CODE_COUNT + 1] = { 0 };
+    for (unsigned i = 0; i < count; ++i)
+        ++length_counts[sorted[i].key < max_length ? sorted[i].key : max_length];
+
+    uint32_t total = 0;
+    for (unsigned length = max_length; length > 0; --length)
+        total += length_counts[length] << (max_length - length);
+    while (total != 1u << max_length) {
+        --length_counts[max_length];
+        for (unsigned length = max_length - 1; length > 0; --length) {
+            if (length_counts[length]) {
+                --length_counts[length];
+                length_counts[length + 1] += 2;
+                break;
+            }
+        }
+        --total;
+    }
+
+    /* The most frequent symbols, at the end of sorted, receive the shortest codes. */
+    unsigned index = count;
+    for (unsigned length = 1; length <= max_length; ++length) {
+        for (unsigned i = length_counts[length]; i > 0; --i)
+            lengths[sorted[--index].symbol] = (uint8_t)length;
+    }
+}
+
+static void assign_codes(const uint8_t* lengths, unsigned symbol_count, uint16_t* codes) {
+    unsigned length_counts[INFLATE_MAX_CODE_LENGTH + 1] = { 0 };
+    for (unsigned symbol = 0; symbol < symbol_count; ++symbol)
+        ++length_counts[lengths[symbol]];
+    length_counts[0] = 0;
+
+    unsigned next_code[INFLATE_MAX_CODE_LENGTH + 1];
+    unsigned code = 0;
+    for (unsigned length = 1; length <= INFLATE_MAX_CODE_LENGTH; ++length) {
+        code = (code + length_counts[length - 1]) << 1;
+        next_code[length] = code;
+    }
+
+    for (unsigned symbol = 0; symbol < symbol_count; ++symbol) {
+        unsigned length = lengths[symbol];
+        if (!length)
+            continue;
+
+        unsigned forward = next_code[length]++;
+        unsigned reversed = 0;
+        for (unsigned bit = 0; bit < length; ++bit)
+            reversed |= (forward >> bit & 1) << (length - 1 - bit);
+        codes[symbol] = (uint16_t)reversed;
+    }
+}
+
+static unsigned encode_code_lengths(const uint8_t* lengths, unsigned length_count, uint16_t* entries, uint32_t* frequencies) {
+    unsigned entry_count = 0;
+
+    for (unsigned i = 0; i < length_count;) {
+        unsigned length = lengths[i];
+        unsigned run = 1;
+        while (i + run < length_count && lengths[i + run] == length)
+            ++run;
+        i += run;
+
+        if (!length) {
+            while (run >= 11) {
+                unsigned piece = run < 138 ? run : 138;
+                entries[entry_count++] = DEFLATE_CODE_LENGTH_ZEROS_LONG | (piece - 11) << 8;
+                ++frequencies[DEFLATE_CODE_LENGTH_ZEROS_LONG];
+                run -= piece;
+            }
+            if (run >= 3) {
+                entries[entry_count++] = DEFLATE_CODE_LENGTH_ZEROS | (run - 3) << 8;
+                ++frequencies[DEFLATE_CODE_LENGTH_ZEROS];
+                run = 0;
+            }
+        } else {
+            entries[entry_count++] = (uint16_t)length;
+            ++frequencies[length];
+            --run;
+            while (run >= 3) {
+                unsigned piece = run < 6 ? run : 6;
+                entries[entry_count++] = DEFLATE_CODE_LENGTH_REPEAT | (piece - 3) << 8;
+                ++frequencies[DEFLATE_CODE_LENGTH_REPEAT];
+                run -= piece;
+            }
+        }
+
+        for (; run; --run) {
+            entries[entry_count++] = (uint16_t)length;
+            ++frequencies[length];
+        }
+    }
+
+    return entry_count;
+}
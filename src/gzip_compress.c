@@ -0,0 +1,399 @@
+/*
+ * Parallel gzip compression. The input is cut into fixed size chunks which
+ * threads claim from a shared counter and compress into buffers of their own;
+ * the calling thread then lays the chunks out behind the header. Chunks that
+ * do not end the stream finish with an empty stored block, so their deflate
+ * data concatenates on byte boundaries and the CRC-32s of the chunks combine
+ * into the trailer without another pass over the data.
+ */
+
+#include "gzip_compress.h"
+
+#include <pthread.h>
+#include <stdatomic.h>
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+
+#include "crc32.h"
+#include "deflate.h"
+#include "gzip_header.h"
+#include "inflate.h"
+
+
+
+#define GZIP_COMPRESS_DEFAULT_CHUNK     (128 * 1024)
+
+/* Largest BGZF input per member, as used by htslib, so that stored data still fits BSIZE. */
+#define GZIP_COMPRESS_BGZF_CHUNK        0xFF00
+
+/* dictzip's chunk length: incompressible chunks of this size still fit a 16 bit compressed length. */
+#define GZIP_COMPRESS_DICTZIP_CHUNK     58315
+
+#define GZIP_COMPRESS_MAX_THREADS       256
+
+#define GZIP_OS_UNKNOWN                 255
+
+/* Extra field bytes ahead of the chunk lengths: XLEN, SI1, SI2, LEN, VER, CHLEN, CHCNT. */
+#define DICTZIP_FIELD_LENGTH            12
+#define DICTZIP_MAX_CHUNKS              ((UINT16_MAX - (DICTZIP_FIELD_LENGTH - 2)) / 2)
+
+#define GZIP_SEEK_INDEX_MAGIC           "GZSI"
+#define GZIP_SEEK_INDEX_VERSION         1
+#define GZIP_SEEK_INDEX_HEADER_LENGTH   16
+
+
+struct GzipCompressChunk {
+    uint8_t* compressed;
+    size_t compressed_length;
+    uint32_t crc32;
+};
+
+struct GzipCompressJob {
+    const uint8_t* data;
+    size_t length;
+    size_t chunk_length;
+    enum GzipCompressMode mode;
+    int level;
+
+    struct GzipCompressChunk* chunks;
+    size_t chunk_count;
+
+    atomic_size_t next_chunk;
+    atomic_int result;
+};
+
+
+/* Picks the chunk length for the options. Returns 0 if the options are not allowed. */
+static size_t chunk_length_for(const struct GzipCompressOptions* options);
+
+/* Writes the header of the single member modes. Returns its length. */
+static size_t write_member_header(uint8_t* compressed, const struct GzipCompressOptions* options, const struct GzipCompressChunk* chunks, size_t chunk_count, size_t chunk_length);
+
+/* Lays the compressed chunks out in compressed and fills index. */
+static int assemble(const struct GzipCompressJob* job, const struct GzipCompressOptions* options, uint8_t* compressed, size_t* compressed_length, size_t compressed_max_length,
+                    struct GzipSeekIndex* index);
+
+static void* gzip_compress_worker(void* argument);
+
+static inline void write_le64(uint8_t* bytes, uint64_t value) {
+    gzip_write_le32(bytes, (uint32_t)value);
+    gzip_write_le32(bytes + 4, (uint32_t)(value >> 32));
+}
+
+static inline uint64_t read_le64(const uint8_t* bytes) {
+    return gzip_read_le32(bytes) | (uint64_t)gzip_read_le32(bytes + 4) << 32;
+}
+
+static inline uint8_t extra_flags(int level) {
+    return level == DEFLATE_MAX_LEVEL ? 2 : level == 1 ? 4 : 0;
+}
+
+
+extern size_t gzip_compress_bound(size_t length, const struct GzipCompressOptions* options) {
+    size_t chunk_length = chunk_length_for(options);
+    if (!chunk_length)
+        return 0;
+
+    size_t chunk_count = length ? (length + chunk_length - 1) / chunk_length : 1;
+    size_t chunk_bound = deflate_bound(chunk_length < length ? chunk_length : length);
+    if (options->mode == GZIP_COMPRESS_BGZF)
+        return chunk_count * (BGZF_HEADER_LENGTH + chunk_bound + GZIP_TRAILER_LENGTH) + BGZF_HEADER_LENGTH + 2 + GZIP_TRAILER_LENGTH;
+
+    size_t extra_length = options->extra_index ? DICTZIP_FIELD_LENGTH + 2 * chunk_count : 0;
+    return GZIP_MIN_HEADER_LENGTH + extra_length + chunk_count * chunk_bound + GZIP_TRAILER_LENGTH;
+}
+
+extern int gzip_compress(const unsigned char* data, size_t length, unsigned char* compressed, size_t* compressed_length, size_t compressed_max_length,
+                         const struct GzipCompressOptions* options, struct GzipSeekIndex* index) {
+    *compressed_length = 0;
+    if (index)
+        *index = (struct GzipSeekIndex){ 0 };
+
+    if (!compressed)
+        return INFLATE_NO_OUTPUT;
+    if (options->level < DEFLATE_MIN_LEVEL || options->level > DEFLATE_MAX_LEVEL)
+        return INFLATE_VALUE_NOT_ALLOWED;
+    if (options->extra_index && options->mode != GZIP_COMPRESS_INDEPENDENT)
+        return INFLATE_VALUE_NOT_ALLOWED;
+    if (index && options->mode == GZIP_COMPRESS_DICTIONARY)
+        return INFLATE_NOT_INDEXABLE;
+
+    size_t chunk_length = chunk_length_for(options);
+    if (!chunk_length)
+        return options->extra_index ? INFLATE_NOT_INDEXABLE : INFLATE_VALUE_NOT_ALLOWED;
+
+    size_t chunk_count = length ? (length + chunk_length - 1) / chunk_length : 1;
+    if (options->extra_index && chunk_count > DICTZIP_MAX_CHUNKS)
+        return INFLATE_NOT_INDEXABLE;
+
+    unsigned thread_count = options->thread_count;
+    if (!thread_count) {
+        long online = sysconf(_SC_NPROCESSORS_ONLN);
+        thread_count = online > 0 ? (unsigned)online : 1;
+    }
+    if (thread_count > GZIP_COMPRESS_MAX_THREADS)
+        thread_count = GZIP_COMPRESS_MAX_THREADS;
+    if (thread_count > chunk_count)
+        thread_count = (unsigned)chunk_count;
+
+    struct GzipCompressJob job = {
+        .data = data,
+        .length = length,
+        .chunk_length = chunk_length,
+        .mode = options->mode,
+        .level = options->level,
+        .chunk_count = chunk_count,
+    };
+    job.chunks = calloc(chunk_count, sizeof(struct GzipCompressChunk));
+    if (!job.chunks)
+        return INFLATE_NO_MEMORY;
+    atomic_init(&job.next_chunk, 0);
+    atomic_init(&job.result, INFLATE_SUCCESS);
+
+    /* The calling thread works as well, so only thread_count - 1 helpers are started. */
+    pthread_t threads[GZIP_COMPRESS_MAX_THREADS];
+    unsigned started = 0;
+    for (; started < thread_count - 1; ++started) {
+        if (pthread_create(&threads[started], NULL, gzip_compress_worker, &job))
+            break;
+    }
+
+    gzip_compress_worker(&job);
+
+    for (unsigned i = 0; i < started; ++i)
+        pthread_join(threads[i], NULL);
+
+    int result = atomic_load(&job.result);
+    if (!result)
+        result = assemble(&job, options, compressed, compressed_length, compressed_max_length, index);
+
+    for (size_t i = 0; i < chunk_count; ++i)
+        free(job.chunks[i].compressed);
+    free(job.chunks);
+
+    return result;
+}
+
+extern size_t gzip_seek_index_write(const struct GzipSeekIndex* index, unsigned char* out, size_t max_length) {
+    if (max_length < GZIP_SEEK_INDEX_HEADER_LENGTH || index->point_count > (max_length - GZIP_SEEK_INDEX_HEADER_LENGTH) / 16)
+        return 0;
+
+    memcpy(out, GZIP_SEEK_INDEX_MAGIC, 4);
+    gzip_write_le32(out + 4, GZIP_SEEK_INDEX_VERSION);
+    write_le64(out + 8, index->point_count);
+
+    uint8_t* next = out + GZIP_SEEK_INDEX_HEADER_LENGTH;
+    for (size_t i = 0; i < index->point_count; ++i) {
+        write_le64(next, index->points[i].compressed_offset);
+        write_le64(next + 8, index->points[i].decompressed_offset);
+        next += 16;
+    }
+
+    return next - out;
+}
+
+extern int gzip_seek_index_read(const unsigned char* in, size_t length, struct GzipSeekIndex* index) {
+    *index = (struct GzipSeekIndex){ 0 };
+
+    if (length < GZIP_SEEK_INDEX_HEADER_LENGTH)
+        return INFLATE_COMPRESSED_INCOMPLETE;
+    if (memcmp(in, GZIP_SEEK_INDEX_MAGIC, 4) || gzip_read_le32(in + 4) != GZIP_SEEK_INDEX_VERSION)
+        return INFLATE_INVALID_HEADER;
+
+    uint64_t point_count = read_le64(in + 8);
+    if (point_count > (length - GZIP_SEEK_INDEX_HEADER_LENGTH) / 16)
+        return INFLATE_COMPRESSED_INCOMPLETE;
+
+    index->points = malloc((point_count ? point_count : 1) * sizeof(struct GzipSeekPoint));
+    if (!index->points)
+        return INFLATE_NO_MEMORY;
+    index->point_count = point_count;
+
+    const uint8_t* next = in + GZIP_SEEK_INDEX_HEADER_LENGTH;
+    for (size_t i = 0; i < point_count; ++i) {
+        index->points[i].compressed_offset = read_le64(next);
+        index->points[i].decompressed_offset = read_le64(next + 8);
+        next += 16;
+    }
+
+    return INFLATE_SUCCESS;
+}
+
+extern void gzip_seek_index_free(struct GzipSeekIndex* index) {
+    free(index->points);
+    *index = (struct GzipSeekIndex){ 0 };
+}
+
+
+
+static size_t chunk_length_for(const struct GzipCompressOptions* options) {
+    size_t chunk_length = options->chunk_length;
+
+    switch (options->mode) {
+        case GZIP_COMPRESS_DICTIONARY:
+            return chunk_length ? chunk_length : GZIP_COMPRESS_DEFAULT_CHUNK;
+        case GZIP_COMPRESS_INDEPENDENT:
+            if (!options->extra_index)
+                return chunk_length ? chunk_length : GZIP_COMPRESS_DEFAULT_CHUNK;
+            if (!chunk_length)
+                return GZIP_COMPRESS_DICTZIP_CHUNK;
+            return chunk_length <= UINT16_MAX ? chunk_length : 0;
+        case GZIP_COMPRESS_BGZF:
+            if (!chunk_length)
+                return GZIP_COMPRESS_BGZF_CHUNK;
+            return chunk_length <= GZIP_COMPRESS_BGZF_CHUNK ? chunk_length : 0;
+        default:
+            return 0;
+    }
+}
+
+static size_t write_member_header(uint8_t* compressed, const struct GzipCompressOptions* options, const struct GzipCompressChunk* chunks, size_t chunk_count, size_t chunk_length) {
+    compressed[0] = GZIP_ID1;
+    compressed[1] = GZIP_ID2;
+    compressed[2] = GZIP_CM_DEFLATE;
+    compressed[3] = options->extra_index ? GZIP_FEXTRA : 0;
+    gzip_write_le32(compressed + 4, 0);     // MTIME
+    compressed[8] = extra_flags(options->level);
+    compressed[9] = GZIP_OS_UNKNOWN;
+    if (!options->extra_index)
+        return GZIP_MIN_HEADER_LENGTH;
+
+    uint8_t* extra = compressed + GZIP_MIN_HEADER_LENGTH;
+    size_t subfield_length = DICTZIP_FIELD_LENGTH - 6 + 2 * chunk_count;
+    gzip_write_le16(extra, (uint16_t)(subfield_length + 4));
+    extra[2] = DICTZIP_SI1;
+    extra[3] = DICTZIP_SI2;
+    gzip_write_le16(extra + 4, (uint16_t)subfield_length);
+    gzip_write_le16(extra + 6, DICTZIP_VERSION);
+    gzip_write_le16(extra + 8, (uint16_t)chunk_length);
+    gzip_write_le16(extra + 10, (uint16_t)chunk_count);
+    for (size_t i = 0; i < chunk_count; ++i)
+        gzip_write_le16(extra + DICTZIP_FIELD_LENGTH + 2 * i, (uint16_t)chunks[i].compressed_length);
+
+    return GZIP_MIN_HEADER_LENGTH + DICTZIP_FIELD_LENGTH + 2 * chunk_count;
+}
+
+static int assemble(const struct GzipCompressJob* job, const struct GzipCompressOptions* options, uint8_t* compressed, size_t* compressed_length, size_t compressed_max_length,
+                    struct GzipSeekIndex* index) {
+    const struct GzipCompressChunk* chunks = job->chunks;
+    size_t chunk_count = job->chunk_count;
+    bool bgzf = job->mode == GZIP_COMPRESS_BGZF;
+
+    /* Size everything first so nothing is written when it does not fit. */
+    size_t header_length = GZIP_MIN_HEADER_LENGTH + (options->extra_index ? DICTZIP_FIELD_LENGTH + 2 * chunk_count : 0);
+    size_t total = bgzf ? BGZF_HEADER_LENGTH + 2 + GZIP_TRAILER_LENGTH : header_length + GZIP_TRAILER_LENGTH;
+    for (size_t i = 0; i < chunk_count; ++i) {
+        if (bgzf && BGZF_HEADER_LENGTH + chunks[i].compressed_length + GZIP_TRAILER_LENGTH > BGZF_MAX_BLOCK_LENGTH)
+            return INFLATE_VALUE_NOT_ALLOWED;
+        if (options->extra_index && chunks[i].compressed_length > UINT16_MAX)
+            return INFLATE_NOT_INDEXABLE;
+        total += chunks[i].compressed_length + (bgzf ? BGZF_HEADER_LENGTH + GZIP_TRAILER_LENGTH : 0);
+    }
+    if (total > compressed_max_length)
+        return INFLATE_DECOMPRESSED_OVERFLOW;
+
+    if (index) {
+        index->points = malloc(chunk_count * sizeof(struct GzipSeekPoint));
+        if (!index->points)
+            return INFLATE_NO_MEMORY;
+        index->point_count = chunk_count;
+    }
+
+    uint8_t* next = compressed;
+    if (!bgzf)
+        next += write_member_header(compressed, options, chunks, chunk_count, job->chunk_length);
+
+    uint32_t crc = 0;
+    for (size_t i = 0; i < chunk_count; ++i) {
+        const struct GzipCompressChunk* chunk = &chunks[i];
+        size_t start = i * job->chunk_length;
+        size_t length = job->length - start < job->chunk_length ? job->length - start : job->chunk_length;
+
+        if (index)
+            index->points[i] = (struct GzipSeekPoint){ .compressed_offset = next - compressed, .decompressed_offset = start };
+
+        if (bgzf) {
+            static const uint8_t bgzf_header[BGZF_HEADER_LENGTH - 2] = {
+                GZIP_ID1, GZIP_ID2, GZIP_CM_DEFLATE, GZIP_FEXTRA, 0, 0, 0, 0, 0, GZIP_OS_UNKNOWN, 6, 0, BGZF_SI1, BGZF_SI2, BGZF_SLEN, 0
+            };
+            memcpy(next, bgzf_header, sizeof(bgzf_header));
+            next[8] = extra_flags(job->level);
+            gzip_write_le16(next + 16, (uint16_t)(BGZF_HEADER_LENGTH + chunk->compressed_length + GZIP_TRAILER_LENGTH - 1));
+            next += BGZF_HEADER_LENGTH;
+        }
+
+        memcpy(next, chunk->compressed, chunk->compressed_length);
+        next += chunk->compressed_length;
+
+        if (bgzf) {
+            gzip_write_le32(next, chunk->crc32);
+            gzip_write_le32(next + 4, (uint32_t)length);
+            next += GZIP_TRAILER_LENGTH;
+        } else {
+            crc = i ? crc32_merge(crc, chunk->crc32, length) : chunk->crc32;
+        }
+    }
+
+    if (bgzf) {
+        /* The end-of-file marker: an empty BGZF member. */
+        static const uint8_t bgzf_eof[BGZF_HEADER_LENGTH + 2 + GZIP_TRAILER_LENGTH] = {
+            GZIP_ID1, GZIP_ID2, GZIP_CM_DEFLATE, GZIP_FEXTRA, 0, 0, 0, 0, 0, GZIP_OS_UNKNOWN, 6, 0, BGZF_SI1, BGZF_SI2, BGZF_SLEN, 0, 27, 0, 3, 0
+        };
+        memcpy(next, bgzf_eof, sizeof(bgzf_eof));
+        next += sizeof(bgzf_eof);
+    } else {
+        gzip_write_le32(next, crc);
+        gzip_write_le32(next + 4, (uint32_t)job->length);
+        next += GZIP_TRAILER_LENGTH;
+    }
+
+    *compressed_length = next - compressed;
+
+    return INFLATE_SUCCESS;
+}
+
+static void* gzip_compress_worker(void* argument) {
+    struct GzipCompressJob* job = argument;
+
+    struct Deflator* deflator = deflator_alloc(job->level);
+    if (!deflator) {
+        atomic_store(&job->result, INFLATE_NO_MEMORY);
+        return NULL;
+    }
+
+    for (;;) {
+        if (atomic_load_explicit(&job->result, memory_order_relaxed))
+            break;
+        size_t index = atomic_fetch_add_explicit(&job->next_chunk, 1, memory_order_relaxed);
+        if (index >= job->chunk_count)
+            break;
+
+        struct GzipCompressChunk* chunk = &job->chunks[index];
+        size_t start = index * job->chunk_length;
+        size_t length = job->length - start < job->chunk_length ? job->length - start : job->chunk_length;
+        size_t dictionary_length = job->mode == GZIP_COMPRESS_DICTIONARY ? start : 0;
+        bool final = job->mode == GZIP_COMPRESS_BGZF || index == job->chunk_count - 1;
+
+        size_t bound = deflate_bound(length);
+        chunk->compressed = malloc(bound);
+        if (!chunk->compressed) {
+            atomic_store(&job->result, INFLATE_NO_MEMORY);
+            break;
+        }
+        chunk->compressed_length = deflate_chunk(deflator, job->data + start, dictionary_length, length, final, chunk->compressed, bound);
+        if (!chunk->compressed_length) {
+            /* Output of deflate_chunk() is never empty, nothing came out only when the chunk is too long. */
+            atomic_store(&job->result, INFLATE_VALUE_NOT_ALLOWED);
+            break;
+        }
+        chunk->crc32 = crc32_update(0, job->data + start, length);
+    }
+
+    deflator_free(deflator);
+
+    return NULL;
+}
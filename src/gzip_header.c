@@ -0,0 +1,78 @@
+#include "gzip_header.h"
+
+#include <stddef.h>
+#include <stdint.h>
+#include <string.h>
+
+#include "inflate.h"
+
+
+
+/* Skips a zero terminated field. Returns the offset after the terminator or 0 if it is missing. */
+static size_t skip_zero_terminated(const uint8_t* compressed, size_t offset, size_t compressed_length) {
+    const uint8_t* terminator = memchr(compressed + offset, 0, compressed_length - offset);
+    if (!terminator)
+        return 0;
+
+    return (size_t)(terminator - compressed) + 1;
+}
+
+int gzip_parse_header(const uint8_t* compressed, size_t compressed_length, struct GzipHeader* header) {
+    if (compressed_length < GZIP_MIN_HEADER_LENGTH)
+        return INFLATE_COMPRESSED_INCOMPLETE;
+    if (compressed[0] != GZIP_ID1 || compressed[1] != GZIP_ID2 || compressed[2] != GZIP_CM_DEFLATE)
+        return INFLATE_INVALID_HEADER;
+
+    header->flags = compressed[3];
+    header->block_length = 0;
+    if (header->flags & GZIP_FRESERVED)
+        return INFLATE_INVALID_HEADER;
+
+    /* MTIME, XFL and OS carry no information needed for decoding. */
+    size_t offset = GZIP_MIN_HEADER_LENGTH;
+
+    if (header->flags & GZIP_FEXTRA) {
+        if (compressed_length - offset < 2)
+            return INFLATE_COMPRESSED_INCOMPLETE;
+        size_t extra_length = compressed[offset] | (size_t)compressed[offset + 1] << 8;
+        offset += 2;
+        if (compressed_length - offset < extra_length)
+            return INFLATE_COMPRESSED_INCOMPLETE;
+
+        /* Walk the subfields looking for the BGZF block size. */
+        const uint8_t* subfield = compressed + offset;
+        const uint8_t* extra_end = subfield + extra_length;
+        while (extra_end - subfield >= 4) {
+            size_t subfield_length = subfield[2] | (size_t)subfield[3] << 8;
+            if ((size_t)(extra_end - subfield - 4) < subfield_length)
+                return INFLATE_INVALID_HEADER;
+
+            if (subfield[0] == BGZF_SI1 && subfield[1] == BGZF_SI2 && subfield_length == BGZF_SLEN)
+                header->block_length = (subfield[4] | (uint32_t)subfield[5] << 8) + 1;
+            subfield += 4 + subfield_length;
+        }
+        offset += extra_length;
+    }
+
+    if (header->flags & GZIP_FNAME) {
+        offset = skip_zero_terminated(compressed, offset, compressed_length);
+        if (!offset)
+            return INFLATE_COMPRESSED_INCOMPLETE;
+    }
+
+    if (header->flags & GZIP_FCOMMENT) {
+        offset = skip_zero_terminated(compressed, offset, compressed_length);
+        if (!offset)
+            return INFLATE_COMPRESSED_INCOMPLETE;
+    }
+
+    if (header->flags & GZIP_FHCRC) {
+        if (compressed_length - offset < 2)
+            return INFLATE_COMPRESSED_INCOMPLETE;
+        offset += 2;
+    }
+
+    header->header_length = offset;
+
+    return INFLATE_SUCCESS;
+}
@@ -0,0 +1,279 @@
+#include "gzip_members.h"
+
+#include <pthread.h>
+#include <stdatomic.h>
+#include <stdbool.h>
+#include <stdint.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+
+#include "crc32.h"
+#include "gzip_header.h"
+#include "inflate.h"
+#include "inflate_scan_internal.h"
+#include "inflate_stream.h"
+
+
+
+/* Number of members a worker claims at once. BGZF members hold at most 64 KiB, so this keeps the shared counter cold. */
+#define GZIP_MEMBERS_BATCH          8
+
+#define GZIP_MEMBERS_MAX_THREADS    256
+
+
+struct GzipMembersJob {
+    const uint8_t* compressed;
+    const struct GzipMemberIndex* index;
+    uint8_t* decompressed;
+
+    atomic_size_t next_member;
+    atomic_int result;
+};
+
+
+/*
+ * Finds the end of a member without BSIZE by walking its deflate stream. The
+ * stream state is allocated on first use and kept for the following members.
+ */
+static int scan_member(const uint8_t* compressed, size_t compressed_length, const struct GzipHeader* header, struct InflateStream** stream, size_t* member_length);
+
+/* Decompresses a single member into its final location and verifies its trailer. */
+static int decompress_member(const uint8_t* compressed, const struct GzipMember* member, uint8_t* decompressed);
+
+static void* gzip_members_worker(void* argument);
+
+
+extern int gzip_members_scan(const unsigned char* compressed, size_t compressed_length, struct GzipMemberIndex* index) {
+    *index = (struct GzipMemberIndex){ 0 };
+
+    if (!compressed || !compressed_length)
+        return INFLATE_COMPRESSED_INCOMPLETE;
+
+    struct InflateStream* stream = NULL;
+    bool bgzf = true;
+    size_t capacity = 0;
+    size_t offset = 0;
+    size_t decompressed_offset = 0;
+    int result = INFLATE_SUCCESS;
+    while (!result && offset < compressed_length) {
+        struct GzipHeader header;
+        result = gzip_parse_header(compressed + offset, compressed_length - offset, &header);
+        if (result)
+            break;
+
+        size_t member_length = header.block_length;
+        if (!member_length) {
+            bgzf = false;
+            result = scan_member(compressed + offset, compressed_length - offset, &header, &stream, &member_length);
+        } else if (member_length < header.header_length + GZIP_TRAILER_LENGTH) {
+            result = INFLATE_INVALID_HEADER;
+        } else if (member_length > compressed_length - offset) {
+            result = INFLATE_COMPRESSED_INCOMPLETE;
+        }
+        if (result)
+            break;
+
+        if (index->member_count == capacity) {
+            capacity = capacity ? 2 * capacity : 64;
+            struct GzipMember* members = realloc(index->members, capacity * sizeof(*members));
+            if (!members) {
+                result = INFLATE_NO_MEMORY;
+                break;
+            }
+            index->members = members;
+        }
+
+        const uint8_t* trailer = compressed + offset + member_length - GZIP_TRAILER_LENGTH;
+        struct GzipMember* member = &index->members[index->member_count];
+        member->compressed_offset = offset;
+        member->deflate_offset = offset + header.header_length;
+        member->deflate_length = member_length - header.header_length - GZIP_TRAILER_LENGTH;
+        member->decompressed_offset = decompressed_offset;
+        member->crc32 = gzip_read_le32(trailer);
+        member->decompressed_length = gzip_read_le32(trailer + 4);
+        ++index->member_count;
+
+        decompressed_offset += member->decompressed_length;
+        offset += member_length;
+    }
+    free(stream);
+
+    if (result) {
+        gzip_members_free(index);
+        return result;
+    }
+
+    index->decompressed_length = decompressed_offset;
+    index->bgzf = bgzf;
+
+    return INFLATE_SUCCESS;
+}
+
+extern int gzip_members_decompress(const unsigned char* compressed, const struct GzipMemberIndex* index, unsigned char* decompressed, size_t decompressed_max_length, unsigned thread_count) {
+    if (!decompressed)
+        return INFLATE_NO_OUTPUT;
+    if (index->decompressed_length > decompressed_max_length)
+        return INFLATE_DECOMPRESSED_OVERFLOW;
+
+    if (!thread_count) {
+        long online = sysconf(_SC_NPROCESSORS_ONLN);
+        thread_count = online > 0 ? (unsigned)online : 1;
+    }
+    if (thread_count > GZIP_MEMBERS_MAX_THREADS)
+        thread_count = GZIP_MEMBERS_MAX_THREADS;
+    size_t batch_count = (index->member_count + GZIP_MEMBERS_BATCH - 1) / GZIP_MEMBERS_BATCH;
+    if (thread_count > batch_count)
+        thread_count = batch_count ? (unsigned)batch_count : 1;
+
+    struct GzipMembersJob job = {
+        .compressed = compressed,
+        .index = index,
+        .decompressed = decompressed,
+    };
+    atomic_init(&job.next_member, 0);
+    atomic_init(&job.result, INFLATE_SUCCESS);
+
+    /* The calling thread works as well, so only thread_count - 1 helpers are started. */
+    pthread_t threads[GZIP_MEMBERS_MAX_THREADS];
+    unsigned started = 0;
+    for (; started < thread_count - 1; ++started) {
+        if (pthread_create(&threads[started], NULL, gzip_members_worker, &job))
+            break;
+    }
+
+    gzip_members_worker(&job);
+
+    for (unsigned i = 0; i < started; ++i)
+        pthread_join(threads[i], NULL);
+
+    return atomic_load(&job.result);
+}
+
+extern int gzip_members_read_virtual(const unsigned char* compressed, const struct GzipMemberIndex* index, uint64_t virtual_offset, unsigned char* decompressed, size_t* decompressed_length, size_t decompressed_max_length) {
+    *decompressed_length = 0;
+
+    if (!decompressed)
+        return INFLATE_NO_OUTPUT;
+
+    size_t compressed_offset = virtual_offset >> 16;
+    size_t member_offset = virtual_offset & 0xFFFF;
+
+    /* Binary search for the member starting at compressed_offset. */
+    size_t low = 0;
+    size_t high = index->member_count;
+    while (low < high) {
+        size_t middle = low + (high - low) / 2;
+        if (index->members[middle].compressed_offset < compressed_offset)
+            low = middle + 1;
+        else
+            high = middle;
+    }
+    if (low == index->member_count || index->members[low].compressed_offset != compressed_offset)
+        return INFLATE_VALUE_NOT_ALLOWED;
+
+    const struct GzipMember* member = &index->members[low];
+    if (member_offset > member->decompressed_length)
+        return INFLATE_VALUE_NOT_ALLOWED;
+
+    size_t length = member->decompressed_length - member_offset;
+    if (length > decompressed_max_length)
+        length = decompressed_max_length;
+
+    /* Decode in place when the caller wants the whole member, otherwise go through a scratch buffer. */
+    if (!member_offset && length == member->decompressed_length) {
+        int result = decompress_member(compressed, member, decompressed);
+        if (!result)
+            *decompressed_length = length;
+        return result;
+    }
+
+    uint8_t* scratch = malloc(member->decompressed_length ? member->decompressed_length : 1);
+    if (!scratch)
+        return INFLATE_NO_MEMORY;
+
+    int result = decompress_member(compressed, member, scratch);
+    if (!result) {
+        memcpy(decompressed, scratch + member_offset, length);
+        *decompressed_length = length;
+    }
+    free(scratch);
+
+    return result;
+}
+
+extern void gzip_members_free(struct GzipMemberIndex* index) {
+    free(index->members);
+    *index = (struct GzipMemberIndex){ 0 };
+}
+
+
+
+static int scan_member(const uint8_t* compressed, size_t compressed_length, const struct GzipHeader* header, struct InflateStream** stream, size_t* member_length) {
+    if (!*stream) {
+        *stream = malloc(sizeof(struct InflateStream));
+        if (!*stream)
+            return INFLATE_NO_MEMORY;
+    }
+
+    size_t decompressed_length = 0;
+    inflate_stream_init(*stream, compressed + header->header_length, compressed_length - header->header_length, NULL, 0);
+    int result = inflate_scan_count(*stream, &decompressed_length);
+    if (result)
+        return result;
+
+    size_t length = inflate_stream_compressed_end(*stream) - compressed + GZIP_TRAILER_LENGTH;
+    if (length > compressed_length)
+        return INFLATE_COMPRESSED_INCOMPLETE;
+    /* ISIZE is all the index keeps of the length, so it has to be exact. */
+    if (decompressed_length > UINT32_MAX)
+        return INFLATE_NOT_INDEXABLE;
+    if (gzip_read_le32(compressed + length - GZIP_TRAILER_LENGTH + 4) != decompressed_length)
+        return INFLATE_CHECKSUM_MISMATCH;
+
+    *member_length = length;
+
+    return INFLATE_SUCCESS;
+}
+
+static int decompress_member(const uint8_t* compressed, const struct GzipMember* member, uint8_t* decompressed) {
+    size_t decompressed_length = 0;
+    int result = tinflate(compressed + member->deflate_offset, member->deflate_length, decompressed, &decompressed_length, member->decompressed_length);
+    if (result)
+        return result;
+
+    if (decompressed_length != member->decompressed_length)
+        return INFLATE_CHECKSUM_MISMATCH;
+    if (crc32_update(0, decompressed, decompressed_length) != member->crc32)
+        return INFLATE_CHECKSUM_MISMATCH;
+
+    return INFLATE_SUCCESS;
+}
+
+static void* gzip_members_worker(void* argument) {
+    struct GzipMembersJob* job = argument;
+    const struct GzipMemberIndex* index = job->index;
+
+    for (;;) {
+        size_t first = atomic_fetch_add_explicit(&job->next_member, GZIP_MEMBERS_BATCH, memory_order_relaxed);
+        if (first >= index->member_count)
+            break;
+        size_t last = first + GZIP_MEMBERS_BATCH < index->member_count ? first + GZIP_MEMBERS_BATCH : index->member_count;
+
+        for (size_t i = first; i < last; ++i) {
+            /* Another worker failed, the output is unusable anyway. */
+            if (atomic_load_explicit(&job->result, memory_order_relaxed))
+                return NULL;
+
+            const struct GzipMember* member = &index->members[i];
+            int result = decompress_member(job->compressed, member, job->decompressed + member->decompressed_offset);
+            if (result) {
+                int expected = INFLATE_SUCCESS;
+                atomic_compare_exchange_strong(&job->result, &expected, result);
+                return NULL;
+            }
+        }
+    }
+
+    return NULL;
+}
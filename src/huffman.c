@@ -37,19 +37,6 @@ static const uint32_t code_length_decode[] = {
 };
 
 
-/* Indicates a literal entry in the literal table. */
-#define HUFFMAN_LITERAL             0x80000000
-
-/* Indicates that HUFFMAN_SUBTABLE_POINTER or HUFFMAN_END_OF_BLOCK */
-#define HUFFMAN_EXCEPTIONAL         0x00008000
-
-/* Indicates a subtable pointer entry in the literal or distance table. */
-#define HUFFMAN_SUBTABLE_POINTER    0x00004000
-
-/* Indicates end-of-block entry in the literal table. */
-#define HUFFMAN_END_OF_BLOCK        0x00002000
-
-
 /*
  * Here is the format of the literal table entries. Bits not explicitly
  * described contain zeroes:
@@ -77,6 +64,14 @@ static const uint32_t code_length_decode[] = {
  *		Bit 13:     1 (HUFFMAN_END_OF_BLOCK)
  *		Bit 11-8:   remaining codeword length [not used]
  *		Bit 3-0:    remaining codeword length
+ *	Invalid (286, 287):
+ *		Bit 31:     0 (!HUFFMAN_LITERAL)
+ *		Bit 15:     1 (HUFFMAN_EXCEPTIONAL)
+ *		Bit 14:     0 (!HUFFMAN_SUBTABLE_POINTER)
+ *		Bit 13:     0 (!HUFFMAN_END_OF_BLOCK)
+ *		Bit 12:     1 (HUFFMAN_INVALID)
+ *		Bit 11-8:   remaining codeword length [not used]
+ *		Bit 3-0:    remaining codeword length
  *	Subtable pointer:
  *		Bit 31:     0 (!HUFFMAN_LITERAL)
  *		Bit 30-16:  index of start of subtable
@@ -170,7 +165,11 @@ static const uint32_t literal_decode[] = {
         ENTRY(35, 3),   ENTRY(43, 3),   ENTRY(51, 3),   ENTRY(59, 3),
         ENTRY(67, 4),   ENTRY(83, 4),   ENTRY(99, 4),   ENTRY(115, 4),
         ENTRY(131, 5),  ENTRY(163, 5),  ENTRY(195, 5),  ENTRY(227, 5),
-        ENTRY(258, 0),  ENTRY(258, 0),  ENTRY(258, 0),
+        ENTRY(258, 0),
+#undef ENTRY
+
+        /* Reserved. */
+        HUFFMAN_EXCEPTIONAL | HUFFMAN_INVALID,      HUFFMAN_EXCEPTIONAL | HUFFMAN_INVALID,
 };
 
 
@@ -184,6 +183,10 @@ static const uint32_t literal_decode[] = {
  *		Bit 14:     0 (!HUFFMAN_SUBTABLE_POINTER)
  *		Bit 11-8:   remaining codeword length
  *		Bit 4-0:    remaining codeword length + number of extra bits
+ *	Invalid (30, 31):
+ *		Bit 12:     1 (HUFFMAN_INVALID)
+ *		Bit 11-8:   remaining codeword length [not used]
+ *		Bit 3-0:    remaining codeword length
  *	Subtable pointer:
  *		Bit 31-16:  index of start of subtable
  *		Bit 15:     1 (HUFFMAN_EXCEPTIONAL)
@@ -199,14 +202,17 @@ static const uint32_t literal_decode[] = {
 static const uint32_t distance_decode[] = {
 #define ENTRY(distance_base, distance_extra_bits)   (((uint32_t)(distance_base) << 16) | (distance_extra_bits))
         ENTRY(1, 0),        ENTRY(2, 0),        ENTRY(3, 0),        ENTRY(4, 0),
-        ENTRY(5, 1),        ENTRY(7, 1),        ENTRY(9, 2),        ENTRY(12, 2),
+        ENTRY(5, 1),        ENTRY(7, 1),        ENTRY(9, 2),        ENTRY(13, 2),
         ENTRY(17, 3),       ENTRY(25, 3),       ENTRY(33, 4),       ENTRY(49, 4),
         ENTRY(65, 5),       ENTRY(97, 5),       ENTRY(129, 6),      ENTRY(193, 6),
         ENTRY(257, 7),      ENTRY(385, 7),      ENTRY(513, 8),      ENTRY(769, 8),
         ENTRY(1025, 9),     ENTRY(1537, 9),     ENTRY(2049, 10),    ENTRY(3073, 10),
         ENTRY(4097, 11),    ENTRY(6145, 11),    ENTRY(8193, 12),    ENTRY(12289, 12),
-        ENTRY(16385, 13),   ENTRY(24577, 13),   ENTRY(24577, 13),   ENTRY(24577, 13),
+        ENTRY(16385, 13),   ENTRY(24577, 13),
 #undef ENTRY
+
+        /* Reserved. */
+        HUFFMAN_INVALID,    HUFFMAN_INVALID,
 };
 
 
@@ -341,14 +347,14 @@ static int build_huffman_table(uint32_t table[], const uint8_t code_lengths[], c
         if (code == (1U << length) - 1)
             return INFLATE_SUCCESS;
 
-        unsigned bit_scan_reversed = (code ^ (current_table_end - 1)) >> 1;
-        unsigned i = 0;
+        unsigned bit_scan_reversed = (code ^ ((1U << length) - 1)) >> 1;
+        unsigned bit_index = 0;
         while (bit_scan_reversed) {
-            ++i;
+            ++bit_index;
             bit_scan_reversed >>= 1;
         }
 
-        unsigned bit = 1U << i;
+        unsigned bit = 1U << bit_index;
         code &= bit - 1;
         code |= bit;
 
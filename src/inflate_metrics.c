@@ -0,0 +1,431 @@
+#if defined(__linux__)
+#define _GNU_SOURCE     // RUSAGE_THREAD
+#endif
+
+#include "inflate_metrics.h"
+
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+#include <string.h>
+
+#include "inflate.h"
+#include "inflate_metrics_internal.h"
+
+#if defined(INFLATE_METRICS)
+#include <stdatomic.h>
+#include <stdlib.h>
+#include <sys/resource.h>
+#include <time.h>
+
+#include "inflate_stream.h"
+#endif
+
+
+
+#if defined(INFLATE_METRICS)
+
+/* A histogram only its thread writes. Plain loads and stores suffice; they are atomic so that snapshots never see torn values. */
+struct MetricsHistogram {
+    atomic_uint_least64_t count;
+    atomic_uint_least64_t sum;
+    atomic_uint_least64_t min;
+    atomic_uint_least64_t max;
+    atomic_uint_least64_t buckets[INFLATE_HISTOGRAM_BUCKET_COUNT];
+};
+
+/* The histograms of one entry point and result, allocated when first needed. */
+struct MetricsSet {
+    struct MetricsHistogram latency;
+    struct MetricsHistogram compressed;
+    struct MetricsHistogram decompressed;
+};
+
+/* Per thread state. Never freed: a thread releasing it hands its counts on to the next one to take it. */
+struct MetricsThread {
+    _Atomic(struct MetricsSet*) sets[INFLATE_METRICS_ENTRY_COUNT][INFLATE_METRICS_RESULT_COUNT];
+    atomic_bool in_use;
+    struct MetricsThread* next;
+
+    unsigned sample_countdown;
+    bool tracing;                       // The current call is traced.
+    long page_faults;                   // At the start of the traced call.
+    struct InflateTrace trace;
+};
+
+/* A trace is being written while version is odd. */
+struct TraceSlot {
+    atomic_uint_least64_t version;
+    struct InflateTrace trace;
+};
+
+
+atomic_bool inflate_metrics_enabled;
+
+static atomic_uint_least64_t trace_threshold;
+static atomic_uint trace_sample;
+
+static _Atomic(struct MetricsThread*) metrics_threads;
+static _Thread_local struct MetricsThread* metrics_thread;
+
+static struct TraceSlot trace_ring[INFLATE_TRACE_RING_LENGTH];
+static atomic_uint_least64_t trace_count;
+
+
+/* The calling thread's state, taken over from a released thread or allocated. NULL without memory. */
+static struct MetricsThread* thread_state(void);
+
+static void record(struct MetricsHistogram* histogram, uint64_t value);
+
+static void load(struct InflateHistogram* destination, const struct MetricsHistogram* source);
+
+/* Copies the calling thread's finished trace into the ring. */
+static void publish_trace(const struct InflateTrace* trace);
+
+static unsigned bucket_index(uint64_t value);
+
+static inline unsigned highest_bit(uint64_t value) {
+    return 63 - (unsigned)__builtin_clzll(value);
+}
+
+static inline uint64_t now(void) {
+    struct timespec time;
+    clock_gettime(CLOCK_MONOTONIC, &time);
+    return (uint64_t)time.tv_sec * 1000000000 + (uint64_t)time.tv_nsec;
+}
+
+static inline long page_faults(void) {
+#if defined(RUSAGE_THREAD)
+    struct rusage usage;
+    if (!getrusage(RUSAGE_THREAD, &usage))
+        return usage.ru_minflt + usage.ru_majflt;
+#endif
+    return -1;
+}
+
+#endif
+
+
+extern int inflate_metrics_configure(const struct InflateMetricsOptions* options) {
+#if defined(INFLATE_METRICS)
+    if (!options) {
+        atomic_store(&inflate_metrics_enabled, false);
+        return INFLATE_SUCCESS;
+    }
+
+    atomic_store(&trace_threshold, options->trace_threshold);
+    atomic_store(&trace_sample, options->trace_sample ? options->trace_sample : 1);
+    atomic_store(&inflate_metrics_enabled, options->enabled);
+
+    return INFLATE_SUCCESS;
+#else
+    return options && options->enabled ? INFLATE_VALUE_NOT_ALLOWED : INFLATE_SUCCESS;
+#endif
+}
+
+extern void inflate_metrics_snapshot(struct InflateMetricsSnapshot* snapshot) {
+    memset(snapshot, 0, sizeof(struct InflateMetricsSnapshot));
+
+#if defined(INFLATE_METRICS)
+    for (struct MetricsThread* thread = atomic_load(&metrics_threads); thread; thread = thread->next) {
+        for (unsigned entry = 0; entry < INFLATE_METRICS_ENTRY_COUNT; ++entry) {
+            for (unsigned result = 0; result < INFLATE_METRICS_RESULT_COUNT; ++result) {
+                const struct MetricsSet* set = atomic_load_explicit(&thread->sets[entry][result], memory_order_acquire);
+                if (!set)
+                    continue;
+
+                struct InflateHistogram histogram;
+                load(&histogram, &set->latency);
+                inflate_histogram_merge(&snapshot->latency[entry][result], &histogram);
+                load(&histogram, &set->compressed);
+                inflate_histogram_merge(&snapshot->compressed[entry][result], &histogram);
+                load(&histogram, &set->decompressed);
+                inflate_histogram_merge(&snapshot->decompressed[entry][result], &histogram);
+            }
+        }
+    }
+#endif
+}
+
+extern void inflate_metrics_merge(struct InflateMetricsSnapshot* destination, const struct InflateMetricsSnapshot* source) {
+    for (unsigned entry = 0; entry < INFLATE_METRICS_ENTRY_COUNT; ++entry) {
+        for (unsigned result = 0; result < INFLATE_METRICS_RESULT_COUNT; ++result) {
+            inflate_histogram_merge(&destination->latency[entry][result], &source->latency[entry][result]);
+            inflate_histogram_merge(&destination->compressed[entry][result], &source->compressed[entry][result]);
+            inflate_histogram_merge(&destination->decompressed[entry][result], &source->decompressed[entry][result]);
+        }
+    }
+}
+
+extern void inflate_histogram_merge(struct InflateHistogram* destination, const struct InflateHistogram* source) {
+    if (!source->count)
+        return;
+
+    if (!destination->count || source->min < destination->min)
+        destination->min = source->min;
+    if (source->max > destination->max)
+        destination->max = source->max;
+    destination->count += source->count;
+    destination->sum += source->sum;
+    for (unsigned i = 0; i < INFLATE_HISTOGRAM_BUCKET_COUNT; ++i)
+        destination->buckets[i] += source->buckets[i];
+}
+
+extern uint64_t inflate_histogram_quantile(const struct InflateHistogram* histogram, double quantile) {
+    if (!histogram->count)
+        return 0;
+    if (quantile <= 0)
+        return histogram->min;
+    if (quantile >= 1)
+        return histogram->max;
+
+    /* The rank-th smallest value, counting from 1: rank = ceil(quantile * count). */
+    double position = quantile * (double)histogram->count;
+    uint64_t rank = (uint64_t)position;
+    if (rank < position || !rank)
+        ++rank;
+    uint64_t seen = 0;
+    for (unsigned i = 0; i < INFLATE_HISTOGRAM_BUCKET_COUNT; ++i) {
+        seen += histogram->buckets[i];
+        if (seen >= rank) {
+            uint64_t value = inflate_histogram_bucket_value(i);
+            return value < histogram->min ? histogram->min : value;
+        }
+    }
+
+    return histogram->max;
+}
+
+extern uint64_t inflate_histogram_bucket_value(unsigned bucket) {
+    const unsigned sub_buckets = 1u << INFLATE_HISTOGRAM_SUB_BUCKET_BITS;
+
+    if (bucket < 2 * sub_buckets)
+        return bucket;
+    unsigned shift = bucket / sub_buckets - 1;
+    return (uint64_t)(sub_buckets + bucket % sub_buckets) << shift;
+}
+
+extern size_t inflate_metrics_traces(struct InflateTrace* traces, size_t max_count) {
+    size_t count = 0;
+
+#if defined(INFLATE_METRICS)
+    uint64_t end = atomic_load_explicit(&trace_count, memory_order_acquire);
+    uint64_t sequence = end > INFLATE_TRACE_RING_LENGTH ? end - INFLATE_TRACE_RING_LENGTH : 0;
+    for (; sequence < end && count < max_count; ++sequence) {
+        struct TraceSlot* slot = &trace_ring[sequence % INFLATE_TRACE_RING_LENGTH];
+        uint64_t version = atomic_load_explicit(&slot->version, memory_order_acquire);
+        if (version != 2 * sequence + 2)
+            continue;
+        /* A seqlock: the copy may race with a writer reusing the slot, in which case version has moved on and the copy is dropped. */
+        memcpy(&traces[count], &slot->trace, sizeof(struct InflateTrace));
+        atomic_thread_fence(memory_order_acquire);
+        if (atomic_load_explicit(&slot->version, memory_order_relaxed) == version)
+            ++count;
+    }
+#else
+    (void)traces;
+    (void)max_count;
+#endif
+
+    return count;
+}
+
+extern void inflate_metrics_release_thread(void) {
+#if defined(INFLATE_METRICS)
+    if (!metrics_thread)
+        return;
+    atomic_store_explicit(&metrics_thread->in_use, false, memory_order_release);
+    metrics_thread = NULL;
+#endif
+}
+
+
+
+#if defined(INFLATE_METRICS)
+
+void inflate_metrics_begin(struct InflateMetricsCall* call) {
+    struct MetricsThread* thread = thread_state();
+    if (!thread)
+        return;
+
+    uint64_t threshold = atomic_load_explicit(&trace_threshold, memory_order_relaxed);
+    if (threshold && !thread->sample_countdown--) {
+        thread->sample_countdown = atomic_load_explicit(&trace_sample, memory_order_relaxed) - 1;
+        thread->tracing = true;
+        thread->trace.block_count = 0;
+        memset(thread->trace.phase_time, 0, sizeof(thread->trace.phase_time));
+        thread->page_faults = page_faults();
+    }
+
+    call->start = now();
+}
+
+void inflate_metrics_end(struct InflateMetricsCall* call, enum InflateMetricsEntry entry, int result, size_t compressed_length, size_t decompressed_length) {
+    uint64_t latency = now() - call->start;
+    struct MetricsThread* thread = metrics_thread;
+    if (result < 0 || result >= INFLATE_METRICS_RESULT_COUNT)
+        return;
+
+    struct MetricsSet* set = atomic_load_explicit(&thread->sets[entry][result], memory_order_relaxed);
+    if (!set) {
+        set = calloc(1, sizeof(struct MetricsSet));
+        atomic_store_explicit(&thread->sets[entry][result], set, memory_order_release);
+    }
+    if (set) {
+        record(&set->latency, latency);
+        record(&set->compressed, compressed_length);
+        record(&set->decompressed, decompressed_length);
+    }
+
+    if (thread->tracing) {
+        thread->tracing = false;
+        if (latency >= atomic_load_explicit(&trace_threshold, memory_order_relaxed)) {
+            struct InflateTrace* trace = &thread->trace;
+            trace->entry = entry;
+            trace->result = result;
+            trace->latency = latency;
+            trace->compressed_length = compressed_length;
+            trace->decompressed_length = decompressed_length;
+            long faults = page_faults();
+            trace->page_faults = faults < 0 || thread->page_faults < 0 ? -1 : faults - thread->page_faults;
+            publish_trace(trace);
+        }
+    }
+}
+
+int inflate_metrics_decode(struct InflateStream* stream) {
+    struct MetricsThread* thread = metrics_thread;
+    if (!thread || !thread->tracing)
+        return inflate_stream_decode(stream);
+
+    struct InflateTrace* trace = &thread->trace;
+    const uint8_t* compressed = stream->cursor.compressed_next;
+    struct InflateTraceBlock* block = NULL;
+    struct InflateTraceBlock overflow;    // Stands in for blocks past INFLATE_TRACE_MAX_BLOCKS.
+
+    for (;;) {
+        if (stream->state == INFLATE_STREAM_DONE)
+            return INFLATE_SUCCESS;
+
+        size_t bits = (size_t)(stream->cursor.compressed_next - compressed) * 8 - stream->cursor.buffer_count;
+        uint8_t* decompressed = stream->cursor.decompressed_next;
+        uint64_t start = now();
+        int result;
+        if (stream->state == INFLATE_STREAM_BLOCK_HEADER) {
+            result = inflate_stream_block_header(stream);
+            uint64_t elapsed = now() - start;
+            trace->phase_time[INFLATE_TRACE_HEADERS] += elapsed;
+            if (result)
+                return result;
+
+            block = trace->block_count < INFLATE_TRACE_MAX_BLOCKS ? &trace->blocks[trace->block_count] : &overflow;
+            ++trace->block_count;
+            *block = (struct InflateTraceBlock){
+                .type = stream->state == INFLATE_STREAM_STORED ? INFLATE_BLOCKTYPE_UNCOMPRESSED
+                        : stream->inflator.static_table_loaded ? INFLATE_BLOCKTYPE_STATIC_HUFFMAN
+                                                               : INFLATE_BLOCKTYPE_DYNAMIC_HUFFMAN,
+                .final = stream->final_block,
+                .header_time = elapsed,
+            };
+        } else {
+            result = inflate_stream_decode_block(stream);
+            uint64_t elapsed = now() - start;
+            trace->phase_time[INFLATE_TRACE_DATA] += elapsed;
+            if (!block)
+                block = &overflow;
+            block->data_time += elapsed;
+            block->decompressed_length += (uint32_t)(stream->cursor.decompressed_next - decompressed);
+        }
+
+        if (block) {
+            size_t used = (size_t)(stream->cursor.compressed_next - compressed) * 8 - stream->cursor.buffer_count;
+            block->compressed_length += (uint32_t)((used >> 3) - (bits >> 3));
+        }
+        if (result)
+            return result;
+    }
+}
+
+uint64_t inflate_metrics_phase_start(void) {
+    struct MetricsThread* thread = metrics_thread;
+    return thread && thread->tracing ? now() : 0;
+}
+
+void inflate_metrics_phase_end(enum InflateTracePhase phase, uint64_t start) {
+    if (start)
+        metrics_thread->trace.phase_time[phase] += now() - start;
+}
+
+
+
+static struct MetricsThread* thread_state(void) {
+    if (metrics_thread)
+        return metrics_thread;
+
+    struct MetricsThread* thread = atomic_load(&metrics_threads);
+    for (; thread; thread = thread->next) {
+        bool expected = false;
+        if (!atomic_load_explicit(&thread->in_use, memory_order_relaxed) && atomic_compare_exchange_strong(&thread->in_use, &expected, true))
+            break;
+    }
+
+    if (!thread) {
+        thread = calloc(1, sizeof(struct MetricsThread));
+        if (!thread)
+            return NULL;
+        atomic_init(&thread->in_use, true);
+        thread->next = atomic_load(&metrics_threads);
+        while (!atomic_compare_exchange_weak(&metrics_threads, &thread->next, thread))
+            ;
+    }
+
+    thread->tracing = false;
+    metrics_thread = thread;
+    return thread;
+}
+
+static void record(struct MetricsHistogram* histogram, uint64_t value) {
+    uint64_t count = atomic_load_explicit(&histogram->count, memory_order_relaxed);
+    atomic_uint_least64_t* bucket = &histogram->buckets[bucket_index(value)];
+
+    atomic_store_explicit(bucket, atomic_load_explicit(bucket, memory_order_relaxed) + 1, memory_order_relaxed);
+    atomic_store_explicit(&histogram->sum, atomic_load_explicit(&histogram->sum, memory_order_relaxed) + value, memory_order_relaxed);
+    if (!count || value < atomic_load_explicit(&histogram->min, memory_order_relaxed))
+        atomic_store_explicit(&histogram->min, value, memory_order_relaxed);
+    if (value > atomic_load_explicit(&histogram->max, memory_order_relaxed))
+        atomic_store_explicit(&histogram->max, value, memory_order_relaxed);
+    /* Last, so that a snapshot seeing the count also sees min. */
+    atomic_store_explicit(&histogram->count, count + 1, memory_order_release);
+}
+
+static void load(struct InflateHistogram* destination, const struct MetricsHistogram* source) {
+    destination->count = atomic_load_explicit(&source->count, memory_order_acquire);
+    destination->sum = atomic_load_explicit(&source->sum, memory_order_relaxed);
+    destination->min = atomic_load_explicit(&source->min, memory_order_relaxed);
+    destination->max = atomic_load_explicit(&source->max, memory_order_relaxed);
+    for (unsigned i = 0; i < INFLATE_HISTOGRAM_BUCKET_COUNT; ++i)
+        destination->buckets[i] = atomic_load_explicit(&source->buckets[i], memory_order_relaxed);
+}
+
+static void publish_trace(const struct InflateTrace* trace) {
+    uint64_t sequence = atomic_fetch_add_explicit(&trace_count, 1, memory_order_relaxed);
+    struct TraceSlot* slot = &trace_ring[sequence % INFLATE_TRACE_RING_LENGTH];
+
+    atomic_store_explicit(&slot->version, 2 * sequence + 1, memory_order_relaxed);
+    atomic_thread_fence(memory_order_release);
+    unsigned block_count = trace->block_count < INFLATE_TRACE_MAX_BLOCKS ? trace->block_count : INFLATE_TRACE_MAX_BLOCKS;
+    memcpy(&slot->trace, trace, offsetof(struct InflateTrace, blocks) + block_count * sizeof(struct InflateTraceBlock));
+    slot->trace.sequence = sequence;
+    atomic_store_explicit(&slot->version, 2 * sequence + 2, memory_order_release);
+}
+
+static unsigned bucket_index(uint64_t value) {
+    const unsigned sub_buckets = 1u << INFLATE_HISTOGRAM_SUB_BUCKET_BITS;
+
+    if (value < 2 * sub_buckets)
+        return (unsigned)value;
+    unsigned shift = highest_bit(value) - INFLATE_HISTOGRAM_SUB_BUCKET_BITS;
+    return (shift + 1) * sub_buckets + (unsigned)(value >> shift) % sub_buckets;
+}
+
+#endif
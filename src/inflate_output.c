@@ -0,0 +1,345 @@
+#if defined(__linux__)
+#define _GNU_SOURCE     // MAP_HUGETLB, MADV_HUGEPAGE, MADV_POPULATE_WRITE
+#endif
+
+#include "inflate_output.h"
+
+#include <pthread.h>
+#include <sched.h>
+#include <stdatomic.h>
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+#include <stdlib.h>
+#include <string.h>
+
+#if defined(__unix__)
+#include <sys/mman.h>
+#include <unistd.h>
+#endif
+
+#include "inflate.h"
+#include "inflate_internal.h"
+#include "inflate_stream.h"
+
+
+
+/* Size of the huge pages asked for; systems whose default differs fall back to transparent huge pages. */
+#define HUGE_PAGE_LENGTH        (2 << 20)
+
+/* The decoder and the prefault thread divide the output between them in chunks of this many bytes. */
+#define CHUNK_LENGTH            (2 << 20)
+
+
+/*
+ * Chunks below next_chunk are taken, either by the decoder, which then faults
+ * them in itself as it writes, or by the helper. When the helper can only
+ * fault pages in by writing to them, the decoder must not write to a chunk
+ * before the helper is done with it; the helper finishes its chunks in order
+ * and touched is one past the last one done.
+ */
+struct Prefault {
+    struct InflateOutput* output;
+    size_t chunk_count;
+    size_t distance;                    // In chunks.
+    bool touch_writes;                  // MADV_POPULATE_WRITE is not available.
+    size_t touch_stride;                // Small pages, even under transparent huge pages which may not materialise.
+
+    atomic_size_t next_chunk;
+    atomic_size_t touched;
+    size_t claimed;                     // The decoder's: end of the chunks it may write to.
+
+    pthread_mutex_t lock;
+    pthread_cond_t progress;
+    atomic_size_t decoder_chunk;        // Chunk the decoder writes to; the helper stays within distance of it.
+    bool stop;
+
+    pthread_t thread;
+    bool running;
+};
+
+
+/* Decodes into output, calling sink (if not NULL) after every chunk. */
+static int decode(const uint8_t* compressed, size_t compressed_length, struct InflateOutput* output, InflateOutputSink sink, void* context, size_t* decompressed_length);
+
+/* Starts the helper thread if output asks for prefaulting. Decoding goes ahead without it if it cannot be started. */
+static void prefault_start(struct Prefault* prefault, struct InflateOutput* output);
+
+static void prefault_stop(struct Prefault* prefault);
+
+/* Lets the decoder write up to chunk_end, waiting for the helper to finish any chunk below it that it is still writing to. */
+static void prefault_claim(struct Prefault* prefault, size_t chunk_end);
+
+static void* prefault_thread(void* argument);
+
+/* Faults in the pages of [bytes, bytes + length), without changing their contents unless touch_writes. */
+static bool populate(const struct Prefault* prefault, uint8_t* bytes, size_t length, bool touch_writes);
+
+
+static inline size_t round_up(size_t value, size_t multiple) {
+    return (value + multiple - 1) / multiple * multiple;
+}
+
+
+extern int inflate_output_create(size_t length, const struct InflateOutputOptions* options, struct InflateOutput* output) {
+    *output = (struct InflateOutput){
+        .length = length,
+        .pages = INFLATE_OUTPUT_SMALL_PAGES,
+    };
+    if (options)
+        output->options = *options;
+    if (!output->options.prefault_distance)
+        output->options.prefault_distance = INFLATE_OUTPUT_DEFAULT_PREFAULT;
+
+#if defined(__unix__)
+    size_t page_length = (size_t)sysconf(_SC_PAGESIZE);
+    if (!length)
+        length = 1;
+
+#if defined(MAP_HUGETLB)
+    if (output->options.huge_pages) {
+        size_t mapping_length = round_up(length, HUGE_PAGE_LENGTH);
+        void* mapping = mmap(NULL, mapping_length, PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANONYMOUS | MAP_HUGETLB, -1, 0);
+        if (mapping != MAP_FAILED) {
+            output->bytes = mapping;
+            output->pages = INFLATE_OUTPUT_HUGETLB;
+            output->page_length = HUGE_PAGE_LENGTH;
+            output->mapping = mapping;
+            output->mapping_length = mapping_length;
+            return INFLATE_SUCCESS;
+        }
+    }
+#endif
+
+    /* With transparent huge pages, one huge page extra lets the buffer start on a huge page boundary. */
+    size_t alignment = output->options.huge_pages ? HUGE_PAGE_LENGTH : page_length;
+    size_t mapping_length = round_up(length, alignment) + (alignment > page_length ? alignment : 0);
+    void* mapping = mmap(NULL, mapping_length, PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+    if (mapping != MAP_FAILED) {
+        output->bytes = (unsigned char*)round_up((uintptr_t)mapping, alignment);
+        output->page_length = page_length;
+        output->mapping = mapping;
+        output->mapping_length = mapping_length;
+#if defined(MADV_HUGEPAGE)
+        if (output->options.huge_pages && !madvise(output->bytes, round_up(length, HUGE_PAGE_LENGTH), MADV_HUGEPAGE)) {
+            output->pages = INFLATE_OUTPUT_TRANSPARENT_HUGE;
+            /* Releasing less would split huge pages. */
+            output->page_length = HUGE_PAGE_LENGTH;
+        }
+#endif
+        return INFLATE_SUCCESS;
+    }
+#endif
+
+    output->bytes = malloc(output->length ? output->length : 1);
+    if (!output->bytes)
+        return INFLATE_NO_MEMORY;
+    output->page_length = output->length ? output->length : 1;
+
+    return INFLATE_SUCCESS;
+}
+
+extern void inflate_output_destroy(struct InflateOutput* output) {
+#if defined(__unix__)
+    if (output->mapping)
+        munmap(output->mapping, output->mapping_length);
+    else
+#endif
+        free(output->bytes);
+
+    output->bytes = NULL;
+    output->mapping = NULL;
+}
+
+extern int tinflate_output(const unsigned char* compressed, size_t compressed_length, struct InflateOutput* output, size_t* decompressed_length) {
+    return decode(compressed, compressed_length, output, NULL, NULL, decompressed_length);
+}
+
+extern int tinflate_output_sink(const unsigned char* compressed, size_t compressed_length, struct InflateOutput* output, InflateOutputSink sink, void* context,
+                                size_t* decompressed_length) {
+    return decode(compressed, compressed_length, output, sink, context, decompressed_length);
+}
+
+extern void inflate_output_release(struct InflateOutput* output, size_t offset, size_t length) {
+#if defined(__unix__) && defined(MADV_DONTNEED)
+    if (!output->mapping || offset >= output->length)
+        return;
+    if (length > output->length - offset)
+        length = output->length - offset;
+
+    /* The mapping runs on to a whole page past the end of the output. */
+    size_t start = round_up(offset, output->page_length);
+    size_t end = offset + length == output->length ? round_up(output->length, output->page_length) : (offset + length) / output->page_length * output->page_length;
+    if (start < end)
+        madvise(output->bytes + start, end - start, MADV_DONTNEED);
+#else
+    (void)output;
+    (void)offset;
+    (void)length;
+#endif
+}
+
+
+
+static int decode(const uint8_t* compressed, size_t compressed_length, struct InflateOutput* output, InflateOutputSink sink, void* context, size_t* decompressed_length) {
+    *decompressed_length = 0;
+
+    if (!output->bytes)
+        return INFLATE_NO_OUTPUT;
+    if (!compressed || !compressed_length)
+        return INFLATE_SUCCESS;
+
+    struct InflateStream* stream = malloc(sizeof(struct InflateStream));
+    if (!stream)
+        return INFLATE_NO_MEMORY;
+    inflate_stream_init(stream, compressed, compressed_length, output->bytes, 0);
+
+    struct Prefault prefault;
+    prefault_start(&prefault, output);
+
+    /* Decode a chunk at a time so that the helper knows where the decoder is and the sink sees output early. */
+    size_t sunk = 0;
+    size_t released = 0;
+    int result;
+    for (;;) {
+        size_t end = stream->cursor.decompressed_end - output->bytes;
+        end = end + CHUNK_LENGTH < output->length ? end + CHUNK_LENGTH : output->length;
+        if (prefault.running)
+            prefault_claim(&prefault, (end + CHUNK_LENGTH - 1) / CHUNK_LENGTH);
+        stream->cursor.decompressed_end = output->bytes + end;
+
+        result = inflate_stream_decode(stream);
+        size_t decoded = stream->cursor.decompressed_next - output->bytes;
+
+        if (sink && decoded > sunk) {
+            int sink_result = sink(context, output->bytes + sunk, decoded - sunk);
+            if (sink_result) {
+                result = sink_result;
+                break;
+            }
+            sunk = decoded;
+
+            /* Back references reach INFLATE_MAX_LZ77_DISTANCE bytes back, everything before that is done with. */
+            if (decoded > released + INFLATE_MAX_LZ77_DISTANCE + output->page_length) {
+                size_t keep = (decoded - INFLATE_MAX_LZ77_DISTANCE) / output->page_length * output->page_length;
+                inflate_output_release(output, released, keep - released);
+                released = keep;
+            }
+        }
+
+        if (result != INFLATE_DECOMPRESSED_OVERFLOW || end == output->length)
+            break;
+    }
+
+    prefault_stop(&prefault);
+    *decompressed_length = stream->cursor.decompressed_next - output->bytes;
+    free(stream);
+
+    return result;
+}
+
+static void prefault_start(struct Prefault* prefault, struct InflateOutput* output) {
+    *prefault = (struct Prefault){
+        .output = output,
+        .chunk_count = (output->length + CHUNK_LENGTH - 1) / CHUNK_LENGTH,
+        .distance = (output->options.prefault_distance + CHUNK_LENGTH - 1) / CHUNK_LENGTH,
+    };
+    if (!output->options.prefault || !output->mapping || prefault->chunk_count < 2)
+        return;
+
+    /* The decoder's first chunk doubles as the probe for MADV_POPULATE_WRITE. */
+    prefault->touch_stride = (size_t)sysconf(_SC_PAGESIZE);
+    prefault->touch_writes = !populate(prefault, output->bytes, output->length < CHUNK_LENGTH ? output->length : CHUNK_LENGTH, false);
+    atomic_init(&prefault->next_chunk, 0);
+    atomic_init(&prefault->touched, 0);
+    atomic_init(&prefault->decoder_chunk, 0);
+    pthread_mutex_init(&prefault->lock, NULL);
+    pthread_cond_init(&prefault->progress, NULL);
+
+    prefault->running = !pthread_create(&prefault->thread, NULL, prefault_thread, prefault);
+    if (!prefault->running) {
+        pthread_mutex_destroy(&prefault->lock);
+        pthread_cond_destroy(&prefault->progress);
+    }
+}
+
+static void prefault_stop(struct Prefault* prefault) {
+    if (!prefault->running)
+        return;
+
+    pthread_mutex_lock(&prefault->lock);
+    prefault->stop = true;
+    pthread_cond_signal(&prefault->progress);
+    pthread_mutex_unlock(&prefault->lock);
+
+    pthread_join(prefault->thread, NULL);
+    pthread_mutex_destroy(&prefault->lock);
+    pthread_cond_destroy(&prefault->progress);
+    prefault->running = false;
+}
+
+static void prefault_claim(struct Prefault* prefault, size_t chunk_end) {
+    if (chunk_end <= prefault->claimed)
+        return;
+
+    size_t chunk = atomic_load(&prefault->next_chunk);
+    while (chunk < chunk_end && !atomic_compare_exchange_weak(&prefault->next_chunk, &chunk, chunk_end))
+        ;
+
+    /* Chunks between what the decoder had and the helper's frontier are the helper's, the last of them possibly still in hand. */
+    size_t helper_end = chunk < chunk_end ? chunk : chunk_end;
+    if (prefault->touch_writes && helper_end > prefault->claimed) {
+        while (atomic_load_explicit(&prefault->touched, memory_order_acquire) < helper_end)
+            sched_yield();
+    }
+    prefault->claimed = chunk_end;
+
+    atomic_store_explicit(&prefault->decoder_chunk, chunk_end, memory_order_relaxed);
+    pthread_mutex_lock(&prefault->lock);
+    pthread_cond_signal(&prefault->progress);
+    pthread_mutex_unlock(&prefault->lock);
+}
+
+static void* prefault_thread(void* argument) {
+    struct Prefault* prefault = argument;
+    struct InflateOutput* output = prefault->output;
+
+    for (;;) {
+        size_t chunk = atomic_load(&prefault->next_chunk);
+        if (chunk >= prefault->chunk_count)
+            break;
+
+        pthread_mutex_lock(&prefault->lock);
+        while (!prefault->stop && chunk >= atomic_load_explicit(&prefault->decoder_chunk, memory_order_relaxed) + prefault->distance) {
+            pthread_cond_wait(&prefault->progress, &prefault->lock);
+            chunk = atomic_load(&prefault->next_chunk);
+        }
+        bool stop = prefault->stop;
+        pthread_mutex_unlock(&prefault->lock);
+        if (stop)
+            break;
+
+        if (!atomic_compare_exchange_strong(&prefault->next_chunk, &chunk, chunk + 1))
+            continue;
+        size_t offset = chunk * CHUNK_LENGTH;
+        size_t length = output->length - offset < CHUNK_LENGTH ? output->length - offset : CHUNK_LENGTH;
+        populate(prefault, output->bytes + offset, length, prefault->touch_writes);
+        atomic_store_explicit(&prefault->touched, chunk + 1, memory_order_release);
+    }
+
+    return NULL;
+}
+
+static bool populate(const struct Prefault* prefault, uint8_t* bytes, size_t length, bool touch_writes) {
+    if (!touch_writes) {
+#if defined(MADV_POPULATE_WRITE)
+        return !madvise(bytes, round_up(length, prefault->output->page_length), MADV_POPULATE_WRITE);
+#else
+        return false;
+#endif
+    }
+
+    for (size_t offset = 0; offset < length; offset += prefault->touch_stride)
+        ((volatile uint8_t*)bytes)[offset] = 0;
+    return true;
+}
@@ -0,0 +1,314 @@
+/*
+ * Parallel decoding of a single deflate stream at flush points. Z_SYNC_FLUSH
+ * and Z_FULL_FLUSH end with an empty stored block, which shows up as the bytes
+ * 00 00 FF FF followed by a byte aligned block header. After a full flush no
+ * back reference reaches across, so the stream can be cut there.
+ *
+ * Every candidate is only a guess: the bytes may occur inside block data, and
+ * a sync flush keeps the history. Segments are therefore decoded on their own
+ * and chained afterwards. A segment counts only if the segment before it
+ * ended exactly at its start, and it fails with INFLATE_INVALID_LZ77 if it
+ * reaches back past its start. From the first segment that does not fit the
+ * chain the rest of the stream is decoded sequentially.
+ *
+ * Later segments decode into buffers of their own, which together never hold
+ * more than decompressed_max_length bytes. A segment that cannot grow within
+ * that budget stops, and the chain falls back to sequential decoding there.
+ */
+
+#include <pthread.h>
+#include <stdatomic.h>
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+
+#include "inflate.h"
+#include "inflate_stream.h"
+
+
+
+/* Segments are cut no closer than this many compressed bytes. */
+#define PARALLEL_MIN_SEGMENT_LENGTH     (256 * 1024)
+
+/* Segments per thread, so that uneven segments even out. */
+#define PARALLEL_SEGMENTS_PER_THREAD    4
+
+#define PARALLEL_MAX_THREADS            256
+
+/* Initial output buffer of a later segment, relative to its compressed length, unless its share of the budget is smaller. */
+#define PARALLEL_EXPANSION_GUESS        16
+
+/* Marks a segment that ran to the end of the stream. */
+#define PARALLEL_STREAM_END             SIZE_MAX
+
+
+struct ParallelSegment {
+    size_t start;               // Offset of the first block header in compressed.
+
+    uint8_t* decompressed;      // The first segment decodes straight into the output.
+    size_t decompressed_length;
+    int result;
+    size_t end;                 // Index of the segment this one ran into, or PARALLEL_STREAM_END.
+};
+
+struct ParallelJob {
+    const uint8_t* compressed;
+    size_t compressed_length;
+    uint8_t* decompressed;
+    size_t decompressed_max_length;
+
+    struct ParallelSegment* segments;
+    size_t segment_count;
+    atomic_size_t next_segment;
+    atomic_size_t output_budget;    // Bytes the buffers of later segments may still take.
+};
+
+
+/* Collects flush point candidates as segment starts. Returns the number of segments, the first starting at offset 0. */
+static size_t find_segments(const uint8_t* compressed, size_t compressed_length, size_t min_segment_length, struct ParallelSegment** segments);
+
+/* Decodes a segment until it runs into the start of a later segment or the stream ends. */
+static void decode_segment(struct ParallelJob* job, size_t index);
+
+/* Takes up to length bytes from the output budget. Returns the number of bytes taken. */
+static size_t reserve_output(struct ParallelJob* job, size_t length);
+
+static void* parallel_worker(void* argument);
+
+
+extern int tinflate_parallel(const unsigned char* compressed, size_t compressed_length, unsigned char* decompressed, size_t* decompressed_length, size_t decompressed_max_length, unsigned thread_count) {
+    *decompressed_length = 0;
+
+    if (!decompressed)
+        return INFLATE_NO_OUTPUT;
+    if (!compressed || !compressed_length)
+        return INFLATE_SUCCESS;
+
+    if (!thread_count) {
+        long online = sysconf(_SC_NPROCESSORS_ONLN);
+        thread_count = online > 0 ? (unsigned)online : 1;
+    }
+    if (thread_count > PARALLEL_MAX_THREADS)
+        thread_count = PARALLEL_MAX_THREADS;
+    if (thread_count == 1)
+        return tinflate(compressed, compressed_length, decompressed, decompressed_length, decompressed_max_length);
+
+    size_t min_segment_length = compressed_length / ((size_t)thread_count * PARALLEL_SEGMENTS_PER_THREAD);
+    if (min_segment_length < PARALLEL_MIN_SEGMENT_LENGTH)
+        min_segment_length = PARALLEL_MIN_SEGMENT_LENGTH;
+
+    struct ParallelJob job = {
+        .compressed = compressed,
+        .compressed_length = compressed_length,
+        .decompressed = decompressed,
+        .decompressed_max_length = decompressed_max_length,
+    };
+    job.segment_count = find_segments(compressed, compressed_length, min_segment_length, &job.segments);
+    if (!job.segment_count)
+        return INFLATE_NO_MEMORY;
+    atomic_init(&job.next_segment, 0);
+    atomic_init(&job.output_budget, decompressed_max_length);
+
+    if (thread_count > job.segment_count)
+        thread_count = (unsigned)job.segment_count;
+
+    /* The calling thread works as well, so only thread_count - 1 helpers are started. */
+    pthread_t threads[PARALLEL_MAX_THREADS];
+    unsigned started = 0;
+    for (; started < thread_count - 1; ++started) {
+        if (pthread_create(&threads[started], NULL, parallel_worker, &job))
+            break;
+    }
+
+    parallel_worker(&job);
+
+    for (unsigned i = 0; i < started; ++i)
+        pthread_join(threads[i], NULL);
+
+    /* Follow the chain from the first segment, copying each link behind the previous one. */
+    struct ParallelSegment* segments = job.segments;
+    size_t length = segments[0].decompressed_length;
+    int result = segments[0].result;
+    size_t index = segments[0].end;
+    while (!result && index != PARALLEL_STREAM_END) {
+        struct ParallelSegment* segment = &segments[index];
+        if (segment->result || segment->decompressed_length > decompressed_max_length - length)
+            break;
+
+        memcpy(decompressed + length, segment->decompressed, segment->decompressed_length);
+        length += segment->decompressed_length;
+        index = segment->end;
+    }
+
+    if (!result && index != PARALLEL_STREAM_END) {
+        /* The segment at index did not stand on its own or did not fit, decode the rest with the output so far as history. */
+        struct InflateStream stream;
+        inflate_stream_init(&stream, compressed + segments[index].start, compressed_length - segments[index].start, decompressed + length, decompressed_max_length - length);
+        stream.cursor.decompressed_start = decompressed;
+        result = inflate_stream_decode(&stream);
+        length = stream.cursor.decompressed_next - decompressed;
+    }
+    *decompressed_length = length;
+
+    for (size_t i = 1; i < job.segment_count; ++i)
+        free(segments[i].decompressed);
+    free(segments);
+
+    return result;
+}
+
+
+
+static size_t find_segments(const uint8_t* compressed, size_t compressed_length, size_t min_segment_length, struct ParallelSegment** segments) {
+    size_t capacity = 16;
+    size_t segment_count = 1;
+    *segments = malloc(capacity * sizeof(struct ParallelSegment));
+    if (!*segments)
+        return 0;
+    (*segments)[0] = (struct ParallelSegment){ .start = 0 };
+
+    const uint8_t* next = compressed + min_segment_length;
+    const uint8_t* end = compressed + compressed_length;
+    while (next < end) {
+        const uint8_t* marker = memchr(next, 0x00, end - next);
+        if (!marker || end - marker < 5)
+            break;
+        if (marker[1] != 0x00 || marker[2] != 0xFF || marker[3] != 0xFF) {
+            next = marker + 1;
+            continue;
+        }
+
+        if (segment_count == capacity) {
+            capacity *= 2;
+            struct ParallelSegment* grown = realloc(*segments, capacity * sizeof(struct ParallelSegment));
+            if (!grown) {
+                free(*segments);
+                return 0;
+            }
+            *segments = grown;
+        }
+        (*segments)[segment_count] = (struct ParallelSegment){ .start = marker + 4 - compressed };
+        ++segment_count;
+
+        next = marker + 4 + min_segment_length;
+    }
+
+    return segment_count;
+}
+
+static void decode_segment(struct ParallelJob* job, size_t index) {
+    struct ParallelSegment* segment = &job->segments[index];
+    segment->end = PARALLEL_STREAM_END;
+
+    /* Later segments decode into a buffer of their own that grows with the output, as far as the budget allows. */
+    size_t capacity = job->decompressed_max_length;
+    uint8_t* decompressed = job->decompressed;
+    if (index) {
+        size_t next_start = index + 1 < job->segment_count ? job->segments[index + 1].start : job->compressed_length;
+        size_t guess = PARALLEL_EXPANSION_GUESS * (next_start - segment->start);
+        size_t share = job->decompressed_max_length / (job->segment_count - 1);
+        capacity = reserve_output(job, guess < share ? guess : share);
+        decompressed = malloc(capacity ? capacity : 1);
+        if (!decompressed) {
+            segment->result = INFLATE_NO_MEMORY;
+            return;
+        }
+    }
+    segment->decompressed = decompressed;
+
+    struct InflateStream* stream = malloc(sizeof(struct InflateStream));
+    if (!stream) {
+        segment->result = INFLATE_NO_MEMORY;
+        return;
+    }
+    inflate_stream_init(stream, job->compressed + segment->start, job->compressed_length - segment->start, decompressed, capacity);
+
+    size_t next_segment = index + 1;
+    int result = INFLATE_SUCCESS;
+    for (;;) {
+        if (stream->state == INFLATE_STREAM_DONE)
+            break;
+        if (stream->state == INFLATE_STREAM_BLOCK_HEADER) {
+            result = inflate_stream_block_header(stream);
+            if (result)
+                break;
+            continue;
+        }
+
+        bool stored = stream->state == INFLATE_STREAM_STORED;
+        result = inflate_stream_decode_block(stream);
+        if (result == INFLATE_DECOMPRESSED_OVERFLOW && index) {
+            /* Out of budget the overflow stands, and sequential decoding takes over from this segment. */
+            size_t extra = reserve_output(job, capacity ? capacity : PARALLEL_MIN_SEGMENT_LENGTH);
+            if (!extra)
+                break;
+            size_t grown_capacity = capacity + extra;
+            size_t length = stream->cursor.decompressed_next - decompressed;
+            uint8_t* grown = realloc(decompressed, grown_capacity);
+            if (!grown) {
+                atomic_fetch_add_explicit(&job->output_budget, extra, memory_order_relaxed);
+                result = INFLATE_NO_MEMORY;
+                break;
+            }
+            stream->cursor.decompressed_start = grown;
+            stream->cursor.decompressed_next = grown + length;
+            stream->cursor.decompressed_end = grown + grown_capacity;
+            decompressed = grown;
+            capacity = grown_capacity;
+            segment->decompressed = decompressed;
+            continue;
+        }
+        if (result)
+            break;
+
+        /* Stored blocks end on a byte boundary, the only place another segment can start. */
+        if (stored && stream->state == INFLATE_STREAM_BLOCK_HEADER) {
+            size_t position = inflate_stream_compressed_end(stream) - job->compressed;
+            while (next_segment < job->segment_count && job->segments[next_segment].start < position)
+                ++next_segment;
+            if (next_segment < job->segment_count && job->segments[next_segment].start == position) {
+                segment->end = next_segment;
+                break;
+            }
+        }
+    }
+
+    segment->decompressed_length = stream->cursor.decompressed_next - decompressed;
+    segment->result = result;
+    free(stream);
+
+    /* Hand what the segment did not use back to the others. */
+    if (index && segment->decompressed_length < capacity) {
+        uint8_t* shrunk = realloc(decompressed, segment->decompressed_length ? segment->decompressed_length : 1);
+        if (shrunk) {
+            segment->decompressed = shrunk;
+            atomic_fetch_add_explicit(&job->output_budget, capacity - segment->decompressed_length, memory_order_relaxed);
+        }
+    }
+}
+
+static size_t reserve_output(struct ParallelJob* job, size_t length) {
+    size_t available = atomic_load_explicit(&job->output_budget, memory_order_relaxed);
+    size_t taken;
+    do {
+        taken = length < available ? length : available;
+    } while (taken && !atomic_compare_exchange_weak_explicit(&job->output_budget, &available, available - taken, memory_order_relaxed, memory_order_relaxed));
+
+    return taken;
+}
+
+static void* parallel_worker(void* argument) {
+    struct ParallelJob* job = argument;
+
+    for (;;) {
+        size_t index = atomic_fetch_add_explicit(&job->next_segment, 1, memory_order_relaxed);
+        if (index >= job->segment_count)
+            break;
+        decode_segment(job, index);
+    }
+
+    return NULL;
+}
@@ -0,0 +1,341 @@
+#include "inflate_pipeline.h"
+
+#include <pthread.h>
+#include <sched.h>
+#include <stdatomic.h>
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "bit_reader.h"
+#include "inflate.h"
+#include "inflate_stream.h"
+
+
+
+/* Ring capacity in tokens. Must be a power of two. */
+#define PIPELINE_RING_LENGTH        (1 << 16)
+#define PIPELINE_RING_MASK          (PIPELINE_RING_LENGTH - 1)
+
+/* Tokens are published, and the consumer's progress reported, in batches to keep the shared counters cold. */
+#define PIPELINE_BATCH              1024
+
+/* Output is checked in pieces of this size while it is still in cache. */
+#define PIPELINE_CHECK_LENGTH       (64 * 1024)
+
+/* Waits spin this many times before yielding the core. */
+#define PIPELINE_SPINS              256
+
+/*
+ * Pipeline tokens extend InflateToken:
+ *
+ *  Stored run:
+ *      Bit 29:     1 (PIPELINE_TOKEN_STORED)
+ *      Bit 15-0:   length
+ *      followed by two tokens holding the low and high half of the run's offset in compressed.
+ *  End of stream:
+ *      Bit 30:     1 (INFLATE_TOKEN_END_OF_BLOCK)
+ */
+#define PIPELINE_TOKEN_STORED       0x20000000
+#define PIPELINE_TOKEN_END          INFLATE_TOKEN_END_OF_BLOCK
+
+/* Most tokens a single step writes to the ring. */
+#define PIPELINE_MAX_STEP_TOKENS    3
+
+
+struct Pipeline {
+    InflateToken* ring;
+    _Alignas(64) atomic_size_t head;    // Written by the tokenizer.
+    _Alignas(64) atomic_size_t tail;    // Written by the materializer.
+
+    _Alignas(64) const uint8_t* compressed;
+    uint8_t* decompressed;
+    uint8_t* decompressed_end;
+
+    InflateCheck check;
+    uint32_t check_value;
+    size_t decompressed_length;
+};
+
+/* The tokenizer's view of the ring. */
+struct PipelineWriter {
+    struct Pipeline* pipeline;
+    size_t head;
+    size_t published;
+    size_t tail;        // Last seen consumer position.
+};
+
+
+/* Decodes the stream into tokens. Returns the result sequential decoding would have, the output it would have produced is described by the tokens. */
+static int tokenize(struct Pipeline* pipeline, struct PipelineWriter* writer, struct InflateStream* stream);
+
+/* Copies the tokens' output into place until the end-of-stream token. */
+static void* materialize(void* argument);
+
+
+static inline void pipeline_wait(unsigned* spins) {
+    if (++*spins < PIPELINE_SPINS) {
+#if defined(__x86_64__) || defined(__i386__)
+        __builtin_ia32_pause();
+#endif
+    } else {
+        sched_yield();
+    }
+}
+
+/* Makes room for PIPELINE_MAX_STEP_TOKENS more tokens. */
+static inline void writer_reserve(struct PipelineWriter* writer) {
+    if (writer->head - writer->tail <= PIPELINE_RING_LENGTH - PIPELINE_MAX_STEP_TOKENS)
+        return;
+
+    unsigned spins = 0;
+    for (;;) {
+        writer->tail = atomic_load_explicit(&writer->pipeline->tail, memory_order_acquire);
+        if (writer->head - writer->tail <= PIPELINE_RING_LENGTH - PIPELINE_MAX_STEP_TOKENS)
+            return;
+        pipeline_wait(&spins);
+    }
+}
+
+static inline void writer_publish(struct PipelineWriter* writer) {
+    atomic_store_explicit(&writer->pipeline->head, writer->head, memory_order_release);
+    writer->published = writer->head;
+}
+
+static inline void writer_put(struct PipelineWriter* writer, InflateToken token) {
+    writer->pipeline->ring[writer->head & PIPELINE_RING_MASK] = token;
+    ++writer->head;
+}
+
+/* Publishes once a batch is complete. Called between steps so the tokens of a step become visible together. */
+static inline void writer_end_step(struct PipelineWriter* writer) {
+    if (writer->head - writer->published >= PIPELINE_BATCH)
+        writer_publish(writer);
+}
+
+
+extern int tinflate_pipelined(const unsigned char* compressed, size_t compressed_length, unsigned char* decompressed, size_t* decompressed_length, size_t decompressed_max_length) {
+    *decompressed_length = 0;
+
+    if (!decompressed)
+        return INFLATE_NO_OUTPUT;
+    if (!compressed || !compressed_length)
+        return INFLATE_SUCCESS;
+
+    const uint8_t* compressed_end;
+    return inflate_pipeline_decode(compressed, compressed_length, decompressed, decompressed_max_length, decompressed_length, &compressed_end, NULL, NULL);
+}
+
+int inflate_pipeline_decode(const uint8_t* compressed, size_t compressed_length, uint8_t* decompressed, size_t decompressed_max_length, size_t* decompressed_length,
+                            const uint8_t** compressed_end, InflateCheck check, uint32_t* check_value) {
+    struct InflateStream* stream = malloc(sizeof(struct InflateStream));
+    struct Pipeline* pipeline = malloc(sizeof(struct Pipeline));
+    InflateToken* ring = malloc(PIPELINE_RING_LENGTH * sizeof(InflateToken));
+    if (!stream || !pipeline || !ring) {
+        free(stream);
+        free(pipeline);
+        free(ring);
+        return INFLATE_NO_MEMORY;
+    }
+
+    inflate_stream_init(stream, compressed, compressed_length, decompressed, decompressed_max_length);
+
+    pipeline->ring = ring;
+    atomic_init(&pipeline->head, 0);
+    atomic_init(&pipeline->tail, 0);
+    pipeline->compressed = compressed;
+    pipeline->decompressed = decompressed;
+    pipeline->decompressed_end = decompressed + decompressed_max_length;
+    pipeline->check = check;
+    pipeline->check_value = check ? *check_value : 0;
+    pipeline->decompressed_length = 0;
+
+    int result = INFLATE_SUCCESS;
+    pthread_t materializer;
+    if (pthread_create(&materializer, NULL, materialize, pipeline)) {
+        /* No second thread, decode sequentially instead. */
+        result = inflate_stream_decode(stream);
+        pipeline->decompressed_length = stream->cursor.decompressed_next - decompressed;
+        if (check)
+            pipeline->check_value = check(pipeline->check_value, decompressed, pipeline->decompressed_length);
+    } else {
+        struct PipelineWriter writer = { .pipeline = pipeline, .head = 0, .published = 0, .tail = 0 };
+        result = tokenize(pipeline, &writer, stream);
+
+        writer_reserve(&writer);
+        writer_put(&writer, PIPELINE_TOKEN_END);
+        writer_publish(&writer);
+        pthread_join(materializer, NULL);
+    }
+
+    *decompressed_length = pipeline->decompressed_length;
+    *compressed_end = inflate_stream_compressed_end(stream);
+    if (check)
+        *check_value = pipeline->check_value;
+
+    free(stream);
+    free(pipeline);
+    free(ring);
+
+    return result;
+}
+
+
+
+static int tokenize(struct Pipeline* pipeline, struct PipelineWriter* writer, struct InflateStream* stream) {
+    const struct Inflator* inflator = &stream->inflator;
+    struct InflateCursor* cursor = &stream->cursor;
+
+    /* Output the tokens so far describe. Back references and the output limit are checked against it. */
+    size_t position = 0;
+    size_t decompressed_max_length = pipeline->decompressed_end - pipeline->decompressed;
+
+    for (;;) {
+        if (stream->state == INFLATE_STREAM_DONE)
+            return INFLATE_SUCCESS;
+
+        if (stream->state == INFLATE_STREAM_BLOCK_HEADER) {
+            int result = inflate_stream_block_header(stream);
+            if (result)
+                return result;
+        } else if (stream->state == INFLATE_STREAM_STORED) {
+            /* Bytes already pulled into the bit buffer go as literals. */
+            while (stream->stored_remaining && cursor->buffer_count >= 8) {
+                if (position == decompressed_max_length)
+                    return INFLATE_DECOMPRESSED_OVERFLOW;
+                writer_reserve(writer);
+                writer_put(writer, (uint8_t)cursor->buffer);
+                writer_end_step(writer);
+                ++position;
+                cursor->buffer >>= 8;
+                cursor->buffer_count -= 8;
+                --stream->stored_remaining;
+            }
+
+            if (stream->stored_remaining) {
+                cursor->buffer = 0;
+
+                size_t length = stream->stored_remaining;
+                if (length > (size_t)(cursor->compressed_end - cursor->compressed_next))
+                    length = cursor->compressed_end - cursor->compressed_next;
+                if (length > decompressed_max_length - position)
+                    length = decompressed_max_length - position;
+
+                if (length) {
+                    size_t offset = cursor->compressed_next - pipeline->compressed;
+                    writer_reserve(writer);
+                    writer_put(writer, PIPELINE_TOKEN_STORED | (uint32_t)length);
+                    writer_put(writer, (uint32_t)offset);
+                    writer_put(writer, (uint32_t)((uint64_t)offset >> 32));
+                    writer_end_step(writer);
+                }
+                cursor->compressed_next += length;
+                position += length;
+                stream->stored_remaining -= length;
+
+                if (stream->stored_remaining)
+                    return cursor->compressed_next == cursor->compressed_end ? INFLATE_COMPRESSED_INCOMPLETE : INFLATE_DECOMPRESSED_OVERFLOW;
+            }
+
+            stream->state = stream->final_block ? INFLATE_STREAM_DONE : INFLATE_STREAM_BLOCK_HEADER;
+        } else {
+            const uint8_t* compressed_next = cursor->compressed_next;
+            const uint8_t* compressed_end = cursor->compressed_end;
+            Buffer buffer = cursor->buffer;
+            uint32_t buffer_count = cursor->buffer_count;
+
+            int result = INFLATE_SUCCESS;
+            for (;;) {
+                if (buffer_count < INFLATE_MAX_TOKEN_BITS)
+                    FILL_BUFFER();
+
+                InflateToken token;
+                unsigned token_bits;
+                result = inflate_decode_token(inflator, buffer, buffer_count, &token, &token_bits);
+                if (result)
+                    break;
+
+                size_t length = 1;
+                if (token & INFLATE_TOKEN_MATCH) {
+                    length = INFLATE_TOKEN_LENGTH(token);
+                    if (INFLATE_TOKEN_DISTANCE(token) > position) {
+                        result = INFLATE_INVALID_LZ77;
+                        break;
+                    }
+                } else if (token & INFLATE_TOKEN_END_OF_BLOCK) {
+                    CONSUME_BITS(token_bits);
+                    stream->state = stream->final_block ? INFLATE_STREAM_DONE : INFLATE_STREAM_BLOCK_HEADER;
+                    break;
+                }
+                if (length > decompressed_max_length - position) {
+                    result = INFLATE_DECOMPRESSED_OVERFLOW;
+                    break;
+                }
+                CONSUME_BITS(token_bits);
+
+                writer_reserve(writer);
+                writer_put(writer, token);
+                writer_end_step(writer);
+                position += length;
+            }
+
+            cursor->compressed_next = compressed_next;
+            cursor->buffer = buffer;
+            cursor->buffer_count = buffer_count;
+            if (result)
+                return result;
+        }
+    }
+}
+
+static void* materialize(void* argument) {
+    struct Pipeline* pipeline = argument;
+    const InflateToken* ring = pipeline->ring;
+    uint8_t* decompressed_next = pipeline->decompressed;
+    uint8_t* decompressed_end = pipeline->decompressed_end;
+    uint8_t* checked = decompressed_next;
+
+    size_t tail = 0;
+    bool done = false;
+    while (!done) {
+        size_t head;
+        unsigned spins = 0;
+        while ((head = atomic_load_explicit(&pipeline->head, memory_order_acquire)) == tail)
+            pipeline_wait(&spins);
+
+        while (tail != head) {
+            InflateToken token = ring[tail & PIPELINE_RING_MASK];
+            ++tail;
+
+            if (!(token & (INFLATE_TOKEN_MATCH | PIPELINE_TOKEN_END | PIPELINE_TOKEN_STORED))) {
+                *decompressed_next = (uint8_t)token;
+                ++decompressed_next;
+            } else if (token & INFLATE_TOKEN_MATCH) {
+                unsigned length = INFLATE_TOKEN_LENGTH(token);
+                lz77(decompressed_next, decompressed_end, INFLATE_TOKEN_DISTANCE(token), length);
+                decompressed_next += length;
+            } else if (token & PIPELINE_TOKEN_STORED) {
+                size_t length = token & BITMASK(16);
+                uint64_t offset = ring[tail & PIPELINE_RING_MASK] | (uint64_t)ring[(tail + 1) & PIPELINE_RING_MASK] << 32;
+                tail += 2;
+                memcpy(decompressed_next, pipeline->compressed + offset, length);
+                decompressed_next += length;
+            } else {
+                done = true;
+                break;
+            }
+        }
+        atomic_store_explicit(&pipeline->tail, tail, memory_order_release);
+
+        if (pipeline->check && (decompressed_next - checked >= PIPELINE_CHECK_LENGTH || done)) {
+            pipeline->check_value = pipeline->check(pipeline->check_value, checked, decompressed_next - checked);
+            checked = decompressed_next;
+        }
+    }
+
+    pipeline->decompressed_length = decompressed_next - pipeline->decompressed;
+
+    return NULL;
+}
@@ -0,0 +1,186 @@
+#include "inflate_reader.h"
+
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+#include <stdlib.h>
+
+#include "adler32.h"
+#include "crc32.h"
+#include "gzip_header.h"
+#include "inflate.h"
+#include "inflate_stream.h"
+#include "inflate_window.h"
+#include "zlib_header.h"
+
+
+
+/* Reader states. */
+#define READER_HEADER       0   // Before the zlib or gzip header, or before a raw stream.
+#define READER_DEFLATE      1
+#define READER_DONE         2
+
+
+struct InflateReader {
+    const uint8_t* compressed_next;
+    const uint8_t* compressed_end;
+    enum InflateFormat format;
+    unsigned state;
+    int result;                 // Kept once decoding failed.
+
+    InflateCheck check;
+    uint32_t check_value;
+    uint32_t member_length;     // Output length of the member modulo 2^32, as in the gzip trailer.
+
+    struct InflateStream stream;
+    struct InflateWindow window;
+};
+
+
+/* Reads the header in front of the next deflate stream and starts decoding it. */
+static int start_stream(struct InflateReader* reader);
+
+/* Reads and verifies the trailer that follows a finished deflate stream. */
+static int finish_stream(struct InflateReader* reader);
+
+
+extern int inflate_reader_create(const unsigned char* compressed, size_t compressed_length, enum InflateFormat format, struct InflateReader** reader) {
+    *reader = NULL;
+    if (format != INFLATE_FORMAT_RAW && format != INFLATE_FORMAT_ZLIB && format != INFLATE_FORMAT_GZIP)
+        return INFLATE_VALUE_NOT_ALLOWED;
+
+    struct InflateReader* created = malloc(sizeof(struct InflateReader));
+    if (!created)
+        return INFLATE_NO_MEMORY;
+    if (inflate_window_create(&created->window, INFLATE_WINDOW_DEFAULT_CAPACITY, true)) {
+        free(created);
+        return INFLATE_NO_MEMORY;
+    }
+
+    created->compressed_next = compressed;
+    created->compressed_end = compressed + compressed_length;
+    created->format = format;
+    created->state = READER_HEADER;
+    created->result = INFLATE_SUCCESS;
+
+    /* Same as the scan modes: an empty raw stream is empty output, zlib and gzip need at least a header. */
+    if (!compressed || !compressed_length) {
+        created->compressed_end = created->compressed_next = NULL;
+        if (format == INFLATE_FORMAT_RAW)
+            created->state = READER_DONE;
+        else
+            created->result = INFLATE_COMPRESSED_INCOMPLETE;
+    }
+
+    *reader = created;
+
+    return INFLATE_SUCCESS;
+}
+
+extern int inflate_reader_next(struct InflateReader* reader, const unsigned char** chunk, size_t* chunk_length) {
+    struct InflateWindow* window = &reader->window;
+    struct InflateStream* stream = &reader->stream;
+
+    *chunk = NULL;
+    *chunk_length = 0;
+    inflate_window_drop(window);
+
+    while (!reader->result && reader->state != READER_DONE) {
+        if (reader->state == READER_HEADER) {
+            reader->result = start_stream(reader);
+            continue;
+        }
+
+        inflate_window_prepare(window, &stream->cursor);
+        const uint8_t* decoded = stream->cursor.decompressed_next;
+        int result = inflate_stream_decode(stream);
+
+        size_t decoded_length = stream->cursor.decompressed_next - decoded;
+        if (reader->check)
+            reader->check_value = reader->check(reader->check_value, decoded, decoded_length);
+        reader->member_length += (uint32_t)decoded_length;
+        inflate_window_commit(window, &stream->cursor);
+
+        if (result == INFLATE_SUCCESS)
+            result = finish_stream(reader);
+        else if (result == INFLATE_DECOMPRESSED_OVERFLOW)
+            result = INFLATE_SUCCESS;
+        reader->result = result;
+
+        if (inflate_window_pending_length(window))
+            break;
+    }
+    if (reader->result)
+        return reader->result;
+
+    *chunk = window->buffer + window->pending;
+    *chunk_length = inflate_window_pending_length(window);
+
+    return INFLATE_SUCCESS;
+}
+
+extern void inflate_reader_destroy(struct InflateReader* reader) {
+    if (!reader)
+        return;
+
+    inflate_window_destroy(&reader->window);
+    free(reader);
+}
+
+
+
+static int start_stream(struct InflateReader* reader) {
+    const uint8_t* compressed_next = reader->compressed_next;
+    const uint8_t* compressed_end = reader->compressed_end;
+
+    if (reader->format == INFLATE_FORMAT_ZLIB) {
+        int result = zlib_parse_header(compressed_next, compressed_end - compressed_next);
+        if (result)
+            return result;
+        compressed_next += ZLIB_HEADER_LENGTH;
+        reader->check = adler32_update;
+        reader->check_value = 1;
+    } else if (reader->format == INFLATE_FORMAT_GZIP) {
+        struct GzipHeader header;
+        int result = gzip_parse_header(compressed_next, compressed_end - compressed_next, &header);
+        if (result)
+            return result;
+        compressed_next += header.header_length;
+        reader->check = crc32_update;
+        reader->check_value = 0;
+    } else {
+        reader->check = NULL;
+    }
+    reader->member_length = 0;
+
+    inflate_window_reset(&reader->window);
+    inflate_stream_init(&reader->stream, compressed_next, compressed_end - compressed_next, NULL, 0);
+    reader->state = READER_DEFLATE;
+
+    return INFLATE_SUCCESS;
+}
+
+static int finish_stream(struct InflateReader* reader) {
+    const uint8_t* compressed_next = inflate_stream_compressed_end(&reader->stream);
+    const uint8_t* compressed_end = reader->compressed_end;
+    reader->state = READER_DONE;
+
+    if (reader->format == INFLATE_FORMAT_ZLIB) {
+        if (compressed_end - compressed_next < ZLIB_TRAILER_LENGTH)
+            return INFLATE_COMPRESSED_INCOMPLETE;
+        if (zlib_read_be32(compressed_next) != reader->check_value)
+            return INFLATE_CHECKSUM_MISMATCH;
+    } else if (reader->format == INFLATE_FORMAT_GZIP) {
+        if (compressed_end - compressed_next < GZIP_TRAILER_LENGTH)
+            return INFLATE_COMPRESSED_INCOMPLETE;
+        if (gzip_read_le32(compressed_next) != reader->check_value || gzip_read_le32(compressed_next + 4) != reader->member_length)
+            return INFLATE_CHECKSUM_MISMATCH;
+
+        /* Another member may follow. */
+        reader->compressed_next = compressed_next + GZIP_TRAILER_LENGTH;
+        if (reader->compressed_next < compressed_end)
+            reader->state = READER_HEADER;
+    }
+
+    return INFLATE_SUCCESS;
+}
@@ -0,0 +1,248 @@
+#include "inflate_scan.h"
+
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+#include <stdlib.h>
+
+#include "adler32.h"
+#include "bit_reader.h"
+#include "crc32.h"
+#include "gzip_header.h"
+#include "inflate.h"
+#include "inflate_scan_internal.h"
+#include "inflate_stream.h"
+#include "inflate_window.h"
+#include "zlib_header.h"
+
+
+
+struct Scan {
+    struct InflateStream stream;
+    struct InflateWindow window;
+    bool verify;
+};
+
+
+/* Runs the scan over the deflate stream at compressed. *compressed_end receives the first byte following it. */
+static int scan_deflate(struct Scan* scan, const uint8_t* compressed, size_t compressed_length, InflateCheck check, uint32_t* check_value, size_t* decompressed_length,
+                        const uint8_t** compressed_end);
+
+/* Counts the output of Huffman block data until the end-of-block symbol. */
+static int count_huffman_block(struct InflateStream* stream, size_t* position);
+
+/* Decodes the stream into the window, updating check with every piece of output before it is dropped. */
+static int verify_stream(struct InflateStream* stream, struct InflateWindow* window, InflateCheck check, uint32_t* check_value, size_t* decompressed_length);
+
+static int scan_format(const uint8_t* compressed, size_t compressed_length, enum InflateFormat format, size_t* decompressed_length, bool verify);
+
+
+extern int inflate_scan_length(const unsigned char* compressed, size_t compressed_length, enum InflateFormat format, size_t* decompressed_length) {
+    return scan_format(compressed, compressed_length, format, decompressed_length, false);
+}
+
+extern int inflate_scan_verify(const unsigned char* compressed, size_t compressed_length, enum InflateFormat format, size_t* decompressed_length) {
+    return scan_format(compressed, compressed_length, format, decompressed_length, true);
+}
+
+int inflate_scan_count(struct InflateStream* stream, size_t* decompressed_length) {
+    struct InflateCursor* cursor = &stream->cursor;
+    size_t position = 0;
+
+    int result = INFLATE_SUCCESS;
+    while (!result && stream->state != INFLATE_STREAM_DONE) {
+        if (stream->state == INFLATE_STREAM_BLOCK_HEADER) {
+            result = inflate_stream_block_header(stream);
+        } else if (stream->state == INFLATE_STREAM_STORED) {
+            /* Stored bytes are skipped, whether they already sit in the bit buffer or not. */
+            while (stream->stored_remaining && cursor->buffer_count >= 8) {
+                cursor->buffer >>= 8;
+                cursor->buffer_count -= 8;
+                --stream->stored_remaining;
+                ++position;
+            }
+
+            if (stream->stored_remaining) {
+                cursor->buffer = 0;
+
+                size_t length = stream->stored_remaining;
+                if (length > (size_t)(cursor->compressed_end - cursor->compressed_next)) {
+                    length = cursor->compressed_end - cursor->compressed_next;
+                    result = INFLATE_COMPRESSED_INCOMPLETE;
+                }
+                cursor->compressed_next += length;
+                stream->stored_remaining -= length;
+                position += length;
+            }
+
+            if (!result)
+                stream->state = stream->final_block ? INFLATE_STREAM_DONE : INFLATE_STREAM_BLOCK_HEADER;
+        } else {
+            result = count_huffman_block(stream, &position);
+        }
+    }
+
+    *decompressed_length = position;
+
+    return result;
+}
+
+
+
+static int scan_format(const uint8_t* compressed, size_t compressed_length, enum InflateFormat format, size_t* decompressed_length, bool verify) {
+    *decompressed_length = 0;
+
+    if (!compressed || !compressed_length)
+        return format == INFLATE_FORMAT_RAW ? INFLATE_SUCCESS : INFLATE_COMPRESSED_INCOMPLETE;
+
+    struct Scan* scan = malloc(sizeof(struct Scan));
+    if (!scan)
+        return INFLATE_NO_MEMORY;
+    scan->verify = verify;
+    inflate_window_init(&scan->window, NULL, 0);
+    if (verify && inflate_window_create(&scan->window, INFLATE_WINDOW_DEFAULT_CAPACITY, true)) {
+        free(scan);
+        return INFLATE_NO_MEMORY;
+    }
+
+    const uint8_t* compressed_next = compressed;
+    const uint8_t* compressed_end = compressed + compressed_length;
+    size_t length = 0;
+    int result = INFLATE_SUCCESS;
+
+    switch (format) {
+        case INFLATE_FORMAT_RAW:
+            result = scan_deflate(scan, compressed_next, compressed_length, NULL, NULL, &length, &compressed_next);
+            break;
+        case INFLATE_FORMAT_ZLIB: {
+            result = zlib_parse_header(compressed_next, compressed_length);
+            if (result)
+                break;
+            compressed_next += ZLIB_HEADER_LENGTH;
+
+            uint32_t adler = 1;
+            result = scan_deflate(scan, compressed_next, compressed_end - compressed_next, adler32_update, &adler, &length, &compressed_next);
+            if (result)
+                break;
+
+            if (compressed_end - compressed_next < ZLIB_TRAILER_LENGTH)
+                result = INFLATE_COMPRESSED_INCOMPLETE;
+            else if (verify && zlib_read_be32(compressed_next) != adler)
+                result = INFLATE_CHECKSUM_MISMATCH;
+            break;
+        }
+        case INFLATE_FORMAT_GZIP:
+            while (!result && compressed_next < compressed_end) {
+                struct GzipHeader header;
+                result = gzip_parse_header(compressed_next, compressed_end - compressed_next, &header);
+                if (result)
+                    break;
+                compressed_next += header.header_length;
+
+                uint32_t crc = 0;
+                size_t member_length = 0;
+                result = scan_deflate(scan, compressed_next, compressed_end - compressed_next, crc32_update, &crc, &member_length, &compressed_next);
+                length += member_length;
+                if (result)
+                    break;
+
+                if (compressed_end - compressed_next < GZIP_TRAILER_LENGTH)
+                    result = INFLATE_COMPRESSED_INCOMPLETE;
+                else if (verify && (gzip_read_le32(compressed_next) != crc || gzip_read_le32(compressed_next + 4) != (uint32_t)member_length))
+                    result = INFLATE_CHECKSUM_MISMATCH;
+                compressed_next += GZIP_TRAILER_LENGTH;
+            }
+            break;
+        default:
+            result = INFLATE_VALUE_NOT_ALLOWED;
+    }
+
+    *decompressed_length = length;
+    inflate_window_destroy(&scan->window);
+    free(scan);
+
+    return result;
+}
+
+static int scan_deflate(struct Scan* scan, const uint8_t* compressed, size_t compressed_length, InflateCheck check, uint32_t* check_value, size_t* decompressed_length,
+                        const uint8_t** compressed_end) {
+    struct InflateStream* stream = &scan->stream;
+    inflate_stream_init(stream, compressed, compressed_length, NULL, 0);
+
+    int result = INFLATE_SUCCESS;
+    if (scan->verify)
+        result = verify_stream(stream, &scan->window, check, check_value, decompressed_length);
+    else
+        result = inflate_scan_count(stream, decompressed_length);
+    *compressed_end = inflate_stream_compressed_end(stream);
+
+    return result;
+}
+
+static int count_huffman_block(struct InflateStream* stream, size_t* position) {
+    const struct Inflator* inflator = &stream->inflator;
+    const uint8_t* compressed_next = stream->cursor.compressed_next;
+    const uint8_t* compressed_end = stream->cursor.compressed_end;
+    Buffer buffer = stream->cursor.buffer;
+    uint32_t buffer_count = stream->cursor.buffer_count;
+    size_t decompressed_length = *position;
+
+    int result = INFLATE_SUCCESS;
+    for (;;) {
+        if (buffer_count < INFLATE_MAX_TOKEN_BITS)
+            FILL_BUFFER();
+
+        InflateToken token;
+        unsigned token_bits;
+        result = inflate_decode_token(inflator, buffer, buffer_count, &token, &token_bits);
+        if (result)
+            break;
+
+        if (token & INFLATE_TOKEN_MATCH) {
+            /* Back references are still checked against the output so far. */
+            if (INFLATE_TOKEN_DISTANCE(token) > decompressed_length) {
+                result = INFLATE_INVALID_LZ77;
+                break;
+            }
+            decompressed_length += INFLATE_TOKEN_LENGTH(token);
+        } else if (token & INFLATE_TOKEN_END_OF_BLOCK) {
+            CONSUME_BITS(token_bits);
+            stream->state = stream->final_block ? INFLATE_STREAM_DONE : INFLATE_STREAM_BLOCK_HEADER;
+            break;
+        } else {
+            ++decompressed_length;
+        }
+        CONSUME_BITS(token_bits);
+    }
+
+    stream->cursor.compressed_next = compressed_next;
+    stream->cursor.buffer = buffer;
+    stream->cursor.buffer_count = buffer_count;
+    *position = decompressed_length;
+
+    return result;
+}
+
+static int verify_stream(struct InflateStream* stream, struct InflateWindow* window, InflateCheck check, uint32_t* check_value, size_t* decompressed_length) {
+    size_t length = 0;
+    int result = INFLATE_SUCCESS;
+
+    inflate_window_reset(window);
+    do {
+        inflate_window_prepare(window, &stream->cursor);
+        const uint8_t* decoded = stream->cursor.decompressed_next;
+        result = inflate_stream_decode(stream);
+
+        size_t decoded_length = stream->cursor.decompressed_next - decoded;
+        if (check)
+            *check_value = check(*check_value, decoded, decoded_length);
+        length += decoded_length;
+
+        inflate_window_commit(window, &stream->cursor);
+        inflate_window_drop(window);
+    } while (result == INFLATE_DECOMPRESSED_OVERFLOW);
+
+    *decompressed_length = length;
+
+    return result;
+}
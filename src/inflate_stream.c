@@ -0,0 +1,482 @@
+#include "inflate_stream.h"
+
+#include <stdbool.h>
+#include <stdint.h>
+#include <string.h>
+
+#include "bit_reader.h"
+#include "huffman.h"
+#include "inflate.h"
+#include "inflate_internal.h"
+
+
+
+/* Returned by decode_source() when a block header did not fit the input. The stream is left as it was before the header. */
+#define HEADER_INCOMPLETE   (-2)
+
+
+static const uint8_t code_length_code_length_order[INFLATE_CODE_LENGTH_CODE_COUNT] = {
+    16, 17, 18, 0, 8, 7, 9, 6, 10, 5, 11, 4, 12, 3, 13, 2, 14, 1, 15
+};
+
+
+/* Reads the code lengths of a dynamic Huffman block into inflator->u.s.code_lengths. */
+static int read_dynamic_code_lengths(struct InflateStream* stream, unsigned* literal_code_count, unsigned* distance_code_count);
+
+/* Copies as much of a stored block as input and output allow. */
+static int decode_stored_block(struct InflateStream* stream);
+
+/* Decodes Huffman block data until the end-of-block symbol or until input or output run out. */
+static int decode_huffman_block(struct InflateStream* stream);
+
+/* Decodes from the cursor's current input, restoring the stream when a block header is incomplete. */
+static int decode_source(struct InflateStream* stream);
+
+/* Hands back the whole bytes a finished stream loaded but did not use. returnable of them may go back to the caller's input. */
+static void return_unused(struct InflateStream* stream, struct InflateStash* stash, const uint8_t** compressed, size_t returnable);
+
+
+void inflate_stream_init(struct InflateStream* stream, const uint8_t* compressed, size_t compressed_length, uint8_t* decompressed, size_t decompressed_max_length) {
+    stream->cursor = (struct InflateCursor){
+        .compressed_next = compressed,
+        .compressed_end = compressed + compressed_length,
+        .buffer = 0,
+        .buffer_count = 0,
+        .decompressed_start = decompressed,
+        .decompressed_next = decompressed,
+        .decompressed_end = decompressed + decompressed_max_length,
+        .history = NULL,
+    };
+
+    stream->state = INFLATE_STREAM_BLOCK_HEADER;
+    stream->final_block = false;
+    stream->stored_remaining = 0;
+
+    stream->inflator.static_table_loaded = false;
+}
+
+int inflate_stream_block_header(struct InflateStream* stream) {
+    const uint8_t* compressed_next = stream->cursor.compressed_next;
+    const uint8_t* compressed_end = stream->cursor.compressed_end;
+    Buffer buffer = stream->cursor.buffer;
+    uint32_t buffer_count = stream->cursor.buffer_count;
+
+    struct Inflator* inflator = &stream->inflator;
+    int result = INFLATE_SUCCESS;
+
+    FILL_BUFFER();
+    if (buffer_count < 1 + 2)
+        return INFLATE_COMPRESSED_INCOMPLETE;
+    unsigned final_block = buffer & BITMASK(1);     // BFINAL: 1 bit.
+    unsigned block_type = buffer >> 1 & BITMASK(2); // BTYPE: 2 bits.
+
+    switch (block_type) {
+        case INFLATE_BLOCKTYPE_UNCOMPRESSED: {
+            /* Skip BFINAL, BTYPE and the padding up to the next byte boundary, then read LEN and NLEN. */
+            unsigned skip = 3 + ((buffer_count - 3) & BITMASK(3));
+            if (buffer_count < skip + 32)
+                return INFLATE_COMPRESSED_INCOMPLETE;
+            CONSUME_BITS(skip);
+
+            uint16_t block_length = PEEK_BITS(16);
+            uint16_t Nblock_length = buffer >> 16 & BITMASK(16);
+            if ((block_length ^ Nblock_length) != 0xFFFF)
+                return INFLATE_BLOCK_LENGTH_UNCERTAIN;
+            CONSUME_BITS(32);
+
+            stream->stored_remaining = block_length;
+            stream->state = INFLATE_STREAM_STORED;
+            break;
+        }
+        case INFLATE_BLOCKTYPE_STATIC_HUFFMAN:
+            CONSUME_BITS(3); // For BFINAL and BTYPE.
+
+            /* The static tables survive until a dynamic block overwrites them. */
+            if (!inflator->static_table_loaded) {
+                /* Initialise literal code lengths as defined by the deflate standard (RFC 1951). */
+                unsigned i = 0;
+                for (; i < 144; ++i)
+                    inflator->u.s.code_lengths[i] = 8;
+                for (; i < 256; ++i)
+                    inflator->u.s.code_lengths[i] = 9;
+                for (; i < 280; ++i)
+                    inflator->u.s.code_lengths[i] = 7;
+                for (; i < INFLATE_LITERAL_CODE_COUNT; ++i)
+                    inflator->u.s.code_lengths[i] = 8;
+
+                /* Initialise distance code lengths as defined by the deflate standard (RFC 1951). */
+                for (; i < INFLATE_LITERAL_CODE_COUNT + INFLATE_DISTANCE_CODE_COUNT; ++i)
+                    inflator->u.s.code_lengths[i] = 5;
+
+                /* The literal table overlays the code lengths, so the distance table has to be built first. */
+                result = build_distance_table(inflator, INFLATE_LITERAL_CODE_COUNT, INFLATE_DISTANCE_CODE_COUNT);
+                if (result)
+                    return result;
+                result = build_literal_table(inflator, INFLATE_LITERAL_CODE_COUNT);
+                if (result)
+                    return result;
+                inflator->static_table_loaded = true;
+            }
+
+            stream->state = INFLATE_STREAM_HUFFMAN;
+            break;
+        case INFLATE_BLOCKTYPE_DYNAMIC_HUFFMAN: {
+            stream->cursor.compressed_next = compressed_next;
+            stream->cursor.buffer = buffer;
+            stream->cursor.buffer_count = buffer_count;
+
+            unsigned literal_code_count = 0;
+            unsigned distance_code_count = 0;
+            inflator->static_table_loaded = false;
+            result = read_dynamic_code_lengths(stream, &literal_code_count, &distance_code_count);
+            if (result)
+                return result;
+
+            result = build_distance_table(inflator, literal_code_count, distance_code_count);
+            if (result)
+                return result;
+            result = build_literal_table(inflator, literal_code_count);
+            if (result)
+                return result;
+
+            stream->final_block = final_block;
+            stream->state = INFLATE_STREAM_HUFFMAN;
+            return INFLATE_SUCCESS;
+        }
+        default:
+            return INFLATE_INVALID_BLOCK_TYPE;
+    }
+
+    stream->cursor.compressed_next = compressed_next;
+    stream->cursor.buffer = buffer;
+    stream->cursor.buffer_count = buffer_count;
+    stream->final_block = final_block;
+
+    return INFLATE_SUCCESS;
+}
+
+int inflate_stream_decode_block(struct InflateStream* stream) {
+    int result = INFLATE_SUCCESS;
+
+    if (stream->state == INFLATE_STREAM_STORED)
+        result = decode_stored_block(stream);
+    else if (stream->state == INFLATE_STREAM_HUFFMAN)
+        result = decode_huffman_block(stream);
+
+    return result;
+}
+
+int inflate_stream_decode(struct InflateStream* stream) {
+    for (;;) {
+        int result = INFLATE_SUCCESS;
+        if (stream->state == INFLATE_STREAM_DONE)
+            return INFLATE_SUCCESS;
+        if (stream->state == INFLATE_STREAM_BLOCK_HEADER)
+            result = inflate_stream_block_header(stream);
+        else
+            result = inflate_stream_decode_block(stream);
+        if (result)
+            return result;
+    }
+}
+
+const uint8_t* inflate_stream_compressed_end(struct InflateStream* stream) {
+    /* Whole bytes still sitting in the bit buffer have not been used; a partial byte belongs to the stream. */
+    return stream->cursor.compressed_next - (stream->cursor.buffer_count >> 3);
+}
+
+int inflate_stream_feed(struct InflateStream* stream, struct InflateStash* stash, const uint8_t** compressed, const uint8_t* compressed_end) {
+    struct InflateCursor* cursor = &stream->cursor;
+    int result = INFLATE_SUCCESS;
+
+    if (stash->length) {
+        /* Top up the stash so a pending header can complete, then decode from it. */
+        size_t take = compressed_end - *compressed;
+        if (take > INFLATE_STASH_SIZE - stash->length)
+            take = INFLATE_STASH_SIZE - stash->length;
+        memcpy(stash->bytes + stash->length, *compressed, take);
+        stash->length += take;
+        *compressed += take;
+
+        cursor->compressed_next = stash->bytes;
+        cursor->compressed_end = stash->bytes + stash->length;
+        result = decode_source(stream);
+
+        size_t used = cursor->compressed_next - stash->bytes;
+        memmove(stash->bytes, stash->bytes + used, stash->length - used);
+        stash->length -= used;
+        cursor->compressed_next = NULL;
+        cursor->compressed_end = NULL;
+
+        if (result == HEADER_INCOMPLETE) {
+            /* A header never exceeds the stash, so a full stash means corrupt input. */
+            return stash->length == INFLATE_STASH_SIZE ? INFLATE_INVALID_HUFFMAN_CODE : INFLATE_COMPRESSED_INCOMPLETE;
+        }
+        if (result == INFLATE_SUCCESS)
+            return_unused(stream, stash, compressed, take);
+        if (result != INFLATE_COMPRESSED_INCOMPLETE)
+            return result;
+    }
+
+    /* The stash is empty, decode straight from the caller's input. */
+    const uint8_t* input_start = *compressed;
+    cursor->compressed_next = *compressed;
+    cursor->compressed_end = compressed_end;
+    result = decode_source(stream);
+    *compressed = cursor->compressed_next;
+
+    if (result == HEADER_INCOMPLETE) {
+        stash->length = compressed_end - *compressed;
+        memcpy(stash->bytes, *compressed, stash->length);
+        *compressed = compressed_end;
+        return INFLATE_COMPRESSED_INCOMPLETE;
+    }
+    if (result == INFLATE_SUCCESS)
+        return_unused(stream, stash, compressed, *compressed - input_start);
+
+    return result;
+}
+
+size_t inflate_stash_read(struct InflateStash* stash, const uint8_t** compressed, const uint8_t* compressed_end, uint8_t* bytes, size_t length) {
+    size_t from_stash = length < stash->length ? length : stash->length;
+    memcpy(bytes, stash->bytes, from_stash);
+    memmove(stash->bytes, stash->bytes + from_stash, stash->length - from_stash);
+    stash->length -= from_stash;
+
+    size_t from_input = length - from_stash;
+    if (from_input > (size_t)(compressed_end - *compressed))
+        from_input = compressed_end - *compressed;
+    memcpy(bytes + from_stash, *compressed, from_input);
+    *compressed += from_input;
+
+    return from_stash + from_input;
+}
+
+void inflate_cursor_copy_history(struct InflateCursor* cursor, unsigned distance, unsigned length) {
+    const struct InflateHistory* history = cursor->history;
+    uint8_t* destination = cursor->decompressed_next;
+    uint8_t* end = destination + length;
+
+    /* Bytes before decompressed_start, counted from the end of the history. */
+    size_t before_start = distance - (cursor->decompressed_next - cursor->decompressed_start);
+    size_t offset = history->start + history->length - before_start;
+    if (offset >= history->capacity)
+        offset -= history->capacity;
+
+    const uint8_t* source = history->bytes + offset;
+    const uint8_t* source_end = history->bytes + history->capacity;
+    uint8_t* history_end = before_start < length ? destination + before_start : end;
+    while (destination < history_end) {
+        *destination++ = *source++;
+        if (source == source_end)
+            source = history->bytes;
+    }
+
+    /* The rest continues from decompressed_start and may run into the bytes just written. */
+    source = cursor->decompressed_start;
+    while (destination < end)
+        *destination++ = *source++;
+
+    cursor->decompressed_next = end;
+}
+
+
+
+static int read_dynamic_code_lengths(struct InflateStream* stream, unsigned* literal_code_count, unsigned* distance_code_count) {
+    const uint8_t* compressed_next = stream->cursor.compressed_next;
+    const uint8_t* compressed_end = stream->cursor.compressed_end;
+    Buffer buffer = stream->cursor.buffer;
+    uint32_t buffer_count = stream->cursor.buffer_count;
+
+    struct Inflator* inflator = &stream->inflator;
+
+    /* Read HLIT, HDIST and HCLEN. */
+    if (buffer_count < 1 + 2 + 5 + 5 + 4 + 3)
+        return INFLATE_COMPRESSED_INCOMPLETE;
+    *literal_code_count = 257 + (buffer >> 3 & BITMASK(5));
+    *distance_code_count = 1 + (buffer >> 8 & BITMASK(5));
+    unsigned code_length_code_count = 4 + (buffer >> 13 & BITMASK(4));
+
+    inflator->u.code_length_code_lengths[code_length_code_length_order[0]] = buffer >> 17 & BITMASK(3);
+    CONSUME_BITS(20);
+    FILL_BUFFER();
+    if (buffer_count < 3 * (code_length_code_count - 1))
+        return INFLATE_COMPRESSED_INCOMPLETE;
+
+    /* Get code length code lengths and construct code length table. */
+    unsigned i = 1;
+    for (; i < code_length_code_count; ++i) {
+        inflator->u.code_length_code_lengths[code_length_code_length_order[i]] = buffer & BITMASK(3);
+        CONSUME_BITS(3);
+    }
+    for (; i < INFLATE_CODE_LENGTH_CODE_COUNT; ++i)
+        inflator->u.code_length_code_lengths[code_length_code_length_order[i]] = 0;
+
+    int result = build_code_length_table(inflator);
+    if (result)
+        return result;
+
+    unsigned code_count = *literal_code_count + *distance_code_count;
+    i = 0;
+    do {
+        if (buffer_count < INFLATE_MAX_CODE_LENGTH_CODE_LENGTH + 7)
+            FILL_BUFFER();
+
+        uint32_t entry = inflator->u.s.code_length_table[buffer & BITMASK(INFLATE_MAX_CODE_LENGTH_CODE_LENGTH)];
+        CHECK_ENOUGH_BITS_IN_BUFFER((uint8_t)entry);
+        CONSUME_BITS((uint8_t)entry);
+        unsigned code = entry >> 16;
+
+        unsigned repeat_value = 0;
+        unsigned repeat_count = 0;
+        if (code < 16) {
+            inflator->u.s.code_lengths[i] = code;
+            ++i;
+        } else if (code == 16) {
+            CHECK_ENOUGH_BITS_IN_BUFFER(2);
+            if (!i)
+                return INFLATE_INVALID_HUFFMAN_CODE;
+
+            repeat_value = inflator->u.s.code_lengths[i - 1];
+            repeat_count = 3 + (buffer & BITMASK(2));
+            CONSUME_BITS(2);
+            inflator->u.s.code_lengths[i] = repeat_value;
+            inflator->u.s.code_lengths[i + 1] = repeat_value;
+            inflator->u.s.code_lengths[i + 2] = repeat_value;
+            inflator->u.s.code_lengths[i + 3] = repeat_value;
+            inflator->u.s.code_lengths[i + 4] = repeat_value;
+            inflator->u.s.code_lengths[i + 5] = repeat_value;
+            i += repeat_count;
+        } else if (code == 17) {
+            CHECK_ENOUGH_BITS_IN_BUFFER(3);
+
+            repeat_count = 3 + (buffer & BITMASK(3));
+            CONSUME_BITS(3);
+            inflator->u.s.code_lengths[i] = 0;
+            inflator->u.s.code_lengths[i + 1] = 0;
+            inflator->u.s.code_lengths[i + 2] = 0;
+            inflator->u.s.code_lengths[i + 3] = 0;
+            inflator->u.s.code_lengths[i + 4] = 0;
+            inflator->u.s.code_lengths[i + 5] = 0;
+            inflator->u.s.code_lengths[i + 6] = 0;
+            inflator->u.s.code_lengths[i + 7] = 0;
+            inflator->u.s.code_lengths[i + 8] = 0;
+            inflator->u.s.code_lengths[i + 9] = 0;
+            i += repeat_count;
+        } else {
+            CHECK_ENOUGH_BITS_IN_BUFFER(7);
+
+            repeat_count = 11 + (buffer & BITMASK(7));
+            CONSUME_BITS(7);
+            memset(&inflator->u.s.code_lengths[i], 0, repeat_count * sizeof(inflator->u.s.code_lengths[i]));
+            i += repeat_count;
+        }
+    } while (i < code_count);
+
+    /* A repeat may not run past the last code length. */
+    if (i > code_count)
+        return INFLATE_INVALID_HUFFMAN_CODE;
+
+    stream->cursor.compressed_next = compressed_next;
+    stream->cursor.buffer = buffer;
+    stream->cursor.buffer_count = buffer_count;
+
+    return INFLATE_SUCCESS;
+}
+
+static int decode_stored_block(struct InflateStream* stream) {
+    struct InflateCursor* cursor = &stream->cursor;
+
+    /* Bytes already pulled into the bit buffer come first. */
+    while (stream->stored_remaining && cursor->buffer_count >= 8) {
+        if (cursor->decompressed_next == cursor->decompressed_end)
+            return INFLATE_DECOMPRESSED_OVERFLOW;
+        *cursor->decompressed_next = (uint8_t)cursor->buffer;
+        ++cursor->decompressed_next;
+        cursor->buffer >>= 8;
+        cursor->buffer_count -= 8;
+        --stream->stored_remaining;
+    }
+
+    if (stream->stored_remaining) {
+        /* The bit buffer is empty but may still hold look-ahead copies of bytes that are now copied directly. */
+        cursor->buffer = 0;
+
+        size_t length = stream->stored_remaining;
+        if (length > (size_t)(cursor->compressed_end - cursor->compressed_next))
+            length = cursor->compressed_end - cursor->compressed_next;
+        if (length > (size_t)(cursor->decompressed_end - cursor->decompressed_next))
+            length = cursor->decompressed_end - cursor->decompressed_next;
+
+        memcpy(cursor->decompressed_next, cursor->compressed_next, length);
+        cursor->compressed_next += length;
+        cursor->decompressed_next += length;
+        stream->stored_remaining -= length;
+
+        if (stream->stored_remaining)
+            return cursor->compressed_next == cursor->compressed_end ? INFLATE_COMPRESSED_INCOMPLETE : INFLATE_DECOMPRESSED_OVERFLOW;
+    }
+
+    stream->state = stream->final_block ? INFLATE_STREAM_DONE : INFLATE_STREAM_BLOCK_HEADER;
+
+    return INFLATE_SUCCESS;
+}
+
+static int decode_huffman_block(struct InflateStream* stream) {
+    struct InflateCursor cursor = stream->cursor;
+    const struct Inflator* inflator = &stream->inflator;
+
+    int result;
+    do {
+        result = inflate_cursor_step(&cursor, inflator);
+    } while (!result);
+
+    stream->cursor = cursor;
+    if (result != INFLATE_STREAM_BLOCK_END)
+        return result;
+
+    stream->state = stream->final_block ? INFLATE_STREAM_DONE : INFLATE_STREAM_BLOCK_HEADER;
+
+    return INFLATE_SUCCESS;
+}
+
+static int decode_source(struct InflateStream* stream) {
+    for (;;) {
+        int result = INFLATE_SUCCESS;
+        if (stream->state == INFLATE_STREAM_DONE)
+            return INFLATE_SUCCESS;
+
+        if (stream->state == INFLATE_STREAM_BLOCK_HEADER) {
+            struct InflateCursor saved = stream->cursor;
+            result = inflate_stream_block_header(stream);
+            if (result == INFLATE_COMPRESSED_INCOMPLETE) {
+                stream->cursor = saved;
+                return HEADER_INCOMPLETE;
+            }
+        } else {
+            result = inflate_stream_decode_block(stream);
+        }
+        if (result)
+            return result;
+    }
+}
+
+static void return_unused(struct InflateStream* stream, struct InflateStash* stash, const uint8_t** compressed, size_t returnable) {
+    struct InflateCursor* cursor = &stream->cursor;
+
+    /* Drop the partial byte that ends the stream, the remaining bytes come before anything still stashed. */
+    unsigned buffered = cursor->buffer_count >> 3;
+    Buffer buffer = cursor->buffer >> (cursor->buffer_count & BITMASK(3));
+    memmove(stash->bytes + buffered, stash->bytes, stash->length);
+    for (unsigned i = 0; i < buffered; ++i)
+        stash->bytes[i] = (uint8_t)(buffer >> 8 * i);
+    stash->length += buffered;
+
+    /* The most recently taken bytes are the caller's and go back to its input. */
+    size_t returned = stash->length < returnable ? stash->length : returnable;
+    stash->length -= returned;
+    *compressed -= returned;
+
+    cursor->buffer = 0;
+    cursor->buffer_count = 0;
+}
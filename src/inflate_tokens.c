@@ -0,0 +1,412 @@
+/*
+ * Token export and re-encoding. Export walks the stream the way the scan modes
+ * do, decoding Huffman codes without producing output, and writes every token
+ * as a record instead. Re-encoding collects the records of a block into the
+ * deflator's token buffer and hands them to the encoder's block writer, so
+ * only symbol statistics and Huffman codes are computed again.
+ */
+
+#include "inflate_tokens.h"
+
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "bit_reader.h"
+#include "deflate.h"
+#include "gzip_header.h"
+#include "inflate.h"
+#include "inflate_internal.h"
+#include "inflate_stream.h"
+#include "zlib_header.h"
+
+
+
+#define TOKENS_MAGIC            "LZTK"
+#define TOKENS_VERSION          1
+#define TOKENS_HEADER_LENGTH    16
+
+#define TOKENS_MAX_RUN_TAG      0x7E
+#define TOKENS_BLOCK_TAG        0x7F
+#define TOKENS_MATCH_TAG        0x80
+
+/* Longest record: a match. */
+#define TOKENS_MAX_RECORD       3
+
+
+struct TokenWriter {
+    uint8_t* next;
+    uint8_t* end;
+    uint8_t* run;           // Tag of the literal run being extended, NULL after any other record.
+};
+
+
+/* Writes the records of the deflate stream at compressed. *compressed_end receives the first byte following it. */
+static int export_deflate(struct InflateStream* stream, struct TokenWriter* writer, const uint8_t* compressed, size_t compressed_length, size_t* decompressed_length,
+                          const uint8_t** compressed_end);
+
+/* Writes the records of Huffman block data until the end-of-block symbol. */
+static int export_huffman_block(struct InflateStream* stream, struct TokenWriter* writer, size_t* position);
+
+/* Writes the bytes of a stored block as literal runs. */
+static int export_stored_block(struct InflateStream* stream, struct TokenWriter* writer, size_t* position);
+
+
+static inline void put_literal(struct TokenWriter* writer, uint8_t literal) {
+    if (writer->run && *writer->run < TOKENS_MAX_RUN_TAG) {
+        ++*writer->run;
+    } else {
+        writer->run = writer->next;
+        *writer->next = 0;
+        ++writer->next;
+    }
+    *writer->next = literal;
+    ++writer->next;
+}
+
+static inline void put_match(struct TokenWriter* writer, unsigned length, unsigned distance) {
+    writer->next[0] = (uint8_t)(TOKENS_MATCH_TAG | (distance - 1) >> 8);
+    writer->next[1] = (uint8_t)(distance - 1);
+    writer->next[2] = (uint8_t)(length - INFLATE_MIN_LZ77_LENGTH);
+    writer->next += 3;
+    writer->run = NULL;
+}
+
+static inline void write_le64(uint8_t* bytes, uint64_t value) {
+    gzip_write_le32(bytes, (uint32_t)value);
+    gzip_write_le32(bytes + 4, (uint32_t)(value >> 32));
+}
+
+static inline uint64_t read_le64(const uint8_t* bytes) {
+    return gzip_read_le32(bytes) | (uint64_t)gzip_read_le32(bytes + 4) << 32;
+}
+
+
+extern size_t inflate_tokens_bound(size_t compressed_length, size_t decompressed_length) {
+    /* A byte of output costs at most a literal and its run tag. Every block takes at least 10 bits of input and 2 bytes of records. */
+    return TOKENS_HEADER_LENGTH + 2 * decompressed_length + 2 * (compressed_length * 8 / 10 + 1);
+}
+
+extern int inflate_tokens_export(const unsigned char* compressed, size_t compressed_length, enum InflateFormat format, unsigned char* tokens,
+                                 size_t* tokens_length, size_t tokens_max_length) {
+    *tokens_length = 0;
+
+    if (!tokens)
+        return INFLATE_NO_OUTPUT;
+    if (tokens_max_length < TOKENS_HEADER_LENGTH)
+        return INFLATE_DECOMPRESSED_OVERFLOW;
+    if (!compressed || !compressed_length)
+        return INFLATE_COMPRESSED_INCOMPLETE;
+
+    struct InflateStream* stream = malloc(sizeof(struct InflateStream));
+    if (!stream)
+        return INFLATE_NO_MEMORY;
+
+    struct TokenWriter writer = {
+        .next = tokens + TOKENS_HEADER_LENGTH,
+        .end = tokens + tokens_max_length,
+        .run = NULL,
+    };
+    const uint8_t* compressed_next = compressed;
+    const uint8_t* compressed_end = compressed + compressed_length;
+    size_t length = 0;
+    int result = INFLATE_SUCCESS;
+
+    switch (format) {
+        case INFLATE_FORMAT_RAW:
+            result = export_deflate(stream, &writer, compressed_next, compressed_length, &length, &compressed_next);
+            break;
+        case INFLATE_FORMAT_ZLIB:
+            result = zlib_parse_header(compressed_next, compressed_length);
+            if (result)
+                break;
+            compressed_next += ZLIB_HEADER_LENGTH;
+
+            result = export_deflate(stream, &writer, compressed_next, compressed_end - compressed_next, &length, &compressed_next);
+            if (!result && compressed_end - compressed_next < ZLIB_TRAILER_LENGTH)
+                result = INFLATE_COMPRESSED_INCOMPLETE;
+            break;
+        case INFLATE_FORMAT_GZIP:
+            while (!result && compressed_next < compressed_end) {
+                struct GzipHeader header;
+                result = gzip_parse_header(compressed_next, compressed_end - compressed_next, &header);
+                if (result)
+                    break;
+                compressed_next += header.header_length;
+
+                size_t member_length = 0;
+                result = export_deflate(stream, &writer, compressed_next, compressed_end - compressed_next, &member_length, &compressed_next);
+                length += member_length;
+                if (result)
+                    break;
+
+                if (compressed_end - compressed_next < GZIP_TRAILER_LENGTH)
+                    result = INFLATE_COMPRESSED_INCOMPLETE;
+                compressed_next += GZIP_TRAILER_LENGTH;
+            }
+            break;
+        default:
+            result = INFLATE_VALUE_NOT_ALLOWED;
+    }
+
+    free(stream);
+    if (result)
+        return result;
+
+    memcpy(tokens, TOKENS_MAGIC, 4);
+    gzip_write_le32(tokens + 4, TOKENS_VERSION);
+    write_le64(tokens + 8, length);
+    *tokens_length = writer.next - tokens;
+
+    return INFLATE_SUCCESS;
+}
+
+extern int inflate_tokens_encode(const unsigned char* tokens, size_t tokens_length, size_t block_tokens, unsigned char* compressed, size_t* compressed_length,
+                                 size_t compressed_max_length) {
+    *compressed_length = 0;
+
+    if (!compressed)
+        return INFLATE_NO_OUTPUT;
+    if (!tokens || tokens_length < TOKENS_HEADER_LENGTH)
+        return INFLATE_COMPRESSED_INCOMPLETE;
+    if (memcmp(tokens, TOKENS_MAGIC, 4) || gzip_read_le32(tokens + 4) != TOKENS_VERSION)
+        return INFLATE_INVALID_HEADER;
+
+    size_t block_limit = block_tokens && block_tokens < DEFLATE_BLOCK_TOKENS ? block_tokens : DEFLATE_BLOCK_TOKENS;
+    uint64_t expected_length = read_le64(tokens + 8);
+
+    /* The level only steers the matcher, which is not used here. */
+    struct Deflator* deflator = deflator_alloc(DEFLATE_MIN_LEVEL);
+    uint8_t* literals = malloc(DEFLATE_BLOCK_TOKENS);
+    if (!deflator || !literals) {
+        deflator_free(deflator);
+        free(literals);
+        return INFLATE_NO_MEMORY;
+    }
+
+    struct BitWriter writer;
+    deflate_writer_init(&writer, compressed, compressed_max_length);
+
+    const uint8_t* next = tokens + TOKENS_HEADER_LENGTH;
+    const uint8_t* end = tokens + tokens_length;
+    InflateToken* block = deflator->tokens;
+    size_t token_count = 0;
+    bool literals_only = true;     // While true, literals holds what the collected tokens decode to and a stored block is possible.
+    uint64_t position = 0;
+    int result = INFLATE_SUCCESS;
+
+    while (next < end) {
+        unsigned tag = *next;
+        ++next;
+
+        if (tag <= TOKENS_MAX_RUN_TAG) {
+            size_t run = tag + 1;
+            if ((size_t)(end - next) < run) {
+                result = INFLATE_COMPRESSED_INCOMPLETE;
+                break;
+            }
+            for (size_t i = 0; i < run; ++i) {
+                literals[token_count] = next[i];
+                block[token_count] = next[i];
+                if (++token_count == block_limit) {
+                    deflate_write_block(deflator, &writer, block, token_count, literals_only ? literals : NULL, token_count, false);
+                    token_count = 0;
+                    literals_only = true;
+                }
+            }
+            next += run;
+            position += run;
+        } else if (tag == TOKENS_BLOCK_TAG) {
+            if (next == end) {
+                result = INFLATE_COMPRESSED_INCOMPLETE;
+                break;
+            }
+            if (*next >> 3) {
+                result = INFLATE_VALUE_NOT_ALLOWED;
+                break;
+            }
+            ++next;
+
+            /* Keeping the source's blocks: close the previous one. Empty blocks are dropped. */
+            if (!block_tokens && token_count) {
+                deflate_write_block(deflator, &writer, block, token_count, literals_only ? literals : NULL, token_count, false);
+                token_count = 0;
+                literals_only = true;
+            }
+        } else {
+            if (end - next < TOKENS_MAX_RECORD - 1) {
+                result = INFLATE_COMPRESSED_INCOMPLETE;
+                break;
+            }
+            unsigned distance = ((tag & ~TOKENS_MATCH_TAG) << 8 | next[0]) + 1;
+            unsigned length = next[1] + INFLATE_MIN_LZ77_LENGTH;
+            next += 2;
+            if (length > INFLATE_MAX_LZ77_LENGTH) {
+                result = INFLATE_VALUE_NOT_ALLOWED;
+                break;
+            }
+            if (distance > position) {
+                result = INFLATE_INVALID_LZ77;
+                break;
+            }
+
+            block[token_count] = INFLATE_TOKEN_MATCH | length << 16 | (distance - 1);
+            literals_only = false;
+            position += length;
+            if (++token_count == block_limit) {
+                deflate_write_block(deflator, &writer, block, token_count, NULL, 0, false);
+                token_count = 0;
+                literals_only = true;
+            }
+        }
+    }
+
+    if (!result && position != expected_length)
+        result = INFLATE_COMPRESSED_INCOMPLETE;
+
+    if (!result) {
+        deflate_write_block(deflator, &writer, block, token_count, literals_only ? literals : NULL, token_count, true);
+        *compressed_length = deflate_writer_finish(&writer, compressed);
+        if (!*compressed_length)
+            result = INFLATE_DECOMPRESSED_OVERFLOW;
+    }
+
+    deflator_free(deflator);
+    free(literals);
+
+    return result;
+}
+
+
+
+static int export_deflate(struct InflateStream* stream, struct TokenWriter* writer, const uint8_t* compressed, size_t compressed_length, size_t* decompressed_length,
+                          const uint8_t** compressed_end) {
+    inflate_stream_init(stream, compressed, compressed_length, NULL, 0);
+    struct InflateCursor* cursor = &stream->cursor;
+    size_t position = 0;
+
+    int result = INFLATE_SUCCESS;
+    while (!result && stream->state != INFLATE_STREAM_DONE) {
+        if (stream->state == INFLATE_STREAM_BLOCK_HEADER) {
+            if (writer->end - writer->next < 2) {
+                result = INFLATE_DECOMPRESSED_OVERFLOW;
+                break;
+            }
+
+            /* BTYPE has to be looked at before the header is consumed. */
+            const uint8_t* compressed_next = cursor->compressed_next;
+            const uint8_t* compressed_end = cursor->compressed_end;
+            Buffer buffer = cursor->buffer;
+            uint32_t buffer_count = cursor->buffer_count;
+            FILL_BUFFER();
+            cursor->compressed_next = compressed_next;
+            cursor->buffer = buffer;
+            cursor->buffer_count = buffer_count;
+            unsigned block_type = buffer >> 1 & BITMASK(2);
+
+            result = inflate_stream_block_header(stream);
+            if (result)
+                break;
+            writer->next[0] = TOKENS_BLOCK_TAG;
+            writer->next[1] = (uint8_t)(block_type << 1 | stream->final_block);
+            writer->next += 2;
+            writer->run = NULL;
+        } else if (stream->state == INFLATE_STREAM_STORED) {
+            result = export_stored_block(stream, writer, &position);
+        } else {
+            result = export_huffman_block(stream, writer, &position);
+        }
+    }
+
+    *decompressed_length = position;
+    *compressed_end = inflate_stream_compressed_end(stream);
+
+    return result;
+}
+
+static int export_huffman_block(struct InflateStream* stream, struct TokenWriter* writer, size_t* position) {
+    const struct Inflator* inflator = &stream->inflator;
+    const uint8_t* compressed_next = stream->cursor.compressed_next;
+    const uint8_t* compressed_end = stream->cursor.compressed_end;
+    Buffer buffer = stream->cursor.buffer;
+    uint32_t buffer_count = stream->cursor.buffer_count;
+    size_t decompressed_length = *position;
+
+    int result = INFLATE_SUCCESS;
+    for (;;) {
+        if (buffer_count < INFLATE_MAX_TOKEN_BITS)
+            FILL_BUFFER();
+
+        InflateToken token;
+        unsigned token_bits;
+        result = inflate_decode_token(inflator, buffer, buffer_count, &token, &token_bits);
+        if (result)
+            break;
+        if (token & INFLATE_TOKEN_END_OF_BLOCK) {
+            CONSUME_BITS(token_bits);
+            stream->state = stream->final_block ? INFLATE_STREAM_DONE : INFLATE_STREAM_BLOCK_HEADER;
+            break;
+        }
+        if (writer->end - writer->next < TOKENS_MAX_RECORD) {
+            result = INFLATE_DECOMPRESSED_OVERFLOW;
+            break;
+        }
+
+        if (token & INFLATE_TOKEN_MATCH) {
+            if (INFLATE_TOKEN_DISTANCE(token) > decompressed_length) {
+                result = INFLATE_INVALID_LZ77;
+                break;
+            }
+            put_match(writer, INFLATE_TOKEN_LENGTH(token), INFLATE_TOKEN_DISTANCE(token));
+            decompressed_length += INFLATE_TOKEN_LENGTH(token);
+        } else {
+            put_literal(writer, (uint8_t)token);
+            ++decompressed_length;
+        }
+        CONSUME_BITS(token_bits);
+    }
+
+    stream->cursor.compressed_next = compressed_next;
+    stream->cursor.buffer = buffer;
+    stream->cursor.buffer_count = buffer_count;
+    *position = decompressed_length;
+
+    return result;
+}
+
+static int export_stored_block(struct InflateStream* stream, struct TokenWriter* writer, size_t* position) {
+    struct InflateCursor* cursor = &stream->cursor;
+
+    /* Bytes already in the bit buffer come first. */
+    while (stream->stored_remaining && cursor->buffer_count >= 8) {
+        if (writer->end - writer->next < 2)
+            return INFLATE_DECOMPRESSED_OVERFLOW;
+        put_literal(writer, (uint8_t)cursor->buffer);
+        cursor->buffer >>= 8;
+        cursor->buffer_count -= 8;
+        --stream->stored_remaining;
+        ++*position;
+    }
+
+    if (stream->stored_remaining) {
+        cursor->buffer = 0;
+
+        size_t length = stream->stored_remaining;
+        if (length > (size_t)(cursor->compressed_end - cursor->compressed_next))
+            return INFLATE_COMPRESSED_INCOMPLETE;
+        if ((size_t)(writer->end - writer->next) < length + length / (TOKENS_MAX_RUN_TAG + 1) + 1)
+            return INFLATE_DECOMPRESSED_OVERFLOW;
+
+        for (size_t i = 0; i < length; ++i)
+            put_literal(writer, cursor->compressed_next[i]);
+        cursor->compressed_next += length;
+        stream->stored_remaining = 0;
+        *position += length;
+    }
+
+    stream->state = stream->final_block ? INFLATE_STREAM_DONE : INFLATE_STREAM_BLOCK_HEADER;
+
+    return INFLATE_SUCCESS;
+}
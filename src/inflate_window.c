@@ -0,0 +1,168 @@
+#if defined(__linux__)
+#define _GNU_SOURCE     // memfd_create()
+#endif
+
+#include "inflate_window.h"
+
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+#include <stdlib.h>
+#include <string.h>
+
+#if defined(__unix__)
+#include <sys/mman.h>
+#include <unistd.h>
+#endif
+
+#include "inflate.h"
+#include "inflate_internal.h"
+#include "inflate_stream.h"
+
+
+
+/* Maps capacity bytes of fresh memory twice in a row. Returns NULL where that is not possible. */
+static uint8_t* map_mirrored(size_t capacity);
+
+/* Offset of the oldest byte the window must keep: the history or the first pending byte, whichever comes first. */
+static inline size_t keep_from(const struct InflateWindow* window) {
+    size_t offset = window->end > INFLATE_MAX_LZ77_DISTANCE ? window->end - INFLATE_MAX_LZ77_DISTANCE : 0;
+    return offset < window->pending ? offset : window->pending;
+}
+
+
+void inflate_window_init(struct InflateWindow* window, uint8_t* buffer, size_t capacity) {
+    window->buffer = buffer;
+    window->capacity = capacity;
+    window->memory = INFLATE_WINDOW_BORROWED;
+    inflate_window_reset(window);
+}
+
+int inflate_window_create(struct InflateWindow* window, size_t capacity, bool mirrored) {
+    if (capacity < 2 * INFLATE_MAX_LZ77_DISTANCE)
+        capacity = 2 * INFLATE_MAX_LZ77_DISTANCE;
+
+#if defined(__unix__)
+    if (mirrored) {
+        size_t page_size = (size_t)sysconf(_SC_PAGESIZE);
+        size_t ring_capacity = (capacity + page_size - 1) / page_size * page_size;
+        uint8_t* buffer = map_mirrored(ring_capacity);
+        if (buffer) {
+            inflate_window_init(window, buffer, ring_capacity);
+            window->memory = INFLATE_WINDOW_MIRRORED;
+            return INFLATE_SUCCESS;
+        }
+    }
+#else
+    (void)mirrored;
+#endif
+
+    if (capacity < INFLATE_WINDOW_SLIDING_CAPACITY)
+        capacity = INFLATE_WINDOW_SLIDING_CAPACITY;
+    uint8_t* buffer = malloc(capacity);
+    if (!buffer)
+        return INFLATE_NO_MEMORY;
+    inflate_window_init(window, buffer, capacity);
+    window->memory = INFLATE_WINDOW_ALLOCATED;
+
+    return INFLATE_SUCCESS;
+}
+
+void inflate_window_destroy(struct InflateWindow* window) {
+#if defined(__unix__)
+    if (window->memory == INFLATE_WINDOW_MIRRORED)
+        munmap(window->buffer, 2 * window->capacity);
+#endif
+    if (window->memory == INFLATE_WINDOW_ALLOCATED)
+        free(window->buffer);
+
+    window->buffer = NULL;
+    window->capacity = 0;
+    window->memory = INFLATE_WINDOW_BORROWED;
+    inflate_window_reset(window);
+}
+
+void inflate_window_reset(struct InflateWindow* window) {
+    window->pending = 0;
+    window->end = 0;
+}
+
+void inflate_window_prepare(struct InflateWindow* window, struct InflateCursor* cursor) {
+    size_t kept = keep_from(window);
+
+    if (window->memory == INFLATE_WINDOW_MIRRORED) {
+        /*
+         * Byte i and byte i + capacity share an address, so moving back by whole
+         * capacities costs nothing. That keeps kept in the first mapping and the
+         * next capacity bytes from it writable without wrapping. Bytes before
+         * kept may be overwritten, the last INFLATE_MAX_LZ77_DISTANCE never are.
+         */
+        size_t turns = kept - kept % window->capacity;
+        window->pending -= turns;
+        window->end -= turns;
+
+        cursor->decompressed_start = window->buffer;
+        cursor->decompressed_next = window->buffer + window->end;
+        cursor->decompressed_end = window->buffer + (kept - turns) + window->capacity;
+        return;
+    }
+
+    /* Sliding costs a copy of the kept bytes, so only do it once a quarter of the window is left. */
+    if (window->capacity - window->end < window->capacity / 4 && kept) {
+        memmove(window->buffer, window->buffer + kept, window->end - kept);
+        window->pending -= kept;
+        window->end -= kept;
+    }
+
+    cursor->decompressed_start = window->buffer;
+    cursor->decompressed_next = window->buffer + window->end;
+    cursor->decompressed_end = window->buffer + window->capacity;
+}
+
+void inflate_window_commit(struct InflateWindow* window, const struct InflateCursor* cursor) {
+    window->end = cursor->decompressed_next - window->buffer;
+}
+
+size_t inflate_window_take(struct InflateWindow* window, uint8_t* decompressed, size_t length) {
+    size_t pending_length = inflate_window_pending_length(window);
+    if (length > pending_length)
+        length = pending_length;
+
+    if (length) {
+        memcpy(decompressed, window->buffer + window->pending, length);
+        window->pending += length;
+    }
+
+    return length;
+}
+
+
+
+static uint8_t* map_mirrored(size_t capacity) {
+#if defined(__linux__) && defined(MFD_CLOEXEC)
+    int file = memfd_create("inflate_window", MFD_CLOEXEC);
+    if (file < 0)
+        return NULL;
+
+    uint8_t* buffer = NULL;
+    if (!ftruncate(file, (off_t)capacity)) {
+        /* Reserve the whole range first so nothing else can be mapped between the halves. */
+        uint8_t* reserved = mmap(NULL, 2 * capacity, PROT_NONE, MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+        if (reserved != MAP_FAILED) {
+            if (mmap(reserved, capacity, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_FIXED, file, 0) != MAP_FAILED &&
+                mmap(reserved + capacity, capacity, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_FIXED, file, 0) != MAP_FAILED)
+                buffer = reserved;
+            else
+                munmap(reserved, 2 * capacity);
+        }
+    }
+
+    /* The mappings keep the memory alive. */
+    close(file);
+
+    return buffer;
+#else
+    (void)capacity;
+    return NULL;
+#endif
+}
@@ -0,0 +1,330 @@
+/*
+ * PNG image data decoding. The zlib stream is fed to an InflateStream chunk
+ * by chunk, so IDAT data is never concatenated; a block header split between
+ * chunks waits in the stash. Filtered scanlines collect in an InflateWindow,
+ * which holds the history back references need, and each one is added to the
+ * Adler-32 and unfiltered into the output as soon as its last byte is decoded,
+ * while it and the row above are still in cache.
+ */
+
+#include "png_decode.h"
+
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "adler32.h"
+#include "crc32.h"
+#include "inflate.h"
+#include "inflate_stream.h"
+#include "inflate_window.h"
+#include "png_filter.h"
+#include "zlib_header.h"
+
+
+
+#define PNG_SIGNATURE_LENGTH        8
+#define PNG_CHUNK_HEADER_LENGTH     8       // Length and type.
+#define PNG_CHUNK_CRC_LENGTH        4
+#define PNG_IHDR_LENGTH             13
+#define PNG_MAX_CHUNK_LENGTH        0x7FFFFFFF
+#define PNG_MAX_DIMENSION           0x7FFFFFFF
+
+/* Decoder states. */
+#define PNG_STATE_HEADER            0
+#define PNG_STATE_DEFLATE           1
+#define PNG_STATE_TRAILER           2
+#define PNG_STATE_DONE              3
+
+
+static const uint8_t png_signature[PNG_SIGNATURE_LENGTH] = { 137, 80, 78, 71, 13, 10, 26, 10 };
+
+
+struct PngDecoder {
+    struct InflateStream stream;
+    struct InflateStash stash;
+    struct InflateWindow window;
+
+    const struct PngImage* image;
+    uint8_t* pixels;
+    const uint8_t* zero_row;    // The row above the first row.
+    uint32_t row;
+
+    unsigned state;
+    uint8_t wrapper[ZLIB_TRAILER_LENGTH];
+    size_t wrapper_length;
+    uint32_t adler;
+};
+
+
+/* Allocates a decoder for the image. The zero row lives right behind it. */
+static int decoder_create(const struct PngImage* image, uint8_t* pixels, size_t pixels_max_length, struct PngDecoder** decoder);
+
+static void decoder_destroy(struct PngDecoder* decoder);
+
+/* Decodes the zlib stream data of one chunk. Returns INFLATE_COMPRESSED_INCOMPLETE when the next chunk is needed and INFLATE_SUCCESS once the stream is complete. */
+static int decoder_feed(struct PngDecoder* decoder, const uint8_t* data, size_t length);
+
+/* Checksums and unfilters every complete scanline pending in the window. */
+static int unfilter_rows(struct PngDecoder* decoder);
+
+static bool chunk_type_is(const uint8_t* chunk, const char* type);
+
+
+extern int png_read_header(const unsigned char* png, size_t png_length, struct PngImage* image) {
+    *image = (struct PngImage){ 0 };
+
+    if (png_length < PNG_SIGNATURE_LENGTH + PNG_CHUNK_HEADER_LENGTH + PNG_IHDR_LENGTH + PNG_CHUNK_CRC_LENGTH)
+        return INFLATE_COMPRESSED_INCOMPLETE;
+    if (memcmp(png, png_signature, PNG_SIGNATURE_LENGTH))
+        return INFLATE_INVALID_HEADER;
+
+    const uint8_t* chunk = png + PNG_SIGNATURE_LENGTH;
+    if (zlib_read_be32(chunk) != PNG_IHDR_LENGTH || !chunk_type_is(chunk, "IHDR"))
+        return INFLATE_INVALID_HEADER;
+    if (crc32_update(0, chunk + 4, 4 + PNG_IHDR_LENGTH) != zlib_read_be32(chunk + PNG_CHUNK_HEADER_LENGTH + PNG_IHDR_LENGTH))
+        return INFLATE_CHECKSUM_MISMATCH;
+
+    const uint8_t* data = chunk + PNG_CHUNK_HEADER_LENGTH;
+    uint32_t width = zlib_read_be32(data);
+    uint32_t height = zlib_read_be32(data + 4);
+    uint8_t bit_depth = data[8];
+    uint8_t color_type = data[9];
+    if (!width || !height || width > PNG_MAX_DIMENSION || height > PNG_MAX_DIMENSION)
+        return INFLATE_INVALID_HEADER;
+    if (data[10] || data[11] || data[12] > 1)
+        return INFLATE_INVALID_HEADER;
+
+    /* Allowed bit depths per color type. */
+    unsigned channels;
+    bool allowed;
+    switch (color_type) {
+        case PNG_COLOR_GRAY:
+            channels = 1;
+            allowed = bit_depth == 1 || bit_depth == 2 || bit_depth == 4 || bit_depth == 8 || bit_depth == 16;
+            break;
+        case PNG_COLOR_PALETTE:
+            channels = 1;
+            allowed = bit_depth == 1 || bit_depth == 2 || bit_depth == 4 || bit_depth == 8;
+            break;
+        case PNG_COLOR_RGB:
+            channels = 3;
+            allowed = bit_depth == 8 || bit_depth == 16;
+            break;
+        case PNG_COLOR_GRAY_ALPHA:
+            channels = 2;
+            allowed = bit_depth == 8 || bit_depth == 16;
+            break;
+        case PNG_COLOR_RGBA:
+            channels = 4;
+            allowed = bit_depth == 8 || bit_depth == 16;
+            break;
+        default:
+            return INFLATE_INVALID_HEADER;
+    }
+    if (!allowed)
+        return INFLATE_INVALID_HEADER;
+
+    unsigned bits_per_pixel = channels * bit_depth;
+    *image = (struct PngImage){
+        .width = width,
+        .height = height,
+        .bit_depth = bit_depth,
+        .color_type = color_type,
+        .interlace = data[12],
+        .row_length = ((size_t)width * bits_per_pixel + 7) / 8,
+        .bytes_per_pixel = bits_per_pixel < 8 ? 1 : bits_per_pixel / 8,
+    };
+
+    return INFLATE_SUCCESS;
+}
+
+extern int png_decode(const unsigned char* png, size_t png_length, unsigned char* pixels, size_t pixels_max_length, struct PngImage* image) {
+    int result = png_read_header(png, png_length, image);
+    if (result)
+        return result;
+
+    struct PngDecoder* decoder;
+    result = decoder_create(image, pixels, pixels_max_length, &decoder);
+    if (result)
+        return result;
+
+    /* Walk the chunks, feeding IDAT data as it comes. */
+    size_t offset = PNG_SIGNATURE_LENGTH + PNG_CHUNK_HEADER_LENGTH + PNG_IHDR_LENGTH + PNG_CHUNK_CRC_LENGTH;
+    result = INFLATE_COMPRESSED_INCOMPLETE;
+    while (result == INFLATE_COMPRESSED_INCOMPLETE) {
+        if (png_length - offset < PNG_CHUNK_HEADER_LENGTH + PNG_CHUNK_CRC_LENGTH)
+            break;
+
+        const uint8_t* chunk = png + offset;
+        uint32_t length = zlib_read_be32(chunk);
+        if (length > PNG_MAX_CHUNK_LENGTH) {
+            result = INFLATE_INVALID_HEADER;
+            break;
+        }
+        if (png_length - offset - PNG_CHUNK_HEADER_LENGTH - PNG_CHUNK_CRC_LENGTH < length)
+            break;
+        offset += PNG_CHUNK_HEADER_LENGTH + length + PNG_CHUNK_CRC_LENGTH;
+
+        if (chunk_type_is(chunk, "IEND"))
+            break;
+        if (!chunk_type_is(chunk, "IDAT"))
+            continue;
+
+        if (crc32_update(0, chunk + 4, 4 + (size_t)length) != zlib_read_be32(chunk + PNG_CHUNK_HEADER_LENGTH + length)) {
+            result = INFLATE_CHECKSUM_MISMATCH;
+            break;
+        }
+        result = decoder_feed(decoder, chunk + PNG_CHUNK_HEADER_LENGTH, length);
+    }
+
+    decoder_destroy(decoder);
+
+    return result;
+}
+
+extern int png_decode_idat(const struct PngImage* image, const unsigned char* const* chunks, const size_t* chunk_lengths, size_t chunk_count, unsigned char* pixels,
+                           size_t pixels_max_length) {
+    struct PngDecoder* decoder;
+    int result = decoder_create(image, pixels, pixels_max_length, &decoder);
+    if (result)
+        return result;
+
+    result = INFLATE_COMPRESSED_INCOMPLETE;
+    for (size_t i = 0; i < chunk_count && result == INFLATE_COMPRESSED_INCOMPLETE; ++i)
+        result = decoder_feed(decoder, chunks[i], chunk_lengths[i]);
+
+    decoder_destroy(decoder);
+
+    return result;
+}
+
+
+
+static int decoder_create(const struct PngImage* image, uint8_t* pixels, size_t pixels_max_length, struct PngDecoder** decoder) {
+    *decoder = NULL;
+
+    if (!pixels)
+        return INFLATE_NO_OUTPUT;
+    if (image->interlace)
+        return INFLATE_VALUE_NOT_ALLOWED;
+    if (image->row_length > pixels_max_length / image->height)
+        return INFLATE_DECOMPRESSED_OVERFLOW;
+
+    /*
+     * Room for the history and two filtered rows, so the window always makes
+     * progress. A mirrored window never slides, however long the rows are.
+     */
+    size_t filtered_length = image->row_length + 1;
+    size_t window_capacity = 2 * INFLATE_WINDOW_DEFAULT_CAPACITY + 2 * filtered_length;
+    struct PngDecoder* created = malloc(sizeof(struct PngDecoder) + image->row_length);
+    if (!created)
+        return INFLATE_NO_MEMORY;
+    if (inflate_window_create(&created->window, window_capacity, true)) {
+        free(created);
+        return INFLATE_NO_MEMORY;
+    }
+
+    uint8_t* zero_row = (uint8_t*)(created + 1);
+    memset(zero_row, 0, image->row_length);
+
+    inflate_stream_init(&created->stream, NULL, 0, NULL, 0);
+    created->stash.length = 0;
+    created->image = image;
+    created->pixels = pixels;
+    created->zero_row = zero_row;
+    created->row = 0;
+    created->state = PNG_STATE_HEADER;
+    created->wrapper_length = 0;
+    created->adler = 1;
+
+    *decoder = created;
+
+    return INFLATE_SUCCESS;
+}
+
+static void decoder_destroy(struct PngDecoder* decoder) {
+    inflate_window_destroy(&decoder->window);
+    free(decoder);
+}
+
+static int decoder_feed(struct PngDecoder* decoder, const uint8_t* data, size_t length) {
+    const uint8_t* in = data;
+    const uint8_t* in_end = data + length;
+
+    for (;;) {
+        if (decoder->state == PNG_STATE_HEADER) {
+            decoder->wrapper_length += inflate_stash_read(&decoder->stash, &in, in_end, decoder->wrapper + decoder->wrapper_length, ZLIB_HEADER_LENGTH - decoder->wrapper_length);
+            if (decoder->wrapper_length < ZLIB_HEADER_LENGTH)
+                return INFLATE_COMPRESSED_INCOMPLETE;
+
+            int result = zlib_parse_header(decoder->wrapper, ZLIB_HEADER_LENGTH);
+            if (result)
+                return result;
+            decoder->wrapper_length = 0;
+            decoder->state = PNG_STATE_DEFLATE;
+        } else if (decoder->state == PNG_STATE_DEFLATE) {
+            struct InflateWindow* window = &decoder->window;
+            inflate_window_prepare(window, &decoder->stream.cursor);
+            int result = inflate_stream_feed(&decoder->stream, &decoder->stash, &in, in_end);
+            inflate_window_commit(window, &decoder->stream.cursor);
+
+            int unfilter_result = unfilter_rows(decoder);
+            if (unfilter_result)
+                return unfilter_result;
+
+            if (result == INFLATE_SUCCESS) {
+                /* A partial last row still counts towards the checksum. */
+                decoder->adler = adler32_update(decoder->adler, window->buffer + window->pending, inflate_window_pending_length(window));
+                decoder->state = PNG_STATE_TRAILER;
+            } else if (result != INFLATE_DECOMPRESSED_OVERFLOW) {
+                return result;
+            }
+        } else if (decoder->state == PNG_STATE_TRAILER) {
+            decoder->wrapper_length += inflate_stash_read(&decoder->stash, &in, in_end, decoder->wrapper + decoder->wrapper_length, ZLIB_TRAILER_LENGTH - decoder->wrapper_length);
+            if (decoder->wrapper_length < ZLIB_TRAILER_LENGTH)
+                return INFLATE_COMPRESSED_INCOMPLETE;
+
+            if (zlib_read_be32(decoder->wrapper) != decoder->adler)
+                return INFLATE_CHECKSUM_MISMATCH;
+            /* The stream may end before the last scanline. */
+            if (decoder->row != decoder->image->height)
+                return INFLATE_COMPRESSED_INCOMPLETE;
+            decoder->state = PNG_STATE_DONE;
+        } else {
+            return INFLATE_SUCCESS;
+        }
+    }
+}
+
+static int unfilter_rows(struct PngDecoder* decoder) {
+    const struct PngImage* image = decoder->image;
+    struct InflateWindow* window = &decoder->window;
+    size_t row_length = image->row_length;
+
+    while (inflate_window_pending_length(window) > row_length && decoder->row < image->height) {
+        const uint8_t* filtered = window->buffer + window->pending;
+        uint8_t* row = decoder->pixels + (size_t)decoder->row * row_length;
+        const uint8_t* previous = decoder->row ? row - row_length : decoder->zero_row;
+
+        decoder->adler = adler32_update(decoder->adler, filtered, row_length + 1);
+        int result = png_unfilter_row(filtered[0], filtered + 1, previous, row, row_length, image->bytes_per_pixel);
+        if (result)
+            return result;
+
+        window->pending += row_length + 1;
+        ++decoder->row;
+    }
+
+    /* Data past the last scanline. */
+    if (decoder->row == image->height && inflate_window_pending_length(window))
+        return INFLATE_DECOMPRESSED_OVERFLOW;
+
+    return INFLATE_SUCCESS;
+}
+
+static bool chunk_type_is(const uint8_t* chunk, const char* type) {
+    return !memcmp(chunk + 4, type, 4);
+}
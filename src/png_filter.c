@@ -0,0 +1,187 @@
+/*
+ * Scanline unfiltering. Up has no dependency between bytes and is done a
+ * vector at a time. Sub, Average and Paeth depend on the pixel to the left, so
+ * for 3, 4, 6 and 8 byte pixels the SSE2 kernels work a whole pixel per step,
+ * as libpng does; other pixel sizes go byte by byte.
+ */
+
+#include "png_filter.h"
+
+#include <stddef.h>
+#include <stdint.h>
+#include <stdlib.h>
+#include <string.h>
+
+#if defined(__SSE2__)
+#include <emmintrin.h>
+#endif
+#if defined(__AVX2__)
+#include <immintrin.h>
+#endif
+
+#include "inflate.h"
+
+
+
+static void unfilter_sub(const uint8_t* filtered, uint8_t* row, size_t length, unsigned bytes_per_pixel);
+
+static void unfilter_up(const uint8_t* filtered, const uint8_t* previous, uint8_t* row, size_t length);
+
+static void unfilter_average(const uint8_t* filtered, const uint8_t* previous, uint8_t* row, size_t length, unsigned bytes_per_pixel);
+
+static void unfilter_paeth(const uint8_t* filtered, const uint8_t* previous, uint8_t* row, size_t length, unsigned bytes_per_pixel);
+
+
+static inline uint8_t paeth_predictor(uint8_t left, uint8_t up, uint8_t up_left) {
+    int estimate_left = abs((int)up - up_left);
+    int estimate_up = abs((int)left - up_left);
+    int estimate_up_left = abs((int)left + up - 2 * up_left);
+
+    /* Ties favour left, then up. */
+    if (estimate_left <= estimate_up && estimate_left <= estimate_up_left)
+        return left;
+    return estimate_up <= estimate_up_left ? up : up_left;
+}
+
+#if defined(__SSE2__)
+static inline int vector_pixel(unsigned bytes_per_pixel) {
+    return bytes_per_pixel == 3 || bytes_per_pixel == 4 || bytes_per_pixel == 6 || bytes_per_pixel == 8;
+}
+
+/* Loads a pixel into the low bytes of a vector without reading past it. */
+static inline __m128i load_pixel(const uint8_t* bytes, unsigned bytes_per_pixel) {
+    uint64_t pixel = 0;
+    memcpy(&pixel, bytes, bytes_per_pixel);
+    return _mm_loadl_epi64((const __m128i*)&pixel);
+}
+
+static inline void store_pixel(uint8_t* bytes, __m128i vector, unsigned bytes_per_pixel) {
+    uint64_t pixel;
+    _mm_storel_epi64((__m128i*)&pixel, vector);
+    memcpy(bytes, &pixel, bytes_per_pixel);
+}
+
+static inline __m128i select_vector(__m128i mask, __m128i a, __m128i b) {
+    return _mm_or_si128(_mm_and_si128(mask, a), _mm_andnot_si128(mask, b));
+}
+
+static inline __m128i abs_epi16(__m128i value) {
+    return _mm_max_epi16(value, _mm_sub_epi16(_mm_setzero_si128(), value));
+}
+#endif
+
+
+int png_unfilter_row(unsigned filter, const uint8_t* filtered, const uint8_t* previous, uint8_t* row, size_t length, unsigned bytes_per_pixel) {
+    switch (filter) {
+        case PNG_FILTER_NONE:
+            memcpy(row, filtered, length);
+            break;
+        case PNG_FILTER_SUB:
+            unfilter_sub(filtered, row, length, bytes_per_pixel);
+            break;
+        case PNG_FILTER_UP:
+            unfilter_up(filtered, previous, row, length);
+            break;
+        case PNG_FILTER_AVERAGE:
+            unfilter_average(filtered, previous, row, length, bytes_per_pixel);
+            break;
+        case PNG_FILTER_PAETH:
+            unfilter_paeth(filtered, previous, row, length, bytes_per_pixel);
+            break;
+        default:
+            return INFLATE_VALUE_NOT_ALLOWED;
+    }
+
+    return INFLATE_SUCCESS;
+}
+
+
+
+static void unfilter_sub(const uint8_t* filtered, uint8_t* row, size_t length, unsigned bytes_per_pixel) {
+    size_t i = 0;
+#if defined(__SSE2__)
+    if (vector_pixel(bytes_per_pixel)) {
+        __m128i left = _mm_setzero_si128();
+        for (; i + bytes_per_pixel <= length; i += bytes_per_pixel) {
+            left = _mm_add_epi8(load_pixel(filtered + i, bytes_per_pixel), left);
+            store_pixel(row + i, left, bytes_per_pixel);
+        }
+    }
+#endif
+    for (; i < length; ++i)
+        row[i] = filtered[i] + (i >= bytes_per_pixel ? row[i - bytes_per_pixel] : 0);
+}
+
+static void unfilter_up(const uint8_t* filtered, const uint8_t* previous, uint8_t* row, size_t length) {
+    size_t i = 0;
+#if defined(__AVX2__)
+    for (; i + 32 <= length; i += 32) {
+        __m256i sum = _mm256_add_epi8(_mm256_loadu_si256((const __m256i*)(filtered + i)), _mm256_loadu_si256((const __m256i*)(previous + i)));
+        _mm256_storeu_si256((__m256i*)(row + i), sum);
+    }
+#endif
+#if defined(__SSE2__)
+    for (; i + 16 <= length; i += 16) {
+        __m128i sum = _mm_add_epi8(_mm_loadu_si128((const __m128i*)(filtered + i)), _mm_loadu_si128((const __m128i*)(previous + i)));
+        _mm_storeu_si128((__m128i*)(row + i), sum);
+    }
+#endif
+    for (; i < length; ++i)
+        row[i] = filtered[i] + previous[i];
+}
+
+static void unfilter_average(const uint8_t* filtered, const uint8_t* previous, uint8_t* row, size_t length, unsigned bytes_per_pixel) {
+    size_t i = 0;
+#if defined(__SSE2__)
+    if (vector_pixel(bytes_per_pixel)) {
+        /* _mm_avg_epu8 rounds up, the filter rounds down. */
+        const __m128i one = _mm_set1_epi8(1);
+        __m128i left = _mm_setzero_si128();
+        for (; i + bytes_per_pixel <= length; i += bytes_per_pixel) {
+            __m128i up = load_pixel(previous + i, bytes_per_pixel);
+            __m128i average = _mm_sub_epi8(_mm_avg_epu8(left, up), _mm_and_si128(_mm_xor_si128(left, up), one));
+            left = _mm_add_epi8(load_pixel(filtered + i, bytes_per_pixel), average);
+            store_pixel(row + i, left, bytes_per_pixel);
+        }
+    }
+#endif
+    for (; i < length; ++i)
+        row[i] = filtered[i] + (((i >= bytes_per_pixel ? row[i - bytes_per_pixel] : 0) + previous[i]) >> 1);
+}
+
+static void unfilter_paeth(const uint8_t* filtered, const uint8_t* previous, uint8_t* row, size_t length, unsigned bytes_per_pixel) {
+    size_t i = 0;
+#if defined(__SSE2__)
+    if (vector_pixel(bytes_per_pixel)) {
+        /* Predictor arithmetic needs 9 bits and a sign, so pixels are widened to 16 bit lanes. */
+        const __m128i zero = _mm_setzero_si128();
+        __m128i left = zero;
+        __m128i up_left = zero;
+        for (; i + bytes_per_pixel <= length; i += bytes_per_pixel) {
+            __m128i up = _mm_unpacklo_epi8(load_pixel(previous + i, bytes_per_pixel), zero);
+
+            __m128i estimate_left = _mm_sub_epi16(up, up_left);
+            __m128i estimate_up = _mm_sub_epi16(left, up_left);
+            __m128i estimate_up_left = abs_epi16(_mm_add_epi16(estimate_left, estimate_up));
+            estimate_left = abs_epi16(estimate_left);
+            estimate_up = abs_epi16(estimate_up);
+
+            __m128i smallest = _mm_min_epi16(estimate_up_left, _mm_min_epi16(estimate_left, estimate_up));
+            __m128i predictor = select_vector(_mm_cmpeq_epi16(smallest, estimate_left), left,
+                                              select_vector(_mm_cmpeq_epi16(smallest, estimate_up), up, up_left));
+
+            __m128i pixel = _mm_add_epi8(load_pixel(filtered + i, bytes_per_pixel), _mm_packus_epi16(predictor, predictor));
+            store_pixel(row + i, pixel, bytes_per_pixel);
+
+            left = _mm_unpacklo_epi8(pixel, zero);
+            up_left = up;
+        }
+    }
+#endif
+    for (; i < length; ++i) {
+        if (i < bytes_per_pixel)
+            row[i] = filtered[i] + previous[i];
+        else
+            row[i] = filtered[i] + paeth_predictor(row[i - bytes_per_pixel], previous[i], previous[i - bytes_per_pixel]);
+    }
+}
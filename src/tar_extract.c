@@ -0,0 +1,1174 @@
+/*
+ * tar.gz extraction in three stages. The calling thread inflates into
+ * buffers taken from a fixed pool; when a buffer is full it parses the tar
+ * records in it and queues a write for every piece of file data, pointing
+ * into the buffer. Writer threads create, write and close the files. Every
+ * queued write holds a reference on its buffer and the decoder holds one on
+ * the buffer before the current one, whose last 32 KiB back references may
+ * still reach through the cursor's history. A buffer returns to the pool when
+ * its last reference is dropped.
+ *
+ * Buffers are multiples of the 512 byte tar record and only the last one is
+ * ever partly filled, so a header never straddles two buffers. Inflating stops
+ * before a match that does not fit, so each buffer has some slack: the bytes
+ * decoded past buffer_length are copied to the start of the next one. File data
+ * may straddle buffers; its pieces are then written by whichever writers pick them up, the first
+ * one to run opening the file and the last one closing it. Files with the same
+ * path take turns in archive order, so the last one is what remains.
+ */
+
+#if defined(__linux__)
+#define _GNU_SOURCE     // O_DIRECT, fallocate()
+#endif
+
+#include "tar_extract.h"
+
+#include <errno.h>
+#include <fcntl.h>
+#include <pthread.h>
+#include <stdatomic.h>
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/stat.h>
+#include <time.h>
+#include <unistd.h>
+
+#include "crc32.h"
+#include "gzip_header.h"
+#include "inflate.h"
+#include "inflate_internal.h"
+#include "inflate_stream.h"
+
+
+
+#define TAR_RECORD_LENGTH           512
+#define TAR_DEFAULT_BUFFER_LENGTH   (4 << 20)
+#define TAR_MIN_BUFFER_LENGTH       (64 << 10)
+#define TAR_DEFAULT_BUFFER_COUNT    8
+#define TAR_MAX_WRITERS             256
+#define TAR_PAGE_LENGTH             4096
+
+/* Room past buffer_length for the match that overflows it, moved to the start of the next buffer. */
+#define TAR_BUFFER_SLACK            TAR_PAGE_LENGTH
+
+/* Longest GNU long name or pax header accepted. */
+#define TAR_MAX_META_LENGTH         (1 << 20)
+
+/* Header fields (offset, length). */
+#define TAR_NAME            0, 100
+#define TAR_MODE            100, 8
+#define TAR_SIZE            124, 12
+#define TAR_MTIME           136, 12
+#define TAR_CHECKSUM        148, 8
+#define TAR_LINKNAME        157, 100
+#define TAR_PREFIX          345, 155
+#define TAR_TYPE_OFFSET     156
+#define TAR_MAGIC_OFFSET    257
+
+/* Type flags. */
+#define TAR_REGULAR         '0'
+#define TAR_REGULAR_OLD     '\0'
+#define TAR_HARD_LINK       '1'
+#define TAR_SYMBOLIC_LINK   '2'
+#define TAR_DIRECTORY       '5'
+#define TAR_CONTIGUOUS      '7'
+#define TAR_PAX             'x'
+#define TAR_GNU_LONG_NAME   'L'
+#define TAR_GNU_LONG_LINK   'K'
+
+/* Parser states. */
+#define TAR_STATE_HEADER    0
+#define TAR_STATE_DATA      1       // File data, queued for the writers.
+#define TAR_STATE_META      2       // A long name or pax header, collected.
+#define TAR_STATE_SKIP      3
+#define TAR_STATE_END       4       // Past the two zero records that end the archive.
+
+
+struct TarBuffer {
+    uint8_t* bytes;
+    atomic_uint references;
+    struct TarBuffer* next_free;
+};
+
+/* A path regular files are extracted to. Files with the same path open one at a time, in archive order. */
+struct TarPath {
+    char* path;
+    uint64_t hash;
+    unsigned opened;        // Files given the path so far. Parser only.
+    unsigned closed;        // Of them, the ones closed. Guarded by path_lock.
+    uint64_t last_entry;    // Archive position of the last of them.
+    struct TarPath* next;
+};
+
+/* A regular file, shared by the writes of its data. */
+struct TarFile {
+    const char* path;       // Owned by same_path.
+    struct TarPath* same_path;
+    unsigned turn;          // Opens once same_path->closed reaches it.
+    bool has_turn;
+    mode_t mode;
+    struct timespec mtime;
+    uint64_t length;
+    bool direct;
+
+    pthread_mutex_t lock;   // Guards fd: whichever write runs first opens the file.
+    int fd;
+    atomic_uint references; // One per queued write and one of the parser's until all data is queued. The last closes the file.
+};
+
+struct TarWrite {
+    struct TarFile* file;
+    struct TarBuffer* buffer;   // NULL for a file without data.
+    const uint8_t* data;
+    size_t length;
+    uint64_t offset;
+    struct TarWrite* next;
+};
+
+/*
+ * Links wait until the writers are done: a hard link's target is then surely
+ * complete, and no later entry can be written through a symbolic link. A link
+ * that a later regular file replaces is never made.
+ */
+struct TarLink {
+    char* path;
+    char* target;
+    bool symbolic;
+    uint64_t entry;         // Archive position.
+    struct TarLink* next;
+};
+
+struct TarParser {
+    unsigned state;
+    uint64_t remaining;         // Data bytes of the current entry left.
+    unsigned padding;           // Bytes up to the next record once remaining is 0.
+    unsigned zero_records;
+
+    struct TarFile* file;       // TAR_STATE_DATA.
+    uint64_t file_offset;
+
+    /* TAR_STATE_META and what it leaves for the next header. */
+    char meta_type;
+    char* meta;
+    size_t meta_length;
+    char* long_name;
+    char* long_link;
+    bool has_size;
+    uint64_t size;
+    bool has_mtime;
+    struct timespec mtime;
+
+    struct TarLink* links;
+    uint64_t entry_count;       // Files and links so far.
+};
+
+struct TarWriter {
+    struct TarExtract* extract;
+    pthread_t thread;
+    double busy;
+    double wait;
+};
+
+struct TarExtract {
+    int directory;
+    size_t buffer_length;
+    uint64_t direct_length;
+
+    /* Buffer pool. */
+    pthread_mutex_t pool_lock;
+    pthread_cond_t pool_ready;
+    struct TarBuffer* buffers;
+    unsigned buffer_count;
+    struct TarBuffer* free_buffers;
+
+    /* Write queue. */
+    pthread_mutex_t queue_lock;
+    pthread_cond_t queue_ready;
+    struct TarWrite* queue_head;
+    struct TarWrite* queue_tail;
+    bool closing;
+
+    /* Paths of regular files, chained hash table. */
+    pthread_mutex_t path_lock;
+    pthread_cond_t path_closed;
+    struct TarPath** paths;
+    size_t path_slots;
+    size_t path_count;
+
+    atomic_int result;
+    struct TarParser parser;
+    uint64_t file_count;
+};
+
+
+/* Inflates every gzip member, parsing each buffer once it is full. */
+static int decode_members(struct TarExtract* extract, const uint8_t* compressed, size_t compressed_length, struct TarExtractStats* stats);
+
+/* Parses the records in bytes[0, length), queueing writes that reference buffer. */
+static int parse_buffer(struct TarExtract* extract, struct TarBuffer* buffer, const uint8_t* bytes, size_t length);
+
+static int parse_header(struct TarExtract* extract, const uint8_t* header);
+
+/* Applies a finished long name or pax header to the next header. */
+static int finish_meta(struct TarParser* parser);
+
+static void* tar_writer(void* argument);
+
+static void run_write(struct TarExtract* extract, struct TarWrite* write);
+
+static int open_file(struct TarExtract* extract, struct TarFile* file);
+
+/* Waits until every earlier file with the same path is closed. */
+static void wait_turn(struct TarExtract* extract, struct TarFile* file);
+
+static void release_file(struct TarExtract* extract, struct TarFile* file);
+
+static void release_buffer(struct TarExtract* extract, struct TarBuffer* buffer);
+
+static void queue_write(struct TarExtract* extract, struct TarWrite* write);
+
+/* Returns the table entry of path, adding it when add is set. NULL when there is none or memory runs out. */
+static struct TarPath* find_path(struct TarExtract* extract, const char* path, bool add);
+
+/* Replaces whatever is at the link's path. */
+static int create_link(int directory, const struct TarLink* link);
+
+/*
+ * Opens the directory holding path one component at a time without following
+ * symbolic links, so that it is surely below directory, and points *name at
+ * the last component. A path through a symbolic link gives
+ * INFLATE_VALUE_NOT_ALLOWED.
+ */
+static int open_parent(int directory, const char* path, bool create, int* parent, const char** name);
+
+/* Creates the directories leading up to path. */
+static void make_parents(int directory, const char* path);
+
+/* Strips leading "/" and "./" and refuses ".." components. Returns NULL for paths that name directory itself. */
+static const char* clean_path(char* path, bool* unsafe);
+
+
+static inline double now(void) {
+    struct timespec time;
+    clock_gettime(CLOCK_MONOTONIC, &time);
+    return time.tv_sec + time.tv_nsec * 1e-9;
+}
+
+static inline void fail(struct TarExtract* extract, int result) {
+    int expected = INFLATE_SUCCESS;
+    atomic_compare_exchange_strong(&extract->result, &expected, result);
+}
+
+/* Numeric header field: octal, or base-256 big endian when the high bit of the first byte is set. */
+static inline uint64_t read_number(const uint8_t* header, size_t offset, size_t length) {
+    const uint8_t* field = header + offset;
+    uint64_t value = 0;
+
+    if (field[0] & 0x80) {
+        value = field[0] & 0x3F;
+        for (size_t i = 1; i < length; ++i)
+            value = value << 8 | field[i];
+        return value;
+    }
+
+    size_t i = 0;
+    while (i < length && field[i] == ' ')
+        ++i;
+    for (; i < length && field[i] >= '0' && field[i] <= '7'; ++i)
+        value = value << 3 | (uint64_t)(field[i] - '0');
+    return value;
+}
+
+static inline char* copy_field(const uint8_t* header, size_t offset, size_t length) {
+    const char* field = (const char*)header + offset;
+    size_t used = strnlen(field, length);
+    char* copy = malloc(used + 1);
+    if (copy) {
+        memcpy(copy, field, used);
+        copy[used] = '\0';
+    }
+    return copy;
+}
+
+
+extern int tar_extract(const unsigned char* compressed, size_t compressed_length, const char* directory, const struct TarExtractOptions* options,
+                       struct TarExtractStats* stats) {
+    struct TarExtractOptions defaults = { 0 };
+    if (!options)
+        options = &defaults;
+    struct TarExtractStats local_stats;
+    if (!stats)
+        stats = &local_stats;
+    *stats = (struct TarExtractStats){ 0 };
+    double start = now();
+
+    if (!compressed || !compressed_length)
+        return INFLATE_COMPRESSED_INCOMPLETE;
+    if (options->buffer_count == 1)
+        return INFLATE_VALUE_NOT_ALLOWED;
+
+    unsigned writer_count = options->writer_count;
+    if (!writer_count) {
+        long online = sysconf(_SC_NPROCESSORS_ONLN);
+        writer_count = online > 0 ? (unsigned)online : 1;
+    }
+    if (writer_count > TAR_MAX_WRITERS)
+        writer_count = TAR_MAX_WRITERS;
+
+    size_t buffer_length = options->buffer_length ? options->buffer_length : TAR_DEFAULT_BUFFER_LENGTH;
+    if (buffer_length < TAR_MIN_BUFFER_LENGTH)
+        buffer_length = TAR_MIN_BUFFER_LENGTH;
+    buffer_length = (buffer_length + TAR_PAGE_LENGTH - 1) / TAR_PAGE_LENGTH * TAR_PAGE_LENGTH;
+
+    struct TarExtract* extract = calloc(1, sizeof(struct TarExtract));
+    if (!extract)
+        return INFLATE_NO_MEMORY;
+    extract->buffer_length = buffer_length;
+    extract->direct_length = options->direct_length;
+    extract->buffer_count = options->buffer_count ? options->buffer_count : TAR_DEFAULT_BUFFER_COUNT;
+    pthread_mutex_init(&extract->pool_lock, NULL);
+    pthread_cond_init(&extract->pool_ready, NULL);
+    pthread_mutex_init(&extract->queue_lock, NULL);
+    pthread_cond_init(&extract->queue_ready, NULL);
+    pthread_mutex_init(&extract->path_lock, NULL);
+    pthread_cond_init(&extract->path_closed, NULL);
+    atomic_init(&extract->result, INFLATE_SUCCESS);
+
+    int result = INFLATE_SUCCESS;
+    extract->directory = open(directory, O_RDONLY | O_DIRECTORY | O_CLOEXEC);
+    if (extract->directory < 0)
+        result = INFLATE_IO_ERROR;
+
+    /* Page aligned so that O_DIRECT writes can go straight out of them. */
+    extract->buffers = calloc(extract->buffer_count, sizeof(struct TarBuffer));
+    if (!result && !extract->buffers)
+        result = INFLATE_NO_MEMORY;
+    for (unsigned i = 0; !result && i < extract->buffer_count; ++i) {
+        struct TarBuffer* buffer = &extract->buffers[i];
+        buffer->bytes = aligned_alloc(TAR_PAGE_LENGTH, buffer_length + TAR_BUFFER_SLACK);
+        if (!buffer->bytes) {
+            result = INFLATE_NO_MEMORY;
+            break;
+        }
+        buffer->next_free = extract->free_buffers;
+        extract->free_buffers = buffer;
+    }
+
+    struct TarWriter writers[TAR_MAX_WRITERS];
+    unsigned started = 0;
+    for (; !result && started < writer_count; ++started) {
+        writers[started] = (struct TarWriter){ .extract = extract };
+        if (pthread_create(&writers[started].thread, NULL, tar_writer, &writers[started])) {
+            if (!started)
+                result = INFLATE_NO_MEMORY;
+            break;
+        }
+    }
+
+    if (!result)
+        result = decode_members(extract, compressed, compressed_length, stats);
+    if (!result)
+        result = atomic_load(&extract->result);
+    else
+        fail(extract, result);
+
+    /* Data of a file cut short by an error is never queued; drop the parser's hold so it is closed. */
+    struct TarParser* parser = &extract->parser;
+    if (parser->state == TAR_STATE_DATA && parser->file) {
+        release_file(extract, parser->file);
+        if (!result)
+            result = INFLATE_COMPRESSED_INCOMPLETE;
+    }
+
+    pthread_mutex_lock(&extract->queue_lock);
+    extract->closing = true;
+    pthread_cond_broadcast(&extract->queue_ready);
+    pthread_mutex_unlock(&extract->queue_lock);
+    for (unsigned i = 0; i < started; ++i) {
+        pthread_join(writers[i].thread, NULL);
+        stats->write_busy += writers[i].busy;
+        stats->write_wait += writers[i].wait;
+    }
+    if (!result)
+        result = atomic_load(&extract->result);
+
+    double parse_start = now();
+    struct TarLink* reversed = NULL;
+    while (parser->links) {
+        struct TarLink* link = parser->links;
+        parser->links = link->next;
+        link->next = reversed;
+        reversed = link;
+    }
+    parser->links = reversed;
+    while (parser->links) {
+        struct TarLink* link = parser->links;
+        parser->links = link->next;
+        struct TarPath* replaced = find_path(extract, link->path, false);
+        if (!result && !(replaced && replaced->last_entry > link->entry))
+            result = create_link(extract->directory, link);
+        free(link->path);
+        free(link->target);
+        free(link);
+    }
+    stats->parse_busy += now() - parse_start;
+
+    free(parser->meta);
+    free(parser->long_name);
+    free(parser->long_link);
+    for (size_t i = 0; i < extract->path_slots; ++i) {
+        while (extract->paths[i]) {
+            struct TarPath* entry = extract->paths[i];
+            extract->paths[i] = entry->next;
+            free(entry->path);
+            free(entry);
+        }
+    }
+    free(extract->paths);
+    if (extract->buffers) {
+        for (unsigned i = 0; i < extract->buffer_count; ++i)
+            free(extract->buffers[i].bytes);
+        free(extract->buffers);
+    }
+    if (extract->directory >= 0)
+        close(extract->directory);
+    pthread_mutex_destroy(&extract->pool_lock);
+    pthread_cond_destroy(&extract->pool_ready);
+    pthread_mutex_destroy(&extract->queue_lock);
+    pthread_cond_destroy(&extract->queue_ready);
+    pthread_mutex_destroy(&extract->path_lock);
+    pthread_cond_destroy(&extract->path_closed);
+
+    stats->file_count = extract->file_count;
+    stats->writer_count = started;
+    stats->elapsed = now() - start;
+    free(extract);
+
+    return result;
+}
+
+
+
+static struct TarBuffer* acquire_buffer(struct TarExtract* extract, struct TarExtractStats* stats) {
+    double start = now();
+
+    pthread_mutex_lock(&extract->pool_lock);
+    while (!extract->free_buffers)
+        pthread_cond_wait(&extract->pool_ready, &extract->pool_lock);
+    struct TarBuffer* buffer = extract->free_buffers;
+    extract->free_buffers = buffer->next_free;
+    pthread_mutex_unlock(&extract->pool_lock);
+
+    atomic_init(&buffer->references, 1);
+    stats->decode_wait += now() - start;
+
+    return buffer;
+}
+
+/* Parses the full buffer and moves what was decoded past its end to the start of a fresh one. */
+static int next_buffer(struct TarExtract* extract, struct TarBuffer** buffer, struct TarBuffer** previous, size_t* filled, struct TarExtractStats* stats) {
+    double parse_start = now();
+    int result = parse_buffer(extract, *buffer, (*buffer)->bytes, extract->buffer_length);
+    stats->byte_count += extract->buffer_length;
+    stats->parse_busy += now() - parse_start;
+    if (!result)
+        result = atomic_load_explicit(&extract->result, memory_order_relaxed);
+    if (result)
+        return result;
+
+    if (*previous)
+        release_buffer(extract, *previous);
+    *previous = *buffer;
+    *buffer = acquire_buffer(extract, stats);
+    *filled -= extract->buffer_length;
+    memcpy((*buffer)->bytes, (*previous)->bytes + extract->buffer_length, *filled);
+
+    return INFLATE_SUCCESS;
+}
+
+static int decode_members(struct TarExtract* extract, const uint8_t* compressed, size_t compressed_length, struct TarExtractStats* stats) {
+    struct InflateStream* stream = malloc(sizeof(struct InflateStream));
+    if (!stream)
+        return INFLATE_NO_MEMORY;
+
+    const uint8_t* compressed_next = compressed;
+    const uint8_t* compressed_end = compressed + compressed_length;
+    struct TarBuffer* buffer = acquire_buffer(extract, stats);
+    struct TarBuffer* previous = NULL;  // Held while the current buffer may still refer back into it.
+    size_t filled = 0;
+    struct InflateHistory history;
+    int result = INFLATE_SUCCESS;
+
+    while (!result && compressed_next < compressed_end) {
+        struct GzipHeader header;
+        result = gzip_parse_header(compressed_next, compressed_end - compressed_next, &header);
+        if (result)
+            break;
+        compressed_next += header.header_length;
+
+        double decode_start = now();
+        size_t capacity = extract->buffer_length + TAR_BUFFER_SLACK;
+        inflate_stream_init(stream, compressed_next, compressed_end - compressed_next, buffer->bytes + filled, capacity - filled);
+        uint32_t crc = 0;
+        uint64_t member_length = 0;
+
+        for (;;) {
+            uint8_t* decoded = stream->cursor.decompressed_next;
+            result = inflate_stream_decode(stream);
+            size_t decoded_length = stream->cursor.decompressed_next - decoded;
+            crc = crc32_update(crc, decoded, decoded_length);
+            member_length += decoded_length;
+            filled += decoded_length;
+            if (result != INFLATE_DECOMPRESSED_OVERFLOW)
+                break;
+
+            /* Full: hand the buffer to the parser and carry on in a fresh one, referring back through history. */
+            stats->decode_busy += now() - decode_start;
+            result = next_buffer(extract, &buffer, &previous, &filled, stats);
+            if (result)
+                break;
+            decode_start = now();
+
+            size_t behind = member_length - filled;
+            size_t history_length = behind < INFLATE_MAX_LZ77_DISTANCE ? behind : INFLATE_MAX_LZ77_DISTANCE;
+            history = (struct InflateHistory){
+                .bytes = previous->bytes,
+                .start = extract->buffer_length - history_length,
+                .length = history_length,
+                .capacity = extract->buffer_length,
+            };
+            stream->cursor.decompressed_start = buffer->bytes;
+            stream->cursor.decompressed_next = buffer->bytes + filled;
+            stream->cursor.decompressed_end = buffer->bytes + capacity;
+            stream->cursor.history = &history;
+        }
+        if (result)
+            break;
+
+        compressed_next = inflate_stream_compressed_end(stream);
+        if (compressed_end - compressed_next < GZIP_TRAILER_LENGTH)
+            result = INFLATE_COMPRESSED_INCOMPLETE;
+        else if (gzip_read_le32(compressed_next) != crc || gzip_read_le32(compressed_next + 4) != (uint32_t)member_length)
+            result = INFLATE_CHECKSUM_MISMATCH;
+        compressed_next += GZIP_TRAILER_LENGTH;
+        stats->decode_busy += now() - decode_start;
+        if (!result && filled >= extract->buffer_length)
+            result = next_buffer(extract, &buffer, &previous, &filled, stats);
+    }
+
+    if (!result) {
+        double parse_start = now();
+        result = parse_buffer(extract, buffer, buffer->bytes, filled);
+        stats->byte_count += filled;
+        if (!result && extract->parser.state != TAR_STATE_HEADER && extract->parser.state != TAR_STATE_END)
+            result = INFLATE_COMPRESSED_INCOMPLETE;
+        stats->parse_busy += now() - parse_start;
+    }
+
+    if (previous)
+        release_buffer(extract, previous);
+    release_buffer(extract, buffer);
+    free(stream);
+
+    return result;
+}
+
+static int parse_buffer(struct TarExtract* extract, struct TarBuffer* buffer, const uint8_t* bytes, size_t length) {
+    struct TarParser* parser = &extract->parser;
+    size_t position = 0;
+
+    while (position < length) {
+        size_t available = length - position;
+
+        switch (parser->state) {
+            case TAR_STATE_HEADER: {
+                if (available < TAR_RECORD_LENGTH)
+                    return INFLATE_COMPRESSED_INCOMPLETE;
+                int result = parse_header(extract, bytes + position);
+                if (result)
+                    return result;
+                position += TAR_RECORD_LENGTH;
+                break;
+            }
+            case TAR_STATE_DATA: {
+                size_t piece = parser->remaining < available ? (size_t)parser->remaining : available;
+                struct TarWrite* write = malloc(sizeof(struct TarWrite));
+                if (!write)
+                    return INFLATE_NO_MEMORY;
+                atomic_fetch_add_explicit(&buffer->references, 1, memory_order_relaxed);
+                atomic_fetch_add_explicit(&parser->file->references, 1, memory_order_relaxed);
+                *write = (struct TarWrite){
+                    .file = parser->file,
+                    .buffer = buffer,
+                    .data = bytes + position,
+                    .length = piece,
+                    .offset = parser->file_offset,
+                };
+                queue_write(extract, write);
+
+                parser->file_offset += piece;
+                parser->remaining -= piece;
+                position += piece;
+                if (!parser->remaining) {
+                    release_file(extract, parser->file);
+                    parser->file = NULL;
+                    parser->state = TAR_STATE_SKIP;
+                    parser->remaining = parser->padding;
+                }
+                break;
+            }
+            case TAR_STATE_META: {
+                size_t piece = parser->remaining < available ? (size_t)parser->remaining : available;
+                memcpy(parser->meta + parser->meta_length, bytes + position, piece);
+                parser->meta_length += piece;
+                parser->remaining -= piece;
+                position += piece;
+                if (!parser->remaining) {
+                    int result = finish_meta(parser);
+                    if (result)
+                        return result;
+                    parser->state = TAR_STATE_SKIP;
+                    parser->remaining = parser->padding;
+                }
+                break;
+            }
+            case TAR_STATE_SKIP: {
+                size_t piece = parser->remaining < available ? (size_t)parser->remaining : available;
+                parser->remaining -= piece;
+                position += piece;
+                if (!parser->remaining)
+                    parser->state = TAR_STATE_HEADER;
+                break;
+            }
+            default:
+                /* Whatever follows the end of the archive, usually zeroes up to the blocking factor. */
+                return INFLATE_SUCCESS;
+        }
+    }
+
+    return INFLATE_SUCCESS;
+}
+
+static int parse_header(struct TarExtract* extract, const uint8_t* header) {
+    struct TarParser* parser = &extract->parser;
+
+    unsigned sum = 0;
+    bool zero = true;
+    for (size_t i = 0; i < TAR_RECORD_LENGTH; ++i) {
+        sum += i >= 148 && i < 156 ? ' ' : header[i];
+        zero &= !header[i];
+    }
+    if (zero) {
+        if (++parser->zero_records == 2)
+            parser->state = TAR_STATE_END;
+        return INFLATE_SUCCESS;
+    }
+    parser->zero_records = 0;
+    if (sum != read_number(header, TAR_CHECKSUM))
+        return INFLATE_INVALID_HEADER;
+
+    char type = (char)header[TAR_TYPE_OFFSET];
+    uint64_t size = parser->has_size ? parser->size : read_number(header, TAR_SIZE);
+    if (type == TAR_DIRECTORY || type == TAR_SYMBOLIC_LINK || type == TAR_HARD_LINK)
+        size = 0;
+    parser->remaining = size;
+    parser->padding = (unsigned)(-size & (TAR_RECORD_LENGTH - 1));
+    parser->state = size ? TAR_STATE_SKIP : TAR_STATE_HEADER;
+
+    if (type == TAR_GNU_LONG_NAME || type == TAR_GNU_LONG_LINK || type == TAR_PAX) {
+        if (size > TAR_MAX_META_LENGTH)
+            return INFLATE_VALUE_NOT_ALLOWED;
+        char* meta = realloc(parser->meta, size + 1);
+        if (!meta)
+            return INFLATE_NO_MEMORY;
+        parser->meta = meta;
+        parser->meta_length = 0;
+        parser->meta_type = type;
+        if (size) {
+            parser->state = TAR_STATE_META;
+            return INFLATE_SUCCESS;
+        }
+        return finish_meta(parser);
+    }
+
+    /* The path: a long name, a pax path or ustar's prefix and name. */
+    char* path = parser->long_name;
+    parser->long_name = NULL;
+    if (!path) {
+        char* name = copy_field(header, TAR_NAME);
+        char* prefix = !memcmp(header + TAR_MAGIC_OFFSET, "ustar\0", 6) ? copy_field(header, TAR_PREFIX) : NULL;
+        if (prefix && *prefix && name) {
+            path = malloc(strlen(prefix) + 1 + strlen(name) + 1);
+            if (path) {
+                strcpy(path, prefix);
+                strcat(path, "/");
+                strcat(path, name);
+            }
+            free(name);
+        } else {
+            path = name;
+        }
+        free(prefix);
+    }
+    char* link = parser->long_link;
+    parser->long_link = NULL;
+    if (!link && (type == TAR_SYMBOLIC_LINK || type == TAR_HARD_LINK))
+        link = copy_field(header, TAR_LINKNAME);
+
+    struct timespec mtime = { .tv_sec = (time_t)read_number(header, TAR_MTIME) };
+    if (parser->has_mtime)
+        mtime = parser->mtime;
+    parser->has_size = false;
+    parser->has_mtime = false;
+    uint64_t entry_position = parser->entry_count++;
+
+    int result = INFLATE_SUCCESS;
+    bool unsafe = false;
+    const char* clean = path ? clean_path(path, &unsafe) : NULL;
+    if (!path || ((type == TAR_SYMBOLIC_LINK || type == TAR_HARD_LINK) && !link)) {
+        result = INFLATE_NO_MEMORY;
+    } else if (unsafe) {
+        result = INFLATE_VALUE_NOT_ALLOWED;
+    } else if (!clean) {
+        /* The archive's "./" entry. */
+    } else if (type == TAR_DIRECTORY) {
+        if (mkdirat(extract->directory, clean, 0700 | (mode_t)(read_number(header, TAR_MODE) & 07777)) && errno != EEXIST) {
+            make_parents(extract->directory, clean);
+            if (mkdirat(extract->directory, clean, 0700 | (mode_t)(read_number(header, TAR_MODE) & 07777)) && errno != EEXIST)
+                result = INFLATE_IO_ERROR;
+        }
+    } else if (type == TAR_SYMBOLIC_LINK || type == TAR_HARD_LINK) {
+        /* A symbolic link's target is taken as it is, it is only ever read through once extraction is done. */
+        bool target_unsafe = false;
+        const char* target = type == TAR_HARD_LINK ? clean_path(link, &target_unsafe) : link;
+        struct TarLink* entry = calloc(1, sizeof(struct TarLink));
+        if (target_unsafe || !target) {
+            result = INFLATE_VALUE_NOT_ALLOWED;
+        } else if (!entry || !(entry->path = strdup(clean)) || !(entry->target = strdup(target))) {
+            if (entry && entry->path)
+                free(entry->path);
+            result = INFLATE_NO_MEMORY;
+        } else {
+            entry->symbolic = type == TAR_SYMBOLIC_LINK;
+            entry->entry = entry_position;
+            entry->next = parser->links;
+            parser->links = entry;
+            entry = NULL;
+        }
+        free(entry);
+    } else if (type == TAR_REGULAR || type == TAR_REGULAR_OLD || type == TAR_CONTIGUOUS) {
+        struct TarFile* file = malloc(sizeof(struct TarFile));
+        struct TarPath* same_path = find_path(extract, clean, true);
+        if (!file || !same_path) {
+            free(file);
+            result = INFLATE_NO_MEMORY;
+        } else {
+            same_path->last_entry = entry_position;
+            *file = (struct TarFile){
+                .path = same_path->path,
+                .same_path = same_path,
+                .turn = same_path->opened++,
+                .mode = (mode_t)(read_number(header, TAR_MODE) & 07777),
+                .mtime = mtime,
+                .length = size,
+                .direct = extract->direct_length && size >= extract->direct_length,
+                .fd = -1,
+            };
+            pthread_mutex_init(&file->lock, NULL);
+            atomic_init(&file->references, 1);
+            ++extract->file_count;
+
+            if (size) {
+                parser->file = file;
+                parser->file_offset = 0;
+                parser->state = TAR_STATE_DATA;
+            } else {
+                /* Nothing to write but the file itself. */
+                struct TarWrite* write = malloc(sizeof(struct TarWrite));
+                if (!write) {
+                    release_file(extract, file);
+                    result = INFLATE_NO_MEMORY;
+                } else {
+                    *write = (struct TarWrite){ .file = file };
+                    queue_write(extract, write);
+                }
+            }
+        }
+    }
+
+    free(path);
+    free(link);
+
+    return result;
+}
+
+static int finish_meta(struct TarParser* parser) {
+    char* meta = parser->meta;
+    size_t length = parser->meta_length;
+    meta[length] = '\0';
+
+    if (parser->meta_type == TAR_GNU_LONG_NAME || parser->meta_type == TAR_GNU_LONG_LINK) {
+        char** target = parser->meta_type == TAR_GNU_LONG_NAME ? &parser->long_name : &parser->long_link;
+        free(*target);
+        *target = strdup(meta);
+        return *target ? INFLATE_SUCCESS : INFLATE_NO_MEMORY;
+    }
+
+    /* pax records: "<length> <keyword>=<value>\n", length counting the whole record. */
+    size_t position = 0;
+    while (position < length) {
+        char* record = meta + position;
+        char* end;
+        unsigned long record_length = strtoul(record, &end, 10);
+        if (*end != ' ' || record_length <= (size_t)(end - record) + 1 || record_length > length - position || record[record_length - 1] != '\n')
+            return INFLATE_INVALID_HEADER;
+        record[record_length - 1] = '\0';
+
+        char* keyword = end + 1;
+        char* value = strchr(keyword, '=');
+        if (!value)
+            return INFLATE_INVALID_HEADER;
+        *value = '\0';
+        ++value;
+
+        if (!strcmp(keyword, "path") || !strcmp(keyword, "linkpath")) {
+            char** target = keyword[0] == 'p' ? &parser->long_name : &parser->long_link;
+            free(*target);
+            *target = strdup(value);
+            if (!*target)
+                return INFLATE_NO_MEMORY;
+        } else if (!strcmp(keyword, "size")) {
+            parser->has_size = true;
+            parser->size = strtoull(value, NULL, 10);
+        } else if (!strcmp(keyword, "mtime")) {
+            char* fraction;
+            parser->has_mtime = true;
+            parser->mtime.tv_sec = (time_t)strtoll(value, &fraction, 10);
+            parser->mtime.tv_nsec = 0;
+            if (*fraction == '.') {
+                long scale = 100000000;
+                for (++fraction; *fraction >= '0' && *fraction <= '9' && scale; ++fraction, scale /= 10)
+                    parser->mtime.tv_nsec += (*fraction - '0') * scale;
+            }
+        }
+
+        position += record_length;
+    }
+
+    return INFLATE_SUCCESS;
+}
+
+static void queue_write(struct TarExtract* extract, struct TarWrite* write) {
+    write->next = NULL;
+
+    pthread_mutex_lock(&extract->queue_lock);
+    if (extract->queue_tail)
+        extract->queue_tail->next = write;
+    else
+        extract->queue_head = write;
+    extract->queue_tail = write;
+    pthread_cond_signal(&extract->queue_ready);
+    pthread_mutex_unlock(&extract->queue_lock);
+}
+
+static void* tar_writer(void* argument) {
+    struct TarWriter* writer = argument;
+    struct TarExtract* extract = writer->extract;
+
+    for (;;) {
+        double wait_start = now();
+        pthread_mutex_lock(&extract->queue_lock);
+        while (!extract->queue_head && !extract->closing)
+            pthread_cond_wait(&extract->queue_ready, &extract->queue_lock);
+        struct TarWrite* write = extract->queue_head;
+        if (write) {
+            extract->queue_head = write->next;
+            if (!extract->queue_head)
+                extract->queue_tail = NULL;
+        }
+        pthread_mutex_unlock(&extract->queue_lock);
+        double busy_start = now();
+        writer->wait += busy_start - wait_start;
+        if (!write)
+            break;
+
+        run_write(extract, write);
+        writer->busy += now() - busy_start;
+    }
+
+    return NULL;
+}
+
+static void run_write(struct TarExtract* extract, struct TarWrite* write) {
+    struct TarFile* file = write->file;
+
+    /* After an error the queue is only drained. */
+    if (!atomic_load_explicit(&extract->result, memory_order_relaxed)) {
+        pthread_mutex_lock(&file->lock);
+        int result = file->fd < 0 ? open_file(extract, file) : INFLATE_SUCCESS;
+        pthread_mutex_unlock(&file->lock);
+
+        const uint8_t* data = write->data;
+        size_t length = write->length;
+        uint64_t offset = write->offset;
+#if defined(O_DIRECT)
+        /* The tar padding that follows the data keeps the length a whole number of records, the file is cut back when it is closed. */
+        if (!result && file->direct && length) {
+            size_t padded = (length + TAR_RECORD_LENGTH - 1) / TAR_RECORD_LENGTH * TAR_RECORD_LENGTH;
+            ssize_t written = padded <= (size_t)(write->buffer->bytes + extract->buffer_length - data) ? pwrite(file->fd, data, padded, (off_t)offset) : -1;
+            if (written == (ssize_t)padded) {
+                length = 0;
+            } else if (written < 0 && errno == EINVAL) {
+                /* Misaligned for this file system: go through the page cache. */
+                fcntl(file->fd, F_SETFL, fcntl(file->fd, F_GETFL) & ~O_DIRECT);
+            } else if (written > 0) {
+                size_t done = (size_t)written < length ? (size_t)written : length;
+                data += done;
+                length -= done;
+                offset += done;
+            }
+        }
+#endif
+        while (!result && length) {
+            ssize_t written = pwrite(file->fd, data, length, (off_t)offset);
+            if (written < 0 && errno == EINTR)
+                continue;
+            if (written <= 0) {
+                result = INFLATE_IO_ERROR;
+                break;
+            }
+            data += written;
+            length -= (size_t)written;
+            offset += (uint64_t)written;
+        }
+        if (result)
+            fail(extract, result);
+    }
+
+    if (write->buffer)
+        release_buffer(extract, write->buffer);
+    release_file(extract, file);
+    free(write);
+}
+
+static int open_file(struct TarExtract* extract, struct TarFile* file) {
+    int flags = O_WRONLY | O_CREAT | O_TRUNC | O_CLOEXEC;
+#if defined(O_DIRECT)
+    if (file->direct)
+        flags |= O_DIRECT;
+#endif
+
+    wait_turn(extract, file);
+    file->fd = openat(extract->directory, file->path, flags, file->mode);
+    if (file->fd < 0 && errno == ENOENT) {
+        make_parents(extract->directory, file->path);
+        file->fd = openat(extract->directory, file->path, flags, file->mode);
+    }
+#if defined(O_DIRECT)
+    if (file->fd < 0 && file->direct && errno == EINVAL) {
+        flags &= ~O_DIRECT;
+        file->fd = openat(extract->directory, file->path, flags, file->mode);
+    }
+#endif
+    if (file->fd < 0)
+        return INFLATE_IO_ERROR;
+
+#if defined(__linux__)
+    /* One extent up front instead of growing the file write by write. Not every file system can. */
+    if (file->direct)
+        fallocate(file->fd, 0, 0, (off_t)file->length);
+#endif
+
+    return INFLATE_SUCCESS;
+}
+
+static void wait_turn(struct TarExtract* extract, struct TarFile* file) {
+    pthread_mutex_lock(&extract->path_lock);
+    while (file->same_path->closed != file->turn)
+        pthread_cond_wait(&extract->path_closed, &extract->path_lock);
+    pthread_mutex_unlock(&extract->path_lock);
+    file->has_turn = true;
+}
+
+static void release_file(struct TarExtract* extract, struct TarFile* file) {
+    if (atomic_fetch_sub_explicit(&file->references, 1, memory_order_acq_rel) != 1)
+        return;
+
+    /* A file never opened, after an error, still passes the turn on in order. */
+    if (!file->has_turn)
+        wait_turn(extract, file);
+    if (file->fd >= 0) {
+        bool failed = false;
+        if (file->direct)
+            failed |= ftruncate(file->fd, (off_t)file->length) != 0;
+        struct timespec times[2] = { { .tv_nsec = UTIME_OMIT }, file->mtime };
+        futimens(file->fd, times);
+        failed |= close(file->fd) != 0;
+        if (failed)
+            fail(extract, INFLATE_IO_ERROR);
+    }
+
+    pthread_mutex_lock(&extract->path_lock);
+    ++file->same_path->closed;
+    pthread_cond_broadcast(&extract->path_closed);
+    pthread_mutex_unlock(&extract->path_lock);
+
+    pthread_mutex_destroy(&file->lock);
+    free(file);
+}
+
+static void release_buffer(struct TarExtract* extract, struct TarBuffer* buffer) {
+    if (atomic_fetch_sub_explicit(&buffer->references, 1, memory_order_acq_rel) != 1)
+        return;
+
+    pthread_mutex_lock(&extract->pool_lock);
+    buffer->next_free = extract->free_buffers;
+    extract->free_buffers = buffer;
+    pthread_cond_signal(&extract->pool_ready);
+    pthread_mutex_unlock(&extract->pool_lock);
+}
+
+static struct TarPath* find_path(struct TarExtract* extract, const char* path, bool add) {
+    /* FNV-1a. */
+    uint64_t hash = 0xcbf29ce484222325;
+    for (const char* c = path; *c; ++c)
+        hash = (hash ^ (uint8_t)*c) * 0x100000001b3;
+
+    if (extract->path_slots) {
+        for (struct TarPath* entry = extract->paths[hash & (extract->path_slots - 1)]; entry; entry = entry->next) {
+            if (entry->hash == hash && !strcmp(entry->path, path))
+                return entry;
+        }
+    }
+    if (!add)
+        return NULL;
+
+    /* Double the slots once there are as many paths. Entries stay where they are, writers keep pointers to them. */
+    if (extract->path_count == extract->path_slots) {
+        size_t slots = extract->path_slots ? 2 * extract->path_slots : 256;
+        struct TarPath** paths = calloc(slots, sizeof(struct TarPath*));
+        if (!paths)
+            return NULL;
+        for (size_t i = 0; i < extract->path_slots; ++i) {
+            while (extract->paths[i]) {
+                struct TarPath* entry = extract->paths[i];
+                extract->paths[i] = entry->next;
+                entry->next = paths[entry->hash & (slots - 1)];
+                paths[entry->hash & (slots - 1)] = entry;
+            }
+        }
+        free(extract->paths);
+        extract->paths = paths;
+        extract->path_slots = slots;
+    }
+
+    struct TarPath* entry = malloc(sizeof(struct TarPath));
+    char* copy = strdup(path);
+    if (!entry || !copy) {
+        free(entry);
+        free(copy);
+        return NULL;
+    }
+    struct TarPath** slot = &extract->paths[hash & (extract->path_slots - 1)];
+    *entry = (struct TarPath){ .path = copy, .hash = hash, .next = *slot };
+    *slot = entry;
+    ++extract->path_count;
+
+    return entry;
+}
+
+static int create_link(int directory, const struct TarLink* link) {
+    int target_parent = -1;
+    const char* target_name = NULL;
+    if (!link->symbolic) {
+        int result = open_parent(directory, link->target, false, &target_parent, &target_name);
+        if (result)
+            return result;
+    }
+
+    int parent;
+    const char* name;
+    int result = open_parent(directory, link->path, true, &parent, &name);
+    if (!result) {
+        unlinkat(parent, name, 0);
+        /* Without AT_SYMLINK_FOLLOW a hard link to a symbolic link is another symbolic link, not what it points to. */
+        if (link->symbolic ? symlinkat(link->target, parent, name) : linkat(target_parent, target_name, parent, name, 0))
+            result = INFLATE_IO_ERROR;
+        close(parent);
+    }
+    if (target_parent >= 0)
+        close(target_parent);
+
+    return result;
+}
+
+static int open_parent(int directory, const char* path, bool create, int* parent, const char** name) {
+    char* copy = strdup(path);
+    if (!copy)
+        return INFLATE_NO_MEMORY;
+
+    int result = INFLATE_SUCCESS;
+    int current = openat(directory, ".", O_RDONLY | O_DIRECTORY | O_CLOEXEC);
+    if (current < 0)
+        result = INFLATE_IO_ERROR;
+    char* component = copy;
+    for (char* slash = strchr(component, '/'); !result && slash; slash = strchr(component, '/')) {
+        *slash = '\0';
+        if (*component && strcmp(component, ".")) {
+            int next = openat(current, component, O_RDONLY | O_DIRECTORY | O_NOFOLLOW | O_CLOEXEC);
+            if (next < 0 && errno == ENOENT && create && (!mkdirat(current, component, 0777) || errno == EEXIST))
+                next = openat(current, component, O_RDONLY | O_DIRECTORY | O_NOFOLLOW | O_CLOEXEC);
+            if (next < 0) {
+                struct stat status;
+                bool symbolic = errno == ELOOP || (!fstatat(current, component, &status, AT_SYMLINK_NOFOLLOW) && S_ISLNK(status.st_mode));
+                result = symbolic ? INFLATE_VALUE_NOT_ALLOWED : INFLATE_IO_ERROR;
+            }
+            close(current);
+            current = next;
+        }
+        component = slash + 1;
+    }
+
+    *parent = current;
+    *name = path + (component - copy);
+    free(copy);
+
+    return result;
+}
+
+static void make_parents(int directory, const char* path) {
+    char* copy = strdup(path);
+    if (!copy)
+        return;
+
+    for (char* slash = strchr(copy, '/'); slash; slash = strchr(slash + 1, '/')) {
+        *slash = '\0';
+        mkdirat(directory, copy, 0777);
+        *slash = '/';
+    }
+
+    free(copy);
+}
+
+static const char* clean_path(char* path, bool* unsafe) {
+    while (*path == '/' || (path[0] == '.' && path[1] == '/'))
+        ++path;
+
+    size_t length = strlen(path);
+    while (length && path[length - 1] == '/')
+        path[--length] = '\0';
+    if (!length || !strcmp(path, "."))
+        return NULL;
+
+    for (const char* component = path; component; component = strchr(component, '/')) {
+        if (*component == '/')
+            ++component;
+        if (component[0] == '.' && component[1] == '.' && (component[2] == '/' || component[2] == '\0'))
+            *unsafe = true;
+    }
+
+    return path;
+}
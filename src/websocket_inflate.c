@@ -0,0 +1,206 @@
+/*
+ * permessage-deflate decoding. A message is a run of deflate blocks that the
+ * sender ended with a sync flush and then stripped of the flush's empty stored
+ * block. Putting that block back leaves the stream between blocks, byte
+ * aligned, at the end of every message.
+ *
+ * With context takeover the LZ77 window carries over from one message to the
+ * next. Keeping an InflateStream per connection would cost the Huffman tables
+ * on top of the window for every idle connection, so a session keeps only the
+ * window contents, in a ring. Each thread owns one stream, Huffman tables
+ * included, and lends it to one session at a time. A message is decoded
+ * straight into the caller's buffer with the session's ring as the cursor's
+ * history, so back references into earlier messages copy out of the ring. Like
+ * zlib a message only touches the history it refers to, and storing the
+ * history back only appends the message.
+ */
+
+#include "websocket_inflate.h"
+
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "inflate.h"
+#include "inflate_stream.h"
+
+
+
+/* The empty stored block of a sync flush. */
+static const uint8_t websocket_trailer[4] = { 0x00, 0x00, 0xFF, 0xFF };
+
+
+struct WebSocketInflate {
+    uint8_t* history;           // Ring of history_capacity bytes, the oldest at history_start.
+    uint32_t history_start;
+    uint32_t history_length;
+    uint32_t history_capacity;  // Only smaller than window_length while the ring has not wrapped yet.
+    uint32_t window_length;     // History the peer may refer back to, 0 without context takeover.
+};
+
+/* Decoding state of one thread, lent to one session at a time. */
+struct WebSocketThread {
+    struct InflateStream stream;
+    struct InflateStash stash;
+    struct InflateHistory history;
+};
+
+
+static _Thread_local struct WebSocketThread* websocket_thread;
+
+
+/* Returns the calling thread's decoding state, allocating it on first use. */
+static int thread_state(struct WebSocketThread** thread);
+
+/* Appends the end of a message to the ring. */
+static int keep_history(struct WebSocketInflate* session, const uint8_t* message, size_t length);
+
+
+extern int websocket_inflate_create(unsigned window_bits, bool context_takeover, struct WebSocketInflate** session) {
+    *session = NULL;
+
+    if (window_bits < WEBSOCKET_MIN_WINDOW_BITS || window_bits > WEBSOCKET_MAX_WINDOW_BITS)
+        return INFLATE_VALUE_NOT_ALLOWED;
+
+    struct WebSocketInflate* created = malloc(sizeof(struct WebSocketInflate));
+    if (!created)
+        return INFLATE_NO_MEMORY;
+    created->history = NULL;
+    created->history_start = 0;
+    created->history_length = 0;
+    created->history_capacity = 0;
+    created->window_length = context_takeover ? 1u << window_bits : 0;
+
+    *session = created;
+
+    return INFLATE_SUCCESS;
+}
+
+extern void websocket_inflate_free(struct WebSocketInflate* session) {
+    if (!session)
+        return;
+
+    free(session->history);
+    free(session);
+}
+
+extern int websocket_inflate_message(struct WebSocketInflate* session, const unsigned char* payload, size_t payload_length, unsigned char* message,
+                                     size_t* message_length, size_t message_max_length) {
+    *message_length = 0;
+
+    if (!message)
+        return INFLATE_NO_OUTPUT;
+
+    struct WebSocketThread* thread;
+    int result = thread_state(&thread);
+    if (result)
+        return result;
+
+    /* A fresh stream every message, but static tables built for an earlier one are still good. */
+    struct InflateStream* stream = &thread->stream;
+    bool static_table_loaded = stream->inflator.static_table_loaded;
+    inflate_stream_init(stream, NULL, 0, message, message_max_length);
+    stream->inflator.static_table_loaded = static_table_loaded;
+    thread->stash.length = 0;
+    thread->history = (struct InflateHistory){
+        .bytes = session->history,
+        .start = session->history_start,
+        .length = session->history_length,
+        .capacity = session->history_capacity,
+    };
+    stream->cursor.history = &thread->history;
+
+    const uint8_t* payload_next = payload;
+    result = inflate_stream_feed(stream, &thread->stash, &payload_next, payload + payload_length);
+    if (result == INFLATE_COMPRESSED_INCOMPLETE) {
+        const uint8_t* trailer_next = websocket_trailer;
+        result = inflate_stream_feed(stream, &thread->stash, &trailer_next, websocket_trailer + sizeof(websocket_trailer));
+    }
+    *message_length = stream->cursor.decompressed_next - message;
+
+    if (result == INFLATE_COMPRESSED_INCOMPLETE) {
+        /* Unless the message ended in a final block, the trailer must leave the stream between blocks with nothing left over. */
+        if (stream->state != INFLATE_STREAM_BLOCK_HEADER || thread->stash.length || stream->cursor.buffer_count)
+            return INFLATE_COMPRESSED_INCOMPLETE;
+    } else if (result) {
+        return result;
+    }
+
+    return keep_history(session, message, *message_length);
+}
+
+extern size_t websocket_inflate_memory(const struct WebSocketInflate* session) {
+    return sizeof(struct WebSocketInflate) + session->history_capacity;
+}
+
+extern void websocket_inflate_release_thread(void) {
+    if (!websocket_thread)
+        return;
+
+    free(websocket_thread);
+    websocket_thread = NULL;
+}
+
+
+
+static int thread_state(struct WebSocketThread** thread) {
+    if (!websocket_thread) {
+        struct WebSocketThread* created = malloc(sizeof(struct WebSocketThread));
+        if (!created)
+            return INFLATE_NO_MEMORY;
+        created->stream.inflator.static_table_loaded = false;
+        websocket_thread = created;
+    }
+
+    *thread = websocket_thread;
+
+    return INFLATE_SUCCESS;
+}
+
+static int keep_history(struct WebSocketInflate* session, const uint8_t* message, size_t length) {
+    if (!session->window_length || !length)
+        return INFLATE_SUCCESS;
+
+    /* A message as long as the window replaces all history. */
+    if (length >= session->window_length) {
+        message += length - session->window_length;
+        length = session->window_length;
+        session->history_start = 0;
+        session->history_length = 0;
+    }
+
+    size_t needed = session->history_length + length;
+    if (needed > session->window_length)
+        needed = session->window_length;
+    if (needed > session->history_capacity) {
+        /* Grow by doubling, so sessions that only ever see short messages stay small. Until it is full the ring does not wrap. */
+        size_t capacity = 2 * (size_t)session->history_capacity;
+        if (capacity < needed)
+            capacity = needed;
+        if (capacity > session->window_length)
+            capacity = session->window_length;
+
+        uint8_t* history = realloc(session->history, capacity);
+        if (!history)
+            return INFLATE_NO_MEMORY;
+        session->history = history;
+        session->history_capacity = (uint32_t)capacity;
+    }
+
+    size_t offset = (session->history_start + session->history_length) % session->history_capacity;
+    size_t first = session->history_capacity - offset < length ? session->history_capacity - offset : length;
+    memcpy(session->history + offset, message, first);
+    memcpy(session->history, message + first, length - first);
+
+    /* The oldest bytes make way once the ring is full. */
+    size_t history_length = session->history_length + length;
+    if (history_length > session->history_capacity) {
+        session->history_start = (uint32_t)((session->history_start + history_length - session->history_capacity) % session->history_capacity);
+        history_length = session->history_capacity;
+    }
+    session->history_length = (uint32_t)history_length;
+
+    return INFLATE_SUCCESS;
+}
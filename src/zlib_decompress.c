@@ -1,10 +1,36 @@
 #include "zlib_decompress.h"
-#include "bit_reader.h"
+
+#include <stdbool.h>
+#include <stdint.h>
+
+#include "adler32.h"
 #include "inflate.h"
+#include "inflate_metrics_internal.h"
+#include "inflate_pipeline.h"
+#include "inflate_stream.h"
+#include "zlib_header.h"
+
+
 
+/* Decompresses the zlib stream in compressed, pipelined or not, and verifies its trailer. */
+static int decompress(const uint8_t* compressed, size_t compressed_length, uint8_t* decompressed, size_t* decompressed_length, size_t decompressed_max_length, bool pipelined);
 
 
 extern int zlib_decompress(const unsigned char* compressed, size_t compressed_length, unsigned char* decompressed, size_t* decompressed_length, size_t decompressed_max_length) {
+    INFLATE_METRICS_BEGIN(call);
+    int result = decompress(compressed, compressed_length, decompressed, decompressed_length, decompressed_max_length, false);
+    INFLATE_METRICS_END(call, INFLATE_METRICS_ZLIB_DECOMPRESS, result, compressed_length, *decompressed_length);
+
+    return result;
+}
+
+extern int zlib_decompress_pipelined(const unsigned char* compressed, size_t compressed_length, unsigned char* decompressed, size_t* decompressed_length, size_t decompressed_max_length) {
+    return decompress(compressed, compressed_length, decompressed, decompressed_length, decompressed_max_length, true);
+}
+
+
+
+static int decompress(const uint8_t* compressed, size_t compressed_length, uint8_t* decompressed, size_t* decompressed_length, size_t decompressed_max_length, bool pipelined) {
     *decompressed_length = 0;
 
     if (!decompressed) {
@@ -13,24 +39,36 @@ extern int zlib_decompress(const unsigned char* compressed, size_t compressed_le
         return ZLIB_DECOMPRESS_SUCCESS;
     }
 
-    BitReader bit_reader = {
-        .compressed_next = compressed,
-        .compressed_end = compressed + compressed_length,
-        .buffer = 0,
-        .buffer_count = 0
-    };
-    fill_buffer(&bit_reader);
-
-    if (bit_reader.buffer_count < 16)
+    if (compressed_length < ZLIB_HEADER_LENGTH + ZLIB_TRAILER_LENGTH)
         return INFLATE_COMPRESSED_INCOMPLETE;
-    get_bits(&bit_reader, 16);
+    int result = zlib_parse_header(compressed, compressed_length);
+    if (result)
+        return result;
+
+    const uint8_t* trailer = NULL;
+    uint32_t adler = 1;
+    if (pipelined) {
+        result = inflate_pipeline_decode(compressed + ZLIB_HEADER_LENGTH, compressed_length - ZLIB_HEADER_LENGTH, decompressed, decompressed_max_length, decompressed_length,
+                                         &trailer, adler32_update, &adler);
+    } else {
+        struct InflateStream stream;
+        inflate_stream_init(&stream, compressed + ZLIB_HEADER_LENGTH, compressed_length - ZLIB_HEADER_LENGTH, decompressed, decompressed_max_length);
+        result = INFLATE_METRICS_DECODE(&stream);
+        *decompressed_length = stream.cursor.decompressed_next - decompressed;
+        trailer = inflate_stream_compressed_end(&stream);
+        if (!result) {
+            INFLATE_METRICS_PHASE_BEGIN(checksum_start);
+            adler = adler32_update(adler, decompressed, *decompressed_length);
+            INFLATE_METRICS_PHASE_END(INFLATE_TRACE_CHECKSUM, checksum_start);
+        }
+    }
+    if (result)
+        return result;
 
-    int result = tinflate(bit_reader.compressed_next, compressed_length - 6, decompressed, decompressed_length, decompressed_max_length);
-    byte_align(&bit_reader);
-    fill_buffer(&bit_reader);
-    if (bit_reader.buffer_count < 32)
+    if (compressed + compressed_length - trailer < ZLIB_TRAILER_LENGTH)
         return INFLATE_COMPRESSED_INCOMPLETE;
-    get_bits(&bit_reader, 32);
+    if (zlib_read_be32(trailer) != adler)
+        return INFLATE_CHECKSUM_MISMATCH;
 
-    return result;
+    return ZLIB_DECOMPRESS_SUCCESS;
 }
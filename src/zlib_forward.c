@@ -0,0 +1,142 @@
+/*
+ * The part of zlib's API the shim does not implement, passed on to the
+ * system's libz.so.1. Preloaded under the same soname, the shim replaces that
+ * library for the whole process, so it is opened a second time by its full
+ * path (SHIM_SYSTEM_ZLIB, found at configure time) with local symbols. Its
+ * own calls to inflate() and friends still end up in the shim.
+ */
+
+#include "zlib.h"
+
+#include <dlfcn.h>
+#include <pthread.h>
+#include <stdarg.h>
+#include <stdatomic.h>
+#include <stddef.h>
+#include <stdio.h>
+#include <stdlib.h>
+
+
+
+/* Opened once, on the first call that needs it. */
+static pthread_once_t system_once = PTHREAD_ONCE_INIT;
+static void* system_library;
+
+
+static void open_system_library(void) {
+    system_library = dlopen(SHIM_SYSTEM_ZLIB, RTLD_NOW | RTLD_LOCAL);
+}
+
+/*
+ * Returns name from the system's libz, looked up once and kept in *cache.
+ * A program that got past the dynamic linker has no way to handle a missing
+ * zlib function, so this aborts as the dynamic linker would have.
+ */
+static void* system_function(_Atomic(void*)* cache, const char* name) {
+    void* function = atomic_load_explicit(cache, memory_order_acquire);
+    if (function)
+        return function;
+
+    pthread_once(&system_once, open_system_library);
+    if (system_library)
+        function = dlsym(system_library, name);
+    if (!function) {
+        fprintf(stderr, "libz.so.1 (inflate shim): %s not found in %s: %s\n", name, SHIM_SYSTEM_ZLIB, dlerror());
+        abort();
+    }
+    atomic_store_explicit(cache, function, memory_order_release);
+
+    return function;
+}
+
+#define SHIM_FORWARD(type, name, parameters, arguments)                                         \
+    type ZEXPORT name parameters {                                                              \
+        static _Atomic(void*) function;                                                         \
+        return ((type(*) parameters)system_function(&function, #name)) arguments;               \
+    }
+
+
+SHIM_FORWARD(int, deflateInit_, (z_streamp strm, int level, const char* version, int stream_size), (strm, level, version, stream_size))
+SHIM_FORWARD(int, deflateInit2_, (z_streamp strm, int level, int method, int windowBits, int memLevel, int strategy, const char* version, int stream_size),
+             (strm, level, method, windowBits, memLevel, strategy, version, stream_size))
+SHIM_FORWARD(int, deflate, (z_streamp strm, int flush), (strm, flush))
+SHIM_FORWARD(int, deflateEnd, (z_streamp strm), (strm))
+SHIM_FORWARD(int, deflateSetDictionary, (z_streamp strm, const Bytef* dictionary, uInt dictLength), (strm, dictionary, dictLength))
+SHIM_FORWARD(int, deflateGetDictionary, (z_streamp strm, Bytef* dictionary, uInt* dictLength), (strm, dictionary, dictLength))
+SHIM_FORWARD(int, deflateCopy, (z_streamp dest, z_streamp source), (dest, source))
+SHIM_FORWARD(int, deflateReset, (z_streamp strm), (strm))
+SHIM_FORWARD(int, deflateResetKeep, (z_streamp strm), (strm))
+SHIM_FORWARD(int, deflateParams, (z_streamp strm, int level, int strategy), (strm, level, strategy))
+SHIM_FORWARD(int, deflateTune, (z_streamp strm, int good_length, int max_lazy, int nice_length, int max_chain), (strm, good_length, max_lazy, nice_length, max_chain))
+SHIM_FORWARD(uLong, deflateBound, (z_streamp strm, uLong sourceLen), (strm, sourceLen))
+SHIM_FORWARD(int, deflatePending, (z_streamp strm, unsigned* pending, int* bits), (strm, pending, bits))
+SHIM_FORWARD(int, deflatePrime, (z_streamp strm, int bits, int value), (strm, bits, value))
+SHIM_FORWARD(int, deflateSetHeader, (z_streamp strm, gz_headerp head), (strm, head))
+
+SHIM_FORWARD(int, inflateBackInit_, (z_streamp strm, int windowBits, unsigned char* window, const char* version, int stream_size), (strm, windowBits, window, version, stream_size))
+SHIM_FORWARD(int, inflateBack, (z_streamp strm, in_func in, void* in_desc, out_func out, void* out_desc), (strm, in, in_desc, out, out_desc))
+SHIM_FORWARD(int, inflateBackEnd, (z_streamp strm), (strm))
+
+SHIM_FORWARD(uLong, zlibCompileFlags, (void), ())
+SHIM_FORWARD(const char*, zError, (int err), (err))
+SHIM_FORWARD(const uLong*, get_crc_table, (void), ())
+
+SHIM_FORWARD(int, compress, (Bytef* dest, uLongf* destLen, const Bytef* source, uLong sourceLen), (dest, destLen, source, sourceLen))
+SHIM_FORWARD(int, compress2, (Bytef* dest, uLongf* destLen, const Bytef* source, uLong sourceLen, int level), (dest, destLen, source, sourceLen, level))
+SHIM_FORWARD(uLong, compressBound, (uLong sourceLen), (sourceLen))
+SHIM_FORWARD(int, uncompress2, (Bytef* dest, uLongf* destLen, const Bytef* source, uLong* sourceLen), (dest, destLen, source, sourceLen))
+
+SHIM_FORWARD(uLong, adler32_combine, (uLong adler1, uLong adler2, z_off_t len2), (adler1, adler2, len2))
+SHIM_FORWARD(uLong, adler32_combine64, (uLong adler1, uLong adler2, z_off64_t len2), (adler1, adler2, len2))
+SHIM_FORWARD(uLong, crc32_combine, (uLong crc1, uLong crc2, z_off_t len2), (crc1, crc2, len2))
+SHIM_FORWARD(uLong, crc32_combine64, (uLong crc1, uLong crc2, z_off64_t len2), (crc1, crc2, len2))
+SHIM_FORWARD(uLong, crc32_combine_gen, (z_off_t len2), (len2))
+SHIM_FORWARD(uLong, crc32_combine_gen64, (z_off64_t len2), (len2))
+SHIM_FORWARD(uLong, crc32_combine_op, (uLong crc1, uLong crc2, uLong op), (crc1, crc2, op))
+
+SHIM_FORWARD(gzFile, gzopen, (const char* path, const char* mode), (path, mode))
+SHIM_FORWARD(gzFile, gzopen64, (const char* path, const char* mode), (path, mode))
+SHIM_FORWARD(gzFile, gzdopen, (int fd, const char* mode), (fd, mode))
+SHIM_FORWARD(int, gzbuffer, (gzFile file, unsigned size), (file, size))
+SHIM_FORWARD(int, gzsetparams, (gzFile file, int level, int strategy), (file, level, strategy))
+SHIM_FORWARD(int, gzread, (gzFile file, voidp buf, unsigned len), (file, buf, len))
+SHIM_FORWARD(size_t, gzfread, (voidp buf, size_t size, size_t nitems, gzFile file), (buf, size, nitems, file))
+SHIM_FORWARD(int, gzwrite, (gzFile file, voidpc buf, unsigned len), (file, buf, len))
+SHIM_FORWARD(size_t, gzfwrite, (voidpc buf, size_t size, size_t nitems, gzFile file), (buf, size, nitems, file))
+SHIM_FORWARD(int, gzvprintf, (gzFile file, const char* format, va_list va), (file, format, va))
+SHIM_FORWARD(int, gzputs, (gzFile file, const char* s), (file, s))
+SHIM_FORWARD(char*, gzgets, (gzFile file, char* buf, int len), (file, buf, len))
+SHIM_FORWARD(int, gzputc, (gzFile file, int c), (file, c))
+SHIM_FORWARD(int, gzgetc, (gzFile file), (file))
+SHIM_FORWARD(int, gzgetc_, (gzFile file), (file))
+SHIM_FORWARD(int, gzungetc, (int c, gzFile file), (c, file))
+SHIM_FORWARD(int, gzflush, (gzFile file, int flush), (file, flush))
+SHIM_FORWARD(z_off_t, gzseek, (gzFile file, z_off_t offset, int whence), (file, offset, whence))
+SHIM_FORWARD(z_off64_t, gzseek64, (gzFile file, z_off64_t offset, int whence), (file, offset, whence))
+SHIM_FORWARD(int, gzrewind, (gzFile file), (file))
+SHIM_FORWARD(z_off_t, gztell, (gzFile file), (file))
+SHIM_FORWARD(z_off64_t, gztell64, (gzFile file), (file))
+SHIM_FORWARD(z_off_t, gzoffset, (gzFile file), (file))
+SHIM_FORWARD(z_off64_t, gzoffset64, (gzFile file), (file))
+SHIM_FORWARD(int, gzeof, (gzFile file), (file))
+SHIM_FORWARD(int, gzdirect, (gzFile file), (file))
+SHIM_FORWARD(int, gzclose, (gzFile file), (file))
+SHIM_FORWARD(int, gzclose_r, (gzFile file), (file))
+SHIM_FORWARD(int, gzclose_w, (gzFile file), (file))
+SHIM_FORWARD(const char*, gzerror, (gzFile file, int* errnum), (file, errnum))
+
+/* Variadic: passed on as its va_list counterpart. */
+int ZEXPORT gzprintf(gzFile file, const char* format, ...) {
+    va_list va;
+    va_start(va, format);
+    int result = gzvprintf(file, format, va);
+    va_end(va);
+
+    return result;
+}
+
+/* Returns nothing, which the macro cannot express. */
+void ZEXPORT gzclearerr(gzFile file) {
+    static _Atomic(void*) function;
+    ((void (*)(gzFile))system_function(&function, "gzclearerr"))(file);
+}
@@ -0,0 +1,534 @@
+/*
+ * zlib compatible inflate() on top of InflateStream. Output is decoded into an
+ * InflateWindow and copied to next_out from there, input that ends inside a
+ * block header waits in an InflateStash. zlib and gzip headers and trailers
+ * are read here, the check value is updated as output is decoded.
+ */
+
+#include "zlib.h"
+
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "adler32.h"
+#include "crc32.h"
+#include "gzip_header.h"
+#include "inflate.h"
+#include "inflate_stream.h"
+#include "inflate_window.h"
+#include "zlib_decompress.h"
+
+
+
+/* Wrappers around the deflate stream. */
+#define SHIM_WRAP_RAW               0
+#define SHIM_WRAP_ZLIB              1
+#define SHIM_WRAP_GZIP              2
+#define SHIM_WRAP_AUTO              3
+
+/* Decoding modes. */
+#define SHIM_MODE_HEADER            0
+#define SHIM_MODE_DEFLATE           1
+#define SHIM_MODE_TRAILER           2
+#define SHIM_MODE_DONE              3
+#define SHIM_MODE_BAD               4
+
+#define SHIM_ZLIB_HEADER_LENGTH     2
+#define SHIM_ZLIB_TRAILER_LENGTH    4
+
+/* gzip headers are read in steps of this many bytes, the step that completes the header hands back its excess. */
+#define SHIM_HEADER_STEP            256
+
+
+struct internal_state {
+    int wrap;           // As asked for by windowBits.
+    int format;         // As found in the stream.
+    int mode;
+    uint32_t check;
+    uint32_t length;    // Output length modulo 2^32, as in the gzip trailer.
+
+    uint8_t* header;
+    size_t header_length;
+    size_t header_capacity;
+
+    uint8_t trailer[GZIP_TRAILER_LENGTH];
+    size_t trailer_length;
+
+    struct InflateWindow window;
+    struct InflateStash stash;
+    struct InflateStream stream;
+};
+
+
+static voidpf default_alloc(voidpf opaque, uInt items, uInt size) {
+    (void)opaque;
+    return calloc(items, size);
+}
+
+static void default_free(voidpf opaque, voidpf address) {
+    (void)opaque;
+    free(address);
+}
+
+/* Returns non-zero if strm was not set up by inflateInit2_(). */
+static int state_check(z_streamp strm) {
+    return !strm || !strm->state || !strm->zalloc || !strm->zfree;
+}
+
+/* Translates windowBits into a wrapper. Returns -1 for values zlib rejects. */
+static int window_bits_wrap(int window_bits) {
+    if (window_bits < 0) {
+        if (window_bits < -MAX_WBITS || window_bits > -8)
+            return -1;
+        return SHIM_WRAP_RAW;
+    }
+
+    int wrap = SHIM_WRAP_ZLIB;
+    if (window_bits >= 32) {
+        wrap = SHIM_WRAP_AUTO;
+        window_bits -= 32;
+    } else if (window_bits >= 16) {
+        wrap = SHIM_WRAP_GZIP;
+        window_bits -= 16;
+    }
+    if (window_bits && (window_bits < 8 || window_bits > MAX_WBITS))
+        return -1;
+
+    return wrap;
+}
+
+static z_const char* error_message(int result) {
+    switch (result) {
+        case INFLATE_INVALID_BLOCK_TYPE:
+            return "invalid block type";
+        case INFLATE_BLOCK_LENGTH_UNCERTAIN:
+            return "invalid stored block lengths";
+        case INFLATE_INVALID_LZ77:
+            return "invalid distance too far back";
+        case INFLATE_OVERFULL_HUFFMAN_CODE:
+        case INFLATE_INCOMPLETE_HUFFMAN_CODE:
+            return "invalid code lengths set";
+        case INFLATE_INVALID_HEADER:
+            return "incorrect header check";
+        default:
+            return "invalid code";
+    }
+}
+
+/* Makes room for one more header step. */
+static int grow_header(z_streamp strm) {
+    struct internal_state* state = strm->state;
+    if (state->header_capacity - state->header_length >= SHIM_HEADER_STEP)
+        return Z_OK;
+
+    size_t capacity = 2 * state->header_capacity + SHIM_HEADER_STEP;
+    uint8_t* header = strm->zalloc(strm->opaque, 1, (uInt)capacity);
+    if (!header)
+        return Z_MEM_ERROR;
+    if (state->header)
+        memcpy(header, state->header, state->header_length);
+    strm->zfree(strm->opaque, state->header);
+    state->header = header;
+    state->header_capacity = capacity;
+
+    return Z_OK;
+}
+
+/*
+ * Reads the zlib or gzip header, picking the wrapper first if it is to be
+ * detected. Returns Z_OK once the deflate stream can start, Z_BUF_ERROR if
+ * more input is needed.
+ */
+static int read_header(z_streamp strm, const uint8_t** in, const uint8_t* in_end) {
+    struct internal_state* state = strm->state;
+    int result = grow_header(strm);
+    if (result)
+        return result;
+
+    if (state->format == SHIM_WRAP_AUTO || state->format == SHIM_WRAP_ZLIB) {
+        /* Two bytes tell the wrappers apart and make up the whole zlib header. */
+        const uint8_t* bytes = state->header;
+        state->header_length += inflate_stash_read(&state->stash, in, in_end, state->header + state->header_length, SHIM_ZLIB_HEADER_LENGTH - state->header_length);
+        if (state->header_length < SHIM_ZLIB_HEADER_LENGTH)
+            return Z_BUF_ERROR;
+
+        if (state->format == SHIM_WRAP_AUTO && bytes[0] == GZIP_ID1 && bytes[1] == GZIP_ID2) {
+            /* Continue as gzip with the two bytes already read. */
+            state->format = SHIM_WRAP_GZIP;
+        } else {
+            state->format = SHIM_WRAP_ZLIB;
+            if ((bytes[0] & 0x0f) != Z_DEFLATED || (bytes[0] >> 4) + 8 > MAX_WBITS || (bytes[0] << 8 | bytes[1]) % 31) {
+                strm->msg = "incorrect header check";
+                return Z_DATA_ERROR;
+            }
+            if (bytes[1] & 0x20) {
+                strm->msg = "preset dictionary not supported";
+                return Z_DATA_ERROR;
+            }
+            state->check = 1;
+            return Z_OK;
+        }
+    }
+
+    for (;;) {
+        result = grow_header(strm);
+        if (result)
+            return result;
+
+        const uint8_t* step_start = *in;
+        state->header_length += inflate_stash_read(&state->stash, in, in_end, state->header + state->header_length, SHIM_HEADER_STEP);
+
+        struct GzipHeader header;
+        result = gzip_parse_header(state->header, state->header_length, &header);
+        if (result == INFLATE_COMPRESSED_INCOMPLETE) {
+            if (*in == in_end && !state->stash.length)
+                return Z_BUF_ERROR;
+            continue;
+        }
+        if (result) {
+            strm->msg = "incorrect header check";
+            return Z_DATA_ERROR;
+        }
+
+        /* Hand back what the last step read past the header, to the input where it came from. */
+        size_t excess = state->header_length - header.header_length;
+        size_t from_input = *in - step_start;
+        size_t to_input = excess < from_input ? excess : from_input;
+        *in -= to_input;
+        excess -= to_input;
+        if (excess) {
+            memmove(state->stash.bytes + excess, state->stash.bytes, state->stash.length);
+            memcpy(state->stash.bytes, state->header + header.header_length, excess);
+            state->stash.length += excess;
+        }
+
+        state->check = 0;
+        return Z_OK;
+    }
+}
+
+/* Reads and verifies the zlib or gzip trailer. Returns Z_BUF_ERROR if more input is needed. */
+static int read_trailer(z_streamp strm, const uint8_t** in, const uint8_t* in_end) {
+    struct internal_state* state = strm->state;
+    size_t trailer_length = state->format == SHIM_WRAP_GZIP ? GZIP_TRAILER_LENGTH : SHIM_ZLIB_TRAILER_LENGTH;
+
+    state->trailer_length += inflate_stash_read(&state->stash, in, in_end, state->trailer + state->trailer_length, trailer_length - state->trailer_length);
+    if (state->trailer_length < trailer_length)
+        return Z_BUF_ERROR;
+
+    const uint8_t* bytes = state->trailer;
+    if (state->format == SHIM_WRAP_GZIP) {
+        if (gzip_read_le32(bytes) != state->check) {
+            strm->msg = "incorrect data check";
+            return Z_DATA_ERROR;
+        }
+        if (gzip_read_le32(bytes + 4) != state->length) {
+            strm->msg = "incorrect length check";
+            return Z_DATA_ERROR;
+        }
+    } else if (((uint32_t)bytes[0] << 24 | (uint32_t)bytes[1] << 16 | (uint32_t)bytes[2] << 8 | bytes[3]) != state->check) {
+        strm->msg = "incorrect data check";
+        return Z_DATA_ERROR;
+    }
+
+    return Z_OK;
+}
+
+
+const char* ZEXPORT zlibVersion(void) {
+    return ZLIB_VERSION;
+}
+
+int ZEXPORT inflateInit_(z_streamp strm, const char* version, int stream_size) {
+    return inflateInit2_(strm, MAX_WBITS, version, stream_size);
+}
+
+int ZEXPORT inflateInit2_(z_streamp strm, int windowBits, const char* version, int stream_size) {
+    if (!version || version[0] != ZLIB_VERSION[0] || stream_size != (int)sizeof(z_stream))
+        return Z_VERSION_ERROR;
+    if (!strm)
+        return Z_STREAM_ERROR;
+
+    strm->msg = NULL;
+    if (!strm->zalloc) {
+        strm->zalloc = default_alloc;
+        strm->opaque = NULL;
+    }
+    if (!strm->zfree)
+        strm->zfree = default_free;
+
+    struct internal_state* state = strm->zalloc(strm->opaque, 1, sizeof(struct internal_state));
+    if (!state)
+        return Z_MEM_ERROR;
+    uint8_t* window = strm->zalloc(strm->opaque, 1, INFLATE_WINDOW_DEFAULT_CAPACITY);
+    if (!window) {
+        strm->zfree(strm->opaque, state);
+        return Z_MEM_ERROR;
+    }
+
+    state->header = NULL;
+    state->header_capacity = 0;
+    state->stash.length = 0;
+    inflate_window_init(&state->window, window, INFLATE_WINDOW_DEFAULT_CAPACITY);
+    strm->state = state;
+
+    int result = inflateReset2(strm, windowBits);
+    if (result)
+        inflateEnd(strm);
+
+    return result;
+}
+
+int ZEXPORT inflateReset(z_streamp strm) {
+    if (state_check(strm))
+        return Z_STREAM_ERROR;
+    struct internal_state* state = strm->state;
+
+    /* Bytes read past a finished stream start the next one; anything else belongs to the abandoned stream. */
+    if (state->mode != SHIM_MODE_DONE)
+        state->stash.length = 0;
+    state->format = state->wrap;
+    state->mode = SHIM_MODE_HEADER;
+    state->check = 0;
+    state->length = 0;
+    state->header_length = 0;
+    state->trailer_length = 0;
+    inflate_window_reset(&state->window);
+    inflate_stream_init(&state->stream, NULL, 0, NULL, 0);
+
+    strm->total_in = 0;
+    strm->total_out = 0;
+    strm->msg = NULL;
+    strm->data_type = 0;
+    strm->adler = state->format == SHIM_WRAP_ZLIB ? 1 : 0;
+
+    return Z_OK;
+}
+
+int ZEXPORT inflateReset2(z_streamp strm, int windowBits) {
+    if (state_check(strm))
+        return Z_STREAM_ERROR;
+
+    int wrap = window_bits_wrap(windowBits);
+    if (wrap < 0)
+        return Z_STREAM_ERROR;
+    strm->state->wrap = wrap;
+
+    return inflateReset(strm);
+}
+
+int ZEXPORT inflateEnd(z_streamp strm) {
+    if (state_check(strm))
+        return Z_STREAM_ERROR;
+    struct internal_state* state = strm->state;
+
+    if (state->header)
+        strm->zfree(strm->opaque, state->header);
+    strm->zfree(strm->opaque, state->window.buffer);
+    strm->zfree(strm->opaque, state);
+    strm->state = NULL;
+
+    return Z_OK;
+}
+
+int ZEXPORT inflate(z_streamp strm, int flush) {
+    if (state_check(strm) || !strm->next_out || (!strm->next_in && strm->avail_in))
+        return Z_STREAM_ERROR;
+    struct internal_state* state = strm->state;
+
+    const uint8_t* in = strm->next_in;
+    const uint8_t* in_end = in + strm->avail_in;
+    uint8_t* out = strm->next_out;
+    size_t out_length = strm->avail_out;
+    int ret = Z_OK;
+
+    /* Every flush mode decodes as much as input and output allow. */
+    for (;;) {
+        size_t taken = inflate_window_take(&state->window, out, out_length);
+        out += taken;
+        out_length -= taken;
+
+        if (state->mode == SHIM_MODE_HEADER) {
+            int result = state->format == SHIM_WRAP_RAW ? Z_OK : read_header(strm, &in, in_end);
+            if (result == Z_BUF_ERROR)
+                break;
+            if (result) {
+                state->mode = SHIM_MODE_BAD;
+                ret = result;
+                break;
+            }
+            state->mode = SHIM_MODE_DEFLATE;
+        } else if (state->mode == SHIM_MODE_DEFLATE) {
+            if (inflate_window_pending_length(&state->window) && !out_length)
+                break;
+
+            inflate_window_prepare(&state->window, &state->stream.cursor);
+            const uint8_t* decoded = state->stream.cursor.decompressed_next;
+            int result = inflate_stream_feed(&state->stream, &state->stash, &in, in_end);
+
+            size_t decoded_length = state->stream.cursor.decompressed_next - decoded;
+            if (state->format == SHIM_WRAP_ZLIB)
+                state->check = adler32_update(state->check, decoded, decoded_length);
+            else if (state->format == SHIM_WRAP_GZIP)
+                state->check = crc32_update(state->check, decoded, decoded_length);
+            state->length += (uint32_t)decoded_length;
+            inflate_window_commit(&state->window, &state->stream.cursor);
+
+            if (result == INFLATE_SUCCESS) {
+                state->mode = state->format == SHIM_WRAP_RAW ? SHIM_MODE_DONE : SHIM_MODE_TRAILER;
+            } else if (result == INFLATE_COMPRESSED_INCOMPLETE) {
+                taken = inflate_window_take(&state->window, out, out_length);
+                out += taken;
+                out_length -= taken;
+                break;
+            } else if (result != INFLATE_DECOMPRESSED_OVERFLOW) {
+                strm->msg = error_message(result);
+                state->mode = SHIM_MODE_BAD;
+                ret = Z_DATA_ERROR;
+                break;
+            }
+        } else if (state->mode == SHIM_MODE_TRAILER) {
+            /* As with zlib, the trailer stays in the input until all output is out: gzread() takes no input left to mean no output left. */
+            if (inflate_window_pending_length(&state->window) && !out_length)
+                break;
+
+            int result = read_trailer(strm, &in, in_end);
+            if (result == Z_BUF_ERROR)
+                break;
+            if (result) {
+                state->mode = SHIM_MODE_BAD;
+                ret = result;
+                break;
+            }
+            state->mode = SHIM_MODE_DONE;
+        } else if (state->mode == SHIM_MODE_DONE) {
+            if (!inflate_window_pending_length(&state->window))
+                ret = Z_STREAM_END;
+            break;
+        } else {
+            ret = Z_DATA_ERROR;
+            break;
+        }
+    }
+
+    size_t in_used = in - strm->next_in;
+    size_t out_used = out - strm->next_out;
+    strm->next_in = (z_const Bytef*)in;
+    strm->avail_in = (uInt)(in_end - in);
+    strm->total_in += in_used;
+    strm->next_out = out;
+    strm->avail_out = (uInt)out_length;
+    strm->total_out += out_used;
+    strm->adler = state->check;
+
+    if (ret == Z_OK && ((!in_used && !out_used) || flush == Z_FINISH))
+        ret = Z_BUF_ERROR;
+
+    return ret;
+}
+
+int ZEXPORT uncompress(Bytef* dest, uLongf* destLen, const Bytef* source, uLong sourceLen) {
+    /* zlib_decompress() wants somewhere to write even when there is no room. */
+    unsigned char dummy;
+    size_t decompressed_length = 0;
+    int result = zlib_decompress(source, sourceLen, *destLen ? dest : &dummy, &decompressed_length, *destLen);
+    *destLen = decompressed_length;
+
+    switch (result) {
+        case INFLATE_SUCCESS:
+            return Z_OK;
+        case INFLATE_NO_MEMORY:
+            return Z_MEM_ERROR;
+        case INFLATE_DECOMPRESSED_OVERFLOW:
+            return Z_BUF_ERROR;
+        default:
+            return Z_DATA_ERROR;
+    }
+}
+
+uLong ZEXPORT adler32(uLong adler, const Bytef* buf, uInt len) {
+    if (!buf)
+        return 1;
+    return adler32_update((uint32_t)adler, buf, len);
+}
+
+uLong ZEXPORT crc32(uLong crc, const Bytef* buf, uInt len) {
+    if (!buf)
+        return 0;
+    return crc32_update((uint32_t)crc, buf, len);
+}
+
+uLong ZEXPORT adler32_z(uLong adler, const Bytef* buf, size_t len) {
+    if (!buf)
+        return 1;
+    return adler32_update((uint32_t)adler, buf, len);
+}
+
+uLong ZEXPORT crc32_z(uLong crc, const Bytef* buf, size_t len) {
+    if (!buf)
+        return 0;
+    return crc32_update((uint32_t)crc, buf, len);
+}
+
+int ZEXPORT inflateSetDictionary(z_streamp strm, const Bytef* dictionary, uInt dictLength) {
+    (void)strm, (void)dictionary, (void)dictLength;
+    return Z_STREAM_ERROR;
+}
+
+int ZEXPORT inflateGetDictionary(z_streamp strm, Bytef* dictionary, uInt* dictLength) {
+    (void)strm, (void)dictionary, (void)dictLength;
+    return Z_STREAM_ERROR;
+}
+
+int ZEXPORT inflateSync(z_streamp strm) {
+    (void)strm;
+    return Z_STREAM_ERROR;
+}
+
+int ZEXPORT inflateSyncPoint(z_streamp strm) {
+    (void)strm;
+    return Z_STREAM_ERROR;
+}
+
+int ZEXPORT inflateCopy(z_streamp dest, z_streamp source) {
+    (void)dest, (void)source;
+    return Z_STREAM_ERROR;
+}
+
+int ZEXPORT inflatePrime(z_streamp strm, int bits, int value) {
+    (void)strm, (void)bits, (void)value;
+    return Z_STREAM_ERROR;
+}
+
+long ZEXPORT inflateMark(z_streamp strm) {
+    (void)strm;
+    return -(1L << 16);
+}
+
+int ZEXPORT inflateGetHeader(z_streamp strm, gz_headerp head) {
+    (void)strm, (void)head;
+    return Z_STREAM_ERROR;
+}
+
+int ZEXPORT inflateUndermine(z_streamp strm, int subvert) {
+    (void)strm, (void)subvert;
+    return Z_DATA_ERROR;
+}
+
+int ZEXPORT inflateResetKeep(z_streamp strm) {
+    return inflateReset(strm);
+}
+
+int ZEXPORT inflateValidate(z_streamp strm, int check) {
+    if (state_check(strm) || !check)
+        return Z_STREAM_ERROR;
+    return Z_OK;
+}
+
+unsigned long ZEXPORT inflateCodesUsed(z_streamp strm) {
+    (void)strm;
+    return (unsigned long)-1;
+}
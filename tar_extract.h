@@ -0,0 +1,71 @@
+/*
+ * https://pubs.opengroup.org/onlinepubs/9699919799/utilities/pax.html (ustar and pax formats)
+ * https://www.gnu.org/software/tar/manual/html_node/Standard.html (GNU long names)
+ * https://datatracker.ietf.org/doc/html/rfc1952
+ */
+
+#ifndef TAR_EXTRACT_H
+#define TAR_EXTRACT_H
+
+
+#include <stddef.h>
+#include <stdint.h>
+
+#include "MDE.h"
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+
+
+struct TarExtractOptions {
+    unsigned writer_count;      // Writer threads, 0 selects the number of online processors.
+    size_t buffer_length;       // Decompressed bytes per buffer, rounded up to 4 KiB and at least 64 KiB. 0 selects 4 MiB.
+    unsigned buffer_count;      // Buffers in flight, at least 2. 0 selects 8.
+    uint64_t direct_length;     // Files at least this long are preallocated and written with O_DIRECT where the system allows. 0 never.
+};
+
+/* Where the time went. Writer times are summed over all writers, so write_busy can exceed elapsed. */
+struct TarExtractStats {
+    uint64_t file_count;
+    uint64_t byte_count;        // Length of the tar archive.
+    unsigned writer_count;
+    double elapsed;
+    double decode_busy;         // Inflating and checking CRC-32s.
+    double parse_busy;          // Reading headers, creating directories and links, queueing writes.
+    double decode_wait;         // Waiting for a buffer the writers still hold.
+    double write_busy;          // Opening, writing and closing files.
+    double write_wait;          // Waiting for work.
+};
+
+
+/*
+ * Extracts a tar.gz archive, gzip with one or more members, below directory,
+ * which must exist. The calling thread inflates into buffer_count recycled
+ * buffers and parses tar headers as each buffer fills. File data is never
+ * copied: the writer threads write it straight out of the buffer it was
+ * decoded to, and a buffer is reused once all of its writes are done, so
+ * memory stays at buffer_count * buffer_length however large the archive.
+ *
+ * Regular files, directories and symbolic and hard links are created, others
+ * are skipped. GNU long names and the pax path, linkpath, size and mtime
+ * records are understood. Files get the mode (less the umask) and
+ * modification time of the archive; ownership is not restored. Links are made
+ * once every file is written, so nothing is ever written through one. A
+ * leading "/" is stripped, so absolute paths land below directory as well.
+ * Paths that step outside directory with "..", and links whose path or hard
+ * link target leads through a symbolic link, are refused with
+ * INFLATE_VALUE_NOT_ALLOWED; failing system calls end extraction with
+ * INFLATE_IO_ERROR. Files written before an error are left in place. options
+ * and stats may be NULL.
+ */
+extern int tar_extract(const unsigned char* compressed, size_t compressed_length, const char* directory, const struct TarExtractOptions* options,
+                       struct TarExtractStats* stats);
+
+#ifdef __cplusplus
+}
+#endif
+
+
+#endif /* TAR_EXTRACT_H */
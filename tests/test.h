@@ -0,0 +1,157 @@
+/*
+ * Shared by the tests in this directory: a failure count that becomes the
+ * exit status, and inputs made with zlib.
+ */
+
+#ifndef TEST_H
+#define TEST_H
+
+
+#include <stddef.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include <zlib.h>
+
+
+
+/* Kinds of input test_make_input() produces. */
+#define TEST_TEXT       0   // Words from a small skewed vocabulary.
+#define TEST_RANDOM     1   // Incompressible.
+#define TEST_RUNS       2   // Long runs of a few bytes, matches at distance 1 and beyond 32 KiB.
+#define TEST_MIXED      3   // Text with random stretches.
+#define TEST_KINDS      4
+
+/* LSB first bit writer for hand made streams. */
+struct TestBits {
+    unsigned char bytes[40000];
+    size_t count;
+};
+
+
+static int test_failures;
+
+#define CHECK(condition, ...)                                                                   \
+    do {                                                                                        \
+        if (!(condition)) {                                                                     \
+            ++test_failures;                                                                    \
+            fprintf(stderr, "%s:%d: CHECK(%s) failed: ", __FILE__, __LINE__, #condition);       \
+            fprintf(stderr, __VA_ARGS__);                                                       \
+            fprintf(stderr, "\n");                                                              \
+        }                                                                                       \
+    } while (0)
+
+/* Returns the exit status of a test program. */
+#define TEST_RESULT() (test_failures ? (fprintf(stderr, "%d checks failed\n", test_failures), 1) : 0)
+
+
+static inline uint32_t test_random(uint32_t* state) {
+    *state = *state * 1103515245 + 12345;
+    return *state >> 8;
+}
+
+static inline void test_make_input(unsigned char* data, size_t length, unsigned kind, uint32_t seed) {
+    static const char* words[] = { "the ", "of ", "inflate ", "deflate ", "stream ", "block ", "Huffman ", "window\n", "0123456789 " };
+    uint32_t state = seed;
+    size_t i = 0;
+    while (i < length) {
+        uint32_t r = test_random(&state);
+        if (kind == TEST_RANDOM || (kind == TEST_MIXED && r % 16 == 0)) {
+            size_t end = i + 1 + r % 300;
+            for (; i < end && i < length; ++i)
+                data[i] = (unsigned char)test_random(&state);
+        } else if (kind == TEST_RUNS) {
+            size_t end = i + 1 + r % 70000;
+            unsigned char byte = (unsigned char)(r >> 12) % 4;
+            for (; i < end && i < length; ++i)
+                data[i] = byte;
+        } else {
+            const char* word = words[r % (r % 9 + 1)];
+            for (; *word && i < length; ++word, ++i)
+                data[i] = (unsigned char)*word;
+        }
+    }
+}
+
+/*
+ * Compresses data with zlib into a new allocation. window_bits selects the
+ * container like deflateInit2() does. With flush_interval, a full flush
+ * follows every flush_interval bytes.
+ */
+static inline unsigned char* test_compress(const unsigned char* data, size_t length, int level, int strategy, int window_bits, size_t flush_interval,
+                                           size_t* compressed_length) {
+    z_stream deflater;
+    memset(&deflater, 0, sizeof(deflater));
+    if (deflateInit2(&deflater, level, Z_DEFLATED, window_bits, 8, strategy) != Z_OK)
+        return NULL;
+    size_t max_length = deflateBound(&deflater, length) + (flush_interval ? length / flush_interval * 8 + 64 : 0);
+    unsigned char* compressed = (unsigned char*)malloc(max_length);
+    deflater.next_out = compressed;
+    deflater.avail_out = (uInt)max_length;
+
+    size_t offset = 0;
+    do {
+        size_t piece = flush_interval && length - offset > flush_interval ? flush_interval : length - offset;
+        deflater.next_in = (unsigned char*)data + offset;
+        deflater.avail_in = (uInt)piece;
+        offset += piece;
+        deflate(&deflater, offset == length ? Z_FINISH : Z_FULL_FLUSH);
+    } while (offset < length);
+
+    *compressed_length = max_length - deflater.avail_out;
+    deflateEnd(&deflater);
+    return compressed;
+}
+
+/* Length symbol and distance code pairs for test_reserved_stream(). The first is valid, the others are reserved. */
+static const unsigned test_reserved_symbols[][2] = { { 257, 29 }, { 286, 0 }, { 287, 0 }, { 257, 30 }, { 257, 31 } };
+
+#define TEST_RESERVED_COUNT (sizeof(test_reserved_symbols) / sizeof(*test_reserved_symbols))
+
+static inline void test_put_bits(struct TestBits* bits, uint32_t value, unsigned count) {
+    for (unsigned i = 0; i < count; ++i, ++bits->count) {
+        if (!(bits->count % 8))
+            bits->bytes[bits->count / 8] = 0;
+        bits->bytes[bits->count / 8] |= (value >> i & 1) << bits->count % 8;
+    }
+}
+
+/* Huffman codes go out most significant bit first. */
+static inline void test_put_code(struct TestBits* bits, uint32_t code, unsigned count) {
+    while (count--)
+        test_put_bits(bits, code >> count & 1, 1);
+}
+
+/*
+ * 30000 bytes of stored data followed by a static block holding a match of
+ * length symbol length_symbol at distance code distance_code. Symbols 286 and
+ * 287 and distance codes 30 and 31 take part in the static codes but must not
+ * occur in a stream. Returns the length of the raw deflate stream in bytes.
+ */
+static inline size_t test_reserved_stream(struct TestBits* bits, unsigned length_symbol, unsigned distance_code) {
+    bits->count = 0;
+    test_put_bits(bits, 0, 3);
+    bits->count = (bits->count + 7) & ~(size_t)7;
+    test_put_bits(bits, 30000, 16);
+    test_put_bits(bits, ~30000u, 16);
+    for (unsigned i = 0; i < 30000; ++i)
+        test_put_bits(bits, 'a' + i % 26, 8);
+
+    test_put_bits(bits, 1, 1);
+    test_put_bits(bits, 1, 2);
+    if (length_symbol < 280)
+        test_put_code(bits, length_symbol - 256, 7);
+    else
+        test_put_code(bits, 0xC0 + length_symbol - 280, 8);
+    test_put_code(bits, distance_code, 5);
+    test_put_bits(bits, 0, distance_code >= 4 && distance_code < 30 ? distance_code / 2 - 1 : 0);
+    test_put_code(bits, 0, 7);
+
+    return (bits->count + 7) / 8;
+}
+
+
+
+#endif /* TEST_H */
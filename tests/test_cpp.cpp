@@ -0,0 +1,124 @@
+/*
+ * The C++20 interface in inflate.hpp: growing result buffers up to their
+ * bound, and iterating raw, zlib and gzip streams in chunks.
+ */
+
+#include <cstddef>
+#include <cstdint>
+#include <cstdlib>
+#include <cstring>
+#include <span>
+#include <vector>
+
+#include "inflate.hpp"
+#include "test.h"
+
+
+
+namespace {
+
+std::span<const std::byte> as_bytes(const unsigned char* bytes, std::size_t length) {
+    return { reinterpret_cast<const std::byte*>(bytes), length };
+}
+
+bool same(std::span<const std::byte> decoded, const unsigned char* expected, std::size_t length) {
+    return decoded.size() == length && (!length || !std::memcmp(decoded.data(), expected, length));
+}
+
+/* Concatenates all chunks. *count receives the number of chunks. */
+std::vector<std::byte> gather(Inflate::Generator<std::span<const std::byte>>& generator, InflateError* error, std::size_t* count) {
+    std::vector<std::byte> gathered;
+    *count = 0;
+    for (std::span<const std::byte> chunk : generator) {
+        gathered.insert(gathered.end(), chunk.begin(), chunk.end());
+        ++*count;
+    }
+    *error = generator.error();
+    return gathered;
+}
+
+void check_buffers(const unsigned char* data, std::size_t length) {
+    std::size_t raw_length, zlib_length;
+    unsigned char* raw = test_compress(data, length, 6, Z_DEFAULT_STRATEGY, -15, 0, &raw_length);
+    unsigned char* zlib = test_compress(data, length, 6, Z_DEFAULT_STRATEGY, 15, 0, &zlib_length);
+
+    auto decoded = Inflate::decompress(as_bytes(raw, raw_length));
+    CHECK(decoded && same(decoded->span(), data, length), "decompress");
+
+    auto exact = Inflate::decompress(as_bytes(raw, raw_length), 0, length);
+    CHECK(exact && same(exact->span(), data, length), "decompress with max_size of the output");
+
+    auto bounded = Inflate::decompress(as_bytes(raw, raw_length), 0, length - 1);
+    CHECK(!bounded && bounded.error() == INFLATE_DECOMPRESSED_OVERFLOW, "decompress past max_size");
+
+    auto hinted = Inflate::zlib_decompress(as_bytes(zlib, zlib_length), 1000, length - 1);
+    CHECK(!hinted && hinted.error() == INFLATE_DECOMPRESSED_OVERFLOW, "zlib_decompress past max_size");
+
+    auto grown = Inflate::zlib_decompress(as_bytes(zlib, zlib_length), 1000);
+    CHECK(grown && same(grown->span(), data, length), "zlib_decompress from a small hint");
+
+    std::free(raw);
+    std::free(zlib);
+}
+
+void check_chunks(const unsigned char* data, std::size_t length) {
+    std::size_t lengths[3];
+    unsigned char* inputs[3] = {
+        test_compress(data, length, 6, Z_DEFAULT_STRATEGY, -15, 0, &lengths[INFLATE_FORMAT_RAW]),
+        test_compress(data, length, 6, Z_DEFAULT_STRATEGY, 15, 0, &lengths[INFLATE_FORMAT_ZLIB]),
+        test_compress(data, length, 6, Z_DEFAULT_STRATEGY, 31, 0, &lengths[INFLATE_FORMAT_GZIP]),
+    };
+
+    for (int format = INFLATE_FORMAT_RAW; format <= INFLATE_FORMAT_GZIP; ++format) {
+        auto generator = Inflate::chunks(as_bytes(inputs[format], lengths[format]), static_cast<InflateFormat>(format));
+        InflateError error;
+        std::size_t count;
+        std::vector<std::byte> gathered = gather(generator, &error, &count);
+        CHECK(!error && count > 1 && same(gathered, data, length), "chunks format %d: %d, %zu bytes in %zu chunks", format, error, gathered.size(), count);
+    }
+
+    /* Two plain gzip members, no BGZF index needed. */
+    std::size_t half = length / 2;
+    std::size_t first_length, second_length;
+    unsigned char* first = test_compress(data, half, 6, Z_DEFAULT_STRATEGY, 31, 0, &first_length);
+    unsigned char* second = test_compress(data + half, length - half, 1, Z_DEFAULT_STRATEGY, 31, 0, &second_length);
+    std::vector<unsigned char> members(first, first + first_length);
+    members.insert(members.end(), second, second + second_length);
+
+    auto generator = Inflate::chunks(as_bytes(members.data(), members.size()), INFLATE_FORMAT_GZIP);
+    InflateError error;
+    std::size_t count;
+    std::vector<std::byte> gathered = gather(generator, &error, &count);
+    CHECK(!error && same(gathered, data, length), "chunks of two gzip members: %d, %zu bytes", error, gathered.size());
+
+    /* A damaged CRC-32 ends iteration with the mismatch. */
+    members[first_length - 8] ^= 1;
+    auto damaged = Inflate::chunks(as_bytes(members.data(), members.size()), INFLATE_FORMAT_GZIP);
+    gathered = gather(damaged, &error, &count);
+    CHECK(error == INFLATE_CHECKSUM_MISMATCH && gathered.size() <= half, "chunks of a damaged member: %d, %zu bytes", error, gathered.size());
+
+    auto empty = Inflate::chunks({}, INFLATE_FORMAT_RAW);
+    gathered = gather(empty, &error, &count);
+    CHECK(!error && !count, "chunks of an empty raw stream: %d, %zu chunks", error, count);
+
+    std::free(first);
+    std::free(second);
+    for (unsigned char* input : inputs)
+        std::free(input);
+}
+
+} // namespace
+
+
+int main() {
+    std::size_t length = 1 << 20;
+    unsigned char* data = static_cast<unsigned char*>(std::malloc(length));
+    test_make_input(data, length, TEST_MIXED, 5);
+
+    check_buffers(data, length);
+    check_chunks(data, length);
+
+    std::free(data);
+
+    return TEST_RESULT();
+}
@@ -0,0 +1,80 @@
+/*
+ * Files written by gzip_compress() in every mode read back with zlib and the
+ * verify scan, and BGZF output through the member index.
+ */
+
+#include <stddef.h>
+#include <stdint.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "gzip_compress.h"
+#include "gzip_members.h"
+#include "inflate.h"
+#include "inflate_scan.h"
+#include "test.h"
+
+
+
+/* Files written by gzip_compress() read back with zlib, and BGZF through the member index. */
+static void check_gzip_compress(const unsigned char* data, size_t length) {
+    for (enum GzipCompressMode mode = GZIP_COMPRESS_DICTIONARY; mode <= GZIP_COMPRESS_BGZF; ++mode) {
+        struct GzipCompressOptions options = { .mode = mode, .level = 6, .chunk_length = 50000, .thread_count = 2 };
+        size_t compressed_max_length = gzip_compress_bound(length, &options);
+        unsigned char* compressed = malloc(compressed_max_length);
+        size_t compressed_length;
+        int result = gzip_compress(data, length, compressed, &compressed_length, compressed_max_length, &options, NULL);
+        CHECK(!result, "gzip_compress mode %d: %d", mode, result);
+        if (result) {
+            free(compressed);
+            continue;
+        }
+
+        unsigned char* out = malloc(length + 1);
+        z_stream inflater;
+        memset(&inflater, 0, sizeof(inflater));
+        inflateInit2(&inflater, 31);
+        inflater.next_in = compressed;
+        inflater.avail_in = (uInt)compressed_length;
+        inflater.next_out = out;
+        inflater.avail_out = (uInt)length + 1;
+        /* BGZF is a series of members. */
+        while ((result = inflate(&inflater, Z_NO_FLUSH)) == Z_STREAM_END && inflater.avail_in && inflater.next_in[0] == 0x1F)
+            inflateReset(&inflater);
+        size_t out_length = length + 1 - inflater.avail_out;
+        inflateEnd(&inflater);
+        CHECK(result == Z_STREAM_END && out_length == length && !memcmp(out, data, length), "gzip_compress mode %d read by zlib: %d, %zu bytes", mode, result,
+              out_length);
+
+        size_t verified;
+        result = inflate_scan_verify(compressed, compressed_length, INFLATE_FORMAT_GZIP, &verified);
+        CHECK(!result && verified == length, "gzip_compress mode %d verified: %d, %zu bytes", mode, result, verified);
+
+        if (mode == GZIP_COMPRESS_BGZF) {
+            struct GzipMemberIndex index;
+            result = gzip_members_scan(compressed, compressed_length, &index);
+            CHECK(!result && index.bgzf && index.decompressed_length == length, "gzip_members_scan %d", result);
+            if (!result) {
+                memset(out, 0, length);
+                result = gzip_members_decompress(compressed, &index, out, length, 2);
+                CHECK(!result && !memcmp(out, data, length), "gzip_members_decompress %d", result);
+                gzip_members_free(&index);
+            }
+        }
+
+        free(out);
+        free(compressed);
+    }
+}
+
+int main(void) {
+    static const size_t lengths[] = { 0, 1, 300000 };
+    unsigned char* data = malloc(300000);
+    for (size_t l = 0; l < sizeof(lengths) / sizeof(*lengths); ++l) {
+        test_make_input(data, lengths[l], TEST_MIXED, 7);
+        check_gzip_compress(data, lengths[l]);
+    }
+    free(data);
+
+    return TEST_RESULT();
+}
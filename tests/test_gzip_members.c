@@ -0,0 +1,66 @@
+/*
+ * The gzip member index: plain members without BSIZE, one of them empty, are
+ * indexed by walking their deflate streams, decoded in parallel and read by
+ * virtual offset. Truncated members and a wrong ISIZE are refused.
+ */
+
+#include <stddef.h>
+#include <stdint.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "gzip_members.h"
+#include "inflate.h"
+#include "test.h"
+
+
+
+/* Plain gzip members without BSIZE, one of them empty, are indexed by walking their deflate streams. */
+static void check_gzip_members(const unsigned char* data, size_t length) {
+    size_t splits[] = { 0, length / 3, length / 3, length };
+    unsigned char* compressed = NULL;
+    size_t compressed_length = 0;
+    size_t second_offset = 0;
+    for (size_t i = 0; i + 1 < sizeof(splits) / sizeof(*splits); ++i) {
+        size_t member_length;
+        unsigned char* member = test_compress(data + splits[i], splits[i + 1] - splits[i], 1 + (int)i * 4, Z_DEFAULT_STRATEGY, 31, 0, &member_length);
+        compressed = realloc(compressed, compressed_length + member_length);
+        memcpy(compressed + compressed_length, member, member_length);
+        if (i == 1)
+            second_offset = compressed_length;
+        compressed_length += member_length;
+        free(member);
+    }
+
+    struct GzipMemberIndex index;
+    int result = gzip_members_scan(compressed, compressed_length, &index);
+    CHECK(!result && !index.bgzf && index.member_count == 3 && index.decompressed_length == length, "gzip_members_scan without BSIZE %d", result);
+    if (!result) {
+        unsigned char* out = malloc(length);
+        result = gzip_members_decompress(compressed, &index, out, length, 2);
+        CHECK(!result && !memcmp(out, data, length), "gzip_members_decompress without BSIZE %d", result);
+        size_t out_length;
+        result = gzip_members_read_virtual(compressed, &index, (uint64_t)second_offset << 16, out, &out_length, length);
+        CHECK(!result && out_length == 0, "gzip_members_read_virtual of the empty member %d, %zu bytes", result, out_length);
+        free(out);
+        gzip_members_free(&index);
+    }
+
+    result = gzip_members_scan(compressed, compressed_length - 1, &index);
+    CHECK(result == INFLATE_COMPRESSED_INCOMPLETE, "gzip_members_scan of a truncated member %d", result);
+    compressed[compressed_length - 1] ^= 1;
+    result = gzip_members_scan(compressed, compressed_length, &index);
+    CHECK(result == INFLATE_CHECKSUM_MISMATCH, "gzip_members_scan of a wrong ISIZE %d", result);
+
+    free(compressed);
+}
+
+int main(void) {
+    size_t length = 300000;
+    unsigned char* data = malloc(length);
+    test_make_input(data, length, TEST_MIXED, 7);
+    check_gzip_members(data, length);
+    free(data);
+
+    return TEST_RESULT();
+}
@@ -0,0 +1,253 @@
+/*
+ * The histograms and traces of inflate_metrics.h, against a library built
+ * with INFLATE_METRICS: counts and sizes per entry point and result, from
+ * this thread and a released one, quantiles, merging, and slow call traces
+ * by threshold and sample rate.
+ */
+
+#include <pthread.h>
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "inflate.h"
+#include "inflate_internal.h"
+#include "inflate_metrics.h"
+#include "test.h"
+#include "zlib_decompress.h"
+
+
+
+#define MESSAGE_COUNT   30
+
+
+struct Message {
+    unsigned char* raw;
+    size_t raw_length;
+    unsigned char* zlib;
+    size_t zlib_length;
+    size_t length;
+};
+
+
+static const size_t message_lengths[] = { 100, 1000, 10000 };
+
+static struct Message messages[MESSAGE_COUNT];
+static unsigned char output[1 << 20];
+
+
+/* Every message once through tinflate() and zlib_decompress(), with undersized output every other time and a damaged trailer every fifth. */
+static void decode_messages(void) {
+    for (unsigned i = 0; i < MESSAGE_COUNT; ++i) {
+        const struct Message* message = &messages[i];
+        size_t out_length;
+        size_t max_length = i % 2 ? message->length : message->length - 1;
+        tinflate(message->raw, message->raw_length, output, &out_length, max_length);
+
+        message->zlib[message->zlib_length - 1] ^= i % 5 ? 0 : 1;
+        zlib_decompress(message->zlib, message->zlib_length, output, &out_length, message->length);
+        message->zlib[message->zlib_length - 1] ^= i % 5 ? 0 : 1;
+    }
+}
+
+static void* decode_on_thread(void* argument) {
+    (void)argument;
+    decode_messages();
+    inflate_metrics_release_thread();
+    return NULL;
+}
+
+static bool buckets_add_up(const struct InflateHistogram* histogram) {
+    uint64_t count = 0;
+    for (unsigned i = 0; i < INFLATE_HISTOGRAM_BUCKET_COUNT; ++i)
+        count += histogram->buckets[i];
+    return count == histogram->count;
+}
+
+/* Counts for decode_messages() run rounds times. */
+static void check_counts(const struct InflateMetricsSnapshot* snapshot, unsigned rounds, const char* name) {
+    const struct InflateHistogram* tinflate_success = &snapshot->latency[INFLATE_METRICS_TINFLATE][INFLATE_SUCCESS];
+    const struct InflateHistogram* tinflate_overflow = &snapshot->latency[INFLATE_METRICS_TINFLATE][INFLATE_DECOMPRESSED_OVERFLOW];
+    const struct InflateHistogram* zlib_success = &snapshot->latency[INFLATE_METRICS_ZLIB_DECOMPRESS][INFLATE_SUCCESS];
+    const struct InflateHistogram* zlib_mismatch = &snapshot->latency[INFLATE_METRICS_ZLIB_DECOMPRESS][INFLATE_CHECKSUM_MISMATCH];
+
+    CHECK(tinflate_success->count == rounds * MESSAGE_COUNT / 2, "%s: tinflate successes %llu", name, (unsigned long long)tinflate_success->count);
+    CHECK(tinflate_overflow->count == rounds * MESSAGE_COUNT / 2, "%s: tinflate overflows %llu", name, (unsigned long long)tinflate_overflow->count);
+    CHECK(zlib_success->count == rounds * MESSAGE_COUNT * 4 / 5, "%s: zlib_decompress successes %llu", name, (unsigned long long)zlib_success->count);
+    CHECK(zlib_mismatch->count == rounds * MESSAGE_COUNT / 5, "%s: zlib_decompress mismatches %llu", name, (unsigned long long)zlib_mismatch->count);
+
+    uint64_t total = 0;
+    for (unsigned entry = 0; entry < INFLATE_METRICS_ENTRY_COUNT; ++entry) {
+        for (unsigned result = 0; result < INFLATE_METRICS_RESULT_COUNT; ++result) {
+            const struct InflateHistogram* latency = &snapshot->latency[entry][result];
+            total += latency->count;
+            CHECK(buckets_add_up(latency) && buckets_add_up(&snapshot->compressed[entry][result]) && buckets_add_up(&snapshot->decompressed[entry][result]),
+                  "%s: entry %u, result %u: buckets and count differ", name, entry, result);
+            CHECK(snapshot->compressed[entry][result].count == latency->count && snapshot->decompressed[entry][result].count == latency->count,
+                  "%s: entry %u, result %u: histograms disagree on the count", name, entry, result);
+        }
+    }
+    CHECK(total == rounds * MESSAGE_COUNT * 2, "%s: %llu calls recorded", name, (unsigned long long)total);
+
+    /* Every message length decodes to itself, in equal numbers. */
+    const struct InflateHistogram* decompressed = &snapshot->decompressed[INFLATE_METRICS_TINFLATE][INFLATE_SUCCESS];
+    uint64_t sum = 0;
+    for (unsigned i = 0; i < MESSAGE_COUNT; ++i)
+        sum += i % 2 ? messages[i].length : 0;
+    CHECK(decompressed->sum == rounds * sum && decompressed->min == 100 && decompressed->max == 10000, "%s: decompressed sum %llu, min %llu, max %llu", name,
+          (unsigned long long)decompressed->sum, (unsigned long long)decompressed->min, (unsigned long long)decompressed->max);
+}
+
+static void check_histograms(void) {
+    struct InflateMetricsSnapshot* snapshot = malloc(sizeof(struct InflateMetricsSnapshot));
+    struct InflateMetricsSnapshot* merged = calloc(1, sizeof(struct InflateMetricsSnapshot));
+
+    /* Off: nothing is recorded. */
+    decode_messages();
+    inflate_metrics_snapshot(snapshot);
+    CHECK(!snapshot->latency[INFLATE_METRICS_TINFLATE][INFLATE_SUCCESS].count, "recorded while off");
+
+    struct InflateMetricsOptions options = { .enabled = true };
+    int result = inflate_metrics_configure(&options);
+    CHECK(result == INFLATE_SUCCESS, "configure %d", result);
+    decode_messages();
+    inflate_metrics_snapshot(snapshot);
+    check_counts(snapshot, 1, "this thread");
+
+    /* A released thread's counts stay, and its state is taken over by the next thread. */
+    pthread_t thread;
+    pthread_create(&thread, NULL, decode_on_thread, NULL);
+    pthread_join(thread, NULL);
+    pthread_create(&thread, NULL, decode_on_thread, NULL);
+    pthread_join(thread, NULL);
+    inflate_metrics_snapshot(snapshot);
+    check_counts(snapshot, 3, "three threads");
+
+    inflate_metrics_merge(merged, snapshot);
+    inflate_metrics_merge(merged, snapshot);
+    check_counts(merged, 6, "merged twice");
+
+    /* A third of the successful outputs each are 100, 1000 and 10000 bytes long. */
+    const struct InflateHistogram* decompressed = &snapshot->decompressed[INFLATE_METRICS_TINFLATE][INFLATE_SUCCESS];
+    uint64_t median = inflate_histogram_quantile(decompressed, 0.5);
+    uint64_t high = inflate_histogram_quantile(decompressed, 0.9);
+    CHECK(median <= 1000 && 1000 - median < 1000 >> INFLATE_HISTOGRAM_SUB_BUCKET_BITS, "median %llu", (unsigned long long)median);
+    CHECK(high <= 10000 && 10000 - high < 10000 >> INFLATE_HISTOGRAM_SUB_BUCKET_BITS, "90th percentile %llu", (unsigned long long)high);
+    CHECK(inflate_histogram_quantile(decompressed, 0) == 100 && inflate_histogram_quantile(decompressed, 1) == 10000, "quantiles 0 and 1");
+    const struct InflateHistogram* latency = &snapshot->latency[INFLATE_METRICS_TINFLATE][INFLATE_SUCCESS];
+    CHECK(latency->min <= inflate_histogram_quantile(latency, 0.5) && inflate_histogram_quantile(latency, 0.5) <= latency->max, "latency median out of range");
+
+    /* Stopped: nothing more is recorded. */
+    inflate_metrics_configure(NULL);
+    decode_messages();
+    inflate_metrics_snapshot(snapshot);
+    check_counts(snapshot, 3, "stopped");
+
+    free(snapshot);
+    free(merged);
+}
+
+static void check_bucket_values(void) {
+    for (unsigned bucket = 0; bucket < 2u << INFLATE_HISTOGRAM_SUB_BUCKET_BITS; ++bucket)
+        CHECK(inflate_histogram_bucket_value(bucket) == bucket, "bucket %u", bucket);
+    for (unsigned bucket = 1; bucket < INFLATE_HISTOGRAM_BUCKET_COUNT; ++bucket)
+        CHECK(inflate_histogram_bucket_value(bucket) > inflate_histogram_bucket_value(bucket - 1), "bucket %u not above the one before", bucket);
+}
+
+/* Traces recorded from here on, newest last. */
+static size_t new_traces(struct InflateTrace* traces, size_t max_count, uint64_t after) {
+    size_t count = inflate_metrics_traces(traces, max_count);
+    size_t first = 0;
+    while (first < count && traces[first].sequence < after)
+        ++first;
+    memmove(traces, traces + first, (count - first) * sizeof(struct InflateTrace));
+    return count - first;
+}
+
+static void check_traces(void) {
+    struct InflateTrace* traces = malloc(INFLATE_TRACE_RING_LENGTH * sizeof(struct InflateTrace));
+    size_t count = inflate_metrics_traces(traces, INFLATE_TRACE_RING_LENGTH);
+    uint64_t next = count ? traces[count - 1].sequence + 1 : 0;
+
+    /* Many blocks, to see them listed one by one. */
+    size_t length = 1 << 20;
+    unsigned char* data = malloc(length);
+    test_make_input(data, length, TEST_MIXED, 11);
+    size_t zlib_length;
+    unsigned char* zlib = test_compress(data, length, 6, Z_DEFAULT_STRATEGY, 15, 16384, &zlib_length);
+
+    /* Every call is slower than a nanosecond. */
+    struct InflateMetricsOptions options = { .enabled = true, .trace_threshold = 1 };
+    inflate_metrics_configure(&options);
+    size_t out_length;
+    int result = zlib_decompress(zlib, zlib_length, output, &out_length, length);
+    CHECK(result == INFLATE_SUCCESS && out_length == length, "zlib_decompress %d", result);
+
+    count = new_traces(traces, INFLATE_TRACE_RING_LENGTH, next);
+    CHECK(count == 1, "%zu traces of one call above the threshold", count);
+    if (count) {
+        const struct InflateTrace* trace = &traces[count - 1];
+        CHECK(trace->entry == INFLATE_METRICS_ZLIB_DECOMPRESS && trace->result == INFLATE_SUCCESS, "trace of entry %d, result %d", trace->entry, trace->result);
+        CHECK(trace->compressed_length == zlib_length && trace->decompressed_length == length && trace->latency >= 1, "trace lengths %zu, %zu", trace->compressed_length,
+              trace->decompressed_length);
+        CHECK(trace->phase_time[INFLATE_TRACE_DATA] > 0 && trace->phase_time[INFLATE_TRACE_DATA] <= trace->latency, "data phase %llu of %llu ns",
+              (unsigned long long)trace->phase_time[INFLATE_TRACE_DATA], (unsigned long long)trace->latency);
+
+        uint64_t block_length = 0;
+        unsigned listed = trace->block_count < INFLATE_TRACE_MAX_BLOCKS ? trace->block_count : INFLATE_TRACE_MAX_BLOCKS;
+        for (unsigned i = 0; i < listed; ++i)
+            block_length += trace->blocks[i].decompressed_length;
+        CHECK(trace->block_count > 1 && trace->blocks[0].type == INFLATE_BLOCKTYPE_DYNAMIC_HUFFMAN, "%u blocks, the first of type %u", trace->block_count, trace->blocks[0].type);
+        CHECK(trace->block_count > INFLATE_TRACE_MAX_BLOCKS ? block_length < length : block_length == length && trace->blocks[listed - 1].final,
+              "blocks add up to %llu bytes", (unsigned long long)block_length);
+        next = trace->sequence + 1;
+    }
+
+    /* Nothing takes an hour. */
+    options.trace_threshold = 3600 * UINT64_C(1000000000);
+    inflate_metrics_configure(&options);
+    zlib_decompress(zlib, zlib_length, output, &out_length, length);
+    count = new_traces(traces, INFLATE_TRACE_RING_LENGTH, next);
+    CHECK(count == 0, "%zu traces of a call below the threshold", count);
+
+    /* Every fourth call traced. */
+    options.trace_threshold = 1;
+    options.trace_sample = 4;
+    inflate_metrics_configure(&options);
+    for (unsigned i = 0; i < 8; ++i)
+        tinflate(messages[i].raw, messages[i].raw_length, output, &out_length, messages[i].length);
+    count = new_traces(traces, INFLATE_TRACE_RING_LENGTH, next);
+    CHECK(count == 2 && traces[0].entry == INFLATE_METRICS_TINFLATE, "%zu traces of 8 calls sampled 1 in 4", count);
+
+    inflate_metrics_configure(NULL);
+    free(data);
+    free(zlib);
+    free(traces);
+}
+
+
+int main(void) {
+    unsigned char* data = malloc(message_lengths[2]);
+    for (unsigned i = 0; i < MESSAGE_COUNT; ++i) {
+        struct Message* message = &messages[i];
+        message->length = message_lengths[i % 3];
+        test_make_input(data, message->length, i % TEST_KINDS, i + 1);
+        message->raw = test_compress(data, message->length, 6, Z_DEFAULT_STRATEGY, -15, 0, &message->raw_length);
+        message->zlib = test_compress(data, message->length, 6, Z_DEFAULT_STRATEGY, 15, 0, &message->zlib_length);
+    }
+    free(data);
+
+    check_histograms();
+    check_bucket_values();
+    check_traces();
+
+    for (unsigned i = 0; i < MESSAGE_COUNT; ++i) {
+        free(messages[i].raw);
+        free(messages[i].zlib);
+    }
+
+    return TEST_RESULT();
+}
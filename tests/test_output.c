@@ -0,0 +1,86 @@
+/*
+ * Output buffers from inflate_output_create(), with huge pages and
+ * prefaulting asked for: tinflate_output() and tinflate_output_sink() give the
+ * same output as zlib's input, in whatever pages the system provided, and a
+ * buffer one byte short is reported.
+ */
+
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "inflate.h"
+#include "inflate_output.h"
+#include "test.h"
+
+
+
+struct SinkCheck {
+    const unsigned char* expected;
+    size_t offset;
+    bool differs;
+};
+
+
+static const size_t lengths[] = { 0, 1, 100, 65536 + 3, (1 << 20) + 7, (5 << 20) + 1 };
+
+
+static int sink_check(void* context, const unsigned char* bytes, size_t length) {
+    struct SinkCheck* check = context;
+    if (memcmp(check->expected + check->offset, bytes, length))
+        check->differs = true;
+    check->offset += length;
+    return 0;
+}
+
+static void check_output(const unsigned char* data, size_t length, const struct InflateOutputOptions* options, const char* name) {
+    size_t raw_length, out_length;
+    unsigned char* raw = test_compress(data, length, 6, Z_DEFAULT_STRATEGY, -15, 0, &raw_length);
+
+    struct InflateOutput output;
+    int result = inflate_output_create(length ? length : 1, options, &output);
+    CHECK(!result, "%s: inflate_output_create %d", name, result);
+    if (!result) {
+        result = tinflate_output(raw, raw_length, &output, &out_length);
+        CHECK(!result && out_length == length && !memcmp(output.bytes, data, length), "%s: tinflate_output %d, %zu bytes", name, result, out_length);
+        struct SinkCheck check = { data, 0, false };
+        result = tinflate_output_sink(raw, raw_length, &output, sink_check, &check, &out_length);
+        CHECK(!result && out_length == length && check.offset == length && !check.differs, "%s: tinflate_output_sink %d, %zu bytes", name, result, out_length);
+        inflate_output_destroy(&output);
+    }
+
+    if (length > 1) {
+        result = inflate_output_create(length - 1, options, &output);
+        if (!result) {
+            result = tinflate_output(raw, raw_length, &output, &out_length);
+            CHECK(result == INFLATE_DECOMPRESSED_OVERFLOW && !memcmp(output.bytes, data, out_length), "%s: tinflate_output one byte short %d", name, result);
+            inflate_output_destroy(&output);
+        }
+    }
+
+    free(raw);
+}
+
+int main(void) {
+    static const struct InflateOutputOptions options[] = {
+        { .huge_pages = false, .prefault = false },
+        { .huge_pages = true, .prefault = true, .prefault_distance = 1 << 20 },
+    };
+    unsigned char* data = malloc(lengths[sizeof(lengths) / sizeof(*lengths) - 1]);
+    for (unsigned kind = 0; kind < TEST_KINDS; ++kind) {
+        for (size_t l = 0; l < sizeof(lengths) / sizeof(*lengths); ++l) {
+            test_make_input(data, lengths[l], kind, (uint32_t)(kind * 31 + l + 1));
+            for (size_t o = 0; o < sizeof(options) / sizeof(*options); ++o) {
+                char name[96];
+                snprintf(name, sizeof(name), "kind %u, %zu bytes, huge pages %d", kind, lengths[l], options[o].huge_pages);
+                check_output(data, lengths[l], &options[o], name);
+            }
+        }
+    }
+    free(data);
+
+    return TEST_RESULT();
+}
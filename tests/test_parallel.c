@@ -0,0 +1,122 @@
+/*
+ * tinflate_parallel(): streams with full flush points decode on several
+ * threads into the same output as zlib's input, a short output buffer is
+ * reported, and reserved Huffman symbols are refused. Streams without flush
+ * points take the sequential path.
+ */
+
+#include <stddef.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "inflate.h"
+#include "test.h"
+
+
+
+struct Configuration {
+    int level;
+    int strategy;
+};
+
+
+static const size_t lengths[] = { 0, 1, 100, 65536 + 3, (1 << 20) + 7 };
+
+static const struct Configuration configurations[] = {
+    { 0, Z_DEFAULT_STRATEGY },
+    { 1, Z_DEFAULT_STRATEGY },
+    { 6, Z_DEFAULT_STRATEGY },
+    { 9, Z_DEFAULT_STRATEGY },
+    { 6, Z_FIXED },
+    { 6, Z_HUFFMAN_ONLY },
+    { 6, Z_RLE },
+};
+
+
+/* A full flush every 40000 bytes, and none at all. */
+static void check_segments(const unsigned char* data, size_t length, const struct Configuration* configuration, const char* name) {
+    unsigned char* out = malloc(length + 1);
+    static const size_t flush_intervals[] = { 40000, 0 };
+    for (size_t i = 0; i < sizeof(flush_intervals) / sizeof(*flush_intervals); ++i) {
+        size_t compressed_length, out_length;
+        unsigned char* compressed = test_compress(data, length, configuration->level, configuration->strategy, -15, flush_intervals[i], &compressed_length);
+        int result = tinflate_parallel(compressed, compressed_length, out, &out_length, length, 3);
+        CHECK(!result && out_length == length && !memcmp(out, data, length), "%s, flush interval %zu: tinflate_parallel %d, %zu bytes", name, flush_intervals[i], result,
+              out_length);
+        if (length) {
+            result = tinflate_parallel(compressed, compressed_length / 2, out, &out_length, length, 3);
+            CHECK(result != INFLATE_SUCCESS, "%s, flush interval %zu: tinflate_parallel decoded truncated input", name, flush_intervals[i]);
+        }
+        free(compressed);
+    }
+    free(out);
+}
+
+/*
+ * Incompressible data cut into several segments, then long runs that all land
+ * in the last one. Its buffer has to grow from its share of the output budget
+ * to most of the output. With the output one byte short the chain stops at
+ * that segment and the sequential decode reports the overflow.
+ */
+static void check_parallel(void) {
+    size_t random_length = 1200000;
+    size_t length = random_length + 12000000;
+    unsigned char* data = malloc(length);
+    test_make_input(data, random_length, TEST_RANDOM, 11);
+    test_make_input(data + random_length, length - random_length, TEST_RUNS, 12);
+    size_t compressed_length;
+    unsigned char* compressed = test_compress(data, length, 6, Z_DEFAULT_STRATEGY, -15, 100000, &compressed_length);
+    unsigned char* out = malloc(length + 1);
+
+    static const unsigned thread_counts[] = { 2, 4, 8 };
+    for (size_t i = 0; i < sizeof(thread_counts) / sizeof(*thread_counts); ++i) {
+        size_t out_length;
+        int result = tinflate_parallel(compressed, compressed_length, out, &out_length, length, thread_counts[i]);
+        CHECK(!result && out_length == length && !memcmp(out, data, length), "tinflate_parallel %u threads, exact output: %d, %zu bytes", thread_counts[i], result,
+              out_length);
+        result = tinflate_parallel(compressed, compressed_length, out, &out_length, length + 1, thread_counts[i]);
+        CHECK(!result && out_length == length && !memcmp(out, data, length), "tinflate_parallel %u threads, spare output: %d, %zu bytes", thread_counts[i], result,
+              out_length);
+        result = tinflate_parallel(compressed, compressed_length, out, &out_length, length - 1, thread_counts[i]);
+        CHECK(result == INFLATE_DECOMPRESSED_OVERFLOW && !memcmp(out, data, out_length), "tinflate_parallel %u threads, short output: %d", thread_counts[i], result);
+    }
+
+    free(out);
+    free(compressed);
+    free(data);
+}
+
+static void check_reserved_symbols(void) {
+    static struct TestBits bits;
+    unsigned char* out = malloc(40000);
+    for (unsigned i = 0; i < TEST_RESERVED_COUNT; ++i) {
+        const unsigned* symbols = test_reserved_symbols[i];
+        size_t length = test_reserved_stream(&bits, symbols[0], symbols[1]);
+        size_t out_length;
+        int result = tinflate_parallel(bits.bytes, length, out, &out_length, 40000, 2);
+        CHECK(result == (i ? INFLATE_VALUE_NOT_ALLOWED : INFLATE_SUCCESS), "symbol %u, distance code %u: tinflate_parallel %d", symbols[0], symbols[1], result);
+    }
+    free(out);
+}
+
+int main(void) {
+    unsigned char* data = malloc(lengths[sizeof(lengths) / sizeof(*lengths) - 1]);
+    for (unsigned kind = 0; kind < TEST_KINDS; ++kind) {
+        for (size_t l = 0; l < sizeof(lengths) / sizeof(*lengths); ++l) {
+            test_make_input(data, lengths[l], kind, (uint32_t)(kind * 31 + l + 1));
+            for (size_t c = 0; c < sizeof(configurations) / sizeof(*configurations); ++c) {
+                char name[96];
+                snprintf(name, sizeof(name), "kind %u, %zu bytes, level %d, strategy %d", kind, lengths[l], configurations[c].level, configurations[c].strategy);
+                check_segments(data, lengths[l], &configurations[c], name);
+            }
+        }
+    }
+    free(data);
+
+    check_parallel();
+    check_reserved_symbols();
+
+    return TEST_RESULT();
+}
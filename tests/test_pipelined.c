@@ -0,0 +1,97 @@
+/*
+ * The two-stage decoders: tinflate_pipelined() and zlib_decompress_pipelined()
+ * give the same output as zlib's input, report a short output buffer and
+ * truncated input, and refuse reserved Huffman symbols.
+ */
+
+#include <stddef.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "inflate.h"
+#include "test.h"
+#include "zlib_decompress.h"
+
+
+
+struct Configuration {
+    int level;
+    int strategy;
+};
+
+
+static const size_t lengths[] = { 0, 1, 100, 65536 + 3, (1 << 20) + 7 };
+
+static const struct Configuration configurations[] = {
+    { 0, Z_DEFAULT_STRATEGY },
+    { 1, Z_DEFAULT_STRATEGY },
+    { 6, Z_DEFAULT_STRATEGY },
+    { 9, Z_DEFAULT_STRATEGY },
+    { 6, Z_FIXED },
+    { 6, Z_HUFFMAN_ONLY },
+    { 6, Z_RLE },
+};
+
+
+static void check_decoders(const unsigned char* data, size_t length, const struct Configuration* configuration, const char* name) {
+    unsigned char* out = malloc(length + 1);
+    size_t out_length;
+    int result;
+
+    size_t raw_length, zlib_length;
+    unsigned char* raw = test_compress(data, length, configuration->level, configuration->strategy, -15, 0, &raw_length);
+    unsigned char* zlib = test_compress(data, length, configuration->level, configuration->strategy, 15, 0, &zlib_length);
+
+    result = tinflate_pipelined(raw, raw_length, out, &out_length, length);
+    CHECK(!result && out_length == length && !memcmp(out, data, length), "%s: tinflate_pipelined %d, %zu bytes", name, result, out_length);
+
+    result = zlib_decompress_pipelined(zlib, zlib_length, out, &out_length, length);
+    CHECK(!result && out_length == length && !memcmp(out, data, length), "%s: zlib_decompress_pipelined %d, %zu bytes", name, result, out_length);
+
+    /* One byte short of the output, and the input cut in half. */
+    if (length) {
+        result = tinflate_pipelined(raw, raw_length, out, &out_length, length - 1);
+        CHECK(result == INFLATE_DECOMPRESSED_OVERFLOW && !memcmp(out, data, out_length), "%s: tinflate_pipelined undersized output %d", name, result);
+        result = tinflate_pipelined(raw, raw_length / 2, out, &out_length, length);
+        CHECK(result != INFLATE_SUCCESS, "%s: tinflate_pipelined decoded truncated input", name);
+        result = zlib_decompress_pipelined(zlib, zlib_length - 1, out, &out_length, length);
+        CHECK(result != INFLATE_SUCCESS, "%s: zlib_decompress_pipelined accepted a truncated trailer", name);
+    }
+
+    free(raw);
+    free(zlib);
+    free(out);
+}
+
+static void check_reserved_symbols(void) {
+    static struct TestBits bits;
+    unsigned char* out = malloc(40000);
+    for (unsigned i = 0; i < TEST_RESERVED_COUNT; ++i) {
+        const unsigned* symbols = test_reserved_symbols[i];
+        size_t length = test_reserved_stream(&bits, symbols[0], symbols[1]);
+        size_t out_length;
+        int result = tinflate_pipelined(bits.bytes, length, out, &out_length, 40000);
+        CHECK(result == (i ? INFLATE_VALUE_NOT_ALLOWED : INFLATE_SUCCESS), "symbol %u, distance code %u: tinflate_pipelined %d", symbols[0], symbols[1], result);
+    }
+    free(out);
+}
+
+int main(void) {
+    unsigned char* data = malloc(lengths[sizeof(lengths) / sizeof(*lengths) - 1]);
+    for (unsigned kind = 0; kind < TEST_KINDS; ++kind) {
+        for (size_t l = 0; l < sizeof(lengths) / sizeof(*lengths); ++l) {
+            test_make_input(data, lengths[l], kind, (uint32_t)(kind * 31 + l + 1));
+            for (size_t c = 0; c < sizeof(configurations) / sizeof(*configurations); ++c) {
+                char name[96];
+                snprintf(name, sizeof(name), "kind %u, %zu bytes, level %d, strategy %d", kind, lengths[l], configurations[c].level, configurations[c].strategy);
+                check_decoders(data, lengths[l], &configurations[c], name);
+            }
+        }
+    }
+    check_reserved_symbols();
+    free(data);
+
+    return TEST_RESULT();
+}
@@ -0,0 +1,235 @@
+/*
+ * Decodes PNG images of several pixel sizes with every filter type, their
+ * zlib data split into IDAT chunks of several lengths, with png_decode() and
+ * png_decode_idat(), and compares the pixels. Also checks that truncated
+ * data, data past the last scanline, unknown filter types and damaged CRCs
+ * are reported.
+ */
+
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "inflate.h"
+#include "png_decode.h"
+#include "png_filter.h"
+#include "test.h"
+
+
+
+struct Configuration {
+    uint32_t width;
+    uint32_t height;
+    unsigned bytes_per_pixel;
+};
+
+/* Ways to spoil the filtered data before it is compressed. */
+#define DAMAGE_NONE         0
+#define DAMAGE_SHORT        1   // The stream ends halfway through the last scanline.
+#define DAMAGE_LONG         2   // A byte follows the last scanline.
+#define DAMAGE_FILTER       3   // A scanline has filter type 5.
+
+
+static const struct Configuration configurations[] = {
+    { 1, 1, 1 },
+    { 37, 23, 1 },
+    { 300, 40, 3 },
+    { 129, 70, 4 },
+    { 2000, 9, 8 },
+};
+
+static const size_t idat_lengths[] = { 1, 7, 8192, (size_t)1 << 30 };
+
+
+static void put_be32(unsigned char* bytes, uint32_t value) {
+    bytes[0] = (unsigned char)(value >> 24);
+    bytes[1] = (unsigned char)(value >> 16);
+    bytes[2] = (unsigned char)(value >> 8);
+    bytes[3] = (unsigned char)value;
+}
+
+static size_t put_chunk(unsigned char* png, const char* type, const unsigned char* data, size_t length) {
+    uLong crc = crc32(0, (const unsigned char*)type, 4);
+    put_be32(png, (uint32_t)length);
+    memcpy(png + 4, type, 4);
+    if (length) {
+        memcpy(png + 8, data, length);
+        crc = crc32(crc, data, (uInt)length);
+    }
+    put_be32(png + 8 + length, (uint32_t)crc);
+    return length + 12;
+}
+
+/* Filters the image, cycling through all five filter types, and compresses it as zlib data. */
+static unsigned char* make_idat(const struct Configuration* configuration, const unsigned char* image, unsigned damage, size_t* idat_length) {
+    unsigned bytes_per_pixel = configuration->bytes_per_pixel;
+    size_t row_length = (size_t)configuration->width * bytes_per_pixel;
+    size_t filtered_length = (row_length + 1) * configuration->height;
+    unsigned char* filtered = malloc(filtered_length + 1);
+
+    for (size_t y = 0; y < configuration->height; ++y) {
+        unsigned filter = (unsigned)(y % 5);
+        const unsigned char* row = image + y * row_length;
+        unsigned char* out = filtered + y * (row_length + 1);
+        out[0] = (unsigned char)filter;
+        for (size_t x = 0; x < row_length; ++x) {
+            int left = x >= bytes_per_pixel ? row[x - bytes_per_pixel] : 0;
+            int up = y ? row[x - row_length] : 0;
+            int up_left = y && x >= bytes_per_pixel ? row[x - row_length - bytes_per_pixel] : 0;
+            int predictor = 0;
+            if (filter == PNG_FILTER_SUB) {
+                predictor = left;
+            } else if (filter == PNG_FILTER_UP) {
+                predictor = up;
+            } else if (filter == PNG_FILTER_AVERAGE) {
+                predictor = (left + up) / 2;
+            } else if (filter == PNG_FILTER_PAETH) {
+                int estimate = left + up - up_left;
+                int a = abs(estimate - left), b = abs(estimate - up), c = abs(estimate - up_left);
+                predictor = a <= b && a <= c ? left : b <= c ? up : up_left;
+            }
+            out[x + 1] = (unsigned char)(row[x] - predictor);
+        }
+    }
+
+    if (damage == DAMAGE_SHORT)
+        filtered_length -= row_length / 2 + 1;
+    else if (damage == DAMAGE_LONG)
+        filtered[filtered_length++] = 0;
+    else if (damage == DAMAGE_FILTER)
+        filtered[(configuration->height - 1) / 2 * (row_length + 1)] = 5;
+
+    unsigned char* idat = test_compress(filtered, filtered_length, 6, Z_DEFAULT_STRATEGY, 15, 0, idat_length);
+    free(filtered);
+    return idat;
+}
+
+/* Wraps the zlib data in a PNG, split into IDAT chunks of at most chunk_length bytes with an ancillary chunk between the first two. */
+static unsigned char* make_png(const struct Configuration* configuration, const unsigned char* idat, size_t idat_length, size_t chunk_length, size_t* png_length) {
+    static const unsigned char color_types[] = { 0, 0, 0, PNG_COLOR_RGB, PNG_COLOR_RGBA, 0, 0, 0, PNG_COLOR_RGBA };
+    unsigned char* png = malloc(idat_length * 13 + 1024);
+
+    unsigned char header[13];
+    put_be32(header, configuration->width);
+    put_be32(header + 4, configuration->height);
+    header[8] = configuration->bytes_per_pixel == 8 ? 16 : 8;
+    header[9] = color_types[configuration->bytes_per_pixel];
+    header[10] = header[11] = header[12] = 0;
+
+    size_t length = 8;
+    memcpy(png, "\x89PNG\r\n\x1a\n", 8);
+    length += put_chunk(png + length, "IHDR", header, sizeof(header));
+    for (size_t offset = 0; offset < idat_length; offset += chunk_length) {
+        size_t piece = idat_length - offset < chunk_length ? idat_length - offset : chunk_length;
+        length += put_chunk(png + length, "IDAT", idat + offset, piece);
+        if (!offset)
+            length += put_chunk(png + length, "tEXt", (const unsigned char*)"Comment\0test", 12);
+    }
+    length += put_chunk(png + length, "IEND", NULL, 0);
+
+    *png_length = length;
+    return png;
+}
+
+/* Decodes the zlib data with png_decode_idat(), split into chunks of at most chunk_length bytes. */
+static int decode_idat(const struct PngImage* image, const unsigned char* idat, size_t idat_length, size_t chunk_length, unsigned char* pixels, size_t pixels_max_length) {
+    size_t count = idat_length / chunk_length + 1;
+    const unsigned char** chunks = malloc(count * sizeof(*chunks));
+    size_t* chunk_lengths = malloc(count * sizeof(*chunk_lengths));
+
+    count = 0;
+    for (size_t offset = 0; offset < idat_length; offset += chunk_length, ++count) {
+        chunks[count] = idat + offset;
+        chunk_lengths[count] = idat_length - offset < chunk_length ? idat_length - offset : chunk_length;
+    }
+    int result = png_decode_idat(image, chunks, chunk_lengths, count, pixels, pixels_max_length);
+
+    free(chunks);
+    free(chunk_lengths);
+    return result;
+}
+
+static void check_image(const struct Configuration* configuration, uint32_t seed) {
+    size_t image_length = (size_t)configuration->width * configuration->bytes_per_pixel * configuration->height;
+    unsigned char* image = malloc(image_length);
+    unsigned char* pixels = malloc(image_length);
+    test_make_input(image, image_length, TEST_MIXED, seed);
+
+    size_t idat_length;
+    unsigned char* idat = make_idat(configuration, image, DAMAGE_NONE, &idat_length);
+
+    for (size_t i = 0; i < sizeof(idat_lengths) / sizeof(*idat_lengths); ++i) {
+        char name[96];
+        snprintf(name, sizeof(name), "%ux%u, %u bytes per pixel, %zu byte IDATs", configuration->width, configuration->height, configuration->bytes_per_pixel, idat_lengths[i]);
+
+        size_t png_length;
+        unsigned char* png = make_png(configuration, idat, idat_length, idat_lengths[i], &png_length);
+
+        struct PngImage header;
+        memset(pixels, 0, image_length);
+        int result = png_decode(png, png_length, pixels, image_length, &header);
+        CHECK(!result && !memcmp(pixels, image, image_length), "%s: png_decode %d", name, result);
+        CHECK(header.width == configuration->width && header.height == configuration->height && header.row_length * header.height == image_length, "%s: header", name);
+
+        memset(pixels, 0, image_length);
+        result = decode_idat(&header, idat, idat_length, idat_lengths[i], pixels, image_length);
+        CHECK(!result && !memcmp(pixels, image, image_length), "%s: png_decode_idat %d", name, result);
+
+        /* One byte too little room for the pixels. */
+        result = png_decode(png, png_length, pixels, image_length - 1, &header);
+        CHECK(result == INFLATE_DECOMPRESSED_OVERFLOW, "%s: undersized output %d", name, result);
+
+        /* The file cut short in the middle of the IDAT chunks. */
+        result = png_decode(png, png_length / 2, pixels, image_length, &header);
+        CHECK(result == INFLATE_COMPRESSED_INCOMPLETE, "%s: truncated file %d", name, result);
+        result = decode_idat(&header, idat, idat_length / 2, idat_lengths[i], pixels, image_length);
+        CHECK(result == INFLATE_COMPRESSED_INCOMPLETE, "%s: truncated IDAT data %d", name, result);
+
+        /* The CRC of the first IDAT chunk, which png_decode_idat() leaves to the caller. */
+        size_t first_chunk_length = idat_length < idat_lengths[i] ? idat_length : idat_lengths[i];
+        png[8 + 25 + 8 + first_chunk_length] ^= 1;
+        result = png_decode(png, png_length, pixels, image_length, &header);
+        CHECK(result == INFLATE_CHECKSUM_MISMATCH, "%s: damaged CRC %d", name, result);
+        free(png);
+
+        /* The Adler-32 of the zlib data. */
+        idat[idat_length - 1] ^= 1;
+        result = decode_idat(&header, idat, idat_length, idat_lengths[i], pixels, image_length);
+        CHECK(result == INFLATE_CHECKSUM_MISMATCH, "%s: damaged Adler-32 %d", name, result);
+        idat[idat_length - 1] ^= 1;
+    }
+    free(idat);
+
+    /* Well formed zlib data that does not match the image. */
+    static const unsigned damages[] = { DAMAGE_SHORT, DAMAGE_LONG, DAMAGE_FILTER };
+    static const int expected[] = { INFLATE_COMPRESSED_INCOMPLETE, INFLATE_DECOMPRESSED_OVERFLOW, INFLATE_VALUE_NOT_ALLOWED };
+    for (size_t d = 0; d < sizeof(damages) / sizeof(*damages); ++d) {
+        idat = make_idat(configuration, image, damages[d], &idat_length);
+        for (size_t i = 0; i < sizeof(idat_lengths) / sizeof(*idat_lengths); ++i) {
+            size_t png_length;
+            unsigned char* png = make_png(configuration, idat, idat_length, idat_lengths[i], &png_length);
+
+            struct PngImage header;
+            int result = png_decode(png, png_length, pixels, image_length, &header);
+            CHECK(result == expected[d], "%ux%u, damage %u, %zu byte IDATs: png_decode %d", configuration->width, configuration->height, damages[d], idat_lengths[i], result);
+            result = decode_idat(&header, idat, idat_length, idat_lengths[i], pixels, image_length);
+            CHECK(result == expected[d], "%ux%u, damage %u, %zu byte IDATs: png_decode_idat %d", configuration->width, configuration->height, damages[d], idat_lengths[i], result);
+
+            free(png);
+        }
+        free(idat);
+    }
+
+    free(image);
+    free(pixels);
+}
+
+int main(void) {
+    for (size_t c = 0; c < sizeof(configurations) / sizeof(*configurations); ++c)
+        check_image(&configurations[c], (uint32_t)c + 1);
+
+    return TEST_RESULT();
+}
@@ -0,0 +1,127 @@
+/*
+ * Compresses inputs of several kinds and lengths with zlib at every level and
+ * strategy, then decodes them with tinflate(), zlib_decompress() and in reader
+ * chunks, and compares the output. Also checks that output overflow, truncated
+ * input and reserved Huffman symbols are reported. The other decoders have
+ * test programs of their own.
+ */
+
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "inflate.h"
+#include "inflate_reader.h"
+#include "inflate_scan.h"
+#include "test.h"
+#include "zlib_decompress.h"
+
+
+
+struct Configuration {
+    int level;
+    int strategy;
+};
+
+
+static const size_t lengths[] = { 0, 1, 100, 65536 + 3, (1 << 20) + 7 };
+
+static const struct Configuration configurations[] = {
+    { 0, Z_DEFAULT_STRATEGY },
+    { 1, Z_DEFAULT_STRATEGY },
+    { 6, Z_DEFAULT_STRATEGY },
+    { 9, Z_DEFAULT_STRATEGY },
+    { 6, Z_FIXED },
+    { 6, Z_HUFFMAN_ONLY },
+    { 6, Z_RLE },
+};
+
+
+/* Decodes the same data in every container. */
+static void check_decoders(const unsigned char* data, size_t length, const struct Configuration* configuration, const char* name) {
+    unsigned char* out = malloc(length + 1);
+    size_t out_length;
+    int result;
+
+    size_t raw_length, zlib_length, gzip_length;
+    unsigned char* raw = test_compress(data, length, configuration->level, configuration->strategy, -15, 0, &raw_length);
+    unsigned char* zlib = test_compress(data, length, configuration->level, configuration->strategy, 15, 0, &zlib_length);
+    unsigned char* gzip = test_compress(data, length, configuration->level, configuration->strategy, 31, 0, &gzip_length);
+
+    result = tinflate(raw, raw_length, out, &out_length, length);
+    CHECK(!result && out_length == length && !memcmp(out, data, length), "%s: tinflate %d, %zu bytes", name, result, out_length);
+
+    result = zlib_decompress(zlib, zlib_length, out, &out_length, length);
+    CHECK(!result && out_length == length && !memcmp(out, data, length), "%s: zlib_decompress %d, %zu bytes", name, result, out_length);
+
+    const unsigned char* inputs[] = { raw, zlib, gzip };
+    const size_t input_lengths[] = { raw_length, zlib_length, gzip_length };
+    for (enum InflateFormat format = INFLATE_FORMAT_RAW; format <= INFLATE_FORMAT_GZIP; ++format) {
+        struct InflateReader* reader;
+        result = inflate_reader_create(inputs[format], input_lengths[format], format, &reader);
+        size_t read = 0;
+        bool same = true;
+        const unsigned char* chunk;
+        size_t chunk_length = 1;
+        while (!result && chunk_length) {
+            result = inflate_reader_next(reader, &chunk, &chunk_length);
+            same &= read + chunk_length <= length && (!chunk_length || !memcmp(chunk, data + read, chunk_length));
+            read += chunk_length;
+        }
+        inflate_reader_destroy(reader);
+        CHECK(!result && read == length && same, "%s: inflate_reader format %d: %d, %zu bytes", name, format, result, read);
+    }
+
+    /* One byte short of the output, and the input cut in half. */
+    if (length) {
+        result = tinflate(raw, raw_length, out, &out_length, length - 1);
+        CHECK(result == INFLATE_DECOMPRESSED_OVERFLOW && !memcmp(out, data, out_length), "%s: undersized output %d", name, result);
+        result = tinflate(raw, raw_length / 2, out, &out_length, length);
+        CHECK(result != INFLATE_SUCCESS, "%s: truncated input decoded", name);
+        result = zlib_decompress(zlib, zlib_length - 1, out, &out_length, length);
+        CHECK(result != INFLATE_SUCCESS, "%s: truncated zlib trailer accepted", name);
+    }
+
+    free(raw);
+    free(zlib);
+    free(gzip);
+    free(out);
+}
+
+/* Reserved symbols were once decoded as length 258 and distance 24577 and up. */
+static void check_reserved_symbols(void) {
+    static struct TestBits bits;
+    unsigned char* out = malloc(40000);
+    for (unsigned i = 0; i < TEST_RESERVED_COUNT; ++i) {
+        const unsigned* symbols = test_reserved_symbols[i];
+        size_t length = test_reserved_stream(&bits, symbols[0], symbols[1]);
+        int expected = i ? INFLATE_VALUE_NOT_ALLOWED : INFLATE_SUCCESS;
+        size_t out_length;
+
+        int result = tinflate(bits.bytes, length, out, &out_length, 40000);
+        CHECK(result == expected, "symbol %u, distance code %u: tinflate %d", symbols[0], symbols[1], result);
+    }
+    free(out);
+}
+
+int main(void) {
+    unsigned char* data = malloc(lengths[sizeof(lengths) / sizeof(*lengths) - 1]);
+    for (unsigned kind = 0; kind < TEST_KINDS; ++kind) {
+        for (size_t l = 0; l < sizeof(lengths) / sizeof(*lengths); ++l) {
+            test_make_input(data, lengths[l], kind, (uint32_t)(kind * 31 + l + 1));
+            for (size_t c = 0; c < sizeof(configurations) / sizeof(*configurations); ++c) {
+                char name[96];
+                snprintf(name, sizeof(name), "kind %u, %zu bytes, level %d, strategy %d", kind, lengths[l], configurations[c].level, configurations[c].strategy);
+                check_decoders(data, lengths[l], &configurations[c], name);
+            }
+        }
+    }
+
+    check_reserved_symbols();
+    free(data);
+
+    return TEST_RESULT();
+}
@@ -0,0 +1,100 @@
+/*
+ * The scan modes: inflate_scan_length() and inflate_scan_verify() find the
+ * decompressed length of raw, zlib and gzip input without output. Only the
+ * verify mode notices a damaged check value; both refuse truncated input and
+ * reserved Huffman symbols.
+ */
+
+#include <stddef.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "inflate.h"
+#include "inflate_scan.h"
+#include "test.h"
+
+
+
+struct Configuration {
+    int level;
+    int strategy;
+};
+
+
+static const size_t lengths[] = { 0, 1, 100, 65536 + 3, (1 << 20) + 7 };
+
+static const struct Configuration configurations[] = {
+    { 0, Z_DEFAULT_STRATEGY },
+    { 1, Z_DEFAULT_STRATEGY },
+    { 6, Z_DEFAULT_STRATEGY },
+    { 9, Z_DEFAULT_STRATEGY },
+    { 6, Z_FIXED },
+    { 6, Z_HUFFMAN_ONLY },
+    { 6, Z_RLE },
+};
+
+
+static void check_scan(const unsigned char* data, size_t length, const struct Configuration* configuration, const char* name) {
+    static const int window_bits[] = { -15, 15, 31 };
+    for (enum InflateFormat format = INFLATE_FORMAT_RAW; format <= INFLATE_FORMAT_GZIP; ++format) {
+        size_t compressed_length;
+        unsigned char* compressed = test_compress(data, length, configuration->level, configuration->strategy, window_bits[format], 0, &compressed_length);
+
+        size_t scanned = 0;
+        int result = inflate_scan_length(compressed, compressed_length, format, &scanned);
+        CHECK(!result && scanned == length, "%s: inflate_scan_length format %d: %d, %zu bytes", name, format, result, scanned);
+        result = inflate_scan_verify(compressed, compressed_length, format, &scanned);
+        CHECK(!result && scanned == length, "%s: inflate_scan_verify format %d: %d, %zu bytes", name, format, result, scanned);
+
+        result = inflate_scan_length(compressed, compressed_length / 2, format, &scanned);
+        CHECK(result != INFLATE_SUCCESS, "%s: inflate_scan_length format %d accepted truncated input", name, format);
+        result = inflate_scan_verify(compressed, compressed_length / 2, format, &scanned);
+        CHECK(result != INFLATE_SUCCESS, "%s: inflate_scan_verify format %d accepted truncated input", name, format);
+
+        /* The first byte of the Adler-32 or CRC-32. */
+        if (format != INFLATE_FORMAT_RAW) {
+            compressed[compressed_length - (format == INFLATE_FORMAT_GZIP ? 8 : 4)] ^= 1;
+            result = inflate_scan_length(compressed, compressed_length, format, &scanned);
+            CHECK(!result && scanned == length, "%s: inflate_scan_length format %d of a damaged check value: %d", name, format, result);
+            result = inflate_scan_verify(compressed, compressed_length, format, &scanned);
+            CHECK(result == INFLATE_CHECKSUM_MISMATCH, "%s: inflate_scan_verify format %d of a damaged check value: %d", name, format, result);
+        }
+
+        free(compressed);
+    }
+}
+
+static void check_reserved_symbols(void) {
+    static struct TestBits bits;
+    for (unsigned i = 0; i < TEST_RESERVED_COUNT; ++i) {
+        const unsigned* symbols = test_reserved_symbols[i];
+        size_t length = test_reserved_stream(&bits, symbols[0], symbols[1]);
+        int expected = i ? INFLATE_VALUE_NOT_ALLOWED : INFLATE_SUCCESS;
+        size_t scanned;
+
+        int result = inflate_scan_length(bits.bytes, length, INFLATE_FORMAT_RAW, &scanned);
+        CHECK(result == expected, "symbol %u, distance code %u: inflate_scan_length %d", symbols[0], symbols[1], result);
+        result = inflate_scan_verify(bits.bytes, length, INFLATE_FORMAT_RAW, &scanned);
+        CHECK(result == expected, "symbol %u, distance code %u: inflate_scan_verify %d", symbols[0], symbols[1], result);
+    }
+}
+
+int main(void) {
+    unsigned char* data = malloc(lengths[sizeof(lengths) / sizeof(*lengths) - 1]);
+    for (unsigned kind = 0; kind < TEST_KINDS; ++kind) {
+        for (size_t l = 0; l < sizeof(lengths) / sizeof(*lengths); ++l) {
+            test_make_input(data, lengths[l], kind, (uint32_t)(kind * 31 + l + 1));
+            for (size_t c = 0; c < sizeof(configurations) / sizeof(*configurations); ++c) {
+                char name[96];
+                snprintf(name, sizeof(name), "kind %u, %zu bytes, level %d, strategy %d", kind, lengths[l], configurations[c].level, configurations[c].strategy);
+                check_scan(data, lengths[l], &configurations[c], name);
+            }
+        }
+    }
+    check_reserved_symbols();
+    free(data);
+
+    return TEST_RESULT();
+}
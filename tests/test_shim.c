@@ -0,0 +1,320 @@
+/*
+ * Conformance of the zlib shim. Built against the system zlib and run with
+ * the shim preloaded (LD_PRELOAD=libz.so.1), which then stands in for zlib
+ * entirely, versioned symbols included, the way programs built against zlib
+ * use it. Compression is passed on to the system's zlib, so test inputs come
+ * from zlib's own deflate() as in the other tests. They are fed in pieces of
+ * every size from single bytes up, with output space handed out in pieces as
+ * well, in each container zlib's inflate() understands.
+ */
+
+#if defined(__linux__)
+#define _GNU_SOURCE     // dladdr()
+#endif
+
+#include <dlfcn.h>
+#include <stddef.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+
+#include <zlib.h>
+
+#include "test.h"
+
+
+
+struct Container {
+    int deflate_window_bits;
+    int inflate_window_bits;
+    const char* name;
+};
+
+
+static const struct Container containers[] = {
+    { -15, -15, "raw" },
+    { 15, 15, "zlib" },
+    { 15, 0, "zlib, window from header" },
+    { 31, 31, "gzip" },
+    { 31, 47, "gzip, detected" },
+    { 15, 47, "zlib, detected" },
+};
+
+static const size_t input_steps[] = { 1, 3, 17, 1024, SIZE_MAX };
+static const size_t output_steps[] = { 1, 7, 4096, SIZE_MAX };
+
+
+static uint32_t reference_adler32(const unsigned char* data, size_t length) {
+    uint32_t a = 1, b = 0;
+    for (size_t i = 0; i < length; ++i) {
+        a = (a + data[i]) % 65521;
+        b = (b + a) % 65521;
+    }
+    return b << 16 | a;
+}
+
+static uint32_t reference_crc32(const unsigned char* data, size_t length) {
+    uint32_t crc = 0xFFFFFFFF;
+    for (size_t i = 0; i < length; ++i) {
+        crc ^= data[i];
+        for (int bit = 0; bit < 8; ++bit)
+            crc = crc >> 1 ^ (0xEDB88320 & -(crc & 1));
+    }
+    return ~crc;
+}
+
+/* Compresses data with zlib's deflate(), passed on to the system's libz by the shim. */
+static unsigned char* compress_stream(const unsigned char* data, size_t length, int window_bits, size_t* compressed_length) {
+    return test_compress(data, length, 6, Z_DEFAULT_STRATEGY, window_bits, 0, compressed_length);
+}
+
+/* The shared object a function was loaded from. */
+static const char* origin(void* function) {
+    Dl_info info;
+    if (!dladdr(function, &info) || !info.dli_fname)
+        return "";
+    return info.dli_fname;
+}
+
+/*
+ * Inflates compressed handing out at most input_step bytes of input and
+ * output_step bytes of output per call. Returns the last result of inflate().
+ */
+static int inflate_in_steps(z_stream* inflater, const unsigned char* compressed, size_t compressed_length, unsigned char* out, size_t out_max_length,
+                            size_t input_step, size_t output_step) {
+    size_t in_offset = 0, out_offset = 0;
+    int result = Z_OK;
+    for (unsigned stalls = 0; stalls < 2;) {
+        size_t in_piece = compressed_length - in_offset < input_step ? compressed_length - in_offset : input_step;
+        size_t out_piece = out_max_length - out_offset < output_step ? out_max_length - out_offset : output_step;
+        inflater->next_in = (unsigned char*)compressed + in_offset;
+        inflater->avail_in = (uInt)in_piece;
+        inflater->next_out = out + out_offset;
+        inflater->avail_out = (uInt)out_piece;
+
+        result = inflate(inflater, Z_NO_FLUSH);
+        size_t in_used = in_piece - inflater->avail_in;
+        size_t out_used = out_piece - inflater->avail_out;
+        in_offset += in_used;
+        out_offset += out_used;
+        if (result == Z_STREAM_END || (result != Z_OK && result != Z_BUF_ERROR))
+            break;
+        stalls = in_used || out_used ? 0 : stalls + 1;
+    }
+    return result;
+}
+
+static void check_steps(const unsigned char* data, size_t length, const char* kind) {
+    unsigned char* out = malloc(length + 1);
+    uint32_t adler = reference_adler32(data, length);
+    uint32_t crc = reference_crc32(data, length);
+
+    for (size_t c = 0; c < sizeof(containers) / sizeof(*containers); ++c) {
+        const struct Container* container = &containers[c];
+        size_t compressed_length;
+        unsigned char* compressed = compress_stream(data, length, container->deflate_window_bits, &compressed_length);
+
+        for (size_t i = 0; i < sizeof(input_steps) / sizeof(*input_steps); ++i) {
+            for (size_t o = 0; o < sizeof(output_steps) / sizeof(*output_steps); ++o) {
+                /* Single bytes at a time only for the smaller inputs. */
+                if (length > 100000 && (input_steps[i] < 1024 || output_steps[o] < 4096))
+                    continue;
+
+                z_stream inflater;
+                memset(&inflater, 0, sizeof(inflater));
+                int result = inflateInit2(&inflater, container->inflate_window_bits);
+                CHECK(result == Z_OK, "inflateInit2 %d", result);
+                memset(out, 0, length + 1);
+                result = inflate_in_steps(&inflater, compressed, compressed_length, out, length + 1, input_steps[i], output_steps[o]);
+                CHECK(result == Z_STREAM_END && inflater.total_out == length && inflater.total_in == compressed_length && !memcmp(out, data, length),
+                      "%s, %zu bytes, %s, input %zu, output %zu: %d, %lu bytes", kind, length, container->name, input_steps[i], output_steps[o], result,
+                      inflater.total_out);
+                if (container->deflate_window_bits == 15)
+                    CHECK(inflater.adler == adler, "%s, %zu bytes, %s: adler %08lx, expected %08x", kind, length, container->name, inflater.adler, adler);
+                else if (container->deflate_window_bits == 31)
+                    CHECK(inflater.adler == crc, "%s, %zu bytes, %s: crc %08lx, expected %08x", kind, length, container->name, inflater.adler, crc);
+                inflateEnd(&inflater);
+            }
+        }
+
+        /* A corrupted check value, and the stream cut short. */
+        if (container->deflate_window_bits > 0) {
+            z_stream inflater;
+            memset(&inflater, 0, sizeof(inflater));
+            inflateInit2(&inflater, container->inflate_window_bits);
+            size_t check_offset = compressed_length - (container->deflate_window_bits == 31 ? 5 : 1);
+            compressed[check_offset] ^= 0x40;
+            int result = inflate_in_steps(&inflater, compressed, compressed_length, out, length + 1, 4096, SIZE_MAX);
+            CHECK(result == Z_DATA_ERROR, "%s, %zu bytes, %s: corrupted check value gives %d", kind, length, container->name, result);
+            compressed[check_offset] ^= 0x40;
+
+            inflateReset(&inflater);
+            result = inflate_in_steps(&inflater, compressed, compressed_length - 1, out, length + 1, 4096, SIZE_MAX);
+            CHECK(result == Z_BUF_ERROR, "%s, %zu bytes, %s: truncated stream gives %d", kind, length, container->name, result);
+            inflateEnd(&inflater);
+        }
+
+        free(compressed);
+    }
+
+    free(out);
+}
+
+/* Concatenated gzip members read one after the other with inflateReset(), and reused streams. */
+static void check_reset(const unsigned char* data, size_t length) {
+    size_t first_length, second_length;
+    unsigned char* first = compress_stream(data, length / 2, 31, &first_length);
+    unsigned char* second = compress_stream(data + length / 2, length - length / 2, 31, &second_length);
+    unsigned char* members = malloc(first_length + second_length);
+    memcpy(members, first, first_length);
+    memcpy(members + first_length, second, second_length);
+
+    unsigned char* out = malloc(length);
+    z_stream inflater;
+    memset(&inflater, 0, sizeof(inflater));
+    inflateInit2(&inflater, 31);
+    inflater.next_in = members;
+    inflater.avail_in = (uInt)(first_length + second_length);
+    inflater.next_out = out;
+    inflater.avail_out = (uInt)length;
+    int result;
+    unsigned member_count = 0;
+    while ((result = inflate(&inflater, Z_NO_FLUSH)) == Z_STREAM_END) {
+        ++member_count;
+        if (!inflater.avail_in)
+            break;
+        inflateReset(&inflater);
+    }
+    CHECK(result == Z_STREAM_END && member_count == 2 && (size_t)(inflater.next_out - out) == length && !memcmp(out, data, length),
+          "two gzip members: %d, %u members", result, member_count);
+
+    /* The same stream object switched to raw deflate. */
+    size_t raw_length;
+    unsigned char* raw = compress_stream(data, length, -15, &raw_length);
+    result = inflateReset2(&inflater, -15);
+    CHECK(result == Z_OK, "inflateReset2 %d", result);
+    inflater.next_in = raw;
+    inflater.avail_in = (uInt)raw_length;
+    inflater.next_out = out;
+    inflater.avail_out = (uInt)length;
+    result = inflate(&inflater, Z_FINISH);
+    CHECK(result == Z_STREAM_END && inflater.total_out == length && !memcmp(out, data, length), "inflateReset2 to raw: %d", result);
+
+    /* A reset in the middle of a stream forgets the input buffered for it. */
+    size_t zlib_length;
+    unsigned char* zlib = compress_stream(data, length, 15, &zlib_length);
+    result = inflateReset2(&inflater, 15);
+    for (size_t partial = 1; partial <= 10; partial += 9) {
+        inflater.next_in = zlib;
+        inflater.avail_in = (uInt)partial;
+        inflater.next_out = out;
+        inflater.avail_out = (uInt)length;
+        inflate(&inflater, Z_NO_FLUSH);
+        inflateReset(&inflater);
+    }
+    inflater.next_in = zlib;
+    inflater.avail_in = (uInt)zlib_length;
+    inflater.next_out = out;
+    inflater.avail_out = (uInt)length;
+    result = inflate(&inflater, Z_FINISH);
+    CHECK(result == Z_STREAM_END && inflater.total_out == length && !memcmp(out, data, length),
+          "inflateReset after part of a stream: %d %s", result, inflater.msg ? inflater.msg : "");
+    inflateEnd(&inflater);
+
+    free(zlib);
+    free(raw);
+    free(out);
+    free(members);
+    free(first);
+    free(second);
+}
+
+static void check_uncompress(const unsigned char* data, size_t length) {
+    size_t compressed_length;
+    unsigned char* compressed = compress_stream(data, length, 15, &compressed_length);
+    unsigned char* out = malloc(length + 1);
+
+    uLongf out_length = length + 1;
+    int result = uncompress(out, &out_length, compressed, compressed_length);
+    CHECK(result == Z_OK && out_length == length && !memcmp(out, data, length), "uncompress %d, %lu bytes", result, out_length);
+
+    if (length) {
+        out_length = length - 1;
+        result = uncompress(out, &out_length, compressed, compressed_length);
+        CHECK(result == Z_BUF_ERROR, "uncompress into a short buffer gives %d", result);
+    }
+
+    free(out);
+    free(compressed);
+}
+
+/* Functions the shim passes on to the system's zlib, working together with its own inflate(). */
+static void check_forwarded(const unsigned char* data, size_t length) {
+    uLong bound = compressBound((uLong)length);
+    unsigned char* compressed = malloc(bound);
+    unsigned char* out = malloc(length + 1);
+
+    uLongf compressed_length = bound;
+    int result = compress2(compressed, &compressed_length, data, (uLong)length, Z_BEST_SPEED);
+    uLongf out_length = length + 1;
+    int back = uncompress(out, &out_length, compressed, compressed_length);
+    CHECK(result == Z_OK && back == Z_OK && out_length == length && !memcmp(out, data, length), "compress2 %d, uncompress %d", result, back);
+
+    uLong half = (uLong)length / 2;
+    uLong combined = crc32_combine(crc32(0, data, (uInt)half), crc32(0, data + half, (uInt)(length - half)), (z_off_t)(length - half));
+    CHECK(combined == reference_crc32(data, length), "crc32_combine");
+
+    /* gzread() decodes through the shim's inflate(). */
+    char path[] = "/tmp/test_shim_XXXXXX";
+    int fd = mkstemp(path);
+    gzFile file = gzdopen(fd, "wb");
+    int written = gzwrite(file, data, (unsigned)length);
+    result = gzclose(file);
+    CHECK(written == (int)length && result == Z_OK, "gzwrite %d, gzclose %d", written, result);
+
+    file = gzopen(path, "rb");
+    int read = file ? gzread(file, out, (unsigned)length + 1) : -1;
+    CHECK(read == (int)length && !memcmp(out, data, length) && gzeof(file), "gzread %d of %zu bytes", read, length);
+    if (file)
+        gzclose(file);
+    unlink(path);
+
+    free(out);
+    free(compressed);
+}
+
+int main(void) {
+    /* Without the shim preloaded this would only test zlib. */
+    const char* preloaded = getenv("LD_PRELOAD");
+    CHECK(preloaded && *preloaded, "run with LD_PRELOAD set to the shim");
+    if (!preloaded || !*preloaded)
+        return TEST_RESULT();
+    void* functions[] = { (void*)inflateInit2_, (void*)inflate, (void*)inflateReset, (void*)inflateReset2, (void*)inflateEnd, (void*)uncompress,
+                          (void*)adler32, (void*)crc32, (void*)zlibVersion, (void*)deflate, (void*)compress2, (void*)gzopen };
+    for (size_t i = 0; i < sizeof(functions) / sizeof(*functions); ++i)
+        CHECK(!strcmp(origin(functions[i]), preloaded), "function %zu resolved to %s, not %s", i, origin(functions[i]), preloaded);
+
+    static const size_t lengths[] = { 0, 1, 1000, 70000, 1 << 20 };
+    unsigned char* data = malloc(1 << 20);
+    for (unsigned kind = 0; kind < TEST_KINDS; ++kind) {
+        static const char* kinds[] = { "text", "random", "runs", "mixed" };
+        for (size_t l = 0; l < sizeof(lengths) / sizeof(*lengths); ++l) {
+            test_make_input(data, lengths[l], kind, (uint32_t)(l + 1));
+            check_steps(data, lengths[l], kinds[kind]);
+            check_uncompress(data, lengths[l]);
+            check_forwarded(data, lengths[l]);
+
+            uint32_t adler = reference_adler32(data, lengths[l]);
+            uint32_t crc = reference_crc32(data, lengths[l]);
+            CHECK(adler32(1, data, (uInt)lengths[l]) == adler, "adler32 of %zu bytes", lengths[l]);
+            CHECK(crc32(0, data, (uInt)lengths[l]) == crc, "crc32 of %zu bytes", lengths[l]);
+        }
+    }
+    test_make_input(data, 200000, TEST_MIXED, 5);
+    check_reset(data, 200000);
+    free(data);
+
+    return TEST_RESULT();
+}
@@ -0,0 +1,268 @@
+/*
+ * Extracts tar.gz archives made here into fresh directories below /tmp and
+ * checks the files and links they leave, also when entries share a path. Also
+ * checks that absolute paths stay below the directory and that ".." and links
+ * through symbolic links made by the same archive are refused without touching
+ * anything outside it.
+ */
+
+#define _GNU_SOURCE     // nftw()
+
+#include <errno.h>
+#include <fcntl.h>
+#include <ftw.h>
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+#include "inflate.h"
+#include "tar_extract.h"
+#include "test.h"
+
+
+
+/* A tar archive built in memory. */
+struct Archive {
+    unsigned char* bytes;
+    size_t length;
+};
+
+
+static void add_entry(struct Archive* archive, const char* name, char type, const char* link, const unsigned char* data, size_t length) {
+    size_t padded = (length + 511) / 512 * 512;
+    archive->bytes = realloc(archive->bytes, archive->length + 512 + padded);
+    unsigned char* header = archive->bytes + archive->length;
+    memset(header, 0, 512 + padded);
+
+    snprintf((char*)header, 100, "%s", name);
+    snprintf((char*)header + 100, 8, "%07o", type == '5' ? 0755 : 0644);
+    snprintf((char*)header + 108, 8, "%07o", 0);
+    snprintf((char*)header + 116, 8, "%07o", 0);
+    snprintf((char*)header + 124, 12, "%011zo", length);
+    snprintf((char*)header + 136, 12, "%011o", 1000000000);
+    header[156] = (unsigned char)type;
+    if (link)
+        snprintf((char*)header + 157, 100, "%s", link);
+    memcpy(header + 257, "ustar\0" "00", 8);
+
+    unsigned sum = 0;
+    memset(header + 148, ' ', 8);
+    for (size_t i = 0; i < 512; ++i)
+        sum += header[i];
+    snprintf((char*)header + 148, 8, "%06o", sum);
+
+    if (length)
+        memcpy(header + 512, data, length);
+    archive->length += 512 + padded;
+}
+
+/* Ends the archive, compresses it and extracts it below directory. */
+static int extract_with(struct Archive* archive, const char* directory, const struct TarExtractOptions* options) {
+    archive->bytes = realloc(archive->bytes, archive->length + 1024);
+    memset(archive->bytes + archive->length, 0, 1024);
+    archive->length += 1024;
+
+    size_t compressed_length;
+    unsigned char* compressed = test_compress(archive->bytes, archive->length, 6, Z_DEFAULT_STRATEGY, 31, 0, &compressed_length);
+    int result = tar_extract(compressed, compressed_length, directory, options, NULL);
+
+    free(compressed);
+    free(archive->bytes);
+    *archive = (struct Archive){ 0 };
+    return result;
+}
+
+static int extract(struct Archive* archive, const char* directory) {
+    struct TarExtractOptions options = { .writer_count = 2, .buffer_length = 64 << 10, .buffer_count = 3 };
+    return extract_with(archive, directory, &options);
+}
+
+static int remove_entry(const char* path, const struct stat* status, int flag, struct FTW* walk) {
+    (void)status, (void)flag, (void)walk;
+    remove(path);
+    return 0;
+}
+
+static void remove_tree(const char* path) {
+    nftw(path, remove_entry, 16, FTW_DEPTH | FTW_PHYS);
+}
+
+static bool has_contents(const char* path, const unsigned char* expected, size_t length) {
+    FILE* file = fopen(path, "rb");
+    if (!file)
+        return false;
+    unsigned char* contents = malloc(length + 1);
+    size_t read = fread(contents, 1, length + 1, file);
+    fclose(file);
+    bool same = read == length && (!length || !memcmp(contents, expected, length));
+    free(contents);
+    return same;
+}
+
+static void check_extract(const char* root) {
+    char directory[256], path[512];
+    snprintf(directory, sizeof(directory), "%s/out", root);
+    mkdir(directory, 0755);
+
+    size_t length = 300000;
+    unsigned char* data = malloc(length);
+    test_make_input(data, length, TEST_MIXED, 3);
+
+    struct Archive archive = { 0 };
+    add_entry(&archive, "./", '5', NULL, NULL, 0);
+    add_entry(&archive, "dir/", '5', NULL, NULL, 0);
+    add_entry(&archive, "dir/large", '0', NULL, data, length);
+    add_entry(&archive, "dir/small", '0', NULL, (const unsigned char*)"small\n", 6);
+    add_entry(&archive, "dir/empty", '0', NULL, NULL, 0);
+    add_entry(&archive, "deep/er/file", '0', NULL, (const unsigned char*)"deep\n", 5);
+    add_entry(&archive, "dir/hard", '1', "dir/large", NULL, 0);
+    add_entry(&archive, "dir/soft", '2', "small", NULL, 0);
+    add_entry(&archive, "/absolute/file", '0', NULL, (const unsigned char*)"abs\n", 4);
+    int result = extract(&archive, directory);
+    CHECK(result == INFLATE_SUCCESS, "extract %d", result);
+
+    snprintf(path, sizeof(path), "%s/dir/large", directory);
+    CHECK(has_contents(path, data, length), "dir/large");
+    snprintf(path, sizeof(path), "%s/dir/small", directory);
+    CHECK(has_contents(path, (const unsigned char*)"small\n", 6), "dir/small");
+    snprintf(path, sizeof(path), "%s/dir/empty", directory);
+    CHECK(has_contents(path, NULL, 0), "dir/empty");
+    snprintf(path, sizeof(path), "%s/deep/er/file", directory);
+    CHECK(has_contents(path, (const unsigned char*)"deep\n", 5), "deep/er/file");
+    snprintf(path, sizeof(path), "%s/absolute/file", directory);
+    CHECK(has_contents(path, (const unsigned char*)"abs\n", 4), "leading / stripped");
+
+    struct stat large, hard, soft;
+    snprintf(path, sizeof(path), "%s/dir/large", directory);
+    int status = stat(path, &large);
+    snprintf(path, sizeof(path), "%s/dir/hard", directory);
+    status |= stat(path, &hard);
+    CHECK(!status && large.st_ino == hard.st_ino && large.st_mtime == 1000000000, "hard link");
+    snprintf(path, sizeof(path), "%s/dir/soft", directory);
+    CHECK(!lstat(path, &soft) && S_ISLNK(soft.st_mode), "symbolic link");
+    CHECK(has_contents(path, (const unsigned char*)"small\n", 6), "through symbolic link");
+
+    archive = (struct Archive){ 0 };
+    add_entry(&archive, "dir/../../escape", '0', NULL, (const unsigned char*)"x", 1);
+    result = extract(&archive, directory);
+    CHECK(result == INFLATE_VALUE_NOT_ALLOWED, "\"..\" %d", result);
+    snprintf(path, sizeof(path), "%s/escape", root);
+    CHECK(access(path, F_OK) && errno == ENOENT, "\"..\" wrote outside");
+
+    free(data);
+    remove_tree(directory);
+}
+
+/* Entries with the same path: the last one in the archive is what remains, whatever its type. */
+static void check_same_path(const char* root) {
+    char directory[256], path[512];
+    snprintf(directory, sizeof(directory), "%s/out", root);
+    mkdir(directory, 0755);
+
+    size_t length = 300000;
+    unsigned char* data = malloc(length);
+    test_make_input(data, length, TEST_MIXED, 4);
+
+    /* The large file's pieces are spread over buffers and writers, the small one's truncate must not come first. */
+    struct TarExtractOptions options = { .writer_count = 8, .buffer_length = 64 << 10, .buffer_count = 8 };
+    for (unsigned round = 0; round < 8; ++round) {
+        struct Archive archive = { 0 };
+        add_entry(&archive, "large_first", '0', NULL, data, length);
+        add_entry(&archive, "small_first", '0', NULL, (const unsigned char*)"small\n", 6);
+        add_entry(&archive, "large_first", '0', NULL, (const unsigned char*)"small\n", 6);
+        add_entry(&archive, "small_first", '0', NULL, data, length);
+        add_entry(&archive, "twice", '0', NULL, data, length);
+        add_entry(&archive, "twice", '0', NULL, data + 1, length - 1);
+        int result = extract_with(&archive, directory, &options);
+        CHECK(result == INFLATE_SUCCESS, "round %u: extract %d", round, result);
+
+        snprintf(path, sizeof(path), "%s/large_first", directory);
+        CHECK(has_contents(path, (const unsigned char*)"small\n", 6), "round %u: large file then small file", round);
+        snprintf(path, sizeof(path), "%s/small_first", directory);
+        CHECK(has_contents(path, data, length), "round %u: small file then large file", round);
+        snprintf(path, sizeof(path), "%s/twice", directory);
+        CHECK(has_contents(path, data + 1, length - 1), "round %u: large file twice", round);
+    }
+
+    /* Links are made after the files, but only the ones nothing later replaces. */
+    struct Archive archive = { 0 };
+    add_entry(&archive, "target", '0', NULL, (const unsigned char*)"target\n", 7);
+    add_entry(&archive, "soft_then_file", '2', "target", NULL, 0);
+    add_entry(&archive, "hard_then_file", '1', "target", NULL, 0);
+    add_entry(&archive, "file_then_soft", '0', NULL, (const unsigned char*)"file\n", 5);
+    add_entry(&archive, "soft_then_file", '0', NULL, (const unsigned char*)"file\n", 5);
+    add_entry(&archive, "hard_then_file", '0', NULL, (const unsigned char*)"file\n", 5);
+    add_entry(&archive, "file_then_soft", '2', "target", NULL, 0);
+    int result = extract(&archive, directory);
+    CHECK(result == INFLATE_SUCCESS, "links: extract %d", result);
+
+    struct stat status;
+    snprintf(path, sizeof(path), "%s/soft_then_file", directory);
+    CHECK(!lstat(path, &status) && S_ISREG(status.st_mode) && has_contents(path, (const unsigned char*)"file\n", 5), "symbolic link then file");
+    snprintf(path, sizeof(path), "%s/hard_then_file", directory);
+    CHECK(!lstat(path, &status) && status.st_nlink == 1 && has_contents(path, (const unsigned char*)"file\n", 5), "hard link then file");
+    snprintf(path, sizeof(path), "%s/file_then_soft", directory);
+    CHECK(!lstat(path, &status) && S_ISLNK(status.st_mode) && has_contents(path, (const unsigned char*)"target\n", 7), "file then symbolic link");
+
+    free(data);
+    remove_tree(directory);
+}
+
+/* Symbolic links out of the directory, then links through them. */
+static void check_escape(const char* root, bool hard) {
+    char directory[256], victim[256], path[512];
+    snprintf(directory, sizeof(directory), "%s/out", root);
+    snprintf(victim, sizeof(victim), "%s/victim", root);
+    mkdir(directory, 0755);
+    mkdir(victim, 0755);
+    snprintf(path, sizeof(path), "%s/precious", victim);
+    FILE* file = fopen(path, "wb");
+    fputs("precious\n", file);
+    fclose(file);
+
+    struct Archive archive = { 0 };
+    add_entry(&archive, "d", '2', victim, NULL, 0);
+    if (hard) {
+        add_entry(&archive, "stolen", '1', "d/precious", NULL, 0);
+    } else {
+        add_entry(&archive, "d/precious", '2', "x", NULL, 0);
+        add_entry(&archive, "d/planted", '2', "x", NULL, 0);
+    }
+    int result = extract(&archive, directory);
+    CHECK(result == INFLATE_VALUE_NOT_ALLOWED, "%s link through a symbolic link: %d", hard ? "hard" : "symbolic", result);
+
+    struct stat status;
+    snprintf(path, sizeof(path), "%s/precious", victim);
+    CHECK(!lstat(path, &status) && S_ISREG(status.st_mode) && status.st_nlink == 1, "victim/precious replaced or linked");
+    CHECK(has_contents(path, (const unsigned char*)"precious\n", 9), "victim/precious changed");
+    snprintf(path, sizeof(path), "%s/planted", victim);
+    CHECK(lstat(path, &status) && errno == ENOENT, "victim/planted created");
+    snprintf(path, sizeof(path), "%s/stolen", directory);
+    CHECK(lstat(path, &status) && errno == ENOENT, "outside file linked in");
+
+    remove_tree(directory);
+    remove_tree(victim);
+}
+
+
+int main(void) {
+    char root[] = "/tmp/test_tar.XXXXXX";
+    if (!mkdtemp(root)) {
+        perror("mkdtemp");
+        return 1;
+    }
+
+    check_extract(root);
+    check_same_path(root);
+    check_escape(root, false);
+    check_escape(root, true);
+
+    remove_tree(root);
+
+    return TEST_RESULT();
+}
@@ -0,0 +1,108 @@
+/*
+ * Token files: the LZ77 parse exported from raw, zlib and gzip input and
+ * Huffman coded again, with the source blocks kept or cut every 1000 tokens,
+ * decodes to the original data. Too little room for the tokens and reserved
+ * Huffman symbols are reported.
+ */
+
+#include <stddef.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "inflate.h"
+#include "inflate_tokens.h"
+#include "test.h"
+
+
+
+struct Configuration {
+    int level;
+    int strategy;
+};
+
+
+static const size_t lengths[] = { 0, 1, 100, 65536 + 3, (1 << 20) + 7 };
+
+static const struct Configuration configurations[] = {
+    { 0, Z_DEFAULT_STRATEGY },
+    { 1, Z_DEFAULT_STRATEGY },
+    { 6, Z_DEFAULT_STRATEGY },
+    { 9, Z_DEFAULT_STRATEGY },
+    { 6, Z_FIXED },
+    { 6, Z_HUFFMAN_ONLY },
+    { 6, Z_RLE },
+};
+
+
+static void check_tokens(const unsigned char* data, size_t length, const struct Configuration* configuration, const char* name) {
+    static const int window_bits[] = { -15, 15, 31 };
+    unsigned char* out = malloc(length + 1);
+    for (enum InflateFormat format = INFLATE_FORMAT_RAW; format <= INFLATE_FORMAT_GZIP; ++format) {
+        size_t compressed_length;
+        unsigned char* compressed = test_compress(data, length, configuration->level, configuration->strategy, window_bits[format], 0, &compressed_length);
+
+        size_t tokens_max_length = inflate_tokens_bound(compressed_length, length);
+        unsigned char* tokens = malloc(tokens_max_length);
+        size_t tokens_length;
+        int result = inflate_tokens_export(compressed, compressed_length, format, tokens, &tokens_length, tokens_max_length);
+        CHECK(!result, "%s: inflate_tokens_export format %d: %d", name, format, result);
+        if (!result) {
+            size_t encoded_max_length = compressed_length + length / 4 + 1024;
+            unsigned char* encoded = malloc(encoded_max_length);
+            static const size_t block_tokens[] = { 0, 1000 };
+            for (size_t b = 0; b < sizeof(block_tokens) / sizeof(*block_tokens); ++b) {
+                size_t encoded_length, out_length;
+                result = inflate_tokens_encode(tokens, tokens_length, block_tokens[b], encoded, &encoded_length, encoded_max_length);
+                CHECK(!result, "%s: inflate_tokens_encode format %d, block_tokens %zu: %d", name, format, block_tokens[b], result);
+                if (result)
+                    continue;
+                result = tinflate(encoded, encoded_length, out, &out_length, length);
+                CHECK(!result && out_length == length && !memcmp(out, data, length), "%s: re-encoded tokens format %d, block_tokens %zu: %d, %zu bytes", name, format,
+                      block_tokens[b], result, out_length);
+            }
+            free(encoded);
+
+            /* One byte less than the token file. */
+            size_t short_length;
+            result = inflate_tokens_export(compressed, compressed_length, format, tokens, &short_length, tokens_length - 1);
+            CHECK(result == INFLATE_DECOMPRESSED_OVERFLOW, "%s: inflate_tokens_export format %d into a short buffer: %d", name, format, result);
+        }
+
+        free(tokens);
+        free(compressed);
+    }
+    free(out);
+}
+
+static void check_reserved_symbols(void) {
+    static struct TestBits bits;
+    unsigned char* tokens = malloc(40000);
+    for (unsigned i = 0; i < TEST_RESERVED_COUNT; ++i) {
+        const unsigned* symbols = test_reserved_symbols[i];
+        size_t length = test_reserved_stream(&bits, symbols[0], symbols[1]);
+        size_t tokens_length;
+        int result = inflate_tokens_export(bits.bytes, length, INFLATE_FORMAT_RAW, tokens, &tokens_length, 40000);
+        CHECK(result == (i ? INFLATE_VALUE_NOT_ALLOWED : INFLATE_SUCCESS), "symbol %u, distance code %u: inflate_tokens_export %d", symbols[0], symbols[1], result);
+    }
+    free(tokens);
+}
+
+int main(void) {
+    unsigned char* data = malloc(lengths[sizeof(lengths) / sizeof(*lengths) - 1]);
+    for (unsigned kind = 0; kind < TEST_KINDS; ++kind) {
+        for (size_t l = 0; l < sizeof(lengths) / sizeof(*lengths); ++l) {
+            test_make_input(data, lengths[l], kind, (uint32_t)(kind * 31 + l + 1));
+            for (size_t c = 0; c < sizeof(configurations) / sizeof(*configurations); ++c) {
+                char name[96];
+                snprintf(name, sizeof(name), "kind %u, %zu bytes, level %d, strategy %d", kind, lengths[l], configurations[c].level, configurations[c].strategy);
+                check_tokens(data, lengths[l], &configurations[c], name);
+            }
+        }
+    }
+    check_reserved_symbols();
+    free(data);
+
+    return TEST_RESULT();
+}
@@ -0,0 +1,56 @@
+/*
+ * permessage-deflate sessions fed by zlib's deflate() with a sync flush after
+ * every message, with and without context takeover.
+ */
+
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "test.h"
+#include "websocket_inflate.h"
+
+
+
+/* A permessage-deflate connection: one deflate stream, a sync flush after every message. */
+static void check_websocket(bool context_takeover) {
+    struct WebSocketInflate* session;
+    int result = websocket_inflate_create(15, context_takeover, &session);
+    CHECK(!result, "websocket_inflate_create %d", result);
+    if (result)
+        return;
+
+    z_stream deflater;
+    memset(&deflater, 0, sizeof(deflater));
+    deflateInit2(&deflater, 6, Z_DEFLATED, -15, 8, Z_DEFAULT_STRATEGY);
+    unsigned char message[5000], payload[6000], out[5000];
+    for (unsigned i = 0; i < 50; ++i) {
+        size_t length = 1 + (size_t)i * 97;
+        test_make_input(message, length, i % 2 ? TEST_TEXT : TEST_MIXED, i / 3 + 1);
+        if (!context_takeover)
+            deflateReset(&deflater);
+        deflater.next_in = message;
+        deflater.avail_in = (uInt)length;
+        deflater.next_out = payload;
+        deflater.avail_out = sizeof(payload);
+        deflate(&deflater, Z_SYNC_FLUSH);
+        size_t payload_length = sizeof(payload) - deflater.avail_out - 4;
+
+        size_t out_length;
+        result = websocket_inflate_message(session, payload, payload_length, out, &out_length, sizeof(out));
+        CHECK(!result && out_length == length && !memcmp(out, message, length), "websocket message %u (context takeover %d): %d", i, context_takeover, result);
+        if (result)
+            break;
+    }
+    deflateEnd(&deflater);
+    websocket_inflate_free(session);
+}
+
+int main(void) {
+    check_websocket(true);
+    check_websocket(false);
+
+    return TEST_RESULT();
+}
@@ -0,0 +1,62 @@
+/*
+ * https://datatracker.ietf.org/doc/html/rfc7692 (permessage-deflate)
+ * https://datatracker.ietf.org/doc/html/rfc1951
+ */
+
+#ifndef WEBSOCKET_INFLATE_H
+#define WEBSOCKET_INFLATE_H
+
+
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+
+#include "MDE.h"
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+
+
+/* Negotiated LZ77 window sizes (server_max_window_bits, client_max_window_bits). */
+#define WEBSOCKET_MIN_WINDOW_BITS       8
+#define WEBSOCKET_MAX_WINDOW_BITS       15
+
+
+/*
+ * Decoder for the messages one peer of a connection sends. Between messages a
+ * session holds nothing but the history later messages may refer to, at most
+ * 1 << window_bits bytes and never more than the peer has sent so far. The
+ * stream state and Huffman tables belong to the decoding thread and are only
+ * used while a message is decoded, so any thread may decode for any session,
+ * one message at a time.
+ */
+struct WebSocketInflate;
+
+
+/* Creates a session. Without context takeover every message is decoded on its own and no history is kept. */
+extern int websocket_inflate_create(unsigned window_bits, bool context_takeover, struct WebSocketInflate** session);
+
+extern void websocket_inflate_free(struct WebSocketInflate* session);
+
+/*
+ * Decodes the payload of one message, its compressed frames joined, without
+ * the 00 00 FF FF trailer the sender removed. After an error the session's
+ * history no longer matches the sender's and the connection has to be failed.
+ */
+extern int websocket_inflate_message(struct WebSocketInflate* session, const unsigned char* payload, size_t payload_length, unsigned char* message,
+                                     size_t* message_length, size_t message_max_length);
+
+/* Bytes the session holds while idle, its own state included. */
+extern size_t websocket_inflate_memory(const struct WebSocketInflate* session);
+
+/* Frees the stream state and tables of the calling thread. The next message decoded on it allocates them again. */
+extern void websocket_inflate_release_thread(void);
+
+#ifdef __cplusplus
+}
+#endif
+
+
+#endif /* WEBSOCKET_INFLATE_H */
@@ -7,6 +7,10 @@
 
 #include "MDE.h"
 
+#ifdef __cplusplus
+extern "C" {
+#endif
+
 
 
 enum ZlibDecompressError {
@@ -17,6 +21,12 @@ enum ZlibDecompressError {
 
 extern int zlib_decompress(const unsigned char* compressed, size_t compressed_length, unsigned char* decompressed, size_t* decompressed_length, size_t decompressed_max_length);
 
+/* Same as zlib_decompress(), decoding as tinflate_pipelined() does. The Adler-32 is computed on the second thread. */
+extern int zlib_decompress_pipelined(const unsigned char* compressed, size_t compressed_length, unsigned char* decompressed, size_t* decompressed_length, size_t decompressed_max_length);
+
+#ifdef __cplusplus
+}
+#endif
 
 
 #endif /* ZLIB_DECOMPRESS_H */